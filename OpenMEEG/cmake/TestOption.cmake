@@ -18,6 +18,8 @@ if (BUILD_TESTING)
     include(CTest)
     enable_testing()
     mark_as_advanced(BUILD_TESTING)
+    option(BUILD_BENCHMARKS "Build the benchmarks (run with ctest -L benchmark)" OFF)
+    mark_as_advanced(BUILD_BENCHMARKS)
 endif()
 
 if (USE_GCC AND BUILD_TESTING)
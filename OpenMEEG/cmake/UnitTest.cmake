@@ -27,3 +27,13 @@ function(OPENMEEG_UNIT_TEST TEST_NAME)
     endif()
     openmeeg_test(${TEST_NAME} ${TEST_COMMAND} ${PARAMETERS} ${DEPENDS})
 endfunction()
+
+#   Benchmarks (timings) are only built with BUILD_BENCHMARKS, and registered with the label "benchmark" so that they
+#   can be run apart from the unit tests (ctest -L benchmark).
+
+function(OPENMEEG_BENCHMARK BENCHMARK_NAME)
+    if (BUILD_BENCHMARKS)
+        OPENMEEG_UNIT_TEST(${BENCHMARK_NAME} ${ARGN})
+        set_property(TEST ${BENCHMARK_NAME} PROPERTY LABELS benchmark)
+    endif()
+endfunction()
@@ -40,10 +40,14 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #pragma once
 
 #include <isnormal.H>
-#include <mesh.h>
+#include <triangle.h>
 
 namespace OpenMEEG {
 
+    /// Instruction set used by the batched kernels (selected at runtime from the processor capabilities).
+
+    OPENMEEG_EXPORT const char* analytics_instruction_set();
+
     inline double integral_simplified_green(const Vect3& p0x, const double norm2p0x,
                                             const Vect3& p1x, const double norm2p1x,
                                             const Vect3& p1p0, const double norm2p1p0) 
@@ -123,6 +127,10 @@ namespace OpenMEEG {
 
             return (((p0x*nu0)*g0+(p1x*nu1)*g1+(p2x*nu2)*g2)-alpha*x.solangl(p0, p1, p2));
         }
+
+        /// Batched version of f: values[i] = f(Vect3(x[i],y[i],z[i])) for i in [0,npts[ (see analytics.cpp).
+
+        void f(const unsigned npts,const double* x,const double* y,const double* z,double* values) const;
     };
 
     class OPENMEEG_EXPORT analyticD
@@ -235,6 +243,10 @@ namespace OpenMEEG {
 
             return omega_i;
         }
+
+        /// Batched version of f: the 3 components of f(Vect3(x[i],y[i],z[i])) are stored in values1[i], values2[i] and values3[i].
+
+        void f(const unsigned npts,const double* x,const double* y,const double* z,double* values1,double* values2,double* values3) const;
     };
 
     class OPENMEEG_EXPORT analyticDipPot
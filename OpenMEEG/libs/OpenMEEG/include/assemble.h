@@ -40,24 +40,173 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #pragma once
 
 #include <vector>
+#include <string>
 
 #include <vector.h>
 #include <matrix.h>
 #include <symmatrix.h>
 #include <geometry.h>
 #include <sensors.h>
+#include <integrator.h>
+#include <hmatrix.h>
+#include <fmm.h>
 
 namespace OpenMEEG {
 
+    /// \brief Blocks of the HeadMat that do not depend on the conductivities.
+    /// The S, D, D* and N blocks of a pair of meshes only depend on the geometry: the conductivities of the domains shared
+    /// by the two meshes scale S (by sigma_inv) and N (by sigma) and do not change D and D*. The blocks of all the pairs
+    /// are assembled once, without these factors, so that the HeadMat of any set of conductivities is then a weighted
+    /// sum of the blocks followed by the deflation, which is much faster than a new assembly (conductivity calibration,
+    /// Monte Carlo studies, ...). The conductivities may change, but not the domains of null conductivity (they define
+    /// the current barriers and thus the unknowns).
+
+    class OPENMEEG_EXPORT HeadMatBlocks {
+    public:
+        HeadMatBlocks (): dimension(0) { }
+        HeadMatBlocks (const Geometry& geo, const QuadraturePolicy& quadrature=QuadraturePolicy());
+
+        /// HeadMat of geo, which must have the meshes of the geometry used to build the blocks (conductivities may differ).
+
+        void assemble(const Geometry& geo, SymMatrix& mat) const;
+
+        void save(const std::string& filename) const;
+        void load(const std::string& filename);
+
+        unsigned nb_blocks() const { return blocks.size(); }
+
+    private:
+
+        // Description of a mesh, to check that a geometry matches the blocks.
+
+        struct MeshInfo {
+            unsigned nb_vertices;
+            unsigned nb_triangles;
+            bool     current_barrier;
+            bool     isolated;
+        };
+
+        // Entries of the HeadMat given by a pair of meshes. Lines (resp. columns) are the unknowns of mesh1 (resp. mesh2):
+        // their triangles (none for current barriers) followed by their vertices. Blocks of a mesh with itself are symmetric.
+
+        struct Block {
+            unsigned              mesh1;
+            unsigned              mesh2;
+            unsigned              nb_row_triangles;
+            unsigned              nb_col_triangles;
+            std::vector<unsigned> rows;            // indices in the HeadMat
+            std::vector<unsigned> cols;
+            Matrix                values;          // if mesh1!=mesh2
+            SymMatrix             sym_values;      // if mesh1==mesh2
+        };
+
+        void check(const Geometry& geo) const;
+
+        unsigned               dimension;
+        std::vector<MeshInfo>  meshes;
+        std::vector<Block>     blocks;
+    };
+
+    /// \brief Layout of a HeadMat: content hash and unknowns of each mesh, coefficients of the pairs of meshes and
+    /// deflation coefficients. It allows to update the HeadMat of a geometry in which only some meshes changed.
+
+    class OPENMEEG_EXPORT HeadMatLayout {
+    public:
+        HeadMatLayout (): dimension(0) { }
+        HeadMatLayout (const Geometry& geo, const SymMatrix& HM);
+
+        /// HeadMat of geo from the HeadMat previous described by this layout. Meshes are matched by name: only the
+        /// blocks of the pairs of meshes involving a new or modified mesh (or a mesh sharing vertices with it, or whose
+        /// coefficients changed) are recomputed, the other ones are copied to the (possibly renumbered) unknowns of geo.
+
+        void assemble(const Geometry& geo, const SymMatrix& previous, SymMatrix& mat,
+                      const QuadraturePolicy& quadrature=QuadraturePolicy()) const;
+
+        void save(const std::string& filename) const;
+        void load(const std::string& filename);
+
+        unsigned nb_meshes() const { return meshes.size(); }
+
+    private:
+
+        struct MeshInfo {
+            std::string           name;
+            unsigned long long    hash;            // of the vertices and triangles of the mesh
+            bool                  current_barrier;
+            bool                  isolated;
+            std::vector<unsigned> triangles;       // indices in the HeadMat (none for current barriers)
+            std::vector<unsigned> vertices;
+        };
+
+        // Deflation coefficient added to the pairs of vertices of each mesh of a group of outermost meshes.
+
+        struct Deflation {
+            std::vector<unsigned> meshes;
+            double                coef;
+        };
+
+        void describe(const Geometry& geo);
+
+        unsigned               dimension;
+        std::vector<MeshInfo>  meshes;
+        std::vector<double>    coefficients;       // interaction, Scoeff, Dcoeff and Ncoeff of each pair of meshes
+        std::vector<Deflation> deflations;
+    };
+
     class OPENMEEG_EXPORT HeadMat: public virtual SymMatrix {
     public:
         HeadMat (const Geometry& geo, const unsigned gauss_order=3);
+        HeadMat (const Geometry& geo, const QuadraturePolicy& quadrature);
+        HeadMat (const Geometry& geo, const HeadMatBlocks& blocks);
+        HeadMat (const Geometry& geo, const SymMatrix& previous, const HeadMatLayout& layout,
+                 const QuadraturePolicy& quadrature=QuadraturePolicy());
         virtual ~HeadMat () {};
     };
 
+    /// \brief HeadMat compressed as an H-matrix to the relative accuracy epsilon.
+    /// The entries of the admissible blocks are computed on demand from the S, D, D* and N operators, so that the
+    /// dense matrix is never formed. Use factorize() and solveLin() to solve systems (e.g. in the adjoint gains).
+
+    class OPENMEEG_EXPORT HeadHMatrix: public HMatrix {
+    public:
+        HeadHMatrix (const Geometry& geo, const double epsilon=1e-5, const QuadraturePolicy& quadrature=QuadraturePolicy());
+        virtual ~HeadHMatrix () {};
+    };
+
+    /// \brief Matrix-free HeadMat.
+    /// Products by the HeadMat are computed without assembling it: the S, D and D* blocks of each pair of meshes are
+    /// applied with treecodes (see FMMOperators), the N blocks as S applied to the surface curls of the P1 functions,
+    /// and the deflation is added. Storage and products are almost linear in the number of unknowns (instead of the
+    /// N^2/2 entries of the HeadMat), so that GMRes can solve systems on fine meshes. Entries are computed on demand
+    /// (e.g. the diagonal for the Jacobi preconditioner).
+
+    class OPENMEEG_EXPORT HeadMatOperator: public LinOp {
+    public:
+        HeadMatOperator (const Geometry& geo, const FMMParameters& parameters=FMMParameters(), const QuadraturePolicy& quadrature=QuadraturePolicy());
+        virtual ~HeadMatOperator ();
+
+        size_t size() const { return nlin()*ncol(); }
+        void   info() const;
+
+        Vector operator*(const Vector& x) const;
+
+        /// Entry (i,j) of the HeadMat.
+
+        double operator()(const size_t i,const size_t j) const;
+
+    private:
+
+        HeadMatOperator (const HeadMatOperator&);
+        HeadMatOperator& operator=(const HeadMatOperator&);
+
+        struct Implementation;
+        Implementation* impl;
+    };
+
     class OPENMEEG_EXPORT SurfSourceMat: public virtual Matrix {
     public:
         SurfSourceMat (const Geometry& geo, Mesh& sources, const unsigned gauss_order=3);
+        SurfSourceMat (const Geometry& geo, Mesh& sources, const QuadraturePolicy& quadrature);
         virtual ~SurfSourceMat () {};
     };
 
@@ -71,6 +220,7 @@ namespace OpenMEEG {
     class OPENMEEG_EXPORT EITSourceMat: public virtual Matrix {
     public:
         EITSourceMat(const Geometry& geo, const Sensors& electrodes, const unsigned gauss_order=3);
+        EITSourceMat(const Geometry& geo, const Sensors& electrodes, const QuadraturePolicy& quadrature);
         virtual ~EITSourceMat () {};
     };
 
@@ -123,6 +273,8 @@ namespace OpenMEEG {
     public:
         CorticalMat (const Geometry& geo, const Head2EEGMat& M, const std::string& domain_name = "CORTEX",
                 const unsigned gauss_order=3, double alpha=-1., double beta=-1., const std::string &filename="");
+        CorticalMat (const Geometry& geo, const Head2EEGMat& M, const std::string& domain_name,
+                const QuadraturePolicy& quadrature, double alpha=-1., double beta=-1., const std::string &filename="");
         virtual ~CorticalMat () {};
     };
 
@@ -130,6 +282,8 @@ namespace OpenMEEG {
     public:
         CorticalMat2(const Geometry& geo, const Head2EEGMat& M, const std::string& domain_name = "CORTEX",
                 const unsigned gauss_order=3, double gamma=1., const std::string &filename="");
+        CorticalMat2(const Geometry& geo, const Head2EEGMat& M, const std::string& domain_name,
+                const QuadraturePolicy& quadrature, double gamma=1., const std::string &filename="");
         virtual ~CorticalMat2() {};
     };
 }
@@ -0,0 +1,109 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <vect3.h>
+
+namespace OpenMEEG {
+
+    class Mesh;
+
+    /// \brief Contiguous copy of the geometry of a mesh, for the kernels which stream over all its triangles.
+    /// The coordinates of the mesh vertices (in the order of Mesh::vertices()) are stored in separate x, y and z
+    /// arrays, and each triangle is a packed triple of positions in these arrays, with its normal (also split in
+    /// three arrays) and its area. Vertices and triangles are designated by their positions in the mesh (their indices
+    /// are set later by the geometry and are read in the mesh). TriangleView gives the usual accessors of Triangle.
+
+    class OPENMEEG_EXPORT CompactMesh {
+    public:
+
+        /// \brief Triangle t of a CompactMesh, seen through the accessors of Triangle.
+
+        class TriangleView {
+        public:
+
+            TriangleView(const CompactMesh& m,const unsigned t): mesh(m),t(t) { }
+
+            unsigned position(const unsigned k) const { return mesh.triangles_[3*t+k]; } ///< position of the k-th vertex
+            Vect3    vertex(const unsigned k)   const { return mesh.point(position(k));  }
+            Vect3    operator()(const unsigned k) const { return vertex(k); }
+
+            Normal   normal() const { return Normal(mesh.nx_[t],mesh.ny_[t],mesh.nz_[t]); }
+            double   area()   const { return mesh.areas_[t]; }
+            Vect3    center() const { return (vertex(0)+vertex(1)+vertex(2))/3; }
+
+        private:
+
+            const CompactMesh& mesh;
+            const unsigned     t;
+        };
+
+        CompactMesh() { }
+
+        /// (Re)build the storage from a mesh (its normals, areas and adjacency must be up to date).
+
+        void build(const Mesh& m);
+        void clear();
+
+        unsigned nb_vertices()  const { return x_.size();     }
+        unsigned nb_triangles() const { return areas_.size(); }
+        bool     empty()        const { return areas_.empty(); }
+
+        const double*   x()         const { return &x_[0]; }
+        const double*   y()         const { return &y_[0]; }
+        const double*   z()         const { return &z_[0]; }
+        const unsigned* triangles() const { return &triangles_[0]; } ///< 3 vertex positions per triangle.
+        const double*   nx()        const { return &nx_[0]; }
+        const double*   ny()        const { return &ny_[0]; }
+        const double*   nz()        const { return &nz_[0]; }
+        const double*   areas()     const { return &areas_[0]; }
+
+        Vect3        point(const unsigned i)    const { return Vect3(x_[i],y_[i],z_[i]); }
+        TriangleView triangle(const unsigned t) const { return TriangleView(*this,t); }
+
+    private:
+
+        std::vector<double>   x_,y_,z_;
+        std::vector<unsigned> triangles_;
+        std::vector<double>   nx_,ny_,nz_,areas_;
+    };
+}
@@ -0,0 +1,189 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+/*! \file
+    \brief file containing the fast (treecode) products by the integral operators
+*/
+#pragma once
+
+#include <vector>
+
+#include <vect3.h>
+#include <vector.h>
+#include <matrix.h>
+#include <mesh.h>
+#include <integrator.h>
+#include <hmatrix.h>
+#include <DLLDefinesOpenMEEG.h>
+
+namespace OpenMEEG {
+
+    /// \brief Parameters of the fast products by the integral operators.
+
+    struct OPENMEEG_EXPORT FMMParameters {
+
+        FMMParameters(const unsigned deg=4,const double mac=0.6,const unsigned leaf=64,const double near=3.0,const unsigned order=1):
+            degree(deg),theta(mac),leaf_size(leaf),near_ratio(near),gauss_order(order) { }
+
+        unsigned degree;       ///< degree of the interpolation of the far source clusters (in each direction)
+        double   theta;        ///< sources and targets are far when the sum of their radii is below theta times their distance
+        unsigned leaf_size;    ///< maximal number of points of the leaves of the trees
+        double   near_ratio;   ///< pairs of triangles closer than near_ratio diameters use the analytic kernels
+        unsigned gauss_order;  ///< quadrature rule of the triangles for the other pairs
+    };
+
+    /// \brief Barycentric Lagrange treecode for the Laplace kernel 1/|x-y|.
+    /// Sources and targets are sorted in binary trees (see ClusterTree). The targets are processed by batches (the leaves of
+    /// their tree): a source cluster far from a batch is replaced by charges at the Chebyshev points of its bounding box
+    /// (interpolation of degree p in each direction), the other ones are summed directly. The kernel is only evaluated,
+    /// which makes the method independent of the kernel, and each evaluation costs O(N log N) operations.
+    /// The interaction lists only depend on the positions and are built once.
+
+    class OPENMEEG_EXPORT Treecode {
+    public:
+
+        Treecode(const std::vector<Vect3>& sources,const std::vector<Vect3>& targets,const FMMParameters& parameters=FMMParameters());
+
+        unsigned nb_sources() const { return sources_.size(); }
+        unsigned nb_targets() const { return targets_.size(); }
+
+        /// Potentials (and gradients) at the targets of the given charges and dipoles at the sources:
+        /// potentials[i] += sum_j charges[j]/|x_i-y_j|+dipoles[j].(x_i-y_j)/|x_i-y_j|^3 and gradients[i] += its gradient in x_i.
+        /// Any of the pointers can be null. Pairs of coincident points are skipped.
+
+        void evaluate(const double* charges,const Vect3* dipoles,double* potentials,Vect3* gradients) const;
+
+        /// Same for several sets of charges (the columns of charges, one line per source): the kernel is evaluated once for all of them.
+
+        void evaluate(const Matrix& charges,Matrix& potentials) const;
+
+    private:
+
+        struct Interpolation;
+
+        void interactions(const ClusterTree::Cluster& batch,const unsigned cluster,std::vector<unsigned>& far,std::vector<unsigned>& near) const;
+        void interpolate(const unsigned cluster,const unsigned nrhs,const double* charges,const Vect3* dipoles,double* proxies) const;
+
+        // nrhs interleaved sets of charges and dipoles (charges[j*nrhs+r]), potentials and gradients are interleaved the same way.
+
+        void evaluate(const unsigned nrhs,const double* charges,const Vect3* dipoles,double* potentials,Vect3* gradients) const;
+
+        const FMMParameters             parameters;
+        ClusterTree                     source_tree;
+        ClusterTree                     target_tree;
+        std::vector<Vect3>              sources_;         // in the ordering of source_tree
+        std::vector<Vect3>              targets_;         // in the ordering of target_tree
+        std::vector<unsigned>           batches;          // leaves of target_tree
+        std::vector<std::vector<unsigned> > far_lists;    // interpolated source clusters of each batch
+        std::vector<std::vector<unsigned> > near_lists;   // directly summed source clusters of each batch
+        std::vector<int>                proxy_index;      // position of the proxies of each source cluster (-1 if not interpolated)
+        std::vector<unsigned>           interpolated;     // interpolated source clusters
+        std::vector<double>             nodes;            // Chebyshev points of the interpolated clusters (3*(degree+1) each)
+    };
+
+    /// \brief Fast products by the S, D and D* operators of a pair of meshes, m1 giving the lines as in assemble_HM.
+    /// The interactions of two triangles are approximated by a quadrature on both of them (evaluated by a Treecode), except
+    /// for the pairs closer than near_ratio diameters which are corrected to the values of the analytic kernels
+    /// (_operatorS and _operatorD). The operators are never assembled: storage and products are almost linear in the
+    /// number of triangles. Vectors are indexed by the positions of the triangles (resp. vertices) in their mesh and the
+    /// products are added to the results. The operators do not include the coefficients (conductivities, 1/4pi).
+
+    class OPENMEEG_EXPORT FMMOperators {
+    public:
+
+        FMMOperators(const Mesh& m1,const Mesh& m2,const FMMParameters& parameters=FMMParameters(),const QuadraturePolicy& quadrature=QuadraturePolicy());
+
+        /// y (triangles of m1) += S x (triangles of m2).
+
+        void S(const Vector& x,Vector& y) const;
+
+        /// y (triangles of m2) += S* x (triangles of m1), S* being the transpose of S.
+
+        void Sstar(const Vector& x,Vector& y) const;
+
+        /// Same as above for the columns of X and Y, at the cost of a single product.
+
+        void S(const Matrix& X,Matrix& Y) const;
+        void Sstar(const Matrix& X,Matrix& Y) const;
+
+        /// y (triangles of m1) += D x (vertices of m2).
+
+        void D(const Vector& x,Vector& y) const;
+
+        /// y (vertices of m2) += D* x (triangles of m1), D* being the transpose of D.
+
+        void Dstar(const Vector& x,Vector& y) const;
+
+        /// Number of corrected (near) pairs of triangles.
+
+        unsigned nb_near_pairs() const { return near_triangles.size(); }
+
+    private:
+
+        // Quadrature nodes of the triangles of a mesh, with their weights, the barycentric coordinates of the node
+        // in the triangle and the triangle (its normal and the positions of its vertices in the mesh).
+
+        struct Nodes {
+            Nodes(const Mesh& m,const unsigned order);
+            std::vector<Vect3>    points;
+            std::vector<double>   weights;
+            std::vector<Vect3>    barycentric;
+            std::vector<unsigned> triangles;
+            std::vector<Vect3>    normals;     // of the triangles
+            std::vector<unsigned> vertices;    // 3 per triangle
+            unsigned              nb_points;   // per triangle
+        };
+
+        void near_field(const double near_ratio,const QuadraturePolicy& quadrature);
+
+        const Mesh&           m1;
+        const Mesh&           m2;
+        Nodes                 nodes1;
+        Nodes                 nodes2;
+        Treecode              treecode;       // sources on m2, targets on m1 (S and D)
+        Treecode              treecode_star;  // sources on m1, targets on m2 (S* and D*)
+
+        // Corrections of the near pairs (analytic minus quadrature values), in compressed rows (triangles of m1).
+
+        std::vector<unsigned> near_rows;
+        std::vector<unsigned> near_triangles;
+        std::vector<double>   near_S;
+        std::vector<Vect3>    near_D;
+    };
+}
@@ -39,23 +39,162 @@ knowledge of the CeCILL-B license and that you accept its terms.
 
 #pragma once
 
-#define USE_GMRES 0
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
 
 #include "matrix.h"
 #include "sparse_matrix.h"
 #include "symmatrix.h"
+#include "sym_factorization.h"
 #include "geometry.h"
 #include "assemble.h"
 #include "gmres.h"
+#include "preconditioners.h"
+#include "column_stream.h"
 
 namespace OpenMEEG {
 
+    /// Head2X*HeadMat^{-1}*SourceMat with the factors of the HeadMat (see SymFactorization and om_minverser -factor).
+    /// The HeadMat being symmetric, the systems are solved for the columns of SourceMat or for the lines of
+    /// Head2X, whichever are the fewest.
+
+    template <typename HEAD2X>
+    Matrix solved_product(const SymFactorization& HeadMatFactors,const HEAD2X& Head2X,const Matrix& SourceMat) {
+        if (Head2X.nlin()<SourceMat.ncol()) {
+            Matrix X(Head2X.transpose());
+            HeadMatFactors.solveLin(X);
+            return X.transpose()*SourceMat;
+        }
+        Matrix X(SourceMat,DEEP_COPY);
+        HeadMatFactors.solveLin(X);
+        return Head2X*X;
+    }
+
+    /// Solver of the HeadMat systems of the adjoint gains, chosen at run time (see om_gain -solver):
+    /// - LAPACK: Bunch-Kaufman factorization of the HeadMat,
+    /// - GMRES: block GMRes (see BlockGMRes). The right hand sides are solved by blocks of block_size columns and
+    ///   the Krylov space is restarted every restart block iterations, so that at most (restart+1)*block_size
+    ///   vectors of the size of the HeadMat are stored. The preconditioner is either the diagonal (JACOBI), the
+    ///   diagonal blocks of the meshes (MESH_BLOCKS, see MeshBlockPreconditioner), the incomplete factorization
+    ///   of the near field (NEAR_FIELD, see NearFieldILU) or the two-grid method smoothed by the latter (TWO_GRID,
+    ///   see TwoGridPreconditioner) whose coarse geometry must be provided.
+
+    struct SolverParameters {
+
+        typedef enum { LAPACK, GMRES } Solver;
+        typedef enum { JACOBI, MESH_BLOCKS, NEAR_FIELD, TWO_GRID } Preconditioner;
+
+        SolverParameters(const Solver s=LAPACK,const unsigned r=30,const unsigned b=16,const double tol=1e-7,const unsigned it=1000):
+            solver(s),preconditioner(JACOBI),restart(r),block_size(b),tolerance(tol),max_iterations(it),near_field(2.0),coarsening(0.25),coarse(0) { }
+
+        Solver         solver;
+        Preconditioner preconditioner;
+        unsigned restart;
+        unsigned block_size;
+        double   tolerance;
+        unsigned max_iterations;
+        double   near_field;      ///< radius of the near field (NEAR_FIELD, TWO_GRID), relative to the mean edge length
+        double   coarsening;      ///< ratio of the vertices kept in the coarse geometry (TWO_GRID)
+        const Geometry* coarse;   ///< coarse geometry (TWO_GRID), e.g. the geometry coarsened by this ratio
+    };
+
+    /// Solutions X of HeadMat X = RHS computed with block GMRes preconditioned by M (see SolverParameters).
+    /// Throws std::runtime_error if some right hand sides did not converge.
+
+    template <typename T,typename P>
+    Matrix KrylovSolutions(const T& HeadMat,const P& M,const Matrix& RHS,const SolverParameters& parameters) {
+        Matrix X(RHS.nlin(),RHS.ncol());
+        const unsigned nblocks = (RHS.ncol()+parameters.block_size-1)/parameters.block_size;
+        unsigned failures = 0;
+        for (unsigned b=0;b<nblocks;++b) {
+            const unsigned c0 = b*parameters.block_size;
+            const unsigned nc = std::min<unsigned>(parameters.block_size,RHS.ncol()-c0);
+            Matrix Xb;
+            failures += BlockGMRes(HeadMat,M,Xb,RHS.submat(0,RHS.nlin(),c0,nc),parameters.max_iterations,parameters.tolerance,parameters.restart);
+            std::copy(Xb.data(),Xb.data()+Xb.nlin()*Xb.ncol(),X.data()+c0*X.nlin());
+            PROGRESSBAR(b,nblocks);
+        }
+        if (failures!=0) {
+            std::ostringstream message;
+            message << "GMRes did not converge for " << failures << " of the " << RHS.ncol() << " right hand sides.";
+            throw std::runtime_error(message.str());
+        }
+        return X;
+    }
+
+    template <typename T>
+    Matrix KrylovSolutions(const Geometry& geo,const T& HeadMat,const Matrix& RHS,const SolverParameters& parameters) {
+        switch (parameters.preconditioner) {
+            case SolverParameters::MESH_BLOCKS:
+                return KrylovSolutions(HeadMat,MeshBlockPreconditioner(HeadMat,geo),RHS,parameters);
+            case SolverParameters::NEAR_FIELD:
+                return KrylovSolutions(HeadMat,NearFieldILU(HeadMat,geo,parameters.near_field),RHS,parameters);
+            case SolverParameters::TWO_GRID: {
+                if (parameters.coarse==0)
+                    throw std::invalid_argument("The two-grid preconditioner needs a coarse geometry.");
+                const NearFieldILU     smoother(HeadMat,geo,parameters.near_field);
+                const CoarseCorrection correction(geo,*parameters.coarse);
+                return KrylovSolutions(HeadMat,TwoGridPreconditioner<T,NearFieldILU>(HeadMat,smoother,correction),RHS,parameters);
+            }
+            default:
+                return KrylovSolutions(HeadMat,Jacobi<T>(HeadMat),RHS,parameters);
+        }
+    }
+
+    /// Solutions of the adjoint problems HeadMat X = Head2X' transposed (one line per sensor), i.e. Head2X HeadMat^{-1}.
+
+    template <typename HEAD2X>
+    Matrix AdjointSolutions(const Geometry& geo,const SymMatrix& HeadMat,const HEAD2X& Head2X,const SolverParameters& solver) {
+        Matrix mtemp(Head2X.transpose());
+        if (solver.solver==SolverParameters::GMRES)
+            mtemp = KrylovSolutions(geo, HeadMat, mtemp, solver);
+        else
+            HeadMat.solveLin(mtemp); // solving the system AX=B with LAPACK
+        return mtemp.transpose();
+    }
+
+    /// Same solutions with the factors of the HeadMat (SymFactorization, or HMatrix once factorized).
+
+    template <typename FACTORS,typename HEAD2X>
+    Matrix AdjointSolutions(const FACTORS& HeadMat,const HEAD2X& Head2X) {
+        Matrix mtemp(Head2X.transpose());
+        HeadMat.solveLin(mtemp); // the HeadMat being symmetric, its factors also give the adjoint solutions
+        return mtemp.transpose();
+    }
+
+    /// Leadfields mtemp*DipSourceMat of the dipoles (mtemp holding one line per sensor, see AdjointSolutions).
+    /// The source columns of a block of dipoles are assembled concurrently (see DipSourceMat) in a work buffer
+    /// which is applied with a single matrix product, written directly in the columns of the leadfields.
+
+    inline Matrix DipoleLeadFields(const Geometry& geo,const Matrix& dipoles,const Matrix& mtemp,const unsigned gauss_order,const unsigned block=256) {
+        const unsigned nsensors = mtemp.nlin();
+        const unsigned ndipoles = dipoles.nlin();
+        Matrix LeadField(nsensors,ndipoles);
+        const unsigned nblocks = (ndipoles+block-1)/block;
+        for (unsigned b=0;b<nblocks;++b) {
+            const unsigned first = b*block;
+            const unsigned n     = std::min(block,ndipoles-first);
+            const Matrix rhs = DipSourceMat(geo,dipoles.submat(first,n,0,dipoles.ncol()),gauss_order,true,"");
+            DGEMM(CblasNoTrans,CblasNoTrans,(int)nsensors,(int)n,(int)mtemp.ncol(),1.,mtemp.data(),(int)nsensors,
+                  rhs.data(),(int)rhs.nlin(),0.,LeadField.data()+static_cast<size_t>(first)*nsensors,(int)nsensors);
+            PROGRESSBAR(b,nblocks);
+        }
+        return LeadField;
+    }
+
     class GainMEG : public Matrix {
     public:
         using Matrix::operator=;
         GainMEG (const SymMatrix& HeadMatInv,const Matrix& SourceMat, const Matrix& Head2MEGMat, const Matrix& Source2MEGMat) {
             *this = Source2MEGMat+(Head2MEGMat*HeadMatInv)*SourceMat;
         }
+        GainMEG (const SymFactorization& HeadMatFactors,const Matrix& SourceMat, const Matrix& Head2MEGMat, const Matrix& Source2MEGMat) {
+            *this = Source2MEGMat+solved_product(HeadMatFactors,Head2MEGMat,SourceMat);
+        }
         ~GainMEG () {};
     };
 
@@ -65,41 +204,34 @@ namespace OpenMEEG {
         GainEEG (const SymMatrix& HeadMatInv,const Matrix& SourceMat, const SparseMatrix& Head2EEGMat) {
             *this = (Head2EEGMat*HeadMatInv)*SourceMat;
         }
+        GainEEG (const SymFactorization& HeadMatFactors,const Matrix& SourceMat, const SparseMatrix& Head2EEGMat) {
+            *this = solved_product(HeadMatFactors,Head2EEGMat,SourceMat);
+        }
         ~GainEEG () {};
     };
 
     class GainEEGadjoint : public Matrix {
         public:
             using Matrix::operator=;
-            GainEEGadjoint (const Geometry& geo,const Matrix& dipoles,const SymMatrix& HeadMat, const SparseMatrix& Head2EEGMat) {
-                Matrix LeadField(Head2EEGMat.nlin(),dipoles.nlin());
-                int gauss_order = 3;
-                // Consider the GMRes solver for problem with dimension > 15,000 (3,000 vertices per interface) else use LAPACK solver
-                #if USE_GMRES
-                Matrix mtemp(Head2EEGMat.nlin(),HeadMat.nlin());
-                Jacobi<SymMatrix> M(HeadMat);    // Jacobi preconditionner
-                #pragma omp parallel for
-                #ifndef OPENMP_3_0
-                for (int i=0;i<static_cast<int>(LeadField.nlin());++i) {
-                #else
-                for (unsigned i=0;i<LeadField.nlin();++i) {
-                #endif
-                    Vector vtemp(HeadMat.nlin());
-                    GMRes(HeadMat, M, vtemp, Head2EEGMat.getlin(i), 1e3, 1e-7, HeadMat.nlin()); // max number of iteration = 1000, and precision=1e-7 (1e-5 for faster resolution)
-                    mtemp.setlin(i, vtemp);
-                    #pragma omp critical
-                    PROGRESSBAR(i, LeadField.nlin());
-                }
-                #else
-                Matrix mtemp(Head2EEGMat.transpose());
-                HeadMat.solveLin(mtemp); // solving the system AX=B with LAPACK
-                mtemp=mtemp.transpose();
-                #endif
-                for ( unsigned i = 0; i < LeadField.ncol(); ++i) {
-                    LeadField.setcol(i,mtemp * DipSourceMat(geo, dipoles.submat(i, 1, 0, dipoles.ncol()), gauss_order, true, "").getcol(0)); // TODO ugly
-                    PROGRESSBAR(i,LeadField.ncol());
-                }
-                *this = LeadField;
+            GainEEGadjoint (const Geometry& geo,const Matrix& dipoles,const SymMatrix& HeadMat, const SparseMatrix& Head2EEGMat, const SolverParameters& solver=SolverParameters()) {
+                const Matrix mtemp = AdjointSolutions(geo, HeadMat, Head2EEGMat, solver);
+                *this = DipoleLeadFields(geo, dipoles, mtemp, 3);
+            }
+            /// Same gain using the H-LU factors of a compressed HeadMat (see HeadHMatrix and HMatrix::factorize).
+            GainEEGadjoint (const Geometry& geo,const Matrix& dipoles,const HMatrix& HeadMat, const SparseMatrix& Head2EEGMat) {
+                const Matrix mtemp = AdjointSolutions(HeadMat, Head2EEGMat);
+                *this = DipoleLeadFields(geo, dipoles, mtemp, 3);
+            }
+            /// Same gain using the factors of the HeadMat (see SymFactorization and om_minverser -factor).
+            GainEEGadjoint (const Geometry& geo,const Matrix& dipoles,const SymFactorization& HeadMat, const SparseMatrix& Head2EEGMat) {
+                const Matrix mtemp = AdjointSolutions(HeadMat, Head2EEGMat);
+                *this = DipoleLeadFields(geo, dipoles, mtemp, 3);
+            }
+            /// Same gain solving the adjoint problems with GMRes and the matrix-free HeadMat (see HeadMatOperator).
+            /// The Krylov space is restarted (see SolverParameters) so that the memory stays linear in the size of the HeadMat.
+            GainEEGadjoint (const Geometry& geo,const Matrix& dipoles,const HeadMatOperator& HeadMat, const SparseMatrix& Head2EEGMat, const SolverParameters& solver=SolverParameters(SolverParameters::GMRES)) {
+                Matrix mtemp = KrylovSolutions(geo, HeadMat, Matrix(Head2EEGMat.transpose()), solver).transpose();
+                *this = DipoleLeadFields(geo, dipoles, mtemp, 3);
             }
             ~GainEEGadjoint () {};
     };
@@ -110,80 +242,62 @@ namespace OpenMEEG {
             GainMEGadjoint (const Geometry& geo, const Matrix& dipoles,
                             const SymMatrix& HeadMat,
                             const Matrix& Head2MEGMat,
+                            const Matrix& Source2MEGMat,
+                            const SolverParameters& solver=SolverParameters()) {
+                const Matrix mtemp = AdjointSolutions(geo, HeadMat, Head2MEGMat, solver);
+                *this = DipoleLeadFields(geo, dipoles, mtemp, 3)+Source2MEGMat;
+            }
+            /// Same gain using the H-LU factors of a compressed HeadMat (see HeadHMatrix and HMatrix::factorize).
+            GainMEGadjoint (const Geometry& geo, const Matrix& dipoles,
+                            const HMatrix& HeadMat,
+                            const Matrix& Head2MEGMat,
                             const Matrix& Source2MEGMat) {
-                Matrix LeadField(Head2MEGMat.nlin(),dipoles.nlin());
-                int gauss_order = 3;
-                // Consider the GMRes solver for problem with dimension > 15,000 (3,000 vertices per interface) else use LAPACK solver
-                #if USE_GMRES
-                Matrix mtemp(Head2MEGMat.nlin(),HeadMat.nlin()); 
-                Jacobi<SymMatrix> M(HeadMat);    // Jacobi preconditionner
-                #pragma omp parallel for
-                #ifndef OPENMP_3_0
-                for (int i=0;i<static_cast<int>(LeadField.nlin());++i) {
-                #else
-                for (unsigned i=0;i<LeadField.nlin();++i) {
-                #endif
-                    Vector vtemp(HeadMat.nlin());
-                    GMRes(HeadMat, M, vtemp, Head2MEGMat.getlin(i), 1e3, 1e-7, HeadMat.nlin()); // max number of iteration = 1000, and precision=1e-7 (1e-5 for faster resolution)
-                    mtemp.setlin(i,vtemp);
-                    #pragma omp critical
-                    PROGRESSBAR(i,LeadField.nlin());
-                }
-                #else
-                Matrix mtemp(Head2MEGMat.transpose());
-                HeadMat.solveLin(mtemp); // solving the system AX=B with LAPACK
-                mtemp=mtemp.transpose();
-                #endif
-                for (unsigned i=0;i<LeadField.ncol();i++) {
-                    LeadField.setcol(i, mtemp * DipSourceMat(geo, dipoles.submat(i, 1, 0, dipoles.ncol()), gauss_order, true, "").getcol(0)+Source2MEGMat.getcol(i)); // TODO ugly
-                    PROGRESSBAR(i,LeadField.ncol());
-                }
-                *this = LeadField;
+                const Matrix mtemp = AdjointSolutions(HeadMat, Head2MEGMat);
+                *this = DipoleLeadFields(geo, dipoles, mtemp, 3)+Source2MEGMat;
+            }
+            /// Same gain using the factors of the HeadMat (see SymFactorization and om_minverser -factor).
+            GainMEGadjoint (const Geometry& geo, const Matrix& dipoles,
+                            const SymFactorization& HeadMat,
+                            const Matrix& Head2MEGMat,
+                            const Matrix& Source2MEGMat) {
+                const Matrix mtemp = AdjointSolutions(HeadMat, Head2MEGMat);
+                *this = DipoleLeadFields(geo, dipoles, mtemp, 3)+Source2MEGMat;
+            }
+            /// Same gain solving the adjoint problems with GMRes and the matrix-free HeadMat (see HeadMatOperator).
+            GainMEGadjoint (const Geometry& geo, const Matrix& dipoles,
+                            const HeadMatOperator& HeadMat,
+                            const Matrix& Head2MEGMat,
+                            const Matrix& Source2MEGMat,
+                            const SolverParameters& solver=SolverParameters(SolverParameters::GMRES)) {
+                Matrix mtemp = KrylovSolutions(geo, HeadMat, Head2MEGMat.transpose(), solver).transpose();
+                *this = DipoleLeadFields(geo, dipoles, mtemp, 3)+Source2MEGMat;
             }
             ~GainMEGadjoint () {};
     };
 
     class GainEEGMEGadjoint {
         public:
-            GainEEGMEGadjoint (const Geometry& geo,const Matrix& dipoles,const SymMatrix& HeadMat, const SparseMatrix& Head2EEGMat, const Matrix& Head2MEGMat, const Matrix& Source2MEGMat) {
-                unsigned gauss_order = 3;
-                this->EEGleadfield = Matrix(Head2EEGMat.nlin(), dipoles.nlin());
-                this->MEGleadfield = Matrix(Head2MEGMat.nlin(), dipoles.nlin());
-                Matrix RHS(Head2EEGMat.nlin()+Head2MEGMat.nlin(), HeadMat.nlin());
+            GainEEGMEGadjoint (const Geometry& geo,const Matrix& dipoles,const SymMatrix& HeadMat, const SparseMatrix& Head2EEGMat, const Matrix& Head2MEGMat, const Matrix& Source2MEGMat, const SolverParameters& solver=SolverParameters()) {
+                const Matrix mtemp = AdjointSolutions(geo, HeadMat, sensors(Head2EEGMat, Head2MEGMat), solver);
+                leadfields(geo, dipoles, mtemp, Head2EEGMat.nlin(), Source2MEGMat);
+            }
 
-                for ( unsigned i = 0; i < Head2EEGMat.nlin(); ++i) {
-                    RHS.setlin(i, Head2EEGMat.getlin(i));
-                }
-                for ( unsigned i = 0; i < Head2MEGMat.nlin(); ++i) {
-                    RHS.setlin(i + Head2EEGMat.nlin(), Head2MEGMat.getlin(i));
-                }
-                // Consider the GMRes solver for problem with dimension > 15,000 (3,000 vertices per interface) else use LAPACK solver
-                #if USE_GMRES
-                Matrix mtemp(RHS.nlin(), HeadMat.nlin()); 
-                Jacobi<SymMatrix> M(HeadMat); // Jacobi preconditionner
-                #pragma omp parallel for
-                #ifndef OPENMP_3_0
-                for (int i=0;i<static_cast<int>(RHS.nlin());++i) {
-                #else
-                for (unsigned i=0;i<RHS.nlin();++i) {
-                #endif
-                    Vector vtemp(HeadMat.nlin());
-                    GMRes(HeadMat, M, vtemp, RHS.getlin(i), 1e3, 1e-7, HeadMat.nlin()); // max number of iteration = 1000, and precision=1e-7 (1e-5 for faster resolution)
-                    mtemp.setlin(i, vtemp);
-                    #pragma omp critical
-                    PROGRESSBAR(i, RHS.nlin());
-                }
-                #else
-                Matrix mtemp(RHS.transpose());
-                HeadMat.solveLin(mtemp); // solving the system AX=B with LAPACK
-                mtemp = mtemp.transpose();
-                #endif
-                for ( unsigned i = 0; i < dipoles.nlin(); ++i) {
-                    Vector dsm = DipSourceMat(geo,dipoles.submat(i, 1, 0, dipoles.ncol()), gauss_order, true, "").getcol(0); // TODO ugly
-                    EEGleadfield.setcol(i, mtemp.submat(0, Head2EEGMat.nlin(), 0, HeadMat.nlin()) * dsm);
-                    MEGleadfield.setcol(i, mtemp.submat(Head2EEGMat.nlin(), Head2MEGMat.nlin(), 0, HeadMat.nlin()) * dsm + Source2MEGMat.getcol(i));
-                    PROGRESSBAR(i, dipoles.nlin());
-                }
+            /// Same gains using the H-LU factors of a compressed HeadMat (see HeadHMatrix and HMatrix::factorize).
+            GainEEGMEGadjoint (const Geometry& geo,const Matrix& dipoles,const HMatrix& HeadMat, const SparseMatrix& Head2EEGMat, const Matrix& Head2MEGMat, const Matrix& Source2MEGMat) {
+                const Matrix mtemp = AdjointSolutions(HeadMat, sensors(Head2EEGMat, Head2MEGMat));
+                leadfields(geo, dipoles, mtemp, Head2EEGMat.nlin(), Source2MEGMat);
+            }
+
+            /// Same gains using the factors of the HeadMat (see SymFactorization and om_minverser -factor).
+            GainEEGMEGadjoint (const Geometry& geo,const Matrix& dipoles,const SymFactorization& HeadMat, const SparseMatrix& Head2EEGMat, const Matrix& Head2MEGMat, const Matrix& Source2MEGMat) {
+                const Matrix mtemp = AdjointSolutions(HeadMat, sensors(Head2EEGMat, Head2MEGMat));
+                leadfields(geo, dipoles, mtemp, Head2EEGMat.nlin(), Source2MEGMat);
+            }
+
+            /// Same gains solving the adjoint problems with GMRes and the matrix-free HeadMat (see HeadMatOperator).
+            GainEEGMEGadjoint (const Geometry& geo,const Matrix& dipoles,const HeadMatOperator& HeadMat, const SparseMatrix& Head2EEGMat, const Matrix& Head2MEGMat, const Matrix& Source2MEGMat, const SolverParameters& solver=SolverParameters(SolverParameters::GMRES)) {
+                const Matrix mtemp = KrylovSolutions(geo, HeadMat, sensors(Head2EEGMat, Head2MEGMat).transpose(), solver).transpose();
+                leadfields(geo, dipoles, mtemp, Head2EEGMat.nlin(), Source2MEGMat);
             }
             
             void saveEEG( const std::string filename ) const { EEGleadfield.save(filename); }
@@ -192,6 +306,26 @@ namespace OpenMEEG {
             
             ~GainEEGMEGadjoint () {};
         private:
+            /// Lines of the EEG then of the MEG sensors, solved together.
+            static Matrix sensors(const SparseMatrix& Head2EEGMat, const Matrix& Head2MEGMat) {
+                Matrix Head2X(Head2EEGMat.nlin()+Head2MEGMat.nlin(), Head2MEGMat.ncol());
+                for ( unsigned i = 0; i < Head2EEGMat.nlin(); ++i) {
+                    Head2X.setlin(i, Head2EEGMat.getlin(i));
+                }
+                for ( unsigned i = 0; i < Head2MEGMat.nlin(); ++i) {
+                    Head2X.setlin(i + Head2EEGMat.nlin(), Head2MEGMat.getlin(i));
+                }
+                return Head2X;
+            }
+
+            /// Leadfields from the adjoint solutions (one line per EEG then MEG sensor).
+            void leadfields(const Geometry& geo, const Matrix& dipoles, const Matrix& mtemp, const unsigned nEEG, const Matrix& Source2MEGMat) {
+                const unsigned gauss_order = 3;
+                const Matrix LeadFields = DipoleLeadFields(geo, dipoles, mtemp, gauss_order);
+                EEGleadfield = LeadFields.submat(0, nEEG, 0, dipoles.nlin());
+                MEGleadfield = LeadFields.submat(nEEG, mtemp.nlin()-nEEG, 0, dipoles.nlin())+Source2MEGMat;
+            }
+
             Matrix EEGleadfield;
             Matrix MEGleadfield;
     };
@@ -202,6 +336,9 @@ namespace OpenMEEG {
         GainInternalPot (const SymMatrix& HeadMatInv, const Matrix& SourceMat, const Matrix& Head2IPMat, const Matrix& Source2IPMat) {
             *this = Source2IPMat + (Head2IPMat * HeadMatInv) * SourceMat;
         }
+        GainInternalPot (const SymFactorization& HeadMatFactors, const Matrix& SourceMat, const Matrix& Head2IPMat, const Matrix& Source2IPMat) {
+            *this = Source2IPMat + solved_product(HeadMatFactors, Head2IPMat, SourceMat);
+        }
         ~GainInternalPot () {};
     };
 
@@ -211,6 +348,9 @@ namespace OpenMEEG {
         GainStimInternalPot (const SymMatrix& HeadMatInv, const Matrix& SourceMat, const Matrix& Head2IPMat) {
             *this = (Head2IPMat * HeadMatInv) * SourceMat;
         }
+        GainStimInternalPot (const SymFactorization& HeadMatFactors, const Matrix& SourceMat, const Matrix& Head2IPMat) {
+            *this = solved_product(HeadMatFactors, Head2IPMat, SourceMat);
+        }
         ~GainStimInternalPot () {};
     };
 
@@ -220,6 +360,95 @@ namespace OpenMEEG {
         GainEITInternalPot (const SymMatrix& HeadMatInv,const Matrix& SourceMat, const Matrix& Head2IPMat) {
                 *this = (Head2IPMat*HeadMatInv)*SourceMat;
             }
+        GainEITInternalPot (const SymFactorization& HeadMatFactors,const Matrix& SourceMat, const Matrix& Head2IPMat) {
+                *this = solved_product(HeadMatFactors,Head2IPMat,SourceMat);
+            }
         ~GainEITInternalPot() {};
    };
+
+    // ==========================================
+    // = Gains written by blocks of sources =
+    // ==========================================
+
+    /// Source matrix of dipoles assembled by blocks of dipoles (see DipSourceMat and StreamedGains).
+
+    class DipoleSourceColumns {
+    public:
+
+        DipoleSourceColumns(const Geometry& g,const Matrix& d,const unsigned order=3): geo(g),dipoles(d),gauss_order(order) { }
+
+        size_t ncol() const { return dipoles.nlin(); }
+
+        Matrix read(const size_t first,const size_t n) const {
+            return DipSourceMat(geo, dipoles.submat(first, n, 0, dipoles.ncol()), gauss_order, true, "");
+        }
+
+    private:
+
+        const Geometry& geo;
+        const Matrix&   dipoles;
+        const unsigned  gauss_order;
+    };
+
+    /// Output of StreamedGains: the lines first to first+size-1 of the products, plus the columns of the optional
+    /// source to sensors matrix file (e.g. the DipSource2MEGMat), written to filename in the binary format.
+
+    struct StreamedGain {
+        StreamedGain(const std::string& file,const unsigned f,const unsigned n,const std::string& s2s=""):
+            filename(file),first(f),size(n),source2sensors(s2s) { }
+        std::string filename;
+        unsigned    first;
+        unsigned    size;
+        std::string source2sensors;
+    };
+
+    /// Gains Sensors*Sources (+ Source2Sensors) computed by blocks of chunk sources for large source spaces: each
+    /// block of the source matrix is read (ColumnReader) or assembled (DipoleSourceColumns), multiplied by the
+    /// sensor matrix (e.g. Head2EEGMat*HeadMatInv or the adjoint solutions) and appended to the output files by
+    /// writer threads (ColumnWriter), so that the memory does not depend on the number of sources.
+
+    template <typename SOURCES>
+    void StreamedGains(const Matrix& Sensors,SOURCES& sources,const std::vector<StreamedGain>& outputs,const unsigned chunk) {
+        const size_t nsources = sources.ncol();
+        std::vector<ColumnReader*> source2sensors(outputs.size(),0);
+        std::vector<ColumnWriter*> writers(outputs.size(),0);
+        std::vector<Matrix>        lines;
+        try {
+            for (unsigned k=0;k<outputs.size();++k) {
+                const bool all = outputs[k].first==0 && outputs[k].size==Sensors.nlin();
+                lines.push_back(all ? Sensors : Sensors.submat(outputs[k].first,outputs[k].size,0,Sensors.ncol()));
+                if (!outputs[k].source2sensors.empty()) {
+                    source2sensors[k] = new ColumnReader(outputs[k].source2sensors);
+                    if (source2sensors[k]->nlin()!=outputs[k].size || source2sensors[k]->ncol()!=nsources)
+                        throw maths::BadContent("binary",outputs[k].source2sensors+" matrix of the sources");
+                }
+                writers[k] = new ColumnWriter(outputs[k].filename,outputs[k].size,nsources);
+            }
+            const unsigned nblocks = (nsources+chunk-1)/chunk;
+            for (unsigned b=0;b<nblocks;++b) {
+                const size_t first = static_cast<size_t>(b)*chunk;
+                const size_t n     = std::min<size_t>(chunk,nsources-first);
+                const Matrix& block = sources.read(first,n);
+                for (unsigned k=0;k<outputs.size();++k) {
+                    Matrix gains = lines[k]*block;
+                    if (source2sensors[k]!=0)
+                        gains += source2sensors[k]->read(first,n);
+                    writers[k]->append(gains);
+                }
+                PROGRESSBAR(b,nblocks);
+            }
+            for (unsigned k=0;k<outputs.size();++k)
+                writers[k]->close();
+        } catch (...) {
+            for (unsigned k=0;k<outputs.size();++k) {
+                delete source2sensors[k];
+                delete writers[k];
+            }
+            throw;
+        }
+        for (unsigned k=0;k<outputs.size();++k) {
+            delete source2sensors[k];
+            delete writers[k];
+        }
+    }
 }
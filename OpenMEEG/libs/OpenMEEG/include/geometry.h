@@ -54,6 +54,17 @@ knowledge of the CeCILL-B license and that you accept its terms.
 
 namespace OpenMEEG {
 
+    /// \brief Orderings of the unknowns (see Geometry::generate_indices).
+    /// The unknowns keep their layout (vertices, then triangles mesh by mesh, then the triangles of current barriers),
+    /// but within the vertices (grouped by mesh) and within the triangles of each mesh they can be sorted along a
+    /// space-filling curve (Morton or Hilbert) or in the order of the leaves of a cluster tree, so that spatially
+    /// close unknowns get close indices.
+
+    enum UnknownOrdering { FILE_ORDER, MORTON_ORDER, HILBERT_ORDER, CLUSTER_ORDER };
+
+    OPENMEEG_EXPORT bool        unknown_ordering(const std::string& name,UnknownOrdering& ordering); ///< \brief false if name is not an ordering
+    OPENMEEG_EXPORT std::string unknown_ordering_name(const UnknownOrdering ordering);
+
     /** \brief Geometry contains the electrophysiological model
         Here are stored the vertices, meshes and domains
      */
@@ -86,8 +97,8 @@ namespace OpenMEEG {
         Domains::const_iterator    domain_end()      const { return domains_.end();    }
 
         /// Constructors
-        Geometry(): has_cond_(false), is_nested_(false), size_(0), nb_current_barrier_triangles_(0)  {}
-        Geometry(const std::string& geomFileName, const std::string& condFileName = "", const bool OLD_ORDERING = false): has_cond_(false), is_nested_(false), size_(0), nb_current_barrier_triangles_(0)  { read(geomFileName, condFileName, OLD_ORDERING); }
+        Geometry(): has_cond_(false), is_nested_(false), size_(0), ordering_(FILE_ORDER), nb_current_barrier_triangles_(0)  {}
+        Geometry(const std::string& geomFileName, const std::string& condFileName = "", const bool OLD_ORDERING = false): has_cond_(false), is_nested_(false), size_(0), ordering_(FILE_ORDER), nb_current_barrier_triangles_(0)  { read(geomFileName, condFileName, OLD_ORDERING); }
 
               void       info(const bool verbous = false) const; ///< \brief Print information on the geometry
         const bool&      has_cond()                       const { return has_cond_; }
@@ -118,6 +129,29 @@ namespace OpenMEEG {
         int    oriented(const Mesh&, const Mesh&) const;
 
         void read(const std::string& geomFileName, const std::string& condFileName = "", const bool OLD_ORDERING = false);
+
+        /// \brief Decimate each mesh to about ratio times its number of vertices (coarse level of TwoGridPreconditioner).
+        /// The shortest edges are collapsed, keeping the topology of the meshes and the vertices shared by several meshes.
+        /// The vertices are rebuilt and the unknowns are numbered again (file ordering).
+
+        void coarsen(const double ratio);
+
+        /// Ordering of the unknowns, to be set before reading the geometry.
+
+        const UnknownOrdering& ordering() const { return ordering_; }
+              UnknownOrdering& ordering()       { return ordering_; }
+
+        /// \brief For each unknown, its index in the file ordering (identity for FILE_ORDER).
+
+        const std::vector<unsigned>& permutation() const { return permutation_; }
+
+        /// \brief Save the ordering and the permutation of the unknowns (text file read by load_ordering).
+
+        void save_ordering(const std::string& filename) const;
+
+        /// \brief Read an ordering saved by save_ordering (false if the file cannot be read).
+
+        static bool load_ordering(const std::string& filename, UnknownOrdering& ordering, std::vector<unsigned>& permutation);
         void load_vtp(const std::string& filename) { Matrix trash; load_vtp(filename, trash, false); }
         void load_vtp(const std::string& filename, Matrix& data) { load_vtp(filename, data, true); }
         void load_vtp(const std::string& filename, Matrix& data, const bool READ_DATA);
@@ -134,7 +168,10 @@ namespace OpenMEEG {
         bool       has_cond_;
         bool       is_nested_;
         unsigned   size_;   // total number = nb of vertices + nb of triangles
+        UnknownOrdering       ordering_;
+        std::vector<unsigned> permutation_;
         void          generate_indices(const bool);
+        void          reorder_unknowns();
         const Domains common_domains(const Mesh&, const Mesh&) const;
               double  funct_on_domains(const Mesh&, const Mesh&, const Function& ) const;
 
@@ -39,8 +39,12 @@ knowledge of the CeCILL-B license and that you accept its terms.
 
 #pragma once
 
+#include <vector>
+#include <algorithm>
+
 #include "vector.h"
 #include "matrix.h"
+#include "symmatrix.h"
 #include "sparse_matrix.h"
 
 #include "DLLDefinesOpenMEEG.h"
@@ -53,7 +57,7 @@ namespace OpenMEEG {
     template <typename M>
     class Jacobi {
     public:
-        Jacobi (const M& m): J(m.nlin()) { 
+        Jacobi (const M& m): J(m.nlin(),m.nlin()) { 
             for ( unsigned i = 0; i < m.nlin(); ++i) {
                 J(i, i) = 1.0 / m(i,i);
             }
@@ -62,6 +66,10 @@ namespace OpenMEEG {
         Vector operator()(const Vector& g) const {
             return J*g;
         }
+
+        Matrix operator()(const Matrix& G) const {
+            return J*G;
+        }
     
         ~Jacobi () {};
     private:
@@ -72,7 +80,7 @@ namespace OpenMEEG {
     // = Define a GMRes solver =
     // =========================
 
-    void GeneratePlaneRotation(double &dx, double &dy, double &cs, double &sn)
+    inline void GeneratePlaneRotation(double &dx, double &dy, double &cs, double &sn)
     {
         if (dy == 0.0) {
             cs = 1.0;
@@ -88,7 +96,7 @@ namespace OpenMEEG {
         }
     }
 
-    void ApplyPlaneRotation(double &dx, double &dy, double &cs, double &sn)
+    inline void ApplyPlaneRotation(double &dx, double &dy, double &cs, double &sn)
     {
         double temp  =  cs * dx + sn * dy;
         dy = -sn * dx + cs * dy;
@@ -182,4 +190,178 @@ namespace OpenMEEG {
         delete [] v;
         return 1;
     }
+
+    // ===============================
+    // = Define a block GMRes solver =
+    // ===============================
+
+    /// Products of an operator with the columns of X: the SymMatrix uses its BLAS-3 product (or its BLAS-2
+    /// one for a single column), the other operators (e.g. HeadMatOperator) are applied column by column.
+
+    template <typename T>
+    Matrix BlockProduct(const T& A,const Matrix& X) {
+        Matrix AX(A.nlin(),X.ncol());
+        for (unsigned j=0;j<X.ncol();++j)
+            AX.setcol(j,A*X.getcol(j));
+        return AX;
+    }
+
+    inline Matrix BlockProduct(const SymMatrix& A,const Matrix& X) {
+        if (X.ncol()!=1)
+            return A*X;
+        Matrix AX(A.nlin(),1);
+        AX.setcol(0,A*X.getcol(0));
+        return AX;
+    }
+
+    /// Householder QR factorization W = Q R of a n x p block (n>=p): W is replaced by Q and R is returned.
+
+    inline Matrix BlockOrthonormalize(Matrix& W) {
+        const int n = static_cast<int>(W.nlin());
+        const int p = static_cast<int>(W.ncol());
+        std::vector<double> tau(p);
+        double sizes[2];
+        int info;
+        DGEQRF(n,p,W.data(),n,&tau[0],&sizes[0],-1,info);
+        DORGQR(n,p,p,W.data(),n,&tau[0],&sizes[1],-1,info);
+        std::vector<double> work(std::max(static_cast<int>(std::max(sizes[0],sizes[1])),p));
+        DGEQRF(n,p,W.data(),n,&tau[0],&work[0],static_cast<int>(work.size()),info);
+        Matrix R(p,p);
+        R.set(0.0);
+        for (int j=0;j<p;++j)
+            for (int i=0;i<=j;++i)
+                R(i,j) = W(i,j);
+        DORGQR(n,p,p,W.data(),n,&tau[0],&work[0],static_cast<int>(work.size()),info);
+        return R;
+    }
+
+    /// Applies Q' to the 2p rows of the ncols columns of X (leading dimension ldx), Q being given by the Householder
+    /// vectors and factors of a 2p x p QR factorization computed by DGEQRF.
+
+    inline void ApplyReflections(const Matrix& QR,const std::vector<double>& tau,double* X,const unsigned ldx,const unsigned ncols) {
+        const unsigned m = QR.nlin();
+        for (unsigned c=0;c<ncols;++c) {
+            double* x = X+c*ldx;
+            for (unsigned k=0;k<QR.ncol();++k) {
+                double d = x[k];
+                for (unsigned i=k+1;i<m;++i)
+                    d += QR(i,k)*x[i];
+                d *= tau[k];
+                x[k] -= d;
+                for (unsigned i=k+1;i<m;++i)
+                    x[i] -= d*QR(i,k);
+            }
+        }
+    }
+
+    /// Block GMRes (left preconditioned by M, as GMRes): the columns of B are solved together, the Krylov spaces
+    /// of all the right hand sides being built with block products and BLAS-3 orthogonalizations (block classical
+    /// Gram-Schmidt applied twice). The Krylov space is restarted every restart block iterations, so that at most
+    /// (restart+1)*B.ncol() vectors are stored. Returns the number of columns of B whose relative residual is
+    /// still above tol after max_iter block iterations.
+
+    template<class T,class P> // T should be a linear operator, and P a preconditionner
+    unsigned BlockGMRes(const T& A,const P& M,Matrix& X,const Matrix& B,const unsigned max_iter,const double tol,const unsigned restart) {
+        const unsigned n = A.nlin();
+        const unsigned p = B.ncol();
+
+        X = Matrix(n,p);
+        X.set(0.0);
+
+        Matrix R = M(B);
+        std::vector<double> normb(p);
+        for (unsigned c=0;c<p;++c) {
+            normb[c] = R.getcol(c).norm();
+            if (normb[c]==0.0)
+                normb[c] = 1.0;
+        }
+
+        Matrix V(n,(restart+1)*p); // orthonormal basis of the Krylov space, by blocks of p vectors
+        Matrix H((restart+1)*p,restart*p);
+        std::vector<Matrix> Reflectors(restart); // Householder vectors of the reduction of H (Matrix copies are shallow)
+        for (unsigned i=0;i<restart;++i)
+            Reflectors[i] = Matrix(2*p,p);
+        std::vector<std::vector<double> > Taus(restart,std::vector<double>(p));
+        std::vector<double> work(64*p);
+        for (unsigned iter=0;;) {
+
+            unsigned unconverged = 0;
+            for (unsigned c=0;c<p;++c)
+                if (R.getcol(c).norm()/normb[c]>=tol)
+                    ++unconverged;
+            if (unconverged==0 || iter>=max_iter)
+                return unconverged;
+
+            const Matrix S = BlockOrthonormalize(R);
+            std::copy(R.data(),R.data()+n*p,V.data());
+            H.set(0.0);
+
+            Matrix G((restart+1)*p,p); // rotated right hand side E1 S
+            G.set(0.0);
+            for (unsigned c=0;c<p;++c)
+                for (unsigned i=0;i<=c;++i)
+                    G(i,c) = S(i,c);
+
+            unsigned j = 0;
+            while (j<restart && iter<max_iter) {
+                const unsigned k = (j+1)*p;
+                Matrix W = M(BlockProduct(A,V.submat(0,n,j*p,p)));
+                for (unsigned pass=0;pass<2;++pass) {
+                    Matrix C(k,p);
+                    DGEMM(CblasTrans,CblasNoTrans,(int)k,(int)p,(int)n,1.,V.data(),(int)n,W.data(),(int)n,0.,C.data(),(int)k);
+                    DGEMM(CblasNoTrans,CblasNoTrans,(int)n,(int)p,(int)k,-1.,V.data(),(int)n,C.data(),(int)k,1.,W.data(),(int)n);
+                    for (unsigned c=0;c<p;++c)
+                        for (unsigned i=0;i<k;++i)
+                            H(i,j*p+c) += C(i,c);
+                }
+                const Matrix Hk = BlockOrthonormalize(W);
+                for (unsigned c=0;c<p;++c)
+                    for (unsigned i=0;i<p;++i)
+                        H(k+i,j*p+c) = Hk(i,c);
+                std::copy(W.data(),W.data()+n*p,V.data()+k*n);
+                ++j;
+                ++iter;
+
+                //  Least squares problem min ||E1 S-Hbar Y|| with the (j+1)p x jp block Hessenberg matrix Hbar,
+                //  reduced to triangular form by Householder reflections on 2p rows per block column. The new
+                //  block column undergoes the previous reflections, then its subdiagonal block is eliminated.
+
+                double* h = H.data()+(j-1)*p*H.nlin();
+                for (unsigned i=0;i+1<j;++i)
+                    ApplyReflections(Reflectors[i],Taus[i],h+i*p,H.nlin(),p);
+
+                Matrix& QR = Reflectors[j-1];
+                for (unsigned c=0;c<p;++c)
+                    for (unsigned i=0;i<2*p;++i)
+                        QR(i,c) = H((j-1)*p+i,(j-1)*p+c);
+                int info;
+                DGEQRF(2*p,p,QR.data(),2*p,&Taus[j-1][0],&work[0],static_cast<int>(work.size()),info);
+                for (unsigned c=0;c<p;++c)
+                    for (unsigned i=0;i<2*p;++i)
+                        H((j-1)*p+i,(j-1)*p+c) = (i<=c) ? QR(i,c) : 0.0;
+                ApplyReflections(QR,Taus[j-1],G.data()+(j-1)*p,G.nlin(),p);
+
+                bool converged = true;
+                for (unsigned c=0;c<p && converged;++c) {
+                    double resid = 0.0;
+                    for (unsigned i=j*p;i<(j+1)*p;++i)
+                        resid += G(i,c)*G(i,c);
+                    converged = sqrt(resid)/normb[c]<tol;
+                }
+                if (converged)
+                    break;
+            }
+
+            //  Y is the solution of the triangular system made of the first jp rows.
+
+            Matrix Y(j*p,p);
+            for (unsigned c=0;c<p;++c)
+                for (unsigned i=0;i<j*p;++i)
+                    Y(i,c) = G(i,c);
+            DTRSM(CblasLeft,CblasUpper,CblasNoTrans,CblasNonUnit,(int)(j*p),(int)p,1.,H.data(),(int)H.nlin(),Y.data(),(int)(j*p));
+
+            DGEMM(CblasNoTrans,CblasNoTrans,(int)n,(int)p,(int)(j*p),1.,V.data(),(int)n,Y.data(),(int)(j*p),1.,X.data(),(int)n);
+            R = M(B-BlockProduct(A,X));
+        }
+    }
 }
@@ -0,0 +1,198 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+/*! \file
+    \brief file containing the hierarchical matrices (H-matrices) used to compress the BEM operators
+*/
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include <vect3.h>
+#include <vector.h>
+#include <matrix.h>
+#include <linop.h>
+#include <DLLDefinesOpenMEEG.h>
+
+namespace OpenMEEG {
+
+    /// \brief Binary tree of clusters of unknowns, obtained by recursive bisection of their positions.
+    /// Unknowns are first separated by group (e.g. the vertices and the triangles of each mesh) according to the bits
+    /// of the group labels (most significant first), then by cutting the bounding box of the cluster along its largest
+    /// extent. The unknowns of a cluster are contiguous in the tree ordering, permutation()[i] being the original index
+    /// of the i-th unknown of this ordering (which is also the elimination order of the H-LU factorization).
+    /// Each cluster also has a box aligned on its principal axes, which is much tighter than the bounding box for
+    /// the curved patches of a surface (the bounding boxes of the patches of a sphere all touch its center).
+
+    class OPENMEEG_EXPORT ClusterTree {
+    public:
+
+        struct Cluster {
+            unsigned begin,end;  ///< range of the cluster in the tree ordering
+            int      sons[2];    ///< positions of the sons in the tree (-1 for a leaf)
+            Vect3    lower;      ///< bounding box
+            Vect3    upper;
+            Vect3    center;     ///< principal box: center, orthonormal axes and half extents along them
+            Vect3    axes[3];
+            Vect3    half_extents;
+
+            unsigned size()     const { return end-begin;                }
+            bool     leaf()     const { return sons[0]<0;                }
+            double   diameter() const { return std::min((upper-lower).norm(),2.0*half_extents.norm()); }
+        };
+
+        ClusterTree() { }
+        ClusterTree(const std::vector<Vect3>& points,const std::vector<unsigned>& groups,const unsigned leaf_size=32);
+
+        unsigned nb_unknowns() const { return permutation_.size(); }
+        unsigned size()        const { return clusters_.size();    }
+
+        const Cluster& operator[](const unsigned i) const { return clusters_[i]; }
+        const Cluster& root() const { return clusters_[0]; }
+
+        const std::vector<unsigned>& permutation() const { return permutation_; }
+
+        /// Lower bound of the distance between two clusters: the largest of the distance between their bounding
+        /// boxes and of the gaps between the projections of their principal boxes on separating axes.
+
+        static double distance(const Cluster& c1,const Cluster& c2);
+
+        /// Standard admissibility condition: min(diam(c1),diam(c2)) <= eta*dist(c1,c2) for disjoint clusters.
+        /// The interactions of admissible clusters are approximated by low rank matrices.
+
+        static bool admissible(const Cluster& c1,const Cluster& c2,const double eta) {
+            const double dist = distance(c1,c2);
+            return dist>0.0 && std::min(c1.diameter(),c2.diameter())<=eta*dist;
+        }
+
+    private:
+
+        unsigned build(const std::vector<Vect3>& points,const std::vector<unsigned>& groups,const unsigned begin,const unsigned end,const unsigned leaf_size);
+
+        std::vector<Cluster>  clusters_;
+        std::vector<unsigned> permutation_;
+    };
+
+    /// \brief Entries of a matrix to be compressed as an H-matrix.
+    /// The blocks are requested concurrently by the assembly threads, so block() must be thread safe.
+
+    class OPENMEEG_EXPORT HMatrixEntries {
+    public:
+
+        virtual ~HMatrixEntries() { }
+
+        /// Fill values (of size rows.size() x cols.size()) with the entries (rows[i],cols[j]) of the matrix.
+        /// Indices are in the original numbering of the unknowns.
+
+        virtual void block(const std::vector<unsigned>& rows,const std::vector<unsigned>& cols,Matrix& values) const = 0;
+
+        /// For a symmetric matrix, only the blocks of the upper part are computed, the other ones being transposed.
+
+        virtual bool symmetric() const { return false; }
+    };
+
+    /// \brief Hierarchical matrix.
+    /// The block cluster tree is built on a ClusterTree: blocks of admissible clusters are stored as low rank matrices
+    /// U*V^T obtained by adaptive cross approximation (ACA with partial pivoting) of their entries, blocks involving a
+    /// leaf cluster are stored as dense matrices and the other ones are subdivided. Admissible blocks which are too
+    /// small for a low rank representation to pay off at the requested accuracy are also stored as dense matrices.
+    /// Storage and matrix-vector products are thus almost linear in the number of unknowns for the BEM operators.
+    /// factorize() replaces the matrix by its H-LU factors (without pivoting, low rank blocks being truncated at the
+    /// compression accuracy), after which solveLin() can be used. The H-matrix can then no longer be multiplied.
+    /// A null pivot in the factorization (and solveLin() before factorize()) throws a std::runtime_error.
+
+    class OPENMEEG_EXPORT HMatrix: public LinOp {
+
+        typedef LinOp base;
+
+    public:
+
+        struct Block;
+
+        HMatrix(): base(0,0,FULL,2),root_(0),epsilon_(0.0),factorized_(false) { }
+
+        /// Compression of the entries to a relative accuracy epsilon. eta is the admissibility parameter.
+
+        HMatrix(const ClusterTree& tree,const HMatrixEntries& entries,const double epsilon=1e-6,const double eta=2.0);
+
+        HMatrix(const HMatrix& H);
+        HMatrix& operator=(const HMatrix& H);
+
+        ~HMatrix();
+
+        size_t size() const; ///< \brief Number of stored coefficients.
+        void   info() const;
+
+        double epsilon()            const { return epsilon_;    }
+        bool   factorized()         const { return factorized_; }
+        const ClusterTree& tree()   const { return tree_;       }
+
+        /// Ratio of the storage to the one of the dense matrix.
+
+        double compression() const { return static_cast<double>(size())/(static_cast<double>(nlin())*ncol()); }
+
+        /// Numbers of dense and of low rank blocks.
+
+        unsigned nb_dense_blocks()    const;
+        unsigned nb_low_rank_blocks() const;
+
+        Vector operator*(const Vector& x) const;
+        Matrix operator*(const Matrix& X) const;
+
+        /// In place H-LU factorization.
+
+        void factorize();
+
+        Vector solveLin(const Vector& B) const;
+        Matrix solveLin(Matrix& B) const;
+
+    protected:
+
+        /// Computation of the blocks (for derived classes which need to build the entries first).
+
+        void assemble(const ClusterTree& tree,const HMatrixEntries& entries,const double epsilon,const double eta=2.0);
+
+    private:
+
+        ClusterTree tree_;
+        Block*      root_;
+        double      epsilon_;
+        bool        factorized_;
+    };
+}
@@ -49,6 +49,8 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #include <stack>
 #include <string>
 #include <triangle.h>
+#include <triangle_cache.h>
+#include <compact_mesh.h>
 #include <IOUtils.H>
 #include <om_utils.h>
 #include <sparse_matrix.h>
@@ -92,6 +94,26 @@ namespace OpenMEEG {
         typedef VectPVertex::const_iterator         const_vertex_iterator;
         typedef VectPVertex::const_reverse_iterator const_vertex_reverse_iterator;
 
+        /// \brief Positions (in the mesh) of a set of triangles, read in the adjacency arrays of the mesh.
+
+        class Positions {
+        public:
+
+            typedef std::vector<unsigned>::const_iterator const_iterator;
+
+            Positions(const const_iterator b,const const_iterator e): first(b),last(e) { }
+
+            const_iterator begin() const { return first; }
+            const_iterator end()   const { return last;  }
+            unsigned       size()  const { return last-first; }
+
+            unsigned operator[](const unsigned i) const { return first[i]; }
+
+        private:
+
+            const_iterator first,last;
+        };
+
         // Constructors:
         /// default constructor
 
@@ -166,7 +188,7 @@ namespace OpenMEEG {
         bool has_correct_orientation() const; ///< \brief check the local orientation of the mesh triangles
         void build_mesh_vertices(); ///< \brief construct the list of the mesh vertices out of its triangles
         void generate_indices(); ///< \brief generate indices (if allocate)
-        void update(); ///< \brief recompute triangles normals, area, and links
+        void update(); ///< \brief recompute triangles normals, area, links and cache
         void merge(const Mesh&, const Mesh&); ///< properly merge two meshes into one
 
         /// Flip all triangles
@@ -179,8 +201,24 @@ namespace OpenMEEG {
         void correct_local_orientation(); ///< \brief correct the local orientation of the mesh triangles
         void correct_global_orientation(); ///< \brief correct the global orientation (if there is one)
         double compute_solid_angle(const Vect3& p) const; ///< Given a point p, it computes the solid angle
-        const VectPTriangle& get_triangles_for_vertex(const Vertex& V) const; ///< \brief get the triangles associated with vertex V \return the links
+        VectPTriangle get_triangles_for_vertex(const Vertex& V) const; ///< \brief get the triangles associated with vertex V \return the links
+        unsigned position(const Triangle& T) const { return &T-&*begin(); } ///< \brief position in the mesh of its triangle T
+        unsigned vertex_position(const Vertex& V) const; ///< \brief position of V in the mesh vertices (nb_vertices() if V is not a mesh vertex)
+        const TriangleCache& cache() const { return cache_; } ///< \brief get the precomputed quadrature/analytic data of the triangles (built by update())
+        const CompactMesh& compact() const { return compact_; } ///< \brief get the contiguous copy of the vertices and triangles (built by update())
         VectPTriangle adjacent_triangles(const Triangle&) const; ///< \brief get the adjacent triangles
+
+        /// \brief Positions of the triangles containing the i-th vertex of the mesh (built by update()).
+
+        Positions vertex_triangles(const unsigned i) const {
+            return Positions(vertex_triangles_.begin()+vertex_offsets_[i],vertex_triangles_.begin()+vertex_offsets_[i+1]);
+        }
+
+        /// \brief Positions of the triangles sharing an edge with the i-th triangle of the mesh (built by update()).
+
+        Positions triangle_neighbours(const unsigned i) const {
+            return Positions(triangle_neighbours_.begin()+triangle_offsets_[i],triangle_neighbours_.begin()+triangle_offsets_[i+1]);
+        }
         Normal normal(const Vertex& v) const; ///< \brief get the Normal at vertex
         void laplacian(SymMatrix &A) const; ///< \brief compute mesh laplacian
 
@@ -264,16 +302,12 @@ namespace OpenMEEG {
 
     private:
 
-        /// map the edges with an unsigned
-
-        typedef std::map<std::pair<const Vertex *, const Vertex *>, int> EdgeMap; 
-
         void destroy();
         void copy(const Mesh&);
+        void build_adjacency();
 
         // regarding mesh orientation
 
-        const EdgeMap compute_edge_map() const;
         void  orient_adjacent_triangles(std::stack<Triangle*>& t_stack,std::map<Triangle*,bool>& tri_reoriented);
         bool  triangle_intersection(const Triangle&,const Triangle&) const;
 
@@ -288,12 +322,23 @@ namespace OpenMEEG {
         }
 
         std::string                           name_;         ///< Name of the mesh.
-        std::map<const Vertex*,VectPTriangle> links_;        ///< links[&v] are the triangles that contain vertex v.
+
+        // Compressed adjacency: the triangles of the i-th vertex (resp. the neighbours of the i-th triangle) are at
+        // [vertex_offsets_[i],vertex_offsets_[i+1][ in vertex_triangles_ (resp. triangle_offsets_ and triangle_neighbours_).
+
+        std::vector<unsigned>                 vertex_offsets_;
+        std::vector<unsigned>                 vertex_triangles_;
+        std::vector<unsigned>                 triangle_offsets_;
+        std::vector<unsigned>                 triangle_neighbours_;
+        std::vector<std::pair<const Vertex*,unsigned> > vertex_positions_; ///< Mesh vertices sorted by address, with their positions.
+
         Vertices*                             all_vertices_; ///< Pointer to all the vertices.
         VectPVertex                           vertices_;     ///< Vector of pointers to the mesh vertices.
         bool                                  outermost_;    ///< Is it an outermost mesh ? (i.e does it touch the Air domain)
         bool                                  allocate_;     ///< Are the vertices allocate within the mesh or shared ?
         std::set<Vertex>                      set_vertices_;
+        TriangleCache                         cache_;        ///< Quadrature nodes and analytic data of the triangles.
+        CompactMesh                           compact_;      ///< Contiguous coordinates, vertex triples, normals and areas.
 
     ///handle multiple 0 conductivity domains
     private:
@@ -43,6 +43,8 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #pragma once
 
 #include <iostream>
+#include <map>
+#include <vector>
 
 #include <vector.h>
 #include <matrix.h>
@@ -51,14 +53,13 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #include <geometry.h>
 #include <integrator.h>
 #include <analytics.h>
+#include <task_scheduler.h>
 
 namespace OpenMEEG {
 
-    #ifdef USE_OMP
-    #undef OPTIMIZED_OPERATOR_D
-    #else
+    // The optimized (triangle pair) version of the D operator is also used with OpenMP, as its tiles
+    // accumulate the contributions to the vertices locally (see OperatorDTile).
     #define OPTIMIZED_OPERATOR_D
-    #endif
 
     //#define ADAPT_LHS
 
@@ -68,354 +69,608 @@ namespace OpenMEEG {
     void operatorFerguson(const Vect3& , const Mesh& , Matrix& , const unsigned&, const double&);
     void operatorDipolePotDer(const Vect3& , const Vect3& , const Mesh& , Vector&, const double&, const unsigned, const bool);
     void operatorDipolePot   (const Vect3& , const Vect3& , const Mesh& , Vector&, const double&, const unsigned, const bool);
+    void operatorDipolePotDer(const Vect3& , const Vect3& , const Mesh& , double*, const double&, const unsigned, const bool);
+    void operatorDipolePot   (const Vect3& , const Vect3& , const Mesh& , double*, const double&, const unsigned, const bool);
+
+    /// \brief State of the integral kernels for one thread of computation.
+    /// The data depending on a single triangle are precomputed in the mesh (see TriangleCache). The remaining
+    /// state (analytic parts depending on several elements) cannot be shared between threads: each task (or
+    /// each iteration of a parallel loop) owns a context that it hands to the kernels.
+
+    class KernelContext {
+    public:
+
+        KernelContext(const QuadraturePolicy& q=QuadraturePolicy()): gauss_order(q.order()),quadrature(q) { }
+
+        /// Gauss order for triangle i1 of m1 and triangle i2 of m2.
+
+        unsigned order(const Mesh& m1,const unsigned i1,const Mesh& m2,const unsigned i2) const {
+            if (quadrature.type()==QuadraturePolicy::FIXED)
+                return gauss_order;
+            const TriangleCache& c1 = m1.cache();
+            const TriangleCache& c2 = m2.cache();
+            return quadrature.order((c1.center(i1)-c2.center(i2)).norm(),std::max(c1.diameter(i1),c2.diameter(i2)));
+        }
+
+        const unsigned         gauss_order;
+        const QuadraturePolicy quadrature;
+        analyticD              analyD;     // Depends on a triangle and one of its vertices.
+    };
+
+    // The kernels designate triangles by their mesh and their position in this mesh, so as to use the mesh cache.
 
     #ifndef OPTIMIZED_OPERATOR_D
-    inline double _operatorD(const Triangle& T,const Vertex& V,const Mesh& m,const unsigned gauss_order) {
+    inline double _operatorD(const Mesh& mt,const unsigned it,const Mesh& m,const unsigned iv,KernelContext& context) {
         // consider varying order of quadrature with the distance between T and T2
-        STATIC_OMP analyticD analyD;
     #ifdef ADAPT_LHS
-        STATIC_OMP AdaptiveIntegrator<double, analyticD> gauss(0.005);
-        gauss.setOrder(gauss_order);
-    #else
-        STATIC_OMP Integrator<double, analyticD> gauss(gauss_order);
+        AdaptiveIntegrator<double, analyticD> gauss(0.005);
+        gauss.setOrder(context.gauss_order);
     #endif //ADAPT_LHS
 
         double total = 0;
 
-        const Mesh::VectPTriangle& Tadj = m.get_triangles_for_vertex(V); // loop on triangles of which V is a vertex
+        const Vertex&         V    = **(m.vertex_begin()+iv);
+        const Mesh::Positions Tadj = m.vertex_triangles(iv); // loop on triangles of which V is a vertex
 
-        for (Mesh::VectPTriangle::const_iterator tit = Tadj.begin(); tit != Tadj.end(); ++tit) {
-            analyD.init(**tit, V);
-            total += gauss.integrate(analyD, T);
+        for (Mesh::Positions::const_iterator tit = Tadj.begin(); tit != Tadj.end(); ++tit) {
+            context.analyD.init(*(m.begin()+*tit), V);
+    #ifdef ADAPT_LHS
+            total += gauss.integrate(context.analyD, *(mt.begin()+it));
+    #else
+            total += mt.cache().integrate<double>(context.analyD, it, context.gauss_order);
+    #endif //ADAPT_LHS
         }
         return total;
     }
     #else
 
-    template <typename T>
-    inline void _operatorD(const Triangle& T1,const Triangle& T2,T& mat,const double& coeff,const unsigned gauss_order) {
-        //this version of _operatorD add in the Matrix the contribution of T2 on T1
-        // for all the P1 functions it gets involved
-        // consider varying order of quadrature with the distance between T1 and T2
-        STATIC_OMP analyticD3 analyD;
-
-        analyD.init(T2);
+    inline Vect3 _operatorD(const Mesh& m1,const unsigned i1,const Mesh& m2,const unsigned i2,const KernelContext& context) {
+        //this version of _operatorD returns the contribution of T2 on T1
+        // for all the P1 functions it gets involved (one per vertex of T2)
+        // the quadrature order may depend on the distance between T1 and T2 (see QuadraturePolicy)
+        const analyticD3& analyD = m2.cache().analyD3(i2);
     #ifdef ADAPT_LHS
         AdaptiveIntegrator<Vect3, analyticD3> gauss(0.005);
-        gauss.setOrder(gauss_order);
-        Vect3 total = gauss.integrate(analyD, T1);
+        gauss.setOrder(context.gauss_order);
+        return gauss.integrate(analyD, *(m1.begin()+i1));
     #else
-        STATIC_OMP Integrator<Vect3, analyticD3> gauss(gauss_order);
-        Vect3 total = gauss.integrate(analyD, T1);
+        return m1.cache().integrate<Vect3>(analyD, i1, context.order(m1,i1,m2,i2));
     #endif //ADAPT_LHS
+    }
+
+    // Contributions of T2 on the triangles [i_begin,i_end[ of m1 (batched evaluation of the kernel).
 
-        for (unsigned i = 0; i < 3; ++i)
-            mat(T1.index(), T2(i).index()) += total(i) * coeff;
+    inline void _operatorD(const Mesh& m1,const unsigned i_begin,const unsigned i_end,const Mesh& m2,const unsigned i2,const KernelContext& context,Vect3* values) {
+    #ifdef ADAPT_LHS
+        for (unsigned i=i_begin;i<i_end;++i)
+            values[i-i_begin] = _operatorD(m1,i,m2,i2,context);
+    #else
+        if (context.quadrature.type()==QuadraturePolicy::FIXED) {
+            m1.cache().integrate(m2.cache().analyD3(i2),i_begin,i_end,context.gauss_order,values);
+        } else if (i_begin<i_end) {
+            std::vector<unsigned> orders(i_end-i_begin);
+            for (unsigned i=i_begin;i<i_end;++i)
+                orders[i-i_begin] = context.order(m1,i,m2,i2);
+            m1.cache().integrate(m2.cache().analyD3(i2),i_begin,i_end,&orders[0],values);
+        }
+    #endif //ADAPT_LHS
     }
     #endif //OPTIMIZED_OPERATOR_D
 
-    inline void _operatorDinternal(const Triangle& T2,const Vertex& P,Matrix & mat,const double& coeff) {
-        static analyticD3 analyD;
+    inline void _operatorDinternal(const Mesh& m,const unsigned i,const Vertex& P,Matrix & mat,const double& coeff) {
+        const Triangle& T2 = *(m.begin()+i);
 
-        analyD.init(T2);
+        Vect3 total = m.cache().analyD3(i).f(P);
 
-        Vect3 total = analyD.f(P);
-
-        for (unsigned i=0;i<3;++i)
-            mat(P.index(), T2(i).index()) += total(i) * coeff;
+        for (unsigned k=0;k<3;++k)
+            mat(P.index(), T2(k).index()) += total(k) * coeff;
     }
 
-    inline double _operatorS(const Triangle& T1,const Triangle& T2,const unsigned gauss_order) {
-        STATIC_OMP Triangle *oldT = 0;
-        STATIC_OMP analyticS analyS;
-
-        if ( oldT != &T1 ) { // a few computations are needed only when changing triangle T1
-            oldT = (Triangle*)&T1;
-            analyS.init(T1);
-        }
+    inline double _operatorS(const Mesh& m1,const unsigned i1,const Mesh& m2,const unsigned i2,const KernelContext& context) {
+        const analyticS& analyS = m1.cache().analyS(i1);
     #ifdef ADAPT_LHS
         AdaptiveIntegrator<double, analyticS> gauss(0.005);
-        gauss.setOrder(gauss_order);
-        return gauss.integrate(analyS, T2);
+        gauss.setOrder(context.gauss_order);
+        return gauss.integrate(analyS, *(m2.begin()+i2));
     #else
-        STATIC_OMP Integrator<double, analyticS> gauss;
-        gauss.setOrder(gauss_order);
-        return gauss.integrate(analyS, T2);
+        return m2.cache().integrate<double>(analyS, i2, context.order(m1,i1,m2,i2));
     #endif //ADAPT_LHS
     }
 
-    inline double _operatorSinternal(const Triangle& T,const Vertex& P) {
-        static analyticS analyS;
-        analyS.init(T);
-        return analyS.f(P);
-    }
-
-    template <typename T>
-    inline double _operatorN(const Vertex& V1,const Vertex& V2,const Mesh& m1,const Mesh& m2,const T& mat) {
+    // S integrals of T1 with the triangles [i_begin,i_end[ of m2 (batched evaluation of the kernel).
 
-        const Mesh::VectPTriangle& trgs1 = m1.get_triangles_for_vertex(V1);
-        const Mesh::VectPTriangle& trgs2 = m2.get_triangles_for_vertex(V2);
+    inline void _operatorS(const Mesh& m1,const unsigned i1,const Mesh& m2,const unsigned i_begin,const unsigned i_end,const KernelContext& context,double* values) {
+    #ifdef ADAPT_LHS
+        for (unsigned i=i_begin;i<i_end;++i)
+            values[i-i_begin] = _operatorS(m1,i1,m2,i,context);
+    #else
+        if (context.quadrature.type()==QuadraturePolicy::FIXED) {
+            m2.cache().integrate(m1.cache().analyS(i1),i_begin,i_end,context.gauss_order,values);
+        } else if (i_begin<i_end) {
+            std::vector<unsigned> orders(i_end-i_begin);
+            for (unsigned i=i_begin;i<i_end;++i)
+                orders[i-i_begin] = context.order(m1,i1,m2,i);
+            m2.cache().integrate(m1.cache().analyS(i1),i_begin,i_end,&orders[0],values);
+        }
+    #endif //ADAPT_LHS
+    }
 
-        double result = 0.0;
-        for (Mesh::VectPTriangle::const_iterator tit1 = trgs1.begin(); tit1 != trgs1.end(); ++tit1 ) {
-            for (Mesh::VectPTriangle::const_iterator tit2 = trgs2.begin(); tit2 != trgs2.end(); ++tit2 ) {
+    inline double _operatorSinternal(const Mesh& m,const unsigned i,const Vertex& P) {
+        return m.cache().analyS(i).f(P);
+    }
 
-                // In the second case, we here divided (precalculated) operatorS by the product of areas.
+    // Edges opposite to the vertices of a triangle (the differences next(V)-prev(V) used by the N operator).
 
-                const double Iqr = (m1.current_barrier() || m2.current_barrier()) ?
-                     mat((*tit1)->index()-m1.begin()->index(),(*tit2)->index()-m2.begin()->index()) :
-                     mat((*tit1)->index(),(*tit2)->index())/((*tit1)->area()*(*tit2)->area());
+    struct TriangleEdges {
+        TriangleEdges() { }
+        TriangleEdges(const Triangle& T) {
+            for (unsigned k=0;k<3;++k)
+                edges[k] = T(k+1)-T(k+2);
+        }
+        TriangleEdges(const CompactMesh::TriangleView& T) {
+            for (unsigned k=0;k<3;++k)
+                edges[k] = T((k+1)%3)-T((k+2)%3);
+        }
+        Vect3 edges[3];
+    };
 
-                Vect3 CB1 = (*tit1)->next(V1)-(*tit1)->prev(V1);
-                Vect3 CB2 = (*tit2)->next(V2)-(*tit2)->prev(V2);
+    // N contributions of the pair of triangles (T1,T2) to the pairs of their vertices: values[k1][k2] is the contribution
+    // to (T1(k1),T2(k2)). V1 and V2 are the vertices of the triangles (only compared to detect shared vertices).
+    // Iqr is the S integral of the pair divided by the product of the triangle areas.
 
-                const double value = (CB1*CB2)*Iqr;
+    inline void _operatorN(const Vertex* const V1[3],const TriangleEdges& E1,const Vertex* const V2[3],const TriangleEdges& E2,
+                           const double Iqr,const bool same_mesh,double values[3][3]) {
+        for (unsigned k1=0;k1<3;++k1)
+            for (unsigned k2=0;k2<3;++k2) {
 
                 // if it is the same shared vertex
 
-                result -=  (((&m1!=&m2) && (V1==V2)) ? 0.5 : 0.25)*value;
+                values[k1][k2] = -(((!same_mesh) && (V1[k1]==V2[k2])) ? 0.5 : 0.25)*(E1.edges[k1]*E2.edges[k2])*Iqr;
             }
-        }
-        return result;
     }
 
     inline double _operatorP1P0(const Triangle& T2,const Vertex& V1) {
         return (T2.contains(V1)) ? 0.0 : T2.area()/3.0;
     }
 
-    template <typename T>
-    void operatorN(const Mesh& m1,const Mesh& m2,T& mat,const double& coeff,const unsigned gauss_order) {
-        // This function has the following arguments:
-        //    the 2 interacting meshes
-        //    the storage Matrix for the result
-        //    the coefficient to be appleid to each matrix element (depending on conductivities, ...)
-        //    the gauss order parameter (for adaptive integration)
+    // The tiles access the matrices through the argument(s) of their assemble() method, which is called by
+    // assemble_entries: a SymMatrix stored in the default PACKED layout is passed as a SymMatrix::PackedEntries,
+    // so that the layout is resolved once per tile and not for each entry.
 
-        std::cout << "OPERATOR N ... (arg : mesh " << m1.name() << " , mesh " << m2.name() << " )" << std::endl;
+    template <typename Assembly,typename T>
+    void assemble_entries(Assembly& assembly,T& mat) { assembly.assemble(mat); }
 
-        unsigned i = 0; // for the PROGRESSBAR
-        if (&m1==&m2) {
-            if (m1.current_barrier()) {
-                // we thus precompute operator S divided by the product of triangles area.
+    template <typename Assembly>
+    void assemble_entries(Assembly& assembly,SymMatrix& mat) {
+        if (mat.layout()==SymMatrix::PACKED) {
+            SymMatrix::PackedEntries entries(mat);
+            assembly.assemble(entries);
+        } else {
+            assembly.assemble(mat);
+        }
+    }
 
-                SymMatrix matS(m1.nb_triangles());
-                for (Mesh::const_iterator tit1=m1.begin();tit1!=m1.end();++tit1) {
-                    PROGRESSBAR(i++, m1.nb_triangles());
-                    #pragma omp parallel for
-                    #ifndef OPENMP_3_0
-                    for (int i2=tit1-m1.begin();i2<m1.size();++i2) {
-                        const Mesh::const_iterator tit2 = m1.begin()+i2;
-                    #else
-                    for (Mesh::const_iterator tit2=tit1;tit2<m1.end();++tit2) {
-                    #endif
-                        matS(tit1->index() - m1.begin()->index(), tit2->index() - m1.begin()->index()) = _operatorS(*tit1, *tit2, gauss_order) / ( tit1->area() * tit2->area());
-                    }
-                }
-                i = 0 ;
-                for (Mesh::const_vertex_iterator vit1 = m1.vertex_begin(); vit1 != m1.vertex_end(); ++vit1) {
-                    PROGRESSBAR(i++, m1.nb_vertices());
-                    #pragma omp parallel for
-                    #ifndef OPENMP_3_0
-                    for (int i2=vit1-m1.vertex_begin();i2<m1.vertex_size();++i2) {
-                        const Mesh::const_vertex_iterator vit2 = m1.vertex_begin()+i2;
-                    #else
-                    for (Mesh::const_vertex_iterator vit2=vit1;vit2<m1.vertex_end();++vit2) {
-                    #endif
-                        mat((*vit1)->index(), (*vit2)->index()) += _operatorN(**vit1, **vit2, m1, m1, matS) * coeff;
-                    }
-                }
-            } else {
-                for (Mesh::const_vertex_iterator vit1 = m1.vertex_begin(); vit1 != m1.vertex_end(); ++vit1) {
-                    PROGRESSBAR(i++, m1.nb_vertices());
-                    #pragma omp parallel for
-                    #ifndef OPENMP_3_0
-                    for (int i2=0;i2<=vit1-m1.vertex_begin();++i2) {
-                        const Mesh::const_vertex_iterator vit2 = m1.vertex_begin()+i2;
-                    #else
-                    for (Mesh::const_vertex_iterator vit2=m1.vertex_begin();vit2<=vit1;++vit2) {
-                    #endif
-                        mat((*vit1)->index(), (*vit2)->index()) += _operatorN(**vit1, **vit2, m1, m1, mat) * coeff;
+    // Two matrices: the entries of the second one are resolved within the assembly of the first one.
+
+    template <typename Assembly,typename E1>
+    struct AssembleSecond {
+        AssembleSecond(Assembly& a,E1& e1): assembly(a),entries1(e1) { }
+        template <typename E2>
+        void assemble(E2& entries2) { assembly.assemble(entries1,entries2); }
+        Assembly& assembly;
+        E1&       entries1;
+    };
+
+    template <typename Assembly,typename T2>
+    struct AssembleFirst {
+        AssembleFirst(Assembly& a,T2& m2): assembly(a),mat2(m2) { }
+        template <typename E1>
+        void assemble(E1& entries1) {
+            AssembleSecond<Assembly,E1> second(assembly,entries1);
+            assemble_entries(second,mat2);
+        }
+        Assembly& assembly;
+        T2&       mat2;
+    };
+
+    template <typename Assembly,typename T1,typename T2>
+    void assemble_entries(Assembly& assembly,T1& mat1,T2& mat2) {
+        AssembleFirst<Assembly,T2> first(assembly,mat2);
+        assemble_entries(first,mat1);
+    }
+
+    // The operator blocks are cut into tiles which are assembled concurrently by a TaskScheduler.
+    // Tiles setting their entries (S) write directly into the matrix (each entry belongs to exactly one tile).
+    // Tiles accumulating their entries (D, D*, N) may share entries with the other tiles of their block, and with
+    // the tiles of other mesh pairs through the shared vertices of non nested geometries. They are computed into
+    // a local buffer which is added to the matrix at once, holding the lock of the block (see
+    // TaskScheduler::block_lock), so that the different blocks are added concurrently.
+
+    template <typename T>
+    class OperatorSTile: public Task {
+    public:
+
+        // If by_area is true, S is divided by the product of the triangle areas and stored using the positions of the triangles in the meshes
+        // (this is the precomputation used by the N operator of current barriers).
+
+        OperatorSTile(const Mesh& _m1,const Mesh& _m2,T& _mat,const double& _coeff,const QuadraturePolicy& _quadrature,const Tile& _tile,const bool _by_area=false):
+            m1(_m1),m2(_m2),mat(_mat),coeff(_coeff),quadrature(_quadrature),tile(_tile),by_area(_by_area) { }
+
+        void run() { assemble_entries(*this,mat); }
+
+        template <typename E>
+        void assemble(E& entries) {
+            KernelContext context(quadrature);
+            // For a symmetric block, only the upper part of the diagonal tiles is computed.
+            const bool upper = (&m1==&m2) && tile.diagonal();
+            std::vector<double> values(tile.ncol());
+            for (unsigned i=tile.i_begin;i<tile.i_end;++i) {
+                const Triangle& T1 = *(m1.begin()+i);
+                const unsigned  j0 = (upper) ? i : tile.j_begin;
+                _operatorS(m1,i,m2,j0,tile.j_end,context,&values[0]);
+                for (unsigned j=j0;j<tile.j_end;++j) {
+                    const Triangle& T2 = *(m2.begin()+j);
+                    if (by_area) {
+                        entries(i,j) = values[j-j0]/(T1.area()*T2.area());
+                    } else {
+                        entries(T1.index(),T2.index()) = values[j-j0]*coeff;
                     }
                 }
             }
-        } else {
-            if ( m1.current_barrier() || m2.current_barrier() ) {
-                // we thus precompute operator S divided by the product of triangles area.
-                Matrix matS(m1.nb_triangles(), m2.nb_triangles());
-                for (Mesh::const_iterator tit1 = m1.begin(); tit1 != m1.end(); ++tit1) {
-                    PROGRESSBAR(i++, m1.nb_triangles());
-                    #pragma omp parallel for
-                    #ifndef OPENMP_3_0
-                    for (int i2=0;i2<m2.size();++i2) {
-                        const Mesh::const_iterator tit2 = m2.begin()+i2;
-                    #else
-                    for (Mesh::const_iterator tit2=m2.begin();tit2<m2.end();++tit2) {
-                    #endif
-                        matS(tit1->index()-m1.begin()->index(),tit2->index()-m2.begin()->index()) = _operatorS(*tit1,*tit2,gauss_order)/(tit1->area()*tit2->area());
+        }
+
+        double cost() const { return static_cast<double>(tile.nlin())*tile.ncol(); }
+
+    private:
+
+        const Mesh&    m1;
+        const Mesh&    m2;
+        T              mat;
+        const double   coeff;
+        const QuadraturePolicy quadrature;
+        const Tile     tile;
+        const bool     by_area;
+    };
+
+    #ifndef OPTIMIZED_OPERATOR_D
+    template <typename T>
+    class OperatorDTile: public Task {
+    public:
+
+        // Lines of the tile are the triangles of mt, columns the vertices of mv.
+        // For the adjoint (star) operator, the result is stored in mat(vertex,triangle).
+
+        OperatorDTile(const Mesh& _mt,const Mesh& _mv,T& _mat,const double& _coeff,const QuadraturePolicy& _quadrature,const Tile& _tile,const bool _star,BlockLock& _lock):
+            mt(_mt),mv(_mv),mat(_mat),coeff(_coeff),quadrature(_quadrature),tile(_tile),star(_star),lock(_lock) { }
+
+        void run() { assemble_entries(*this,mat); }
+
+        template <typename E>
+        void assemble(E& entries) {
+            KernelContext context(quadrature);
+            Matrix values(tile.nlin(),tile.ncol());
+            for (unsigned i=tile.i_begin;i<tile.i_end;++i)
+                for (unsigned j=tile.j_begin;j<tile.j_end;++j)
+                    // P1 functions are tested thus looping on vertices
+                    values(i-tile.i_begin,j-tile.j_begin) = _operatorD(mt,i,mv,j,context)*coeff;
+
+            lock.set();
+            for (unsigned i=tile.i_begin;i<tile.i_end;++i) {
+                const Triangle& Tr = *(mt.begin()+i);
+                for (unsigned j=tile.j_begin;j<tile.j_end;++j) {
+                    const Vertex& V = **(mv.vertex_begin()+j);
+                    if (star) {
+                        entries(V.index(),Tr.index()) += values(i-tile.i_begin,j-tile.j_begin);
+                    } else {
+                        entries(Tr.index(),V.index()) += values(i-tile.i_begin,j-tile.j_begin);
                     }
                 }
-                i = 0 ;
-                for (Mesh::const_vertex_iterator vit1 = m1.vertex_begin();vit1!=m1.vertex_end();++vit1) {
-                    PROGRESSBAR(i++,m1.nb_vertices());
-                    #pragma omp parallel for
-                    #ifndef OPENMP_3_0
-                    for (int i2=0;i2<m2.vertex_size();++i2) {
-                        const Mesh::const_vertex_iterator vit2 = m2.vertex_begin()+i2;
-                    #else
-                    for (Mesh::const_vertex_iterator vit2=m2.vertex_begin();vit2<m2.vertex_end();++vit2) {
-                    #endif
-                        mat((*vit1)->index(),(*vit2)->index()) += _operatorN(**vit1,**vit2,m1,m2,matS)*coeff;
-                    }
+            }
+            lock.unset();
+        }
+
+        // A D integral is computed on all the triangles adjacent to the vertex (about 6).
+
+        double cost() const { return 6.0*tile.nlin()*tile.ncol(); }
+
+    private:
+
+        const Mesh&    mt;
+        const Mesh&    mv;
+        T              mat;
+        const double   coeff;
+        const QuadraturePolicy quadrature;
+        const Tile     tile;
+        const bool     star;
+        BlockLock&     lock;
+    };
+    #else
+    template <typename T>
+    class OperatorDTile: public Task {
+    public:
+
+        // Lines of the tile are the triangles of m1, columns the triangles of m2.
+        // The contributions of a triangle of m2 go to its 3 vertices, which are shared with other triangles of the
+        // tile or of other tiles. They are thus summed in a buffer indexed by the vertices touched by the tile,
+        // which is added to mat at the end.
+
+        OperatorDTile(const Mesh& _m1,const Mesh& _m2,T& _mat,const double& _coeff,const QuadraturePolicy& _quadrature,const Tile& _tile,BlockLock& _lock):
+            m1(_m1),m2(_m2),mat(_mat),coeff(_coeff),quadrature(_quadrature),tile(_tile),lock(_lock) { }
+
+        void run() { assemble_entries(*this,mat); }
+
+        template <typename E>
+        void assemble(E& entries) {
+            KernelContext context(quadrature);
+            // Local numbering of the vertices of the triangles of the tile.
+            std::map<unsigned,unsigned> columns;
+            for (unsigned j=tile.j_begin;j<tile.j_end;++j) {
+                const Triangle& T2 = *(m2.begin()+j);
+                for (unsigned k=0;k<3;++k)
+                    columns.insert(std::make_pair(T2(k).index(),0));
+            }
+            unsigned ncols = 0;
+            for (std::map<unsigned,unsigned>::iterator cit=columns.begin();cit!=columns.end();++cit)
+                cit->second = ncols++;
+
+            Matrix values(tile.nlin(),ncols);
+            values.set(0.0);
+            std::vector<Vect3> totals(tile.nlin());
+            for (unsigned j=tile.j_begin;j<tile.j_end;++j) {
+                const Triangle& T2 = *(m2.begin()+j);
+                const unsigned cols[3] = { columns[T2(0).index()], columns[T2(1).index()], columns[T2(2).index()] };
+                _operatorD(m1,tile.i_begin,tile.i_end,m2,j,context,&totals[0]);
+                for (unsigned i=tile.i_begin;i<tile.i_end;++i)
+                    for (unsigned k=0;k<3;++k)
+                        values(i-tile.i_begin,cols[k]) += totals[i-tile.i_begin](k)*coeff;
+            }
+
+            lock.set();
+            for (unsigned i=tile.i_begin;i<tile.i_end;++i) {
+                const unsigned index = (m1.begin()+i)->index();
+                for (std::map<unsigned,unsigned>::const_iterator cit=columns.begin();cit!=columns.end();++cit)
+                    entries(index,cit->first) += values(i-tile.i_begin,cit->second);
+            }
+            lock.unset();
+        }
+
+        double cost() const { return static_cast<double>(tile.nlin())*tile.ncol(); }
+
+    private:
+
+        const Mesh&    m1;
+        const Mesh&    m2;
+        T              mat;
+        const double   coeff;
+        const QuadraturePolicy quadrature;
+        const Tile     tile;
+        BlockLock&     lock;
+    };
+    #endif // OPTIMIZED_OPERATOR_D
+
+    template <typename T,typename TS>
+    class OperatorNTile: public Task {
+    public:
+
+        // Lines of the tile are the triangles of m1, columns the triangles of m2. Each pair of triangles contributes to
+        // the 9 pairs of their vertices: as in OperatorDTile, these contributions are summed in a buffer indexed by the
+        // vertices touched by the tile, which is added to mat at the end.
+        // matS contains the S block of the mesh pair (either mat itself or the S/area precomputation for current barriers).
+        // For a symmetric block (m1==m2), the pairs (T1,T2) and (T2,T1) are both accounted for by the upper part.
+
+        OperatorNTile(const Mesh& _m1,const Mesh& _m2,T& _mat,TS& _matS,const double& _coeff,const Tile& _tile,BlockLock& _lock):
+            m1(_m1),m2(_m2),mat(_mat),matS(_matS),coeff(_coeff),tile(_tile),lock(_lock) { }
+
+        void run() { assemble_entries(*this,mat,matS); }
+
+        template <typename E,typename ES>
+        void assemble(E& entries,ES& S) {
+            const bool same    = (&m1==&m2);
+            const bool by_area = m1.current_barrier() || m2.current_barrier();
+
+            // The triangles are read in the contiguous storage of the meshes (see CompactMesh), their vertices being
+            // designated by their positions in the meshes.
+            const CompactMesh& c1 = m1.compact();
+            const CompactMesh& c2 = m2.compact();
+
+            // Local numbering of the vertices of the triangles of the tile (a single numbering for a symmetric block).
+            std::map<unsigned,unsigned> rows;
+            std::map<unsigned,unsigned> columns;
+            std::map<unsigned,unsigned>& cols = (same) ? rows : columns;
+            for (unsigned i=tile.i_begin;i<tile.i_end;++i)
+                for (unsigned k=0;k<3;++k)
+                    rows.insert(std::make_pair(c1.triangles()[3*i+k],0));
+            for (unsigned j=tile.j_begin;j<tile.j_end;++j)
+                for (unsigned k=0;k<3;++k)
+                    cols.insert(std::make_pair(c2.triangles()[3*j+k],0));
+            unsigned nrows = 0;
+            for (std::map<unsigned,unsigned>::iterator rit=rows.begin();rit!=rows.end();++rit)
+                rit->second = nrows++;
+            unsigned ncols = 0;
+            for (std::map<unsigned,unsigned>::iterator cit=cols.begin();cit!=cols.end();++cit)
+                cit->second = ncols++;
+
+            // Local vertices and edges of the column triangles, used for each line.
+            std::vector<unsigned>      cvertices(3*tile.ncol());
+            std::vector<const Vertex*> cpointers(3*tile.ncol());
+            std::vector<TriangleEdges> cedges(tile.ncol());
+            for (unsigned j=tile.j_begin;j<tile.j_end;++j) {
+                const CompactMesh::TriangleView T2 = c2.triangle(j);
+                for (unsigned k=0;k<3;++k) {
+                    cvertices[3*(j-tile.j_begin)+k] = cols[T2.position(k)];
+                    cpointers[3*(j-tile.j_begin)+k] = m2.vertices()[T2.position(k)];
                 }
-            } else {
-                //  This loop is exactly the same as the one just above with just matS -> mat (factorize).
-                for (Mesh::const_vertex_iterator vit1 = m1.vertex_begin();vit1!=m1.vertex_end();++vit1) {
-                    PROGRESSBAR(i++,m1.nb_vertices());
-                    #pragma omp parallel for
-                    #ifndef OPENMP_3_0
-                    for (int i2=0;i2<m2.vertex_size();++i2) {
-                        const Mesh::const_vertex_iterator vit2 = m2.vertex_begin()+i2;
-                    #else
-                    for (Mesh::const_vertex_iterator vit2=m2.vertex_begin();vit2<m2.vertex_end();++vit2) {
-                    #endif
-                        mat((*vit1)->index(),(*vit2)->index()) += _operatorN(**vit1,**vit2,m1,m2,mat)*coeff;
+                cedges[j-tile.j_begin] = TriangleEdges(T2);
+            }
+
+            Matrix values(nrows,ncols);
+            values.set(0.0);
+            const bool upper = same && tile.diagonal();
+            double contributions[3][3];
+            for (unsigned i=tile.i_begin;i<tile.i_end;++i) {
+                const CompactMesh::TriangleView T1 = c1.triangle(i);
+                const TriangleEdges E1(T1);
+                const unsigned      r[3]  = { rows[T1.position(0)], rows[T1.position(1)], rows[T1.position(2)] };
+                const Vertex* const V1[3] = { m1.vertices()[T1.position(0)], m1.vertices()[T1.position(1)], m1.vertices()[T1.position(2)] };
+                for (unsigned j=(upper) ? i : tile.j_begin;j<tile.j_end;++j) {
+                    const unsigned* c = &cvertices[3*(j-tile.j_begin)];
+
+                    // In the second case, we here divided (precalculated) operatorS by the product of areas.
+
+                    const double Iqr = (by_area) ? S(i,j) : S(m1[i].index(),m2[j].index())/(c1.areas()[i]*c2.areas()[j]);
+                    _operatorN(V1,E1,&cpointers[3*(j-tile.j_begin)],cedges[j-tile.j_begin],Iqr,same,contributions);
+
+                    if (!same) {
+                        for (unsigned k1=0;k1<3;++k1)
+                            for (unsigned k2=0;k2<3;++k2)
+                                values(r[k1],c[k2]) += contributions[k1][k2];
+                    } else if (i==j) {
+                        // Each pair of vertices of the triangle is counted once.
+                        for (unsigned k1=0;k1<3;++k1)
+                            for (unsigned k2=k1;k2<3;++k2)
+                                values(std::min(r[k1],r[k2]),std::max(r[k1],r[k2])) += contributions[k1][k2];
+                    } else {
+                        // (T2,T1) gives the same contributions to the transposed pairs of vertices, which are the same
+                        // entries of the symmetric block (except for a common vertex which gets both).
+                        for (unsigned k1=0;k1<3;++k1)
+                            for (unsigned k2=0;k2<3;++k2)
+                                values(std::min(r[k1],c[k2]),std::max(r[k1],c[k2])) += ((r[k1]==c[k2]) ? 2.0 : 1.0)*contributions[k1][k2];
                     }
                 }
             }
+
+            lock.set();
+            for (std::map<unsigned,unsigned>::const_iterator rit=rows.begin();rit!=rows.end();++rit)
+                for (std::map<unsigned,unsigned>::const_iterator cit=(same) ? rit : cols.begin();cit!=cols.end();++cit)
+                    if (values(rit->second,cit->second)!=0.0)
+                        entries(m1.vertices()[rit->first]->index(),m2.vertices()[cit->first]->index()) += values(rit->second,cit->second)*coeff;
+            lock.unset();
         }
-    }
+
+        double cost() const { return static_cast<double>(tile.nlin())*tile.ncol(); }
+
+    private:
+
+        const Mesh&  m1;
+        const Mesh&  m2;
+        T            mat;
+        TS           matS;
+        const double coeff;
+        const Tile   tile;
+        BlockLock&   lock;
+    };
+
+    // The schedule_operator* functions add the tiles of a block to a scheduler, so that all the blocks of a matrix
+    // are assembled concurrently by a single call to TaskScheduler::run(). They have the following arguments:
+    //    the scheduler
+    //    the 2 interacting meshes
+    //    the storage Matrix for the result
+    //    the coefficient to be applied to each matrix element (depending on conductivities, ...)
+    //    the gauss order parameter (for adaptive integration)
+    // Until the scheduler is run, the meshes and the matrix must not be modified.
+    // The N blocks are scheduled in a second stage, as they depend on the S blocks of the first one.
 
     template <typename T>
-    void operatorS(const Mesh& m1, const Mesh& m2, T& mat, const double& coeff, const unsigned gauss_order)
-    {
-        // This function has the following arguments:
-        //    the 2 interacting meshes
-        //    the storage Matrix for the result
-        //    the coefficient to be appleid to each matrix element (depending on conductivities, ...)
-        //    the gauss order parameter (for adaptive integration)
+    void schedule_operatorS(TaskScheduler& scheduler,const Mesh& m1,const Mesh& m2,T& mat,const double& coeff,const QuadraturePolicy& quadrature) {
 
         std::cout << "OPERATOR S ... (arg : mesh " << m1.name() << " , mesh " << m2.name() << " )" << std::endl;
 
-        unsigned i = 0; // for the PROGRESSBAR
         // The operator S is given by Sij=\Int G*PSI(I, i)*Psi(J, j) with
         // PSI(A, a) is a P0 test function on layer A and triangle a
-        if (&m1==&m2) {
-            for (Mesh::const_iterator tit1=m1.begin();tit1!=m1.end();++tit1) {
-                PROGRESSBAR(i++,m1.nb_triangles());
-                #pragma omp parallel for
-                #ifndef OPENMP_3_0
-                for (int i2=tit1-m1.begin();i2<m1.size();++i2) {
-                    const Mesh::const_iterator tit2 = m1.begin()+i2;
-                #else
-                for (Mesh::const_iterator tit2=tit1;tit2<m1.end();++tit2) {
-                #endif
-                    mat(tit1->index(),tit2->index()) = _operatorS(*tit1,*tit2,gauss_order)*coeff;
-                }
-            }
-        } else {
-            // TODO check the symmetry of _operatorS. 
-            // if we invert tit1 with tit2: results in HeadMat differs at 4.e-5 which is too big.
-            // using ADAPT_LHS with tolerance at 0.000005 (for _opS) drops this at 6.e-6. (but increase the computation time)
-            for (Mesh::const_iterator tit1=m1.begin();tit1!=m1.end();++tit1) {
-                PROGRESSBAR(i++,m1.nb_triangles());
-                #pragma omp parallel for
-                #ifndef OPENMP_3_0
-                for (int i2=0;i2<m2.size();++i2) {
-                    const Mesh::const_iterator tit2 = m2.begin()+i2;
-                #else
-                for (Mesh::const_iterator tit2=m2.begin();tit2<m2.end();++tit2) {
-                #endif
-                    mat(tit1->index(),tit2->index()) = _operatorS(*tit1,*tit2,gauss_order)*coeff;
-                }
-            }
-        }
+        // TODO check the symmetry of _operatorS.
+        // if we invert tit1 with tit2: results in HeadMat differs at 4.e-5 which is too big.
+        // using ADAPT_LHS with tolerance at 0.000005 (for _opS) drops this at 6.e-6. (but increase the computation time)
+
+        const Tiles& tiles = make_tiles(m1.nb_triangles(),m2.nb_triangles(),&m1==&m2);
+        for (Tiles::const_iterator tit=tiles.begin();tit!=tiles.end();++tit)
+            scheduler.add(new OperatorSTile<T>(m1,m2,mat,coeff,quadrature,*tit),TaskScheduler::FIRST_STAGE);
     }
 
-    #ifndef OPTIMIZED_OPERATOR_D
     template <typename T>
-    void operatorD(const Mesh& m1,const Mesh& m2,T& mat,const double& coeff,const unsigned gauss_order,const bool star=false) {
-        // This function (NON OPTIMIZED VERSION) has the following arguments:
-        //    the 2 interacting meshes
-        //    the storage Matrix for the result
-        //    the coefficient to be appleid to each matrix element (depending on conductivities, ...)
-        //    the gauss order parameter (for adaptive integration)
-        //    an optional star parameter, which denotes the adjoint of the operator
+    void schedule_operatorN(TaskScheduler& scheduler,const Mesh& m1,const Mesh& m2,T& mat,const double& coeff,const QuadraturePolicy& quadrature) {
 
-        std::cout << "OPERATOR D" << ((star) ? "*" : " ") << "... (arg : mesh " << m1.name() << " , mesh " << m2.name() << " )" << std::endl;
+        std::cout << "OPERATOR N ... (arg : mesh " << m1.name() << " , mesh " << m2.name() << " )" << std::endl;
 
-        unsigned i = 0; // for the PROGRESSBAR
-        if (star) {
-            for (Mesh::const_iterator tit=m2.begin();tit!=m2.end();++tit) {
-                PROGRESSBAR(i++,m2.nb_triangles());
-                #pragma omp parallel for
-                #ifndef OPENMP_3_0
-                for (int i2=0;i2<m1.vertex_size();++i2) {
-                    const Mesh::const_vertex_iterator vit = m1.vertex_begin()+i2;
-                #else
-                for (Mesh::const_vertex_iterator vit=m1.vertex_begin();vit<m1.vertex_end();++vit) {
-                #endif
-                    // P1 functions are tested thus looping on vertices
-                    mat((*vit)->index(),tit->index()) += _operatorD(*tit,**vit,m1,gauss_order)*coeff;
-                }
+        // N is assembled by pairs of triangles (see OperatorNTile).
+
+        const bool   same  = (&m1==&m2);
+        const Tiles& tiles = make_tiles(m1.nb_triangles(),m2.nb_triangles(),same);
+        BlockLock&   lock  = scheduler.block_lock(m1,m2);
+        if (m1.current_barrier() || m2.current_barrier()) {
+            // we thus precompute operator S divided by the product of triangles area.
+            if (same) {
+                SymMatrix matS(m1.nb_triangles());
+                const Tiles& tilesS = make_tiles(m1.nb_triangles(),m1.nb_triangles(),true);
+                for (Tiles::const_iterator tit=tilesS.begin();tit!=tilesS.end();++tit)
+                    scheduler.add(new OperatorSTile<SymMatrix>(m1,m1,matS,1.0,quadrature,*tit,true),TaskScheduler::FIRST_STAGE);
+                for (Tiles::const_iterator tit=tiles.begin();tit!=tiles.end();++tit)
+                    scheduler.add(new OperatorNTile<T,SymMatrix>(m1,m2,mat,matS,coeff,*tit,lock),TaskScheduler::SECOND_STAGE);
+            } else {
+                Matrix matS(m1.nb_triangles(),m2.nb_triangles());
+                const Tiles& tilesS = make_tiles(m1.nb_triangles(),m2.nb_triangles(),false);
+                for (Tiles::const_iterator tit=tilesS.begin();tit!=tilesS.end();++tit)
+                    scheduler.add(new OperatorSTile<Matrix>(m1,m2,matS,1.0,quadrature,*tit,true),TaskScheduler::FIRST_STAGE);
+                for (Tiles::const_iterator tit=tiles.begin();tit!=tiles.end();++tit)
+                    scheduler.add(new OperatorNTile<T,Matrix>(m1,m2,mat,matS,coeff,*tit,lock),TaskScheduler::SECOND_STAGE);
             }
         } else {
-            for (Mesh::const_iterator tit=m1.begin();tit!=m1.end();++tit) {
-                PROGRESSBAR(i++,m1.nb_triangles());
-                #pragma omp parallel for
-                #ifndef OPENMP_3_0
-                for (int i2=0;i2<m2.vertex_size();++i2) {
-                    const Mesh::const_vertex_iterator vit = m2.vertex_begin()+i2;
-                #else
-                for (Mesh::const_vertex_iterator vit=m2.vertex_begin();vit<m2.vertex_end();++vit) {
-                #endif
-                    // P1 functions are tested thus looping on vertices
-                    mat(tit->index(),(*vit)->index()) += _operatorD(*tit,**vit,m2,gauss_order)*coeff;
-                }
-            }
+            // S is read in mat itself.
+            for (Tiles::const_iterator tit=tiles.begin();tit!=tiles.end();++tit)
+                scheduler.add(new OperatorNTile<T,T>(m1,m2,mat,mat,coeff,*tit,lock),TaskScheduler::SECOND_STAGE);
         }
     }
 
-    #else // OPTIMIZED_OPERATOR_D
-
     template <typename T>
-    void operatorD(const Mesh& m1, const Mesh& m2, T& mat, const double& coeff, const unsigned gauss_order) {
-        // This function (OPTIMIZED VERSION) has the following arguments:
-        //    the 2 interacting meshes
-        //    the storage Matrix for the result
-        //    the coefficient to be appleid to each matrix element (depending on conductivities, ...)
-        //    the gauss order parameter (for adaptive integration)
+    void schedule_operatorD(TaskScheduler& scheduler,const Mesh& m1,const Mesh& m2,T& mat,const double& coeff,const QuadraturePolicy& quadrature,const bool star=false) {
+        // An optional star parameter denotes the adjoint of the operator.
+    #ifndef OPTIMIZED_OPERATOR_D
 
+        std::cout << "OPERATOR D" << ((star) ? "*" : " ") << "... (arg : mesh " << m1.name() << " , mesh " << m2.name() << " )" << std::endl;
+
+        const Mesh& mt = (star) ? m2 : m1;
+        const Mesh& mv = (star) ? m1 : m2;
+        const Tiles& tiles = make_tiles(mt.nb_triangles(),mv.nb_vertices(),false);
+        BlockLock&   lock  = scheduler.block_lock(mt,mv);
+        for (Tiles::const_iterator tit=tiles.begin();tit!=tiles.end();++tit)
+            scheduler.add(new OperatorDTile<T>(mt,mv,mat,coeff,quadrature,*tit,star,lock),TaskScheduler::FIRST_STAGE);
+    #else
         //In this version of the function, in order to skip multiple computations of the same quantities
-        //    loops are run over the triangles but the Matrix cannot be filled in this function anymore
-        //    That's why the filling is done is function _operatorD
-        //
-
-        unsigned i = 0; // for the PROGRESSBAR
-        for (Mesh::const_iterator tit1=m1.begin();tit1!=m1.end();++tit1) {
-            PROGRESSBAR(i++, m1.nb_triangles());
-            for (Mesh::const_iterator tit2=m2.begin();tit2!=m2.end();++tit2)
-                _operatorD(*tit1,*tit2,mat,coeff,gauss_order);
-        }
+        //    loops are run over the pairs of triangles and each vertex gets the contributions of all its triangles.
+        //    That's why the filling is done in OperatorDTile.
+
+        std::cout << "OPERATOR D" << ((star) ? "*" : " ") << "(Optimized) ... (arg : mesh " << m1.name() << " , mesh " << m2.name() << " )" << std::endl;
+
+        const Mesh& mt1 = (star) ? m2 : m1;
+        const Mesh& mt2 = (star) ? m1 : m2;
+        const Tiles& tiles = make_tiles(mt1.nb_triangles(),mt2.nb_triangles(),false);
+        BlockLock&   lock  = scheduler.block_lock(mt1,mt2);
+        for (Tiles::const_iterator tit=tiles.begin();tit!=tiles.end();++tit)
+            scheduler.add(new OperatorDTile<T>(mt1,mt2,mat,coeff,quadrature,*tit,lock),TaskScheduler::FIRST_STAGE);
+    #endif // OPTIMIZED_OPERATOR_D
     }
 
+    // Assembly of a single block.
+
     template <typename T>
-    void operatorD(const Mesh& m1,const Mesh& m2, T& mat,const double& coeff,const unsigned gauss_order,const bool star) {
-        // This function (OPTIMIZED VERSION) has the following arguments:
-        //    the 2 interacting meshes
-        //    the storage Matrix for the result
-        //    the coefficient to be appleid to each matrix element (depending on conductivities, ...)
-        //    the gauss order parameter (for adaptive integration)
-        //    an optional star parameter, which denotes the adjoint of the operator
+    void operatorN(const Mesh& m1,const Mesh& m2,T& mat,const double& coeff,const QuadraturePolicy& quadrature) {
+        TaskScheduler scheduler;
+        schedule_operatorN(scheduler,m1,m2,mat,coeff,quadrature);
+        scheduler.run();
+    }
 
-        std::cout << "OPERATOR D" << ((star) ? "*" : " ") << "(Optimized) ... (arg : mesh " << m1.name() << " , mesh " << m2.name() << " )" << std::endl;
+    template <typename T>
+    void operatorS(const Mesh& m1,const Mesh& m2,T& mat,const double& coeff,const QuadraturePolicy& quadrature) {
+        TaskScheduler scheduler;
+        schedule_operatorS(scheduler,m1,m2,mat,coeff,quadrature);
+        scheduler.run();
+    }
 
-        if (star) {
-            operatorD(m2,m1,mat,coeff,gauss_order);
-        } else {
-            operatorD(m1,m2,mat,coeff,gauss_order);
-        }
+    template <typename T>
+    void operatorD(const Mesh& m1,const Mesh& m2,T& mat,const double& coeff,const QuadraturePolicy& quadrature,const bool star=false) {
+        TaskScheduler scheduler;
+        schedule_operatorD(scheduler,m1,m2,mat,coeff,quadrature,star);
+        scheduler.run();
     }
-    #endif // OPTIMIZED_OPERATOR_D
 
     template <typename T>
     void operatorP1P0(const Mesh& m, T& mat,const double& coeff) {
@@ -426,28 +681,26 @@ namespace OpenMEEG {
                 mat(tit->index(), (*pit)->index()) += _operatorP1P0(*tit, **pit) * coeff;
     }
 
-    inline Vect3 _operatorFerguson(const Vect3& x,const Vertex& V1,const Mesh& m) {
-        STATIC_OMP Vect3 result;
-        STATIC_OMP analyticS analyS;
-
-        result.x() = 0.0;
-        result.y() = 0.0;
-        result.z() = 0.0;
+    inline Vect3 _operatorFerguson(const Vect3& x,const Mesh& m,const unsigned i) {
+        Vect3 result(0.0,0.0,0.0);
 
-        //loop over triangles of which V1 is a vertex
-        const Mesh::VectPTriangle& trgs = m.get_triangles_for_vertex(V1);
+        //loop over triangles of which V1 (the i-th vertex of m) is a vertex
+        const Vertex&         V1   = **(m.vertex_begin()+i);
+        const Mesh::Positions trgs = m.vertex_triangles(i);
 
-        for (Mesh::VectPTriangle::const_iterator tit=trgs.begin();tit!=trgs.end();++tit) {
+        for (Mesh::Positions::const_iterator tit=trgs.begin();tit!=trgs.end();++tit) {
 
-            const Triangle& T1 = **tit;
+            const Triangle& T1 = *(m.begin()+*tit);
 
             // A1 , B1  are the two opposite vertices to V1 (triangle A1, B1, V1)
             Vect3 A1   = T1.next(V1);
             Vect3 B1   = T1.prev(V1);
             Vect3 A1B1 = (A1 - B1) * (0.5 / T1.area());
-            
-            analyS.init(V1, A1, B1);
-            const double opS = analyS.f(x);
+
+            // analyticS initialized with (V1,A1,B1) (a circular permutation of the triangle vertices) uses the
+            // opposite of the triangle normal, which changes the sign of the result: the cached value is negated.
+
+            const double opS = -m.cache().analyS(*tit).f(x);
 
             result += (A1B1 * opS);
         }
@@ -0,0 +1,224 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <vect3.h>
+#include <vector.h>
+#include <matrix.h>
+#include <symmatrix.h>
+#include <sym_factorization.h>
+#include <sparse_matrix.h>
+#include <geometry.h>
+#include <gmres.h>
+#include <DLLDefinesOpenMEEG.h>
+
+namespace OpenMEEG {
+
+    /// \brief Unknowns of the HeadMat of a geometry: the vertices and triangles (except the ones of the current barriers)
+    /// of the meshes which are not isolated, grouped by mesh (an unknown shared by several meshes belongs to the first one),
+    /// with their positions (the vertex or the center of the triangle).
+    /// The HeadMat is singular when a current barrier is not an outermost mesh (e.g. the cortex of a non-conductive brain):
+    /// assemble_HM only deflates the outermost meshes, and the constant potentials on the vertices of such a barrier are in
+    /// its kernel. The systems of the gains are still consistent, but the blocks of these meshes must be deflated by the
+    /// preconditioners.
+
+    struct OPENMEEG_EXPORT HeadMatUnknowns {
+
+        HeadMatUnknowns(const Geometry& geo);
+
+        unsigned size() const { return positions.size(); }
+
+        std::vector<std::vector<unsigned> > meshes;     ///< unknowns of each mesh
+        std::vector<bool>                   kernels;    ///< meshes whose constant potentials are in the kernel of the HeadMat
+        std::vector<Vect3>                  positions;  ///< position of each unknown
+        double                              spacing;    ///< mean length of the edges of the triangles
+    };
+
+    /// \brief Block diagonal preconditioner of the HeadMat: the diagonal block of the unknowns of each mesh (the (mesh,mesh)
+    /// block of assemble_HM) is factorized once (Bunch-Kaufman, the blocks being indefinite) and the preconditioner solves
+    /// these independent systems. Contrary to Jacobi, it takes the coupling of the N, D and S operators of each mesh into
+    /// account. M is a SymMatrix or any operator giving the entries of the HeadMat (e.g. HeadMatOperator).
+
+    class OPENMEEG_EXPORT MeshBlockPreconditioner {
+    public:
+
+        template <typename M>
+        MeshBlockPreconditioner(const M& m,const Geometry& geo): dimension(m.nlin()) {
+            const HeadMatUnknowns unknowns(geo);
+            for (unsigned b=0;b<unknowns.meshes.size();++b) {
+                const std::vector<unsigned>& indices = unknowns.meshes[b];
+                if (indices.empty())
+                    continue;
+                SymMatrix block(indices.size());
+                for (unsigned j=0;j<indices.size();++j)
+                    for (unsigned i=0;i<=j;++i)
+                        block(i,j) = m(indices[i],indices[j]);
+                if (unknowns.kernels[b])
+                    deflate(block);
+                add_block(indices,block);
+            }
+        }
+
+        Vector operator()(const Vector& g) const;
+        Matrix operator()(const Matrix& G) const;
+
+    private:
+
+        // Adds block(0,0)/n to all the entries of block (as deflat does for the outermost meshes), so that the constants
+        // are not in its kernel.
+
+        static void deflate(SymMatrix& block);
+
+        // Factorizes block, or keeps the inverse of its diagonal if it is singular.
+
+        void add_block(const std::vector<unsigned>& indices,SymMatrix& block);
+
+        unsigned                            dimension;
+        std::vector<std::vector<unsigned> > blocks;
+        std::vector<SymFactorization>       factors;
+        std::vector<std::vector<double> >   diagonals;  // inverse diagonals of the singular blocks
+    };
+
+    /// \brief Incomplete LU factorization (ILU(0)) of the near field of the HeadMat: only the entries of the pairs of unknowns
+    /// closer than ratio times the mean edge length are kept (the sparsity pattern includes the N/S coupling of the neighbouring
+    /// vertices and triangles, within and across meshes) and factorized without fill-in. The HeadMat being indefinite, an
+    /// incomplete Cholesky factorization would break down. M is a SymMatrix or any operator giving the entries of the HeadMat.
+
+    class OPENMEEG_EXPORT NearFieldILU {
+    public:
+
+        template <typename M>
+        NearFieldILU(const M& m,const Geometry& geo,const double ratio=2.0) {
+            const HeadMatUnknowns unknowns(geo);
+            pattern(unknowns,ratio*unknowns.spacing);
+            values.resize(columns.size());
+            #pragma omp parallel for
+            for (int i=0;i<static_cast<int>(rows.size())-1;++i)
+                for (unsigned k=rows[i];k<rows[i+1];++k)
+                    values[k] = m(i,columns[k]);
+            factorize();
+        }
+
+        /// Number of kept entries.
+
+        unsigned nb_entries() const { return columns.size(); }
+
+        Vector operator()(const Vector& g) const;
+        Matrix operator()(const Matrix& G) const;
+
+    private:
+
+        // Rows of the pairs of unknowns closer than radius (compressed rows with sorted columns).
+
+        void pattern(const HeadMatUnknowns& unknowns,const double radius);
+        void factorize();
+        void solve(double* x) const;
+
+        std::vector<unsigned> rows;
+        std::vector<unsigned> columns;
+        std::vector<unsigned> diagonal;  // position of the diagonal entry of each row
+        std::vector<double>   values;    // L (unit diagonal, strictly lower part) and U
+    };
+
+    /// \brief Coarse level of a two-grid preconditioner: the HeadMat of a coarsened geometry (see Geometry::coarsen) is
+    /// assembled and factorized once, and the fine residuals are corrected by P HC^{-1} P' r. The prolongation P
+    /// interpolates the coarse P1 potentials at the fine vertices and injects the coarse P0 currents in the fine triangles
+    /// (each fine point being projected on the nearest triangle of the corresponding coarse mesh), the restriction is
+    /// its transpose as for a Galerkin coarse operator.
+
+    class OPENMEEG_EXPORT CoarseCorrection {
+    public:
+
+        CoarseCorrection(const Geometry& fine,const Geometry& coarse,const unsigned gauss_order=3);
+
+        unsigned size() const { return factors.nlin(); }
+
+        /// Prolongation from the coarse unknowns to the fine ones.
+
+        const SparseMatrix& prolongation() const { return P; }
+
+        Matrix operator()(const Matrix& R) const;
+
+    private:
+
+        SparseMatrix     P;
+        SparseMatrix     Pt;
+        SymFactorization factors;
+    };
+
+    /// \brief Two-grid preconditioner of the HeadMat A: the smoother S (e.g. Jacobi, NearFieldILU) is applied before and
+    /// after the coarse correction, each step correcting the current residual (x += S(g-A x), x += P HC^{-1} P'(g-A x)).
+    /// The coarse level captures the smooth components of the error, which the local preconditioners hardly reduce,
+    /// so that the number of GMRes iterations should not grow with the refinement of the meshes. Each application costs
+    /// 2*steps products with A (the fine operator may be a SymMatrix or the matrix-free HeadMatOperator).
+
+    template <typename T,typename S>
+    class TwoGridPreconditioner {
+    public:
+
+        TwoGridPreconditioner(const T& a,const S& s,const CoarseCorrection& c,const unsigned nb_steps=1):
+            A(a),smoother(s),coarse(c),steps(nb_steps) { }
+
+        Matrix operator()(const Matrix& G) const {
+            Matrix X = smoother(G);
+            for (unsigned k=1;k<steps;++k)
+                X += smoother(G-BlockProduct(A,X));
+            X += coarse(G-BlockProduct(A,X));
+            for (unsigned k=0;k<steps;++k)
+                X += smoother(G-BlockProduct(A,X));
+            return X;
+        }
+
+        Vector operator()(const Vector& g) const {
+            Matrix G(g.nlin(),1);
+            G.setcol(0,g);
+            return operator()(G).getcol(0);
+        }
+
+    private:
+
+        const T&                A;
+        const S&                smoother;
+        const CoarseCorrection& coarse;
+        const unsigned          steps;
+    };
+}
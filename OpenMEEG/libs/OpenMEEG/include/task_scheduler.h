@@ -0,0 +1,170 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+/*! \file
+    \brief file containing the task scheduler used to assemble the operator blocks in parallel
+*/
+#pragma once
+
+#include <vector>
+
+#include <om_utils.h>
+#include <DLLDefinesOpenMEEG.h>
+
+namespace OpenMEEG {
+
+    class Mesh;
+
+    /// \brief Rectangular part [i_begin,i_end[ x [j_begin,j_end[ of an operator block.
+    /// Indices are local to the block (i.e. positions of the triangles/vertices in their mesh).
+
+    struct OPENMEEG_EXPORT Tile {
+        Tile(const unsigned ib,const unsigned ie,const unsigned jb,const unsigned je): i_begin(ib),i_end(ie),j_begin(jb),j_end(je) { }
+
+        unsigned nlin() const { return i_end-i_begin; }
+        unsigned ncol() const { return j_end-j_begin; }
+
+        /// Is it a tile crossing the diagonal of a symmetric block ?
+
+        bool diagonal() const { return i_begin==j_begin; }
+
+        unsigned i_begin,i_end,j_begin,j_end;
+    };
+
+    typedef std::vector<Tile> Tiles;
+
+    /// \brief Cut a block of n1 x n2 elements into tiles of (at most) tile_size x tile_size elements.
+    /// For a symmetric block (triangular=true, n1==n2), only the tiles of the upper triangular part are generated.
+
+    OPENMEEG_EXPORT Tiles make_tiles(const unsigned n1,const unsigned n2,const bool triangular,const unsigned tile_size=64);
+
+    /// \brief A unit of work of the assembly (typically a tile of an operator block).
+
+    class OPENMEEG_EXPORT Task {
+    public:
+
+        virtual ~Task() { }
+
+        virtual void run() = 0;
+
+        /// Estimated amount of work (e.g. number of integrals). Largest tasks are started first.
+
+        virtual double cost() const { return 1.0; }
+    };
+
+    /// \brief Lock of the entries of a block accumulated by several tasks (see TaskScheduler::block_lock).
+    /// Without OpenMP, locking does nothing.
+
+    class OPENMEEG_EXPORT BlockLock {
+    public:
+
+        BlockLock();
+        ~BlockLock();
+
+        void set();
+        void unset();
+
+    private:
+
+        friend class TaskScheduler;
+
+        BlockLock(const BlockLock&);
+        BlockLock& operator=(const BlockLock&);
+
+        void*      lock;
+        BlockLock* shared; ///< lock used instead of this one (block sharing entries with other blocks)
+    };
+
+    /// \brief Run a set of tasks on all the available threads.
+    /// Tasks are grouped into stages: all the tasks of a stage are finished before the next stage starts
+    /// (the N blocks for example read the already computed S blocks). Within a stage the tasks are handed to
+    /// the OpenMP runtime which distributes them dynamically to the idle threads, so that blocks of different
+    /// mesh pairs and of different sizes are processed concurrently.
+    /// The scheduler owns the tasks it is given and deletes them once they have been run.
+
+    class OPENMEEG_EXPORT TaskScheduler {
+    public:
+
+        TaskScheduler() { }
+        ~TaskScheduler() { clear(); }
+
+        /// Stage conventionally used for the blocks depending on no other block (S, D, D*).
+
+        static const unsigned FIRST_STAGE  = 0;
+
+        /// Stage conventionally used for the blocks depending on the blocks of the first stage (N).
+
+        static const unsigned SECOND_STAGE = 1;
+
+        void add(Task* task,const unsigned stage=FIRST_STAGE);
+
+        /// Lock shared by the tasks accumulating into the block of the pair of meshes (m1,m2) of a matrix.
+        /// Blocks of different pairs of meshes only share entries through the vertices common to several meshes
+        /// (non nested geometries): when the scheduler is run, the blocks of such meshes are given a single lock.
+
+        BlockLock& block_lock(const Mesh& m1,const Mesh& m2);
+
+        unsigned size() const;
+
+        /// Run all the tasks (stage by stage) and empty the scheduler.
+
+        void run();
+
+        void clear();
+
+    private:
+
+        TaskScheduler(const TaskScheduler&);
+        TaskScheduler& operator=(const TaskScheduler&);
+
+        void share_locks();
+
+        typedef std::vector<Task*> Stage;
+
+        struct LockedBlock {
+            BlockLock*  lock;
+            const Mesh* m1;
+            const Mesh* m2;
+        };
+
+        std::vector<Stage>       stages;
+        std::vector<LockedBlock> locks;
+        BlockLock                common_lock;
+    };
+}
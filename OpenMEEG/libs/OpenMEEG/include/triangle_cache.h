@@ -0,0 +1,135 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <triangle.h>
+#include <integrator.h>
+#include <analytics.h>
+
+namespace OpenMEEG {
+
+    /// \brief Precomputed data of the triangles of a mesh, used by the integral operators.
+    /// For each gauss order, the quadrature nodes of all the triangles are stored in separate x, y and z arrays
+    /// (structure of arrays) along with the quadrature weights multiplied by the (doubled) triangle area, so that
+    /// an integral on a triangle reduces to a weighted sum of the integrand values at its nodes.
+    /// The analytic parts of the S and D kernels, which only depend on the triangle, are also kept.
+    /// Triangles are designated by their position in the mesh.
+
+    class OPENMEEG_EXPORT TriangleCache {
+    public:
+
+        TriangleCache() { }
+
+        /// (Re)compute the data of all the triangles (their normals and areas must be up to date).
+
+        void build(const Triangles& triangles);
+        void clear();
+
+        unsigned size()  const { return analyS_.size(); }
+        bool     empty() const { return analyS_.empty(); }
+
+        static unsigned nb_points(const unsigned order) { return nbPts[order]; }
+
+        /// Quadrature nodes and weights of triangle t are at positions [t*nb_points(order),(t+1)*nb_points(order)[.
+
+        const double* x(const unsigned order)       const { return &nodes[order].x[0]; }
+        const double* y(const unsigned order)       const { return &nodes[order].y[0]; }
+        const double* z(const unsigned order)       const { return &nodes[order].z[0]; }
+        const double* weights(const unsigned order) const { return &nodes[order].w[0]; }
+
+        /// Center and diameter (longest edge) of triangle t.
+
+        const Vect3&  center(const unsigned t)   const { return centers_[t];   }
+        double        diameter(const unsigned t) const { return diameters_[t]; }
+
+        /// analyticS initialized with triangle t.
+
+        const analyticS&  analyS(const unsigned t)  const { return analyS_[t]; }
+
+        /// analyticD3 initialized with triangle t.
+
+        const analyticD3& analyD3(const unsigned t) const { return analyD3_[t]; }
+
+        /// Integral of fc on triangle t (same as Integrator<T,I>(order).integrate(fc,triangle)).
+
+        template <typename T,typename I>
+        T integrate(const I& fc,const unsigned t,const unsigned order) const {
+            const Nodes&   q = nodes[order];
+            const unsigned n = nbPts[order];
+            T result = 0;
+            for (unsigned i=t*n;i<(t+1)*n;++i)
+                multadd(result,q.w[i],fc.f(Vect3(q.x[i],q.y[i],q.z[i])));
+            return result;
+        }
+
+        /// Integrals of fc on the triangles [t_begin,t_end[, stored in results[0..t_end-t_begin[.
+        /// The kernel is evaluated at once on all the nodes of these triangles (batched version of analyticS::f).
+
+        void integrate(const analyticS& fc,const unsigned t_begin,const unsigned t_end,const unsigned order,double* results) const;
+
+        /// Same for analyticD3.
+
+        void integrate(const analyticD3& fc,const unsigned t_begin,const unsigned t_end,const unsigned order,Vect3* results) const;
+
+        /// Same as above with one order per triangle (orders[0..t_end-t_begin[).
+
+        void integrate(const analyticS&  fc,const unsigned t_begin,const unsigned t_end,const unsigned* orders,double* results) const;
+        void integrate(const analyticD3& fc,const unsigned t_begin,const unsigned t_end,const unsigned* orders,Vect3* results) const;
+
+    private:
+
+        struct Nodes {
+            std::vector<double> x,y,z,w;
+        };
+
+        // Gather the nodes of the triangles [t_begin,t_end[ (with their orders) in x, y, z and w.
+
+        void gather(const unsigned t_begin,const unsigned t_end,const unsigned* orders,
+                    std::vector<double>& x,std::vector<double>& y,std::vector<double>& z,std::vector<double>& w) const;
+
+        Nodes                   nodes[4];
+        std::vector<Vect3>      centers_;
+        std::vector<double>     diameters_;
+        std::vector<analyticS>  analyS_;
+        std::vector<analyticD3> analyD3_;
+    };
+}
@@ -0,0 +1,334 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+
+#include <analytics.h>
+
+//  The batched kernels evaluate the analytic integrals on blocks of points in three vectorizable passes: the geometric
+//  quantities are computed for all the points of the block, then the logarithms and arc tangents are evaluated (with
+//  the branch free simd_log and simd_atan2 below, libm calls cannot be vectorized portably), and the results are
+//  finally combined. simd_log and simd_atan2 are accurate to a few ulps, so the batched kernels agree with the scalar
+//  ones up to rounding errors.
+//  When the compiler supports it, the kernels are compiled for several instruction sets (AVX-512, AVX2 and the
+//  default one) and the version matching the processor is selected at runtime.
+//  This file is compiled with -fopenmp-simd -fno-math-errno -fno-trapping-math (see CMakeLists.txt), which lets the
+//  compiler vectorize the loops without reassociating the floating point operations.
+
+#ifdef HAVE_TARGET_CLONES
+    #define TARGET_CLONES __attribute__((target_clones("avx512f","avx2","default")))
+#else
+    #define TARGET_CLONES
+#endif
+
+#if defined(_OPENMP) || defined(__GNUC__)
+    #define SIMD_LOOP _Pragma("omp simd")
+#else
+    #define SIMD_LOOP
+#endif
+
+//  The elementary functions must be inlined in the vectorized loops (a function call prevents the vectorization).
+
+#ifdef __GNUC__
+    #define SIMD_INLINE inline __attribute__((always_inline))
+#else
+    #define SIMD_INLINE inline
+#endif
+
+namespace OpenMEEG {
+
+    const char* analytics_instruction_set() {
+    #ifdef HAVE_TARGET_CLONES
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return "avx512f";
+        if (__builtin_cpu_supports("avx2"))
+            return "avx2";
+    #endif
+        return "default";
+    }
+
+    namespace {
+
+        const unsigned block_size = 64;
+
+        // Plain 3D vectors, easier to keep in vector registers than Vect3 in the vectorized loops.
+
+        struct V3 {
+            double x,y,z;
+        };
+
+        inline V3     make(const Vect3& v)                  { const V3 r = { v.x(), v.y(), v.z() }; return r; }
+        inline V3     make(const double x,const double y,const double z) { const V3 r = { x, y, z }; return r; }
+        inline V3     operator-(const V3& a,const V3& b)    { return make(a.x-b.x,a.y-b.y,a.z-b.z); }
+        inline V3     operator+(const V3& a,const V3& b)    { return make(a.x+b.x,a.y+b.y,a.z+b.z); }
+        inline V3     operator*(const V3& a,const double d) { return make(d*a.x,d*a.y,d*a.z); }
+        inline double operator*(const V3& a,const V3& b)    { return a.x*b.x+a.y*b.y+a.z*b.z; }
+        inline V3     operator^(const V3& a,const V3& b)    { return make(a.y*b.z-a.z*b.y,a.z*b.x-a.x*b.z,a.x*b.y-a.y*b.x); }
+        inline double norm(const V3& a)                     { return sqrt(a*a); }
+
+        // Same test as std::isnormal(a) && a>0 (false for NaN), usable in vectorized loops.
+
+        inline bool positive_normal(const double a) { return (a>=DBL_MIN) & (a<=DBL_MAX); }
+
+        // Natural logarithm without branches nor table lookups (vectorizable): a = m 2^k with m in [sqrt(2)/2,sqrt(2)[
+        // and log(m) = 2 atanh(s) with s = (m-1)/(m+1), |s| < 0.1716 (ten terms of the series). Special values are
+        // those of libm (-inf for 0, NaN for negative numbers and NaN, inf for inf).
+
+        SIMD_INLINE double simd_log(const double a) {
+            const double ln2_hi = 6.93147180369123816490e-01;
+            const double ln2_lo = 1.90821492927058770002e-10;
+            const bool   denormal = a<DBL_MIN;
+            const double b = denormal ? a*18014398509481984.0 : a; // 2^54
+            unsigned long long bits;
+            std::memcpy(&bits,&b,sizeof(double));
+
+            // The exponent is converted to a double by placing it in the mantissa of 2^52 (no integer conversion).
+
+            unsigned long long ebits = ((bits>>52)&0x7ff)|0x4330000000000000ULL;
+            double k;
+            std::memcpy(&k,&ebits,sizeof(double));
+            k -= 4503599627370496.0+1023.0;
+            bits = (bits&0x000fffffffffffffULL)|0x3ff0000000000000ULL;
+            double m;
+            std::memcpy(&m,&bits,sizeof(double));
+            const bool large = m>M_SQRT2;
+            m = large ? 0.5*m : m;
+            k = large ? k+1.0 : k;
+            k = denormal ? k-54.0 : k;
+            const double f  = m-1.0;
+            const double s  = f/(2.0+f);
+            const double s2 = s*s;
+            const double r  = 1.0/3+s2*(1.0/5+s2*(1.0/7+s2*(1.0/9+s2*(1.0/11+s2*(1.0/13+s2*(1.0/15+s2*(1.0/17+s2*(1.0/19))))))));
+            const double l  = k*ln2_hi+(2.0*s+(2.0*s*s2*r+k*ln2_lo));
+            return (a==0.0) ? -HUGE_VAL : (a>DBL_MAX) ? a : (a>0.0) ? l : (a-a)/(a-a);
+        }
+
+        // Arc tangent of y/x in ]-pi,pi] without branches (vectorizable): atan(t), t = min(|x|,|y|)/max(|x|,|y|), is
+        // reduced to |t| <= tan(pi/8) using atan(t) = pi/4+atan((t-1)/(t+1)) and evaluated with 21 terms of its series.
+        // Signed zeros are handled as in libm, infinite arguments are not (they do not occur in the kernels).
+
+        SIMD_INLINE double simd_atan2(const double y,const double x) {
+            const double ax = fabs(x);
+            const double ay = fabs(y);
+            const double mx = std::max(ax,ay);
+            const double t0 = (mx==0.0) ? 0.0 : std::min(ax,ay)/mx;
+            const bool   reduce = t0>0.41421356237309504880;
+            const double t  = reduce ? (t0-1.0)/(t0+1.0) : t0;
+            const double t2 = t*t;
+            double p = 1.0/41;
+            p = 1.0/39-t2*p; p = 1.0/37-t2*p; p = 1.0/35-t2*p; p = 1.0/33-t2*p; p = 1.0/31-t2*p; p = 1.0/29-t2*p;
+            p = 1.0/27-t2*p; p = 1.0/25-t2*p; p = 1.0/23-t2*p; p = 1.0/21-t2*p; p = 1.0/19-t2*p; p = 1.0/17-t2*p;
+            p = 1.0/15-t2*p; p = 1.0/13-t2*p; p = 1.0/11-t2*p; p = 1.0/9-t2*p;  p = 1.0/7-t2*p;  p = 1.0/5-t2*p;
+            p = 1.0/3-t2*p;
+            double r = t-t*t2*p;
+            r = reduce ? M_PI_4+r : r;
+            r = (ay>ax) ? M_PI_2-r : r;
+            r = (copysign(1.0,x)<0.0) ? M_PI-r : r;
+            return copysign(r,y);
+        }
+
+        TARGET_CLONES
+        void analyticS_kernel(const V3 p[3],const V3 e[3],const double ne[3],const V3 nu[3],const V3 normal,
+                              const unsigned npts,const double* x,const double* y,const double* z,double* values)
+        {
+            const V3     P0  = p[0],  P1  = p[1],  P2  = p[2];
+            const V3     E0  = e[0],  E1  = e[1],  E2  = e[2];
+            const double NE0 = ne[0], NE1 = ne[1], NE2 = ne[2];
+            const V3     NU0 = nu[0], NU1 = nu[1], NU2 = nu[2];
+
+            double log0[block_size],log1[block_size],log2[block_size];
+            double ok0[block_size],ok1[block_size],ok2[block_size];
+            double c0[block_size],c1[block_size],c2[block_size];
+            double alpha[block_size],det[block_size],den[block_size];
+
+            for (unsigned b=0;b<npts;b+=block_size) {
+                const unsigned m = std::min(block_size,npts-b);
+                const double* xb = x+b;
+                const double* yb = y+b;
+                const double* zb = z+b;
+                double*       vb = values+b;
+
+                SIMD_LOOP
+                for (unsigned i=0;i<m;++i) {
+                    const V3 X = make(xb[i],yb[i],zb[i]);
+                    const V3 p0x = P0-X;
+                    const V3 p1x = P1-X;
+                    const V3 p2x = P2-X;
+                    const double n0 = norm(p0x);
+                    const double n1 = norm(p1x);
+                    const double n2 = norm(p2x);
+
+                    // Arguments of the logarithms of integral_simplified_green.
+
+                    const double a0 = (n0*NE0-p0x*E0)/(n1*NE0-p1x*E0);
+                    const double a1 = (n1*NE1-p1x*E1)/(n2*NE1-p2x*E1);
+                    const double a2 = (n2*NE2-p2x*E2)/(n0*NE2-p0x*E2);
+                    ok0[i]  = positive_normal(a0) ? 1.0 : 0.0;
+                    ok1[i]  = positive_normal(a1) ? 1.0 : 0.0;
+                    ok2[i]  = positive_normal(a2) ? 1.0 : 0.0;
+                    log0[i] = positive_normal(a0) ? a0 : n1/n0;
+                    log1[i] = positive_normal(a1) ? a1 : n2/n1;
+                    log2[i] = positive_normal(a2) ? a2 : n0/n2;
+
+                    c0[i] = p0x*NU0;
+                    c1[i] = p1x*NU1;
+                    c2[i] = p2x*NU2;
+                    alpha[i] = p0x*normal;
+
+                    // Solid angle (see Vect3::solangl).
+
+                    det[i] = p0x*(p1x^p2x);
+                    den[i] = n0*n1*n2+n0*(p1x*p2x)+n1*(p2x*p0x)+n2*(p0x*p1x);
+                }
+
+                SIMD_LOOP
+                for (unsigned i=0;i<m;++i) {
+                    log0[i] = simd_log(log0[i]);
+                    log1[i] = simd_log(log1[i]);
+                    log2[i] = simd_log(log2[i]);
+                    det[i]  = simd_atan2(det[i],den[i]);
+                }
+
+                SIMD_LOOP
+                for (unsigned i=0;i<m;++i) {
+                    const double g0 = (ok0[i]!=0.0) ? log0[i] : fabs(log0[i]);
+                    const double g1 = (ok1[i]!=0.0) ? log1[i] : fabs(log1[i]);
+                    const double g2 = (ok2[i]!=0.0) ? log2[i] : fabs(log2[i]);
+                    vb[i] = ((c0[i]*g0+c1[i]*g1+c2[i]*g2)-alpha[i]*(2.*det[i]));
+                }
+            }
+        }
+
+        TARGET_CLONES
+        void analyticD3_kernel(const V3 v[3],const unsigned npts,const double* x,const double* y,const double* z,
+                               double* values1,double* values2,double* values3)
+        {
+            const V3 V1 = v[0], V2 = v[1], V3_ = v[2];
+            const double derr = 1e-10;
+
+            double log1[block_size],log2[block_size],log3[block_size];
+            double omega[block_size],den[block_size];
+
+            for (unsigned b=0;b<npts;b+=block_size) {
+                const unsigned m = std::min(block_size,npts-b);
+                const double* xb  = x+b;
+                const double* yb  = y+b;
+                const double* zb  = z+b;
+                double*       v1b = values1+b;
+                double*       v2b = values2+b;
+                double*       v3b = values3+b;
+
+                SIMD_LOOP
+                for (unsigned i=0;i<m;++i) {
+                    const V3 X  = make(xb[i],yb[i],zb[i]);
+                    const V3 Y1 = V1-X;
+                    const V3 Y2 = V2-X;
+                    const V3 Y3 = V3_-X;
+                    const double y1 = norm(Y1);
+                    const double y2 = norm(Y2);
+                    const double y3 = norm(Y3);
+                    const V3 D1 = Y2-Y1;
+                    const V3 D2 = Y3-Y2;
+                    const V3 D3 = Y1-Y3;
+                    const double d1 = norm(D1);
+                    const double d2 = norm(D2);
+                    const double d3 = norm(D3);
+                    log1[i]  = (y1*d1+Y1*D1)/(y2*d1+Y2*D1);
+                    log2[i]  = (y2*d2+Y2*D2)/(y3*d2+Y3*D2);
+                    log3[i]  = (y3*d3+Y3*D3)/(y1*d3+Y1*D3);
+                    omega[i] = Y1*(Y2^Y3);
+                    den[i]   = y1*y2*y3+y1*(Y2*Y3)+y2*(Y3*Y1)+y3*(Y1*Y2);
+                }
+
+                SIMD_LOOP
+                for (unsigned i=0;i<m;++i) {
+                    log1[i]  = simd_log(log1[i]);
+                    log2[i]  = simd_log(log2[i]);
+                    log3[i]  = simd_log(log3[i]);
+                    omega[i] = simd_atan2(omega[i],den[i]);
+                }
+
+                SIMD_LOOP
+                for (unsigned i=0;i<m;++i) {
+                    const V3 X  = make(xb[i],yb[i],zb[i]);
+                    const V3 Y1 = V1-X;
+                    const V3 Y2 = V2-X;
+                    const V3 Y3 = V3_-X;
+                    const double d = Y1*(Y2^Y3);
+                    const V3 Z1 = Y2^Y3;
+                    const V3 Z2 = Y3^Y1;
+                    const V3 Z3 = Y1^Y2;
+                    const V3 D1 = Y2-Y1;
+                    const V3 D2 = Y3-Y2;
+                    const V3 D3 = Y1-Y3;
+                    const double g1 = -1.0/norm(D1)*log1[i];
+                    const double g2 = -1.0/norm(D2)*log2[i];
+                    const double g3 = -1.0/norm(D3)*log3[i];
+                    const V3 N = Z1+Z2+Z3;
+                    const double invA = 1.0/(N*N);
+                    const V3 S = D1*g1+D2*g2+D3*g3;
+                    const double w = 2.*omega[i];
+                    const bool degenerate = fabs(d)<derr;
+                    v1b[i] = degenerate ? 0.0 : invA*((Z1*N)*w+d*(D2*S));
+                    v2b[i] = degenerate ? 0.0 : invA*((Z2*N)*w+d*(D3*S));
+                    v3b[i] = degenerate ? 0.0 : invA*((Z3*N)*w+d*(D1*S));
+                }
+            }
+        }
+    }
+
+    void analyticS::f(const unsigned npts,const double* x,const double* y,const double* z,double* values) const {
+        const V3     p[3]   = { make(p0), make(p1), make(p2) };
+        const V3     e[3]   = { make(p1p0), make(p2p1), make(p0p2) };
+        const double ne[3]  = { norm2p1p0, norm2p2p1, norm2p0p2 };
+        const V3     nus[3] = { make(nu0), make(nu1), make(nu2) };
+        analyticS_kernel(p,e,ne,nus,make(n),npts,x,y,z,values);
+    }
+
+    void analyticD3::f(const unsigned npts,const double* x,const double* y,const double* z,
+                       double* values1,double* values2,double* values3) const
+    {
+        const V3 v[3] = { make(v1), make(v2), make(v3) };
+        analyticD3_kernel(v,npts,x,y,z,values1,values2,values3);
+    }
+}
@@ -41,12 +41,17 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #endif
 
 #include <math.h>
+#include <map>
+#include <string>
 
 #include <matrix.h>
 #include <symmatrix.h>
 #include <geometry.h>
 #include <operators.h>
 #include <assemble.h>
+#include <GeometryExceptions.H>
+
+#include "headmat.h"
 
 namespace OpenMEEG {
 
@@ -69,90 +74,75 @@ namespace OpenMEEG {
         }
     }
 
-    template<class T>
-    void deflat(T& M, const Geometry& geo)
+    std::vector<DeflationGroup> deflation_groups(const Geometry& geo)
     {
-        //deflat all current barriers as one
-        unsigned nb_vertices=0,i_first=0;
-        double coef=0.0;
+        std::vector<DeflationGroup> groups;
         for(std::vector<std::vector<std::string> >::const_iterator git=geo.geo_group().begin();git!=geo.geo_group().end();++git){
-            nb_vertices=0;
-            i_first=0;
+            DeflationGroup group;
+            group.nb_vertices=0;
+            group.i_first=0;
             for(std::vector<std::string>::const_iterator mit=git->begin();mit!=git->end();++mit){
-                const Mesh msh=geo.mesh(*mit);
+                const Mesh& msh=geo.mesh(*mit);
                 if(msh.outermost()){
-                    nb_vertices+=msh.nb_vertices();
-                    if(i_first==0)
-                        i_first=(*msh.vertex_begin())->index();
+                    group.meshes.push_back(&msh);
+                    group.nb_vertices+=msh.nb_vertices();
+                    // First vertex of the mesh in the order of its triangles (i.e. of Mesh::build_mesh_vertices).
+                    if(group.i_first==0)
+                        group.i_first=msh.front().s1().index();
                 }
             }
-            coef=M(i_first,i_first)/nb_vertices;
-            for(std::vector<std::string>::const_iterator mit=git->begin();mit!=git->end();++mit){
-                Mesh msh=geo.mesh(*mit);
-                if(msh.outermost())
-                    for(Mesh::const_vertex_iterator vit1=msh.vertex_begin();vit1!=msh.vertex_end();++vit1){
-                        #pragma omp parallel for
-                        #ifndef OPENMP_3_0
-                        for (int i2=vit1-msh.vertex_begin();i2<msh.vertex_size();++i2) {
-                            const Mesh::const_vertex_iterator vit2 = msh.vertex_begin()+i2;
-                        #else
-                        for (Mesh::const_vertex_iterator vit2=vit1;vit2<msh.vertex_end();++vit2) {
-                        #endif
-                            M((*vit1)->index(),(*vit2)->index()) += coef;
-                        }
-                    }
-            }
+            groups.push_back(group);
         }
+        return groups;
     }
 
-    void assemble_HM(const Geometry& geo, SymMatrix& mat, const unsigned gauss_order) 
+    // Coefficients of the blocks of the pair of meshes (m1,m2) in the HeadMat (false if the meshes do not interact).
+
+    bool HM_coefficients(const Geometry& geo, const Mesh& m1, const Mesh& m2, double& Scoeff, double& Dcoeff, double& Ncoeff)
+    {
+        // if m1 and m2 communicate, i.e they are used for the definition of a common domain
+        if(m1.isolated() || m2.isolated() || geo.sigma(m1,m2)==0.0)
+            return false;
+        const int orientation = geo.oriented(m1, m2); // equals  0, if they don't have any domains in common
+                                                      // equals  1, if they are both oriented toward the same domain
+                                                      // equals -1, if they are not
+        if(orientation==0)
+            return false;
+
+        const double K = 1.0 / (4.0 * M_PI);
+        Scoeff =   orientation * geo.sigma_inv(m1, m2) * K;
+        Dcoeff = - orientation * geo.indicator(m1, m2) * K;
+        if( (!m1.current_barrier()) && (!m2.current_barrier()) ) {
+            Ncoeff = geo.sigma(m1, m2)/geo.sigma_inv(m1, m2);
+        }else{
+            Ncoeff = orientation * geo.sigma(m1, m2) * K;
+        }
+        return true;
+    }
+
+    void assemble_HM(const Geometry& geo, SymMatrix& mat, const QuadraturePolicy& quadrature) 
     {
         mat = SymMatrix((geo.size()-geo.nb_current_barrier_triangles()));
         mat.set(0.0);
-        double K = 1.0 / (4.0 * M_PI);
+
+        // All the blocks are assembled concurrently once they have all been scheduled.
+        TaskScheduler scheduler;
 
         // We iterate over the meshes (or pair of domains) to fill the lower half of the HeadMat (since its symmetry)
         for(Geometry::const_iterator mit1 = geo.begin(); mit1 != geo.end(); ++mit1) {
-            if(!mit1->isolated()){
-                for(Geometry::const_iterator mit2 = geo.begin(); (mit2 != (mit1+1)); ++mit2) {
-                    if((!mit2->isolated()) && (geo.sigma(*mit1,*mit2)!=0.0)){
-                        // if mit1 and mit2 communicate, i.e they are used for the definition of a common domain
-                        const int orientation = geo.oriented(*mit1, *mit2); // equals  0, if they don't have any domains in common
-                                                                            // equals  1, if they are both oriented toward the same domain
-                                                                            // equals -1, if they are not
-                        if(orientation!=0){
-                            double Scoeff =   orientation * geo.sigma_inv(*mit1, *mit2) * K;
-                            double Dcoeff = - orientation * geo.indicator(*mit1, *mit2) * K;
-                            double Ncoeff;
-
-                            if( (!mit1->current_barrier()) && (!mit2->current_barrier()) ) {
-                                // Computing S block first because it's needed for the corresponding N block
-                                operatorS(*mit1, *mit2, mat, Scoeff, gauss_order);
-                                Ncoeff = geo.sigma(*mit1, *mit2)/geo.sigma_inv(*mit1, *mit2);
-                            }else{
-                                Ncoeff = orientation * geo.sigma(*mit1, *mit2) * K;
-                            }
-
-                            if(!mit1->current_barrier()){
-                                // Computing D block
-                                operatorD(*mit1, *mit2, mat, Dcoeff, gauss_order,false);
-                            }
-                            if((*mit1!=*mit2) && (!mit2->current_barrier())){
-                                // Computing D* block
-                                operatorD(*mit1, *mit2, mat, Dcoeff, gauss_order, true);
-                            }
-                            // Computing N block
-                            operatorN(*mit1, *mit2, mat, Ncoeff, gauss_order);
-                        }
-                    }
-                }
+            for(Geometry::const_iterator mit2 = geo.begin(); (mit2 != (mit1+1)); ++mit2) {
+                double Scoeff, Dcoeff, Ncoeff;
+                if(HM_coefficients(geo, *mit1, *mit2, Scoeff, Dcoeff, Ncoeff))
+                    schedule_HM_blocks(scheduler, *mit1, *mit2, mat, Scoeff, Dcoeff, Ncoeff, quadrature);
             }
         }
+        scheduler.run();
+
         // Deflate all current barriers as one
         deflat(mat,geo);
     }
 
-    void assemble_cortical(const Geometry& geo, Matrix& mat, const Head2EEGMat& M, const std::string& domain_name, const unsigned gauss_order, double alpha, double beta, const std::string &filename)
+    void assemble_cortical(const Geometry& geo, Matrix& mat, const Head2EEGMat& M, const std::string& domain_name, const QuadraturePolicy& quadrature, double alpha, double beta, const std::string &filename)
     {
         // Following the article: M. Clerc, J. Kybic "Cortical mapping by Laplace–Cauchy transmission using a boundary element method".
         // Assumptions:
@@ -177,6 +167,7 @@ namespace OpenMEEG {
             SymMatrix mat_temp(Nc);
             mat_temp.set(0.0);
             double K = 1.0 / (4.0 * M_PI);
+            TaskScheduler scheduler;
             // We iterate over the meshes (or pair of domains) to fill the lower half of the HeadMat (since its symmetry)
             for ( Geometry::const_iterator mit1 = geo.begin(); mit1 != geo.end(); ++mit1) {
                 for ( Geometry::const_iterator mit2 = geo.begin(); (mit2 != (mit1+1)); ++mit2) {
@@ -190,26 +181,28 @@ namespace OpenMEEG {
                         double Ncoeff;
                         if ( !(mit1->current_barrier() || mit2->current_barrier()) && ( (*mit1 != *mit2)||( *mit1 != cortex) ) ) {
                             // Computing S block first because it's needed for the corresponding N block
-                            operatorS(*mit1, *mit2, mat_temp, Scoeff, gauss_order);
+                            schedule_operatorS(scheduler, *mit1, *mit2, mat_temp, Scoeff, quadrature);
                             Ncoeff = geo.sigma(*mit1, *mit2)/geo.sigma_inv(*mit1, *mit2);
                         } else {
                             Ncoeff = orientation * geo.sigma(*mit1, *mit2) * K;
                         }
                         if ( !mit1->current_barrier() && (( (*mit1 != *mit2)||( *mit1 != cortex) )) ) {
                             // Computing D block
-                            operatorD(*mit1, *mit2, mat_temp, Dcoeff, gauss_order,false);
+                            schedule_operatorD(scheduler, *mit1, *mit2, mat_temp, Dcoeff, quadrature,false);
                         }
                         if ( ( *mit1 != *mit2 ) && ( !mit2->current_barrier() ) ) {
                             // Computing D* block
-                            operatorD(*mit1, *mit2, mat_temp, Dcoeff, gauss_order, true);
+                            schedule_operatorD(scheduler, *mit1, *mit2, mat_temp, Dcoeff, quadrature, true);
                         }
                         // Computing N block
                         if ( (*mit1 != *mit2)||( *mit1 != cortex) ) {
-                            operatorN(*mit1, *mit2, mat_temp, Ncoeff, gauss_order);
+                            schedule_operatorN(scheduler, *mit1, *mit2, mat_temp, Ncoeff, quadrature);
                         }
                     }
                 }
             }
+            scheduler.run();
+
             // Deflate all current barriers as one
             deflat(mat_temp,geo);
 
@@ -303,7 +296,7 @@ namespace OpenMEEG {
         mat = P * Z.pinverse() * rhs;
     }
 
-    void assemble_cortical2(const Geometry& geo, Matrix& mat, const Head2EEGMat& M, const std::string& domain_name, const unsigned gauss_order, double gamma, const std::string &filename)
+    void assemble_cortical2(const Geometry& geo, Matrix& mat, const Head2EEGMat& M, const std::string& domain_name, const QuadraturePolicy& quadrature, double gamma, const std::string &filename)
     {
         // Re-writting of the optimization problem in M. Clerc, J. Kybic "Cortical mapping by Laplace–Cauchy transmission using a boundary element method".
         // with a Lagrangian formulation as in see http://www.math.uh.edu/~rohop/fall_06/Chapter3.pdf eq3.3
@@ -340,6 +333,7 @@ namespace OpenMEEG {
             SymMatrix mat_temp(Nc);
             mat_temp.set(0.0);
             double K = 1.0 / (4.0 * M_PI);
+            TaskScheduler scheduler;
             // We iterate over the meshes (or pair of domains) to fill the lower half of the HeadMat (since its symmetry)
             for ( Geometry::const_iterator mit1 = geo.begin(); mit1 != geo.end(); ++mit1) {
                 for ( Geometry::const_iterator mit2 = geo.begin(); (mit2 != (mit1+1)); ++mit2) {
@@ -353,26 +347,28 @@ namespace OpenMEEG {
                         double Ncoeff;
                         if ( !(mit1->current_barrier() || mit2->current_barrier()) && ( (*mit1 != *mit2)||( *mit1 != cortex) ) ) {
                             // Computing S block first because it's needed for the corresponding N block
-                            operatorS(*mit1, *mit2, mat_temp, Scoeff, gauss_order);
+                            schedule_operatorS(scheduler, *mit1, *mit2, mat_temp, Scoeff, quadrature);
                             Ncoeff = geo.sigma(*mit1, *mit2)/geo.sigma_inv(*mit1, *mit2);
                         } else {
                             Ncoeff = orientation * geo.sigma(*mit1, *mit2) * K;
                         }
                         if ( !mit1->current_barrier() && (( (*mit1 != *mit2)||( *mit1 != cortex) )) ) {
                             // Computing D block
-                            operatorD(*mit1, *mit2, mat_temp, Dcoeff, gauss_order);
+                            schedule_operatorD(scheduler, *mit1, *mit2, mat_temp, Dcoeff, quadrature);
                         }
                         if ( ( *mit1 != *mit2 ) && ( !mit2->current_barrier() ) ) {
                             // Computing D* block
-                            operatorD(*mit1, *mit2, mat_temp, Dcoeff, gauss_order, true);
+                            schedule_operatorD(scheduler, *mit1, *mit2, mat_temp, Dcoeff, quadrature, true);
                         }
                         // Computing N block
                         if ( (*mit1 != *mit2)||( *mit1 != cortex) ) {
-                            operatorN(*mit1, *mit2, mat_temp, Ncoeff, gauss_order);
+                            schedule_operatorN(scheduler, *mit1, *mit2, mat_temp, Ncoeff, quadrature);
                         }
                     }
                 }
             }
+            scheduler.run();
+
             // Deflate all current barriers as one
             deflat(mat_temp,geo);
 
@@ -462,16 +458,41 @@ namespace OpenMEEG {
         assemble_HM(geo, *this, gauss_order);
     }
 
+    HeadMat::HeadMat(const Geometry& geo, const QuadraturePolicy& quadrature)
+    {
+        assemble_HM(geo, *this, quadrature);
+    }
+
+    HeadMat::HeadMat(const Geometry& geo, const HeadMatBlocks& blocks)
+    {
+        blocks.assemble(geo, *this);
+    }
+
+    HeadMat::HeadMat(const Geometry& geo, const SymMatrix& previous, const HeadMatLayout& layout, const QuadraturePolicy& quadrature)
+    {
+        layout.assemble(geo, previous, *this, quadrature);
+    }
+
     CorticalMat::CorticalMat(const Geometry& geo, const Head2EEGMat& M, const std::string& domain_name, const unsigned gauss_order, double a, double b, const std::string &filename)
     {
         assemble_cortical(geo, *this, M, domain_name, gauss_order, a, b, filename);
     }
 
+    CorticalMat::CorticalMat(const Geometry& geo, const Head2EEGMat& M, const std::string& domain_name, const QuadraturePolicy& quadrature, double a, double b, const std::string &filename)
+    {
+        assemble_cortical(geo, *this, M, domain_name, quadrature, a, b, filename);
+    }
+
     CorticalMat2::CorticalMat2(const Geometry& geo, const Head2EEGMat& M, const std::string& domain_name, const unsigned gauss_order, double gamma, const std::string &filename)
     {
         assemble_cortical2(geo, *this, M, domain_name, gauss_order, gamma, filename);
     }
 
+    CorticalMat2::CorticalMat2(const Geometry& geo, const Head2EEGMat& M, const std::string& domain_name, const QuadraturePolicy& quadrature, double gamma, const std::string &filename)
+    {
+        assemble_cortical2(geo, *this, M, domain_name, quadrature, gamma, filename);
+    }
+
     Surf2VolMat::Surf2VolMat(const Geometry& geo, const Matrix& points) 
     {
         std::map<const Domain, Vertices> m_points;
@@ -48,11 +48,12 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #include <operators.h>
 #include <assemble.h>
 #include <sensors.h>
+#include <GeometryExceptions.H>
 #include <fstream>
 
 namespace OpenMEEG {
 
-    void assemble_SurfSourceMat(Matrix& mat, const Geometry& geo, Mesh& mesh_source, const unsigned gauss_order) 
+    void assemble_SurfSourceMat(Matrix& mat, const Geometry& geo, Mesh& mesh_source, const QuadraturePolicy& quadrature) 
     {
         mat = Matrix((geo.size()-geo.nb_current_barrier_triangles()), mesh_source.nb_vertices());
         mat.set(0.0);
@@ -76,16 +77,18 @@ namespace OpenMEEG {
 
         std::cout << std::endl << "assemble SurfSourceMat with " << nVertexSources << " mesh_source located in domain \"" << d.name() << "\"." << std::endl << std::endl;
 
+        TaskScheduler scheduler;
         for ( Domain::const_iterator hit = d.begin(); hit != d.end(); ++hit) {
             for ( Interface::const_iterator omit = hit->interface().begin(); omit != hit->interface().end(); ++omit) {
                 // First block is nVertexFistLayer*nVertexSources.
                 double coeffN = (hit->inside())?K * omit->orientation() : omit->orientation() * -K;
-                operatorN( omit->mesh(), mesh_source, mat, coeffN, gauss_order);
+                schedule_operatorN(scheduler, omit->mesh(), mesh_source, mat, coeffN, quadrature);
                 // Second block is nFacesFistLayer*nVertexSources.
                 double coeffD = (hit->inside())?-omit->orientation() * K / sigma : omit->orientation() * K / sigma;
-                operatorD(omit->mesh(), mesh_source, mat, coeffD, gauss_order,false);
+                schedule_operatorD(scheduler, omit->mesh(), mesh_source, mat, coeffD, quadrature,false);
             }
         }
+        scheduler.run();
     }
 
     SurfSourceMat::SurfSourceMat(const Geometry& geo, Mesh& mesh_source, const unsigned gauss_order) 
@@ -93,6 +96,11 @@ namespace OpenMEEG {
         assemble_SurfSourceMat(*this, geo, mesh_source, gauss_order);
     }
 
+    SurfSourceMat::SurfSourceMat(const Geometry& geo, Mesh& mesh_source, const QuadraturePolicy& quadrature) 
+    {
+        assemble_SurfSourceMat(*this, geo, mesh_source, quadrature);
+    }
+
     void assemble_DipSourceMat(Matrix& rhs, const Geometry& geo, const Matrix& dipoles,
             const unsigned gauss_order, const bool adapt_rhs, const std::string& domain_name = "") 
     {
@@ -102,22 +110,41 @@ namespace OpenMEEG {
         rhs = Matrix(size,n_dipoles);
         rhs.set(0.0);
 
-        Vector rhs_col(rhs.nlin());
-        for (unsigned s=0; s<n_dipoles; ++s) {
-            PROGRESSBAR(s,n_dipoles);
+        //  The dipoles are distributed over the threads, each of them computing its columns serially and
+        //  directly in the matrix (no temporary column and no synchronization on the accumulations).
+
+        const Domain* named_domain = (domain_name=="") ? 0 : &geo.domain(domain_name);
+        const double  K            = 1.0/(4.*M_PI);
+
+        bool outside = false;
+        #ifdef USE_PROGRESSBAR
+        unsigned done = 0;
+        #endif
+        #pragma omp parallel for schedule(dynamic)
+        for (int s=0; s<static_cast<int>(n_dipoles); ++s) {
             const Vect3 r(dipoles(s,0),dipoles(s,1),dipoles(s,2));
             const Vect3 q(dipoles(s,3),dipoles(s,4),dipoles(s,5));
 
-            const Domain domain = (domain_name=="") ? geo.domain(r) : geo.domain(domain_name);
+            //  Exceptions cannot leave the parallel region, a dipole in no domain is reported after the loop.
+
+            const Domain* domain = named_domain;
+            if (domain==0) {
+                try {
+                    domain = &geo.domain(r);
+                } catch (BadDomain&) {
+                    #pragma omp critical(dipsourcemat_outside)
+                    outside = true;
+                    continue;
+                }
+            }
 
             //  Only consider dipoles in non-zero conductivity domain.
 
-            const double sigma = domain.sigma();
+            const double sigma = domain->sigma();
             if (sigma!=0.0) {
-                rhs_col.set(0.0);
-                const double K = 1.0/(4.*M_PI);
+                double* rhs_col = rhs.data()+static_cast<size_t>(s)*size;
                 //  Iterate over the domain's interfaces (half-spaces)
-                for (Domain::const_iterator hit=domain.begin(); hit!=domain.end(); ++hit) {
+                for (Domain::const_iterator hit=domain->begin(); hit!=domain->end(); ++hit) {
                     //  Iterate over the meshes of the interface
                     for (Interface::const_iterator omit=hit->interface().begin(); omit!=hit->interface().end(); ++omit) {
                         //  Treat the mesh.
@@ -125,14 +152,20 @@ namespace OpenMEEG {
                         operatorDipolePotDer(r,q,omit->mesh(),rhs_col,coeffD,gauss_order,adapt_rhs);
 
                         if (!omit->mesh().current_barrier()) {
-                            const double coeff = -coeffD/sigma;;
+                            const double coeff = -coeffD/sigma;
                             operatorDipolePot(r,q,omit->mesh(),rhs_col,coeff,gauss_order,adapt_rhs);
                         }
                     }
                 }
-                rhs.setcol(s,rhs_col);
             }
+            #ifdef USE_PROGRESSBAR
+            #pragma omp critical(dipsourcemat_progress)
+            PROGRESSBAR(done++,n_dipoles);
+            #endif
         }
+
+        if (outside)
+            throw BadDomain("Impossible");
     }
 
     DipSourceMat::DipSourceMat(const Geometry& geo, const Matrix& dipoles, const unsigned gauss_order,
@@ -141,7 +174,7 @@ namespace OpenMEEG {
         assemble_DipSourceMat(*this, geo, dipoles, gauss_order, adapt_rhs, domain_name);
     }
 
-    void assemble_EITSourceMat(Matrix& mat, const Geometry& geo, const Sensors& electrodes, const unsigned gauss_order)
+    void assemble_EITSourceMat(Matrix& mat, const Geometry& geo, const Sensors& electrodes, const QuadraturePolicy& quadrature)
     {
         //  A Matrix to be applied to the scalp-injected current to obtain the Source Term of the EIT foward problem.
 
@@ -156,16 +189,21 @@ namespace OpenMEEG {
         mat.set(0.0);
 
         for(Geometry::const_iterator mit0=geo.begin();mit0!=geo.end();++mit0){
-            if(mit0->current_barrier())
+            if(mit0->current_barrier()) {
+                // The blocks of a current barrier are assembled concurrently. S blocks set their entries, so the
+                // current barriers are processed one after the other (as two of them may share a S block).
+                TaskScheduler scheduler;
                 for(Geometry::const_iterator mit1=geo.begin();mit1!=geo.end();++mit1){
                     const int orientation=geo.oriented(*mit0,*mit1);
                     if(orientation!=0){
-                        operatorS(*mit1,*mit0,transmat,geo.sigma_inv(*mit0,*mit1)*(-1.0*K*orientation),gauss_order);
-                        operatorD(*mit1,*mit0,transmat,(K*orientation),gauss_order,true);
+                        schedule_operatorS(scheduler,*mit1,*mit0,transmat,geo.sigma_inv(*mit0,*mit1)*(-1.0*K*orientation),quadrature);
+                        schedule_operatorD(scheduler,*mit1,*mit0,transmat,(K*orientation),quadrature,true);
                         if(*mit0==*mit1)
                             operatorP1P0(*mit0,transmat,0.5*orientation);
                     }
                 }
+                scheduler.run();
+            }
         }
 
         for ( unsigned ielec = 0; ielec < n_sensors; ++ielec) {
@@ -189,6 +227,11 @@ namespace OpenMEEG {
         assemble_EITSourceMat(*this, geo, electrodes, gauss_order);
     }
 
+    EITSourceMat::EITSourceMat(const Geometry& geo, const Sensors& electrodes, const QuadraturePolicy& quadrature) 
+    {
+        assemble_EITSourceMat(*this, geo, electrodes, quadrature);
+    }
+
     void assemble_DipSource2InternalPotMat(Matrix& mat, const Geometry& geo, const Matrix& dipoles,
                                            const Matrix& points, const std::string& domain_name)     
     {
@@ -222,7 +265,7 @@ namespace OpenMEEG {
             }
             const double sigma  = domain.sigma();
 
-            static analyticDipPot anaDP;
+            analyticDipPot anaDP;
             anaDP.init(q, r0);
             for ( unsigned iPTS = 0; iPTS < points_.size(); ++iPTS) {
                 if ( points_domain[iPTS] == domain ) {
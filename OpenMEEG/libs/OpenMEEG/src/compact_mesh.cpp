@@ -0,0 +1,85 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <mesh.h>
+#include <compact_mesh.h>
+
+namespace OpenMEEG {
+
+    void CompactMesh::build(const Mesh& m) {
+
+        const unsigned nv = m.nb_vertices();
+        x_.resize(nv);
+        y_.resize(nv);
+        z_.resize(nv);
+        for (unsigned i=0;i<nv;++i) {
+            const Vertex& V = *m.vertices()[i];
+            x_[i] = V.x();
+            y_[i] = V.y();
+            z_[i] = V.z();
+        }
+
+        const unsigned nt = m.nb_triangles();
+        triangles_.resize(3*nt);
+        nx_.resize(nt);
+        ny_.resize(nt);
+        nz_.resize(nt);
+        areas_.resize(nt);
+        for (unsigned t=0;t<nt;++t) {
+            const Triangle& T = m[t];
+            for (unsigned k=0;k<3;++k)
+                triangles_[3*t+k] = m.vertex_position(T(k));
+            nx_[t] = T.normal().x();
+            ny_[t] = T.normal().y();
+            nz_[t] = T.normal().z();
+            areas_[t] = T.area();
+        }
+    }
+
+    void CompactMesh::clear() {
+        x_.clear();
+        y_.clear();
+        z_.clear();
+        triangles_.clear();
+        nx_.clear();
+        ny_.clear();
+        nz_.clear();
+        areas_.clear();
+    }
+}
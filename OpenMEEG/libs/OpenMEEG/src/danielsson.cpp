@@ -44,7 +44,7 @@ Processing 14, 3 (Nov. 1980), 227-248.
 namespace OpenMEEG
 {
 
-    // Distance from p to a triangle (3 pointers to vertex)
+    // Distance from p to a triangle (given by its 3 points)
     // alpha-> barycentric coordinates of closest point
     // sum(alpha_i)=1
     // inside: closest point is inside (alpha_i!=0 for all i)
@@ -53,18 +53,18 @@ namespace OpenMEEG
 
     using namespace std;
 
-    static double dpc(const Vect3& p, const Triangle& triangle, Vect3& alphas, int nb, int* idx, bool& inside)
+    static double dpc(const Vect3& p, const Vect3* points, Vect3& alphas, int nb, int* idx, bool& inside)
     {
         if ( nb == 1 ) {
             alphas(idx[0]) = 1.0;
-            return (p - triangle.vertex(idx[0])).norm();
+            return (p - points[idx[0]]).norm();
         }
         // Solves H=sum(alpha_i A_i), sum(alpha_i)=1, et HM.(A_i-A_0)=0
         Vect3 A0Ai[3]; // A_i-A_0
         for ( unsigned i = 1; i < nb; ++i) {
-            A0Ai[i] = triangle.vertex(idx[i]) - triangle.vertex(idx[0]);
+            A0Ai[i] = points[idx[i]] - points[idx[0]];
         }
-        Vect3 A0M = p - triangle.vertex(idx[0]); // M-A_0
+        Vect3 A0M = p - points[idx[0]]; // M-A_0
         if ( nb == 2 ) {
             alphas(idx[1]) = (A0M * A0Ai[1]) / (A0Ai[1] * A0Ai[1]);
             alphas(idx[0]) = 1.0 - alphas(idx[1]);
@@ -93,7 +93,7 @@ namespace OpenMEEG
                 inside = false;
                 alphas(idx[i]) = 0;
                 swap(idx[i], idx[nb-1]);
-                return dpc(p, triangle, alphas, nb-1, idx, inside);
+                return dpc(p, points, alphas, nb-1, idx, inside);
             }
         }
         // Sinon: distance HM
@@ -105,11 +105,17 @@ namespace OpenMEEG
     }
 
     // Main Function
-    double dist_point_triangle(const Vect3& p, const Triangle& triangle, Vect3& alphas, bool& inside)
+    static double dist_point_triangle(const Vect3& p, const Vect3* points, Vect3& alphas, bool& inside)
     {
         int idx[3] = {0, 1, 2};
         inside = true;
-        return dpc(p, triangle, alphas, 3, idx, inside);
+        return dpc(p, points, alphas, 3, idx, inside);
+    }
+
+    double dist_point_triangle(const Vect3& p, const Triangle& triangle, Vect3& alphas, bool& inside)
+    {
+        const Vect3 points[3] = { triangle.s1(), triangle.s2(), triangle.s3() };
+        return dist_point_triangle(p, points, alphas, inside);
     }
 
     static inline int sgn(double s)
@@ -124,15 +130,29 @@ namespace OpenMEEG
         double distance;
         Vect3 alphasLoop;
 
+        // The triangles are read in the contiguous storage of the meshes (see CompactMesh).
+
         for ( Interface::const_iterator omit = i.begin(); omit != i.end(); ++omit ) {
-            for ( Mesh::const_iterator tit = omit->mesh().begin(); tit !=  omit->mesh().end(); ++tit) {
-                distance = dist_point_triangle(p, *tit, alphasLoop, inside);
+            const Mesh&        m       = omit->mesh();
+            const CompactMesh& compact = m.compact();
+            const unsigned*    tri     = compact.triangles();
+            const double*      x       = compact.x();
+            const double*      y       = compact.y();
+            const double*      z       = compact.z();
+            unsigned nearest = compact.nb_triangles();
+            for ( unsigned t = 0; t < compact.nb_triangles(); ++t, tri += 3) {
+                const Vect3 points[3] = { Vect3(x[tri[0]], y[tri[0]], z[tri[0]]),
+                                          Vect3(x[tri[1]], y[tri[1]], z[tri[1]]),
+                                          Vect3(x[tri[2]], y[tri[2]], z[tri[2]]) };
+                distance = dist_point_triangle(p, points, alphasLoop, inside);
                 if ( distance < distmin ) {
                     distmin = distance;
                     alphas = alphasLoop;
-                    nearestTriangle = *tit;
+                    nearest = t;
                 }
             }
+            if ( nearest != compact.nb_triangles() )
+                nearestTriangle = m[nearest];
         }
         return distmin;
     }
@@ -0,0 +1,553 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cmath>
+#include <map>
+#include <algorithm>
+
+#include <fmm.h>
+#include <operators.h>
+
+namespace OpenMEEG {
+
+    namespace {
+
+        Vect3  center(const ClusterTree::Cluster& c) { return 0.5*(c.lower+c.upper);  }
+        double radius(const ClusterTree::Cluster& c) { return 0.5*(c.upper-c.lower).norm(); }
+
+        // Barycentric weights of the Chebyshev points of the second kind cos(k*pi/p), k=0..p.
+
+        std::vector<double> chebyshev_weights(const unsigned p) {
+            std::vector<double> w(p+1);
+            for (unsigned k=0;k<=p;++k)
+                w[k] = ((k%2) ? -1.0 : 1.0)*((k==0 || k==p) ? 0.5 : 1.0);
+            return w;
+        }
+
+        // Lagrange polynomials of the nodes s (with barycentric weights w) at y, and their derivatives.
+        // When y is (almost) a node, the derivatives are given by the differentiation matrix.
+
+        void lagrange(const unsigned n,const double* s,const double* w,const double y,const double scale,double* L,double* dL) {
+            for (unsigned k=0;k<n;++k)
+                if (std::abs(y-s[k])<=1e-12*scale) {
+                    double diag = 0.0;
+                    for (unsigned j=0;j<n;++j) {
+                        L[j]  = 0.0;
+                        dL[j] = (j==k) ? 0.0 : (w[j]/w[k])/(s[k]-s[j]);
+                        diag -= dL[j];
+                    }
+                    L[k]  = 1.0;
+                    dL[k] = diag;
+                    return;
+                }
+
+            double sum  = 0.0;
+            double dsum = 0.0;
+            for (unsigned k=0;k<n;++k) {
+                L[k]  = w[k]/(y-s[k]);
+                dL[k] = -L[k]/(y-s[k]);
+                sum  += L[k];
+                dsum += dL[k];
+            }
+            for (unsigned k=0;k<n;++k) {
+                dL[k] = (dL[k]-L[k]*dsum/sum)/sum;
+                L[k] /= sum;
+            }
+        }
+    }
+
+    // ============
+    // = Treecode =
+    // ============
+
+    Treecode::Treecode(const std::vector<Vect3>& sources,const std::vector<Vect3>& targets,const FMMParameters& p):
+        parameters(p),
+        source_tree(sources,std::vector<unsigned>(sources.size(),0),p.leaf_size),
+        target_tree(targets,std::vector<unsigned>(targets.size(),0),p.leaf_size),
+        sources_(sources.size()),targets_(targets.size()),proxy_index(source_tree.size(),-1)
+    {
+        for (unsigned i=0;i<sources.size();++i)
+            sources_[i] = sources[source_tree.permutation()[i]];
+        for (unsigned i=0;i<targets.size();++i)
+            targets_[i] = targets[target_tree.permutation()[i]];
+
+        if (source_tree.size()==0)
+            return;
+
+        for (unsigned i=0;i<target_tree.size();++i)
+            if (target_tree[i].leaf())
+                batches.push_back(i);
+
+        far_lists.resize(batches.size());
+        near_lists.resize(batches.size());
+        for (unsigned b=0;b<batches.size();++b)
+            interactions(target_tree[batches[b]],0,far_lists[b],near_lists[b]);
+
+        // Chebyshev points of the interpolated clusters. Flat boxes are thickened to keep the interpolation well defined.
+
+        const unsigned n = parameters.degree+1;
+        for (unsigned b=0;b<batches.size();++b)
+            for (std::vector<unsigned>::const_iterator cit=far_lists[b].begin();cit!=far_lists[b].end();++cit) {
+                if (proxy_index[*cit]>=0)
+                    continue;
+                proxy_index[*cit] = interpolated.size();
+                interpolated.push_back(*cit);
+                const ClusterTree::Cluster& c = source_tree[*cit];
+                const Vect3 extent = c.upper-c.lower;
+                double max_extent = std::max(extent(0),std::max(extent(1),extent(2)));
+                if (max_extent==0.0)
+                    max_extent = 1.0;
+                const Vect3 middle = center(c);
+                for (unsigned k=0;k<3;++k) {
+                    const double half = 0.5*std::max(extent(k),1e-3*max_extent);
+                    for (unsigned a=0;a<n;++a)
+                        nodes.push_back(middle(k)+half*cos(a*M_PI/parameters.degree));
+                }
+            }
+    }
+
+    void Treecode::interactions(const ClusterTree::Cluster& batch,const unsigned cluster,std::vector<unsigned>& far,std::vector<unsigned>& near) const {
+        const ClusterTree::Cluster& c = source_tree[cluster];
+        const unsigned nb_proxies = (parameters.degree+1)*(parameters.degree+1)*(parameters.degree+1);
+        if (radius(batch)+radius(c)<parameters.theta*(center(batch)-center(c)).norm()) {
+            // Small clusters are cheaper to sum directly.
+            if (c.size()>nb_proxies) {
+                far.push_back(cluster);
+            } else {
+                near.push_back(cluster);
+            }
+            return;
+        }
+        if (c.leaf()) {
+            near.push_back(cluster);
+            return;
+        }
+        interactions(batch,c.sons[0],far,near);
+        interactions(batch,c.sons[1],far,near);
+    }
+
+    void Treecode::interpolate(const unsigned cluster,const unsigned nrhs,const double* charges,const Vect3* dipoles,double* proxies) const {
+        const ClusterTree::Cluster& c = source_tree[cluster];
+        const unsigned n = parameters.degree+1;
+        const double*  s = &nodes[3*n*proxy_index[cluster]];
+        const std::vector<double> w = chebyshev_weights(parameters.degree);
+        const double scales[3] = { s[0]-s[n-1], s[n]-s[2*n-1], s[2*n]-s[3*n-1] };
+
+        std::fill(proxies,proxies+n*n*n*nrhs,0.0);
+        std::vector<double> L(3*n),dL(3*n),alpha(nrhs),beta(nrhs);
+        for (unsigned i=c.begin;i<c.end;++i) {
+            const double* q = (charges) ? charges+i*nrhs : 0;
+            const Vect3*  d = (dipoles) ? dipoles+i*nrhs : 0;
+            bool zero = true;
+            for (unsigned r=0;r<nrhs && zero;++r)
+                zero = (!q || q[r]==0.0) && (!d || d[r].norm2()==0.0);
+            if (zero)
+                continue;
+            for (unsigned k=0;k<3;++k)
+                lagrange(n,s+k*n,&w[0],sources_[i](k),scales[k],&L[k*n],&dL[k*n]);
+            const double* Lx = &L[0];
+            const double* Ly = &L[n];
+            const double* Lz = &L[2*n];
+            for (unsigned a=0;a<n;++a)
+                for (unsigned b=0;b<n;++b) {
+                    for (unsigned r=0;r<nrhs;++r) {
+                        alpha[r] = (q) ? q[r]*Lx[a]*Ly[b] : 0.0;
+                        beta[r]  = 0.0;
+                        if (d) {
+                            alpha[r] += d[r](0)*dL[a]*Ly[b]+d[r](1)*Lx[a]*dL[n+b];
+                            beta[r]   = d[r](2)*Lx[a]*Ly[b];
+                        }
+                    }
+                    double* proxy = proxies+(a*n+b)*n*nrhs;
+                    for (unsigned k=0;k<n;++k)
+                        for (unsigned r=0;r<nrhs;++r)
+                            proxy[k*nrhs+r] += alpha[r]*Lz[k]+beta[r]*dL[2*n+k];
+                }
+        }
+    }
+
+    void Treecode::evaluate(const double* charges,const Vect3* dipoles,double* potentials,Vect3* gradients) const {
+        evaluate(1,charges,dipoles,potentials,gradients);
+    }
+
+    void Treecode::evaluate(const Matrix& charges,Matrix& potentials) const {
+        om_assert(charges.nlin()==nb_sources() && potentials.nlin()==nb_targets() && charges.ncol()==potentials.ncol());
+        const unsigned nrhs = charges.ncol();
+        if (nrhs==0)
+            return;
+        std::vector<double> q(nb_sources()*nrhs);
+        std::vector<double> p(nb_targets()*nrhs,0.0);
+        for (unsigned j=0;j<nb_sources();++j)
+            for (unsigned r=0;r<nrhs;++r)
+                q[j*nrhs+r] = charges(j,r);
+        evaluate(nrhs,(q.empty()) ? 0 : &q[0],0,(p.empty()) ? 0 : &p[0],0);
+        for (unsigned i=0;i<nb_targets();++i)
+            for (unsigned r=0;r<nrhs;++r)
+                potentials(i,r) += p[i*nrhs+r];
+    }
+
+    void Treecode::evaluate(const unsigned nrhs,const double* charges,const Vect3* dipoles,double* potentials,Vect3* gradients) const {
+
+        // Sources in the tree ordering.
+
+        std::vector<double> q;
+        std::vector<Vect3>  d;
+        if (charges) {
+            q.resize(sources_.size()*nrhs);
+            for (unsigned i=0;i<sources_.size();++i)
+                std::copy(charges+source_tree.permutation()[i]*nrhs,charges+(source_tree.permutation()[i]+1)*nrhs,q.begin()+i*nrhs);
+        }
+        if (dipoles) {
+            d.resize(sources_.size()*nrhs);
+            for (unsigned i=0;i<sources_.size();++i)
+                std::copy(dipoles+source_tree.permutation()[i]*nrhs,dipoles+(source_tree.permutation()[i]+1)*nrhs,d.begin()+i*nrhs);
+        }
+        const double* Q = (charges && !q.empty()) ? &q[0] : 0;
+        const Vect3*  P = (dipoles && !d.empty()) ? &d[0] : 0;
+
+        // Charges at the Chebyshev points of the interpolated clusters.
+
+        const unsigned n  = parameters.degree+1;
+        const unsigned n3 = n*n*n;
+        std::vector<double> proxies(interpolated.size()*n3*nrhs);
+        #pragma omp parallel for schedule(dynamic)
+        for (int i=0;i<static_cast<int>(interpolated.size());++i)
+            interpolate(interpolated[i],nrhs,Q,P,&proxies[i*n3*nrhs]);
+
+        // Each target belongs to a single batch, so that the batches can be evaluated concurrently.
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int b=0;b<static_cast<int>(batches.size());++b) {
+            const ClusterTree::Cluster& batch = target_tree[batches[b]];
+            std::vector<double> potential(nrhs);
+            std::vector<Vect3>  gradient(nrhs);
+            for (unsigned i=batch.begin;i<batch.end;++i) {
+                const Vect3& x = targets_[i];
+                std::fill(potential.begin(),potential.end(),0.0);
+                std::fill(gradient.begin(),gradient.end(),Vect3(0.0));
+
+                for (std::vector<unsigned>::const_iterator cit=far_lists[b].begin();cit!=far_lists[b].end();++cit) {
+                    const double* proxy = &proxies[proxy_index[*cit]*n3*nrhs];
+                    const double* s     = &nodes[3*n*proxy_index[*cit]];
+                    for (unsigned a=0;a<n;++a) {
+                        const double dx = x(0)-s[a];
+                        for (unsigned c=0;c<n;++c) {
+                            const double dy = x(1)-s[n+c];
+                            const double* pr = proxy+(a*n+c)*n*nrhs;
+                            for (unsigned k=0;k<n;++k,pr+=nrhs) {
+                                const double dz  = x(2)-s[2*n+k];
+                                const double inv = 1.0/sqrt(dx*dx+dy*dy+dz*dz);
+                                for (unsigned r=0;r<nrhs;++r)
+                                    potential[r] += pr[r]*inv;
+                                if (gradients) {
+                                    const double inv3 = inv*inv*inv;
+                                    for (unsigned r=0;r<nrhs;++r) {
+                                        const double g = pr[r]*inv3;
+                                        gradient[r](0) -= g*dx;
+                                        gradient[r](1) -= g*dy;
+                                        gradient[r](2) -= g*dz;
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+
+                for (std::vector<unsigned>::const_iterator cit=near_lists[b].begin();cit!=near_lists[b].end();++cit) {
+                    const ClusterTree::Cluster& c = source_tree[*cit];
+                    for (unsigned j=c.begin;j<c.end;++j) {
+                        const Vect3  r  = x-sources_[j];
+                        const double r2 = r.norm2();
+                        if (r2==0.0)
+                            continue;
+                        const double inv  = 1.0/sqrt(r2);
+                        const double inv3 = inv*inv*inv;
+                        for (unsigned l=0;l<nrhs;++l) {
+                            if (Q) {
+                                const double qj = Q[j*nrhs+l];
+                                potential[l] += qj*inv;
+                                if (gradients)
+                                    gradient[l] -= (qj*inv3)*r;
+                            }
+                            if (P) {
+                                const Vect3& pj = P[j*nrhs+l];
+                                const double pr = pj*r;
+                                potential[l] += pr*inv3;
+                                if (gradients)
+                                    gradient[l] += inv3*pj-(3.0*pr*inv3*inv*inv)*r;
+                            }
+                        }
+                    }
+                }
+
+                const unsigned k = target_tree.permutation()[i];
+                for (unsigned r=0;r<nrhs;++r) {
+                    if (potentials)
+                        potentials[k*nrhs+r] += potential[r];
+                    if (gradients)
+                        gradients[k*nrhs+r] += gradient[r];
+                }
+            }
+        }
+    }
+
+    // ================
+    // = FMMOperators =
+    // ================
+
+    FMMOperators::Nodes::Nodes(const Mesh& m,const unsigned order): nb_points(TriangleCache::nb_points(order)) {
+        std::map<const Vertex*,unsigned> positions;
+        for (Mesh::const_vertex_iterator vit=m.vertex_begin();vit!=m.vertex_end();++vit)
+            positions[*vit] = vit-m.vertex_begin();
+
+        const TriangleCache& cache = m.cache();
+        for (Mesh::const_iterator tit=m.begin();tit!=m.end();++tit) {
+            const unsigned t = tit-m.begin();
+            // The normal of the analytic kernels, given by the order of the vertices.
+            Vect3 normal = (tit->s2()-tit->s1())^(tit->s3()-tit->s1());
+            normal.normalize();
+            normals.push_back(normal);
+            for (unsigned k=0;k<3;++k)
+                vertices.push_back(positions[&(*tit)(k)]);
+            for (unsigned i=t*nb_points;i<(t+1)*nb_points;++i) {
+                const unsigned node = i-t*nb_points;
+                points.push_back(Vect3(cache.x(order)[i],cache.y(order)[i],cache.z(order)[i]));
+                weights.push_back(cache.weights(order)[i]);
+                barycentric.push_back(Vect3(cordBars[order][node][0],cordBars[order][node][1],cordBars[order][node][2]));
+                triangles.push_back(t);
+            }
+        }
+    }
+
+    FMMOperators::FMMOperators(const Mesh& mesh1,const Mesh& mesh2,const FMMParameters& parameters,const QuadraturePolicy& quadrature):
+        m1(mesh1),m2(mesh2),nodes1(mesh1,parameters.gauss_order),nodes2(mesh2,parameters.gauss_order),
+        treecode(nodes2.points,nodes1.points,parameters),treecode_star(nodes1.points,nodes2.points,parameters)
+    {
+        near_field(parameters.near_ratio,quadrature);
+    }
+
+    void FMMOperators::near_field(const double near_ratio,const QuadraturePolicy& quadrature) {
+
+        const TriangleCache& cache1 = m1.cache();
+        const TriangleCache& cache2 = m2.cache();
+
+        std::vector<Vect3> centers(m2.size());
+        double max_diameter = 0.0;
+        for (unsigned j=0;j<m2.size();++j) {
+            centers[j]   = cache2.center(j);
+            max_diameter = std::max(max_diameter,cache2.diameter(j));
+        }
+        const ClusterTree tree(centers,std::vector<unsigned>(centers.size(),0));
+
+        // Corrections of each line, computed concurrently.
+
+        std::vector<std::vector<unsigned> > rows(m1.size());
+        std::vector<std::vector<double> >   rows_S(m1.size());
+        std::vector<std::vector<Vect3> >    rows_D(m1.size());
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int ii=0;ii<static_cast<int>(m1.size());++ii) {
+            const unsigned i  = ii;
+            const Vect3&   ci = cache1.center(i);
+            const double   di = cache1.diameter(i);
+            const double   reach = near_ratio*std::max(di,max_diameter);
+
+            // Triangles of m2 whose center is closer than near_ratio diameters.
+
+            std::vector<unsigned>& near = rows[i];
+            std::vector<unsigned> stack(1,0);
+            while (!stack.empty() && tree.size()!=0) {
+                const ClusterTree::Cluster& c = tree[stack.back()];
+                stack.pop_back();
+                double d2 = 0.0;
+                for (unsigned k=0;k<3;++k) {
+                    const double gap = std::max(0.0,std::max(c.lower(k)-ci(k),ci(k)-c.upper(k)));
+                    d2 += gap*gap;
+                }
+                if (d2>reach*reach)
+                    continue;
+                if (c.leaf()) {
+                    for (unsigned k=c.begin;k<c.end;++k) {
+                        const unsigned j = tree.permutation()[k];
+                        if ((ci-centers[j]).norm()<near_ratio*std::max(di,cache2.diameter(j)))
+                            near.push_back(j);
+                    }
+                } else {
+                    stack.push_back(c.sons[0]);
+                    stack.push_back(c.sons[1]);
+                }
+            }
+            std::sort(near.begin(),near.end());
+
+            // Analytic values (oriented as in assemble_HM) minus the quadrature evaluated by the treecodes.
+
+            const KernelContext context(quadrature);
+            for (std::vector<unsigned>::const_iterator jit=near.begin();jit!=near.end();++jit) {
+                const unsigned j = *jit;
+                double S = (&m1==&m2) ? _operatorS(m1,std::min(i,j),m2,std::max(i,j),context) : _operatorS(m1,i,m2,j,context);
+                Vect3  D = _operatorD(m1,i,m2,j,context);
+                const Vect3& normal = nodes2.normals[j];
+                for (unsigned a=i*nodes1.nb_points;a<(i+1)*nodes1.nb_points;++a)
+                    for (unsigned b=j*nodes2.nb_points;b<(j+1)*nodes2.nb_points;++b) {
+                        const Vect3  r  = nodes1.points[a]-nodes2.points[b];
+                        const double r2 = r.norm2();
+                        if (r2==0.0)
+                            continue;
+                        const double w   = nodes1.weights[a]*nodes2.weights[b];
+                        const double inv = 1.0/sqrt(r2);
+                        S -= w*inv;
+                        D += (w*(normal*r)*inv*inv*inv)*nodes2.barycentric[b];
+                    }
+                rows_S[i].push_back(S);
+                rows_D[i].push_back(D);
+            }
+        }
+
+        near_rows.push_back(0);
+        for (unsigned i=0;i<m1.size();++i) {
+            near_triangles.insert(near_triangles.end(),rows[i].begin(),rows[i].end());
+            near_S.insert(near_S.end(),rows_S[i].begin(),rows_S[i].end());
+            near_D.insert(near_D.end(),rows_D[i].begin(),rows_D[i].end());
+            near_rows.push_back(near_triangles.size());
+        }
+    }
+
+    void FMMOperators::S(const Vector& x,Vector& y) const {
+        om_assert(x.size()==m2.size() && y.size()==m1.size());
+        Matrix X(x.size(),1);
+        Matrix Y(y.size(),1);
+        X.setcol(0,x);
+        Y.setcol(0,y);
+        S(X,Y);
+        for (unsigned i=0;i<y.size();++i)
+            y(i) = Y(i,0);
+    }
+
+    void FMMOperators::Sstar(const Vector& x,Vector& y) const {
+        om_assert(x.size()==m1.size() && y.size()==m2.size());
+        Matrix X(x.size(),1);
+        Matrix Y(y.size(),1);
+        X.setcol(0,x);
+        Y.setcol(0,y);
+        Sstar(X,Y);
+        for (unsigned i=0;i<y.size();++i)
+            y(i) = Y(i,0);
+    }
+
+    void FMMOperators::S(const Matrix& X,Matrix& Y) const {
+        om_assert(X.nlin()==m2.size() && Y.nlin()==m1.size() && X.ncol()==Y.ncol());
+        Matrix charges(nodes2.points.size(),X.ncol());
+        Matrix potentials(nodes1.points.size(),X.ncol());
+        potentials.set(0.0);
+        for (unsigned r=0;r<X.ncol();++r)
+            for (unsigned b=0;b<charges.nlin();++b)
+                charges(b,r) = nodes2.weights[b]*X(nodes2.triangles[b],r);
+        treecode.evaluate(charges,potentials);
+        for (unsigned r=0;r<X.ncol();++r) {
+            for (unsigned a=0;a<potentials.nlin();++a)
+                Y(nodes1.triangles[a],r) += nodes1.weights[a]*potentials(a,r);
+            for (unsigned i=0;i<m1.size();++i)
+                for (unsigned k=near_rows[i];k<near_rows[i+1];++k)
+                    Y(i,r) += near_S[k]*X(near_triangles[k],r);
+        }
+    }
+
+    void FMMOperators::Sstar(const Matrix& X,Matrix& Y) const {
+        om_assert(X.nlin()==m1.size() && Y.nlin()==m2.size() && X.ncol()==Y.ncol());
+        Matrix charges(nodes1.points.size(),X.ncol());
+        Matrix potentials(nodes2.points.size(),X.ncol());
+        potentials.set(0.0);
+        for (unsigned r=0;r<X.ncol();++r)
+            for (unsigned a=0;a<charges.nlin();++a)
+                charges(a,r) = nodes1.weights[a]*X(nodes1.triangles[a],r);
+        treecode_star.evaluate(charges,potentials);
+        for (unsigned r=0;r<X.ncol();++r) {
+            for (unsigned b=0;b<potentials.nlin();++b)
+                Y(nodes2.triangles[b],r) += nodes2.weights[b]*potentials(b,r);
+            for (unsigned i=0;i<m1.size();++i)
+                for (unsigned k=near_rows[i];k<near_rows[i+1];++k)
+                    Y(near_triangles[k],r) += near_S[k]*X(i,r);
+        }
+    }
+
+    void FMMOperators::D(const Vector& x,Vector& y) const {
+        om_assert(x.size()==m2.nb_vertices() && y.size()==m1.size());
+        // The kernel n.(y-x)/|x-y|^3 is the potential of the dipole -n, weighted by the P1 function at the node.
+        std::vector<Vect3>  dipoles(nodes2.points.size());
+        std::vector<double> potentials(nodes1.points.size(),0.0);
+        for (unsigned b=0;b<dipoles.size();++b) {
+            const unsigned  t = nodes2.triangles[b];
+            const unsigned* v = &nodes2.vertices[3*t];
+            const Vect3&    l = nodes2.barycentric[b];
+            dipoles[b] = (-nodes2.weights[b]*(l(0)*x(v[0])+l(1)*x(v[1])+l(2)*x(v[2])))*nodes2.normals[t];
+        }
+        treecode.evaluate(0,&dipoles[0],&potentials[0],0);
+        for (unsigned a=0;a<potentials.size();++a)
+            y(nodes1.triangles[a]) += nodes1.weights[a]*potentials[a];
+        for (unsigned i=0;i<m1.size();++i)
+            for (unsigned k=near_rows[i];k<near_rows[i+1];++k) {
+                const unsigned* v = &nodes2.vertices[3*near_triangles[k]];
+                y(i) += near_D[k](0)*x(v[0])+near_D[k](1)*x(v[1])+near_D[k](2)*x(v[2]);
+            }
+    }
+
+    void FMMOperators::Dstar(const Vector& x,Vector& y) const {
+        om_assert(x.size()==m1.size() && y.size()==m2.nb_vertices());
+        // The kernel n.(y-x)/|x-y|^3 is minus the normal derivative at y of the potential of a charge at x.
+        std::vector<double> charges(nodes1.points.size());
+        std::vector<Vect3>  gradients(nodes2.points.size(),Vect3(0.0));
+        for (unsigned a=0;a<charges.size();++a)
+            charges[a] = nodes1.weights[a]*x(nodes1.triangles[a]);
+        treecode_star.evaluate(&charges[0],0,0,&gradients[0]);
+        for (unsigned b=0;b<gradients.size();++b) {
+            const unsigned  t = nodes2.triangles[b];
+            const unsigned* v = &nodes2.vertices[3*t];
+            const Vect3&    l = nodes2.barycentric[b];
+            const double value = -nodes2.weights[b]*(nodes2.normals[t]*gradients[b]);
+            for (unsigned k=0;k<3;++k)
+                y(v[k]) += l(k)*value;
+        }
+        for (unsigned i=0;i<m1.size();++i)
+            for (unsigned k=near_rows[i];k<near_rows[i+1];++k) {
+                const unsigned* v = &nodes2.vertices[3*near_triangles[k]];
+                for (unsigned l=0;l<3;++l)
+                    y(v[l]) += near_D[k](l)*x(i);
+            }
+    }
+}
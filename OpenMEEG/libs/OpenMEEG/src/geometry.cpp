@@ -37,12 +37,281 @@ The fact that you are presently reading this means that you have had
 knowledge of the CeCILL-B license and that you accept its terms.
 */
 
+#include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <queue>
+
 #include <geometry.h>
 #include <geometry_reader.h>
 #include <geometry_io.h>
+#include <hmatrix.h>
 
 namespace OpenMEEG {
 
+    namespace {
+
+        const char*   ordering_names[] = { "file", "morton", "hilbert", "cluster" };
+        const unsigned nb_orderings    = sizeof(ordering_names)/sizeof(ordering_names[0]);
+
+        // An unknown of a block of unknowns reordered together: its index, its position (vertex or triangle center)
+        // and its group (unknowns of a group stay together, groups being in increasing order).
+
+        struct Slot {
+            Slot(unsigned& i,const Vect3& p,const unsigned g): index(&i),point(p),group(g) { }
+            unsigned* index;
+            Vect3     point;
+            unsigned  group;
+        };
+
+        typedef unsigned long long Key;
+
+        const unsigned key_bits = 21; // bits per coordinate (63 bits keys).
+
+        // Interleaves the bits of the 3 coordinates (most significant first).
+
+        Key morton_key(const unsigned X[3]) {
+            Key key = 0;
+            for (int b=key_bits-1;b>=0;--b)
+                for (unsigned i=0;i<3;++i)
+                    key = (key<<1)|((X[i]>>b)&1);
+            return key;
+        }
+
+        // Position along the Hilbert curve: the coordinates are transformed into the transposed Hilbert index
+        // (J. Skilling, Programming the Hilbert curve, AIP Conf. Proc. 707, 2004), whose bits are then interleaved.
+
+        Key hilbert_key(const unsigned coords[3]) {
+            unsigned X[3] = { coords[0], coords[1], coords[2] };
+            const unsigned M = 1U<<(key_bits-1);
+            for (unsigned Q=M;Q>1;Q>>=1) {
+                const unsigned P = Q-1;
+                for (unsigned i=0;i<3;++i)
+                    if (X[i]&Q) {
+                        X[0] ^= P;
+                    } else {
+                        const unsigned t = (X[0]^X[i])&P;
+                        X[0] ^= t;
+                        X[i] ^= t;
+                    }
+            }
+            for (unsigned i=1;i<3;++i)
+                X[i] ^= X[i-1];
+            unsigned t = 0;
+            for (unsigned Q=M;Q>1;Q>>=1)
+                if (X[2]&Q)
+                    t ^= Q-1;
+            for (unsigned i=0;i<3;++i)
+                X[i] ^= t;
+            return morton_key(X);
+        }
+
+        struct SlotLess {
+            SlotLess(const std::vector<Slot>& s,const std::vector<Key>& k): slots(s),keys(k) { }
+            bool operator()(const unsigned i,const unsigned j) const {
+                return (slots[i].group!=slots[j].group) ? slots[i].group<slots[j].group : keys[i]<keys[j];
+            }
+            const std::vector<Slot>& slots;
+            const std::vector<Key>&  keys;
+        };
+
+        // Sorts a block of unknowns, which get (in this order) the indices they had in the file ordering, and
+        // records the permutation.
+
+        void reorder(const std::vector<Slot>& slots,const UnknownOrdering ordering,std::vector<unsigned>& permutation) {
+            const unsigned n = slots.size();
+            if (n<2)
+                return;
+
+            std::vector<unsigned> order(n);
+            if (ordering==CLUSTER_ORDER) {
+                std::vector<Vect3>    points(n);
+                std::vector<unsigned> groups(n);
+                for (unsigned i=0;i<n;++i) {
+                    points[i] = slots[i].point;
+                    groups[i] = slots[i].group;
+                }
+                order = ClusterTree(points,groups,1).permutation();
+            } else {
+                // Coordinates are quantized in the bounding box of the block, with the same scale on all axes.
+                Vect3 lower = slots[0].point;
+                Vect3 upper = lower;
+                for (unsigned i=1;i<n;++i)
+                    for (unsigned k=0;k<3;++k) {
+                        lower(k) = std::min(lower(k),slots[i].point(k));
+                        upper(k) = std::max(upper(k),slots[i].point(k));
+                    }
+                const double extent = std::max(upper(0)-lower(0),std::max(upper(1)-lower(1),upper(2)-lower(2)));
+                const double scale  = (extent>0.0) ? ((1U<<key_bits)-1)/extent : 0.0;
+                std::vector<Key> keys(n);
+                for (unsigned i=0;i<n;++i) {
+                    unsigned X[3];
+                    for (unsigned k=0;k<3;++k)
+                        X[k] = static_cast<unsigned>((slots[i].point(k)-lower(k))*scale);
+                    keys[i] = (ordering==HILBERT_ORDER) ? hilbert_key(X) : morton_key(X);
+                    order[i] = i;
+                }
+                std::stable_sort(order.begin(),order.end(),SlotLess(slots,keys));
+            }
+
+            std::vector<unsigned> indices(n);
+            for (unsigned i=0;i<n;++i)
+                indices[i] = *slots[i].index;
+            std::sort(indices.begin(),indices.end());
+            std::vector<unsigned> file_indices(indices);
+            for (unsigned i=0;i<n;++i)
+                file_indices[i] = *slots[order[i]].index;
+            for (unsigned i=0;i<n;++i) {
+                *slots[order[i]].index   = indices[i];
+                permutation[indices[i]] = file_indices[i];
+            }
+        }
+    }
+
+        // Decimation of a closed triangulated surface by collapsing its shortest edges into their midpoints (or into their
+        // locked vertex, locked vertices never move). A collapse is rejected if it changes the topology (link condition),
+        // leaves a vertex of degree 3 or flips a triangle. Triangles are given by the positions of their 3 vertices.
+
+        class EdgeCollapse {
+        public:
+
+            EdgeCollapse(const std::vector<Vect3>& p,const std::vector<unsigned>& t,const std::vector<bool>& l):
+                points(p),triangles(t),removed(t.size()/3,false),alive(p.size(),true),locked(l),version(p.size(),0),incident(p.size())
+            {
+                for (unsigned k=0;k<triangles.size()/3;++k)
+                    for (unsigned c=0;c<3;++c)
+                        incident[triangles[3*k+c]].push_back(k);
+            }
+
+            void decimate(const unsigned target) {
+                for (unsigned k=0;k<triangles.size()/3;++k)
+                    for (unsigned c=0;c<3;++c)
+                        if (triangles[3*k+c]<triangles[3*k+(c+1)%3])
+                            push(triangles[3*k+c],triangles[3*k+(c+1)%3]);
+                unsigned nb_alive = points.size();
+                while (nb_alive>target && !queue.empty()) {
+                    const Edge e = queue.top();
+                    queue.pop();
+                    if (alive[e.a] && alive[e.b] && version[e.a]==e.va && version[e.b]==e.vb && collapse(e.a,e.b))
+                        --nb_alive;
+                }
+            }
+
+            std::vector<Vect3>    points;
+            std::vector<unsigned> triangles;
+            std::vector<bool>     removed;  // triangles
+            std::vector<bool>     alive;    // vertices
+
+        private:
+
+            struct Edge {
+                bool operator<(const Edge& e) const { return length>e.length; } // shortest edge on top of the queue
+                double   length;
+                unsigned a,b,va,vb;
+            };
+
+            void push(const unsigned a,const unsigned b) {
+                const Edge e = { (points[a]-points[b]).norm(), a, b, version[a], version[b] };
+                queue.push(e);
+            }
+
+            std::vector<unsigned> neighbours(const unsigned v) const {
+                std::vector<unsigned> n;
+                for (std::vector<unsigned>::const_iterator it=incident[v].begin();it!=incident[v].end();++it)
+                    for (unsigned c=0;c<3;++c)
+                        if (triangles[3*(*it)+c]!=v)
+                            n.push_back(triangles[3*(*it)+c]);
+                std::sort(n.begin(),n.end());
+                n.erase(std::unique(n.begin(),n.end()),n.end());
+                return n;
+            }
+
+            bool contains(const unsigned t,const unsigned v) const {
+                return triangles[3*t]==v || triangles[3*t+1]==v || triangles[3*t+2]==v;
+            }
+
+            bool collapse(const unsigned a,const unsigned b) {
+                if (locked[a] && locked[b])
+                    return false;
+                const unsigned s = locked[b] ? b : a; // survivor
+                const unsigned r = (s==a) ? b : a;
+                const Vect3    m = locked[s] ? points[s] : (points[a]+points[b])*0.5;
+
+                std::vector<unsigned> shared;
+                for (std::vector<unsigned>::const_iterator it=incident[a].begin();it!=incident[a].end();++it)
+                    if (contains(*it,b))
+                        shared.push_back(*it);
+                if (shared.size()!=2)
+                    return false;
+
+                const std::vector<unsigned>& na = neighbours(a);
+                const std::vector<unsigned>& nb = neighbours(b);
+                std::vector<unsigned> common;
+                std::set_intersection(na.begin(),na.end(),nb.begin(),nb.end(),std::back_inserter(common));
+                if (common.size()!=2 || neighbours(common[0]).size()<=3 || neighbours(common[1]).size()<=3)
+                    return false;
+
+                const unsigned ends[2] = { a, b };
+                for (unsigned e=0;e<2;++e)
+                    for (std::vector<unsigned>::const_iterator it=incident[ends[e]].begin();it!=incident[ends[e]].end();++it) {
+                        if (contains(*it,a) && contains(*it,b))
+                            continue;
+                        Vect3 p[3];
+                        Vect3 q[3];
+                        for (unsigned c=0;c<3;++c) {
+                            const unsigned v = triangles[3*(*it)+c];
+                            p[c] = points[v];
+                            q[c] = (v==a || v==b) ? m : points[v];
+                        }
+                        const Vect3 n0 = (p[1]-p[0])^(p[2]-p[0]);
+                        const Vect3 n1 = (q[1]-q[0])^(q[2]-q[0]);
+                        if (n0*n1<=0.2*n0.norm()*n1.norm())
+                            return false;
+                    }
+
+                for (unsigned k=0;k<2;++k) {
+                    removed[shared[k]] = true;
+                    for (unsigned c=0;c<3;++c) {
+                        std::vector<unsigned>& inc = incident[triangles[3*shared[k]+c]];
+                        inc.erase(std::find(inc.begin(),inc.end(),shared[k]));
+                    }
+                }
+                for (std::vector<unsigned>::const_iterator it=incident[r].begin();it!=incident[r].end();++it) {
+                    for (unsigned c=0;c<3;++c)
+                        if (triangles[3*(*it)+c]==r)
+                            triangles[3*(*it)+c] = s;
+                    incident[s].push_back(*it);
+                }
+                incident[r].clear();
+                alive[r]  = false;
+                points[s] = m;
+                ++version[s];
+
+                const std::vector<unsigned>& ns = neighbours(s);
+                for (std::vector<unsigned>::const_iterator it=ns.begin();it!=ns.end();++it)
+                    push(s,*it);
+                return true;
+            }
+
+            const std::vector<bool>             locked;
+            std::vector<unsigned>               version;   // incremented when a vertex moves (invalidates its queued edges)
+            std::vector<std::vector<unsigned> > incident;  // triangles of each vertex
+            std::priority_queue<Edge>           queue;
+        };
+
+    bool unknown_ordering(const std::string& name,UnknownOrdering& ordering) {
+        for (unsigned i=0;i<nb_orderings;++i)
+            if (name==ordering_names[i]) {
+                ordering = static_cast<UnknownOrdering>(i);
+                return true;
+            }
+        return false;
+    }
+
+    std::string unknown_ordering_name(const UnknownOrdering ordering) {
+        return ordering_names[ordering];
+    }
+
     const Interface& Geometry::outermost_interface() const {
         for (Domains::const_iterator dit=domain_begin();dit!=domain_end();++dit)
             if (dit->outermost())
@@ -192,14 +461,151 @@ namespace OpenMEEG {
                     }
 
             size_ = index;
+            reorder_unknowns();
         }else{
             std::cout << "vertex_begin()->index() " << vertex_begin()->index() << std::endl;
             size_ = vertices_.size();
             for (iterator mit=begin();mit!=end();++mit)
                 size_ += mit->size();
+            permutation_.resize(size_);
+            for (unsigned i=0;i<size_;++i)
+                permutation_[i] = i;
         }
     }
 
+    // Sorts the vertices (grouped by the first mesh containing them) and the triangles of each mesh according to
+    // the ordering of the geometry. Each block of unknowns keeps the set of indices of the file ordering.
+
+    void Geometry::reorder_unknowns() {
+
+        permutation_.resize(size_);
+        for (unsigned i=0;i<size_;++i)
+            permutation_[i] = i;
+
+        if (ordering_==FILE_ORDER)
+            return;
+
+        std::cout << "Ordering the unknowns (" << unknown_ordering_name(ordering_) << ")." << std::endl;
+
+        std::vector<unsigned> groups(vertices_.size(),unsigned(-1));
+        for (const_iterator mit=begin();mit!=end();++mit)
+            for (Mesh::const_vertex_iterator vit=mit->vertex_begin();vit!=mit->vertex_end();++vit) {
+                unsigned& group = groups[*vit-&vertices_[0]];
+                if (group==unsigned(-1))
+                    group = mit-begin();
+            }
+
+        std::vector<Slot> slots;
+        for (Vertices::iterator vit=vertex_begin();vit!=vertex_end();++vit)
+            if (vit->index()!=unsigned(-1))
+                slots.push_back(Slot(vit->index(),*vit,groups[vit-vertex_begin()]));
+        reorder(slots,ordering_,permutation_);
+
+        for (iterator mit=begin();mit!=end();++mit) {
+            if (mit->isolated())
+                continue;
+            slots.clear();
+            for (Mesh::iterator tit=mit->begin();tit!=mit->end();++tit)
+                slots.push_back(Slot(tit->index(),tit->center(),0));
+            reorder(slots,ordering_,permutation_);
+        }
+    }
+
+    void Geometry::save_ordering(const std::string& filename) const {
+        std::ofstream os(filename.c_str());
+        if (!os.is_open())
+            throw OpenMEEG::OpenError(filename);
+        os << "ordering " << unknown_ordering_name(ordering_) << std::endl;
+        os << "unknowns " << permutation_.size() << std::endl;
+        for (std::vector<unsigned>::const_iterator pit=permutation_.begin();pit!=permutation_.end();++pit)
+            os << *pit << std::endl;
+    }
+
+    bool Geometry::load_ordering(const std::string& filename, UnknownOrdering& ordering, std::vector<unsigned>& permutation) {
+        std::ifstream is(filename.c_str());
+        std::string   keyword, name;
+        unsigned      n;
+        if (!(is >> keyword >> name) || keyword!="ordering" || !unknown_ordering(name,ordering))
+            return false;
+        if (!(is >> keyword >> n) || keyword!="unknowns")
+            return false;
+        permutation.resize(n);
+        for (unsigned i=0;i<n;++i)
+            if (!(is >> permutation[i]))
+                return false;
+        return true;
+    }
+
+    // Each mesh is decimated separately, the vertices shared by several meshes being locked so that the meshes stay
+    // conforming. The vertices are then rebuilt from the remaining ones (which invalidates the previous pointers to
+    // them) and the unknowns are numbered again.
+
+    void Geometry::coarsen(const double ratio) {
+
+        std::vector<unsigned> nb_meshes(vertices_.size(),0);
+        for (const_iterator mit=begin();mit!=end();++mit)
+            for (Mesh::const_vertex_iterator vit=mit->vertex_begin();vit!=mit->vertex_end();++vit)
+                ++nb_meshes[*vit-&vertices_[0]];
+
+        std::vector<Vect3>    positions(vertices_.begin(),vertices_.end());
+        std::vector<bool>     used(vertices_.size(),false);
+        std::vector<std::vector<unsigned> > triangles(meshes_.size());
+        for (iterator mit=begin();mit!=end();++mit) {
+            std::vector<Vect3>    points;
+            std::vector<bool>     locked;
+            std::vector<unsigned> globals; // index in vertices_ of the vertices of the mesh
+            for (Mesh::const_vertex_iterator vit=mit->vertex_begin();vit!=mit->vertex_end();++vit) {
+                globals.push_back(*vit-&vertices_[0]);
+                points.push_back(**vit);
+                locked.push_back(nb_meshes[globals.back()]>1);
+            }
+            std::vector<unsigned> local;
+            for (Mesh::const_iterator tit=mit->begin();tit!=mit->end();++tit)
+                for (unsigned c=0;c<3;++c)
+                    local.push_back(mit->vertex_position(tit->vertex(c)));
+
+            EdgeCollapse decimation(points,local,locked);
+            decimation.decimate(std::max(static_cast<unsigned>(ratio*points.size()),12U));
+
+            std::vector<unsigned>& mesh_triangles = triangles[mit-begin()];
+            for (unsigned k=0;k<decimation.removed.size();++k)
+                if (!decimation.removed[k])
+                    for (unsigned c=0;c<3;++c)
+                        mesh_triangles.push_back(globals[decimation.triangles[3*k+c]]);
+            for (unsigned i=0;i<points.size();++i)
+                if (decimation.alive[i]) {
+                    positions[globals[i]] = decimation.points[i];
+                    used[globals[i]]      = true;
+                }
+        }
+
+        std::vector<unsigned> renumber(vertices_.size(),unsigned(-1));
+        Vertices coarse;
+        for (unsigned i=0;i<vertices_.size();++i)
+            if (used[i]) {
+                renumber[i] = coarse.size();
+                coarse.push_back(Vertex(positions[i]));
+            }
+        vertices_ = coarse;
+
+        invalid_vertices_.clear();
+        for (iterator mit=begin();mit!=end();++mit) {
+            const std::vector<unsigned>& mesh_triangles = triangles[mit-begin()];
+            mit->clear();
+            for (unsigned k=0;k<mesh_triangles.size();k+=3)
+                mit->push_back(Triangle(&vertices_[renumber[mesh_triangles[k]]],&vertices_[renumber[mesh_triangles[k+1]]],
+                                        &vertices_[renumber[mesh_triangles[k+2]]]));
+            mit->build_mesh_vertices();
+            mit->update();
+            if (mit->isolated())
+                for (Mesh::const_vertex_iterator vit=mit->vertex_begin();vit!=mit->vertex_end();++vit)
+                    invalid_vertices_.insert(**vit);
+        }
+
+        ordering_ = FILE_ORDER;
+        generate_indices(false);
+    }
+
     double Geometry::sigma(const std::string& name) const {
         for (std::vector<Domain>::const_iterator dit=domain_begin();dit!=domain_end();++dit)
             if (name == dit->name())
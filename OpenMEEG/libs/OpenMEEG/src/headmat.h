@@ -0,0 +1,140 @@
+/* OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#pragma once
+
+//  Helpers shared by the translation units assembling the HeadMat and its variants (not installed).
+
+#include <vector>
+#include <fstream>
+
+#include <geometry.h>
+#include <operators.h>
+#include <task_scheduler.h>
+
+namespace OpenMEEG {
+
+    // Outermost meshes of a group of meshes (see Geometry::geo_group), whose vertices are deflated together, with the
+    // line of the HeadMat giving the deflation coefficient and their number of vertices.
+
+    struct DeflationGroup {
+        std::vector<const Mesh*> meshes;
+        unsigned                 i_first;
+        unsigned                 nb_vertices;
+    };
+
+    std::vector<DeflationGroup> deflation_groups(const Geometry& geo);
+
+    // Coefficients of the blocks of the pair of meshes (m1,m2) in the HeadMat (false if the meshes do not interact).
+
+    bool HM_coefficients(const Geometry& geo, const Mesh& m1, const Mesh& m2, double& Scoeff, double& Dcoeff, double& Ncoeff);
+
+    template<class T>
+    void deflat(T& M, const DeflationGroup& group, const double coef)
+    {
+        for(std::vector<const Mesh*>::const_iterator mit=group.meshes.begin();mit!=group.meshes.end();++mit){
+            const Mesh& msh=**mit;
+            for(Mesh::const_vertex_iterator vit1=msh.vertex_begin();vit1!=msh.vertex_end();++vit1){
+                #pragma omp parallel for
+                #ifndef OPENMP_3_0
+                for (int i2=vit1-msh.vertex_begin();i2<msh.vertex_size();++i2) {
+                    const Mesh::const_vertex_iterator vit2 = msh.vertex_begin()+i2;
+                #else
+                for (Mesh::const_vertex_iterator vit2=vit1;vit2<msh.vertex_end();++vit2) {
+                #endif
+                    M((*vit1)->index(),(*vit2)->index()) += coef;
+                }
+            }
+        }
+    }
+
+    template<class T>
+    void deflat(T& M, const Geometry& geo)
+    {
+        //deflat all current barriers as one
+        const std::vector<DeflationGroup>& groups = deflation_groups(geo);
+        for(std::vector<DeflationGroup>::const_iterator git=groups.begin();git!=groups.end();++git)
+            deflat(M,*git,M(git->i_first,git->i_first)/git->nb_vertices);
+    }
+
+    // Schedules the blocks of the pair of meshes (m1,m2) (with m1 after m2 in the geometry) as assembled in the HeadMat.
+
+    template <typename T>
+    void schedule_HM_blocks(TaskScheduler& scheduler, const Mesh& m1, const Mesh& m2, T& mat,
+                            const double Scoeff, const double Dcoeff, const double Ncoeff, const QuadraturePolicy& quadrature)
+    {
+        if( (!m1.current_barrier()) && (!m2.current_barrier()) ) {
+            // Computing S block first because it's needed for the corresponding N block
+            schedule_operatorS(scheduler, m1, m2, mat, Scoeff, quadrature);
+        }
+        if(!m1.current_barrier()){
+            // Computing D block
+            schedule_operatorD(scheduler, m1, m2, mat, Dcoeff, quadrature, false);
+        }
+        if((&m1!=&m2) && (!m2.current_barrier())){
+            // Computing D* block
+            schedule_operatorD(scheduler, m1, m2, mat, Dcoeff, quadrature, true);
+        }
+        // Computing N block
+        schedule_operatorN(scheduler, m1, m2, mat, Ncoeff, quadrature);
+    }
+
+    // Raw binary values of the block and layout files.
+
+    template <typename T>
+    void write_values(std::ofstream& os,const T* values,const size_t n) {
+        os.write(reinterpret_cast<const char*>(values),n*sizeof(T));
+    }
+
+    template <typename T>
+    void read_values(std::ifstream& is,T* values,const size_t n) {
+        is.read(reinterpret_cast<char*>(values),n*sizeof(T));
+    }
+
+    template <typename T>
+    void write_values(std::ofstream& os,const std::vector<T>& values) {
+        if (!values.empty())
+            write_values(os,&values[0],values.size());
+    }
+
+    template <typename T>
+    void read_values(std::ifstream& is,std::vector<T>& values) {
+        if (!values.empty())
+            read_values(is,&values[0],values.size());
+    }
+}
@@ -0,0 +1,295 @@
+/* OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#if WIN32
+#define _USE_MATH_DEFINES
+#endif
+
+#include <fstream>
+#include <stdexcept>
+
+#include <matrix.h>
+#include <symmatrix.h>
+#include <geometry.h>
+#include <operators.h>
+#include <assemble.h>
+#include <GeometryExceptions.H>
+
+#include "headmat.h"
+
+namespace OpenMEEG {
+
+    namespace {
+
+        // Meshes interacting in the HeadMat.
+
+        bool interact(const Geometry& geo,const Mesh& m1,const Mesh& m2) {
+            double Scoeff,Dcoeff,Ncoeff;
+            return HM_coefficients(geo,m1,m2,Scoeff,Dcoeff,Ncoeff);
+        }
+
+        // Entries of the HeadMat given by a pair of meshes, stored in a local matrix (see HeadMatBlocks::Block).
+        // The operators are assembled in it as in the HeadMat, lines and columns being mapped to the local ones.
+        // As the HeadMat is symmetric, an entry whose line (resp. column) is not a local line (resp. column) is
+        // taken transposed.
+
+        template <typename M>
+        class LocalBlock {
+        public:
+
+            LocalBlock(M& m,const std::vector<int>& r,const std::vector<int>& c): values(m),rows(&r),cols(&c) { }
+
+            double& operator()(const size_t i,const size_t j) {
+                return ((*rows)[i]>=0 && (*cols)[j]>=0) ? values((*rows)[i],(*cols)[j]) : values((*rows)[j],(*cols)[i]);
+            }
+
+            double operator()(const size_t i,const size_t j) const {
+                return ((*rows)[i]>=0 && (*cols)[j]>=0) ? values((*rows)[i],(*cols)[j]) : values((*rows)[j],(*cols)[i]);
+            }
+
+        private:
+
+            M                       values;
+            const std::vector<int>* rows;
+            const std::vector<int>* cols;
+        };
+
+        const char     blocks_magic[8] = { 'O', 'M', 'H', 'M', 'B', 'L', 'K', 'S' };
+        const unsigned blocks_version  = 1;
+    }
+
+    HeadMatBlocks::HeadMatBlocks(const Geometry& geo, const QuadraturePolicy& quadrature):
+        dimension(geo.size()-geo.nb_current_barrier_triangles())
+    {
+        const double K = 1.0/(4.0*M_PI);
+        const unsigned nb_meshes = geo.nb_meshes();
+
+        // Unknowns of each mesh (triangles then vertices) and their local numbers.
+
+        std::vector<std::vector<unsigned> > unknowns(nb_meshes);
+        std::vector<unsigned>               nb_triangles(nb_meshes,0);
+        std::vector<std::vector<int> >      locals(nb_meshes,std::vector<int>(geo.size(),-1));
+        for (Geometry::const_iterator mit=geo.begin();mit!=geo.end();++mit) {
+            const unsigned m = mit-geo.begin();
+            const MeshInfo info = { mit->nb_vertices(), mit->nb_triangles(), mit->current_barrier(), mit->isolated() };
+            meshes.push_back(info);
+            if (mit->isolated())
+                continue;
+            if (!mit->current_barrier())
+                for (Mesh::const_iterator tit=mit->begin();tit!=mit->end();++tit)
+                    unknowns[m].push_back(tit->index());
+            nb_triangles[m] = unknowns[m].size();
+            for (Mesh::const_vertex_iterator vit=mit->vertex_begin();vit!=mit->vertex_end();++vit)
+                unknowns[m].push_back((*vit)->index());
+            for (unsigned i=0;i<unknowns[m].size();++i)
+                locals[m][unknowns[m][i]] = i;
+        }
+
+        // Blocks assembled as in assemble_HM, without the conductivities: Scoeff and the N coefficient of the current
+        // barriers are divided by sigma_inv and sigma, the N coefficient of the other meshes (sigma/sigma_inv) is 1 as
+        // the S block it reads is already divided by sigma_inv.
+
+        TaskScheduler scheduler;
+        for (Geometry::const_iterator mit1=geo.begin();mit1!=geo.end();++mit1)
+            for (Geometry::const_iterator mit2=geo.begin();mit2!=(mit1+1);++mit2) {
+                if (!interact(geo,*mit1,*mit2))
+                    continue;
+                const unsigned m1 = mit1-geo.begin();
+                const unsigned m2 = mit2-geo.begin();
+                const int orientation = geo.oriented(*mit1,*mit2);
+                const double Scoeff =   orientation*K;
+                const double Dcoeff = - orientation*geo.indicator(*mit1,*mit2)*K;
+                const double Ncoeff = (mit1->current_barrier() || mit2->current_barrier()) ? orientation*K : 1.0;
+
+                Block block;
+                block.mesh1            = m1;
+                block.mesh2            = m2;
+                block.nb_row_triangles = nb_triangles[m1];
+                block.nb_col_triangles = nb_triangles[m2];
+                block.rows             = unknowns[m1];
+                block.cols             = unknowns[m2];
+                if (m1==m2) {
+                    block.sym_values = SymMatrix(unknowns[m1].size());
+                    block.sym_values.set(0.0);
+                    SymMatrix::PackedEntries entries(block.sym_values);
+                    LocalBlock<SymMatrix::PackedEntries> local(entries,locals[m1],locals[m1]);
+                    schedule_HM_blocks(scheduler,*mit1,*mit2,local,Scoeff,Dcoeff,Ncoeff,quadrature);
+                } else {
+                    block.values = Matrix(unknowns[m1].size(),unknowns[m2].size());
+                    block.values.set(0.0);
+                    LocalBlock<Matrix> local(block.values,locals[m1],locals[m2]);
+                    schedule_HM_blocks(scheduler,*mit1,*mit2,local,Scoeff,Dcoeff,Ncoeff,quadrature);
+                }
+                blocks.push_back(block);
+            }
+        scheduler.run();
+    }
+
+    void HeadMatBlocks::check(const Geometry& geo) const {
+        bool match = (geo.nb_meshes()==meshes.size() && geo.size()-geo.nb_current_barrier_triangles()==dimension);
+        for (Geometry::const_iterator mit=geo.begin();match && mit!=geo.end();++mit) {
+            const MeshInfo& info = meshes[mit-geo.begin()];
+            match = (info.nb_vertices==mit->nb_vertices() && info.nb_triangles==mit->nb_triangles() &&
+                     info.current_barrier==mit->current_barrier() && info.isolated==mit->isolated());
+        }
+        unsigned nb_pairs = 0;
+        for (Geometry::const_iterator mit1=geo.begin();match && mit1!=geo.end();++mit1)
+            for (Geometry::const_iterator mit2=geo.begin();mit2!=(mit1+1);++mit2)
+                if (interact(geo,*mit1,*mit2))
+                    ++nb_pairs;
+        for (std::vector<Block>::const_iterator bit=blocks.begin();match && bit!=blocks.end();++bit)
+            match = interact(geo,*(geo.begin()+bit->mesh1),*(geo.begin()+bit->mesh2));
+        if (!match || nb_pairs!=blocks.size())
+            throw std::invalid_argument("HeadMatBlocks: the geometry (or its non conducting domains) differs from the one of the blocks.");
+    }
+
+    void HeadMatBlocks::assemble(const Geometry& geo, SymMatrix& mat) const {
+
+        check(geo);
+
+        mat = SymMatrix(dimension);
+        mat.set(0.0);
+
+        for (std::vector<Block>::const_iterator bit=blocks.begin();bit!=blocks.end();++bit) {
+            const Mesh& m1 = *(geo.begin()+bit->mesh1);
+            const Mesh& m2 = *(geo.begin()+bit->mesh2);
+
+            // Factors of the S (triangle,triangle), D (triangle,vertex) and N (vertex,vertex) entries.
+
+            const double sigma_inv = (m1.current_barrier() || m2.current_barrier()) ? 0.0 : geo.sigma_inv(m1,m2);
+            const double factors[2][2] = { { sigma_inv, 1.0 }, { 1.0, geo.sigma(m1,m2) } };
+
+            const std::vector<unsigned>& rows = bit->rows;
+            const std::vector<unsigned>& cols = bit->cols;
+            if (bit->mesh1==bit->mesh2) {
+                for (unsigned j=0;j<cols.size();++j)
+                    for (unsigned i=0;i<=j;++i)
+                        mat(rows[i],cols[j]) += factors[i>=bit->nb_row_triangles][j>=bit->nb_col_triangles]*bit->sym_values(i,j);
+            } else {
+                for (unsigned j=0;j<cols.size();++j)
+                    for (unsigned i=0;i<rows.size();++i)
+                        mat(rows[i],cols[j]) += factors[i>=bit->nb_row_triangles][j>=bit->nb_col_triangles]*bit->values(i,j);
+            }
+        }
+
+        // Deflate all current barriers as one
+
+        deflat(mat,geo);
+    }
+
+    void HeadMatBlocks::save(const std::string& filename) const {
+        std::ofstream os(filename.c_str(),std::ios::binary);
+        if (!os.is_open())
+            throw OpenMEEG::OpenError(filename);
+
+        const unsigned header[3] = { blocks_version, dimension, static_cast<unsigned>(meshes.size()) };
+        write_values(os,blocks_magic,8);
+        write_values(os,header,3);
+        for (std::vector<MeshInfo>::const_iterator mit=meshes.begin();mit!=meshes.end();++mit) {
+            const unsigned info[4] = { mit->nb_vertices, mit->nb_triangles, mit->current_barrier, mit->isolated };
+            write_values(os,info,4);
+        }
+
+        const unsigned nb = blocks.size();
+        write_values(os,&nb,1);
+        for (std::vector<Block>::const_iterator bit=blocks.begin();bit!=blocks.end();++bit) {
+            const unsigned info[6] = { bit->mesh1, bit->mesh2, bit->nb_row_triangles, bit->nb_col_triangles,
+                                       static_cast<unsigned>(bit->rows.size()), static_cast<unsigned>(bit->cols.size()) };
+            write_values(os,info,6);
+            write_values(os,bit->rows);
+            write_values(os,bit->cols);
+            if (bit->mesh1==bit->mesh2) {
+                write_values(os,bit->sym_values.data(),bit->sym_values.size());
+            } else {
+                write_values(os,bit->values.data(),bit->values.size());
+            }
+        }
+        if (!os)
+            throw std::runtime_error("HeadMatBlocks: error while writing "+filename+".");
+    }
+
+    void HeadMatBlocks::load(const std::string& filename) {
+        std::ifstream is(filename.c_str(),std::ios::binary);
+        if (!is.is_open())
+            throw OpenMEEG::OpenError(filename);
+
+        char     magic[8];
+        unsigned header[3];
+        read_values(is,magic,8);
+        read_values(is,header,3);
+        if (!is || !std::equal(magic,magic+8,blocks_magic) || header[0]!=blocks_version)
+            throw OpenMEEG::WrongFileFormat(filename);
+
+        dimension = header[1];
+        meshes.resize(header[2]);
+        for (std::vector<MeshInfo>::iterator mit=meshes.begin();mit!=meshes.end();++mit) {
+            unsigned info[4];
+            read_values(is,info,4);
+            mit->nb_vertices     = info[0];
+            mit->nb_triangles    = info[1];
+            mit->current_barrier = info[2];
+            mit->isolated        = info[3];
+        }
+
+        unsigned nb = 0;
+        read_values(is,&nb,1);
+        blocks.clear();
+        blocks.resize(nb);
+        for (std::vector<Block>::iterator bit=blocks.begin();is && bit!=blocks.end();++bit) {
+            unsigned info[6];
+            read_values(is,info,6);
+            bit->mesh1            = info[0];
+            bit->mesh2            = info[1];
+            bit->nb_row_triangles = info[2];
+            bit->nb_col_triangles = info[3];
+            bit->rows.resize(info[4]);
+            bit->cols.resize(info[5]);
+            read_values(is,bit->rows);
+            read_values(is,bit->cols);
+            if (bit->mesh1==bit->mesh2) {
+                bit->sym_values = SymMatrix(bit->rows.size());
+                read_values(is,bit->sym_values.data(),bit->sym_values.size());
+            } else {
+                bit->values = Matrix(bit->rows.size(),bit->cols.size());
+                read_values(is,bit->values.data(),bit->values.size());
+            }
+        }
+        if (!is)
+            throw OpenMEEG::WrongFileFormat(filename);
+    }
+}
@@ -0,0 +1,443 @@
+/* OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#if WIN32
+#define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+#include <map>
+#include <algorithm>
+
+#include <matrix.h>
+#include <geometry.h>
+#include <operators.h>
+#include <analytics.h>
+#include <triangle_cache.h>
+
+#include "headmat_entries.h"
+
+namespace OpenMEEG {
+
+    namespace {
+
+        // Order of the triangles of a list: by mesh, then by decreasing position in the mesh.
+
+        struct MeshThenDecreasingPosition {
+            MeshThenDecreasingPosition(const std::vector<unsigned>& m,const std::vector<unsigned>& p): meshes(m),positions(p) { }
+            bool operator()(const unsigned i,const unsigned j) const {
+                return (meshes[i]!=meshes[j]) ? meshes[i]<meshes[j] : positions[i]>positions[j];
+            }
+            const std::vector<unsigned>& meshes;
+            const std::vector<unsigned>& positions;
+        };
+    }
+
+    HeadMatEntries::HeadMatEntries(const Geometry& g,const QuadraturePolicy& q):
+        geo(g),quadrature(q),nb_meshes(g.nb_meshes()),unknowns(g.size()-g.nb_current_barrier_triangles()),
+        vertex_meshes(unknowns.size()),interactions(nb_meshes*nb_meshes,false),coeffs(nb_meshes,3*nb_meshes)
+    {
+        const double K = 1.0/(4.0*M_PI);
+
+        coeffs.set(0.0);
+        for (unsigned m1=0;m1<nb_meshes;++m1)
+            for (unsigned m2=0;m2<nb_meshes;++m2) {
+                const Mesh& mesh1 = mesh(m1);
+                const Mesh& mesh2 = mesh(m2);
+                if (mesh1.isolated() || mesh2.isolated() || geo.sigma(mesh1,mesh2)==0.0)
+                    continue;
+                const int orientation = geo.oriented(mesh1,mesh2);
+                if (orientation==0)
+                    continue;
+                interactions[m1*nb_meshes+m2] = true;
+                Scoeff(m1,m2) =   orientation*geo.sigma_inv(mesh1,mesh2)*K;
+                Dcoeff(m1,m2) = - orientation*geo.indicator(mesh1,mesh2)*K;
+                Ncoeff(m1,m2) = (!mesh1.current_barrier() && !mesh2.current_barrier()) ?
+                                geo.sigma(mesh1,mesh2)/geo.sigma_inv(mesh1,mesh2) : orientation*geo.sigma(mesh1,mesh2)*K;
+            }
+
+        for (Vertices::const_iterator vit=geo.vertex_begin();vit!=geo.vertex_end();++vit)
+            if (vit->index()<unknowns.size())
+                unknowns[vit->index()].vertex = &*vit;
+
+        for (unsigned m=0;m<nb_meshes;++m) {
+            const Mesh& msh = mesh(m);
+            for (Mesh::const_vertex_iterator vit=msh.vertex_begin();vit!=msh.vertex_end();++vit)
+                if ((*vit)->index()<unknowns.size())
+                    vertex_meshes[(*vit)->index()].push_back(m);
+            if (!msh.isolated() && !msh.current_barrier())
+                for (Mesh::const_iterator tit=msh.begin();tit!=msh.end();++tit) {
+                    Unknown& u = unknowns[tit->index()];
+                    u.mesh     = m;
+                    u.position = tit-msh.begin();
+                }
+        }
+
+        // Same deflation coefficients as deflat(mat,geo), each one depending on the previous deflations.
+
+        for (std::vector<std::vector<std::string> >::const_iterator git=geo.geo_group().begin();git!=geo.geo_group().end();++git) {
+            unsigned nb_vertices = 0;
+            unsigned i_first     = 0;
+            std::vector<unsigned> meshes;
+            for (std::vector<std::string>::const_iterator mit=git->begin();mit!=git->end();++mit) {
+                const Mesh& msh = geo.mesh(*mit);
+                if (msh.outermost()) {
+                    nb_vertices += msh.nb_vertices();
+                    // deflat works on copies of the meshes, whose vertices are rebuilt in the order of
+                    // their triangles: its coefficient is read on the first vertex of the first triangle.
+                    if (i_first==0)
+                        i_first = msh.front().s1().index();
+                    meshes.push_back(&msh-&*geo.begin());
+                }
+            }
+            if (meshes.empty())
+                continue;
+            const std::vector<unsigned> first(1,i_first);
+            Matrix value(1,1);
+            block(first,first,value);
+            deflated_meshes.push_back(meshes);
+            deflation_coeffs.push_back(value(0,0)/nb_vertices);
+        }
+    }
+
+    ClusterTree HeadMatEntries::cluster_tree() const {
+        // Triangles come first: the N block alone is singular for inner meshes (constant potentials), whereas
+        // the S block is positive definite. Eliminating the triangles first makes the LU factorization without
+        // pivoting stable (the Schur complement on the vertices is definite).
+        const unsigned vertex_group = 1U << (8*sizeof(unsigned)-1);
+        std::vector<Vect3>    points(unknowns.size());
+        std::vector<unsigned> groups(unknowns.size());
+        for (unsigned i=0;i<unknowns.size();++i) {
+            const Unknown& u = unknowns[i];
+            if (u.vertex) {
+                points[i] = *u.vertex;
+                groups[i] = vertex_group | ((vertex_meshes[i].empty()) ? 0 : vertex_meshes[i].front());
+            } else {
+                points[i] = (mesh(u.mesh).begin()+u.position)->center();
+                groups[i] = u.mesh;
+            }
+        }
+        return ClusterTree(points,groups);
+    }
+
+    void HeadMatEntries::deflate(const Vector& x,Vector& y) const {
+        for (unsigned g=0;g<deflated_meshes.size();++g)
+            for (std::vector<unsigned>::const_iterator mit=deflated_meshes[g].begin();mit!=deflated_meshes[g].end();++mit) {
+                const Mesh& msh = mesh(*mit);
+                double sum = 0.0;
+                for (Mesh::const_vertex_iterator vit=msh.vertex_begin();vit!=msh.vertex_end();++vit)
+                    sum += x((*vit)->index());
+                for (Mesh::const_vertex_iterator vit=msh.vertex_begin();vit!=msh.vertex_end();++vit)
+                    y((*vit)->index()) += deflation_coeffs[g]*sum;
+            }
+    }
+
+    void HeadMatEntries::adjacency(const std::vector<unsigned>& vertices,Adjacency& adj) const {
+        std::map<std::pair<unsigned,unsigned>,unsigned> numbers;
+        adj.links.resize(vertices.size());
+        for (unsigned i=0;i<vertices.size();++i) {
+            const Vertex& V = *unknowns[vertices[i]].vertex;
+            for (std::vector<unsigned>::const_iterator mit=vertex_meshes[vertices[i]].begin();mit!=vertex_meshes[vertices[i]].end();++mit) {
+                const Mesh& msh = mesh(*mit);
+                const Mesh::Positions triangles = msh.vertex_triangles(msh.vertex_position(V));
+                for (Mesh::Positions::const_iterator pit=triangles.begin();pit!=triangles.end();++pit) {
+                    const Triangle& T = *(msh.begin()+*pit);
+                    const std::pair<unsigned,unsigned> key(*mit,*pit);
+                    std::map<std::pair<unsigned,unsigned>,unsigned>::const_iterator it = numbers.find(key);
+                    if (it==numbers.end()) {
+                        it = numbers.insert(std::make_pair(key,adj.size())).first;
+                        adj.add(key.first,key.second);
+                    }
+                    Adjacency::Link link;
+                    link.mesh     = *mit;
+                    link.triangle = it->second;
+                    link.vertex   = 0;
+                    while (&T(link.vertex)!=&V)
+                        ++link.vertex;
+                    link.edge     = T.next(V)-T.prev(V);
+                    adj.links[i].push_back(link);
+                }
+            }
+        }
+    }
+
+    double HeadMatEntries::S(const unsigned m1,const unsigned i1,const unsigned m2,const unsigned i2,const KernelContext& context) const {
+        // Diagonal blocks are computed in their upper part, the other ones with the triangles of the last mesh first.
+        const bool swap = (m1==m2) ? (i1>i2) : (m1<m2);
+        return (swap) ? _operatorS(mesh(m2),i2,mesh(m1),i1,context) : _operatorS(mesh(m1),i1,mesh(m2),i2,context);
+    }
+
+    HeadMatEntries::Nodes::Nodes(const HeadMatEntries& entries,const Triangles& triangles,const unsigned gauss_order):
+        order(triangles.size()),positions(triangles.size()),offsets(1,0)
+    {
+        for (unsigned i=0;i<order.size();++i)
+            order[i] = i;
+        std::sort(order.begin(),order.end(),MeshThenDecreasingPosition(triangles.meshes,triangles.positions));
+
+        const unsigned n = TriangleCache::nb_points(gauss_order);
+        for (unsigned i=0;i<order.size();++i) {
+            const unsigned m = triangles.meshes[order[i]];
+            const unsigned p = triangles.positions[order[i]];
+            positions[i] = p;
+            if (segments.empty() || segments.back().mesh!=m) {
+                Segment seg;
+                seg.mesh  = m;
+                seg.begin = i;
+                segments.push_back(seg);
+            }
+            segments.back().end = i+1;
+            const TriangleCache& cache = entries.mesh(m).cache();
+            x.insert(x.end(),cache.x(gauss_order)+p*n,cache.x(gauss_order)+(p+1)*n);
+            y.insert(y.end(),cache.y(gauss_order)+p*n,cache.y(gauss_order)+(p+1)*n);
+            z.insert(z.end(),cache.z(gauss_order)+p*n,cache.z(gauss_order)+(p+1)*n);
+            w.insert(w.end(),cache.weights(gauss_order)+p*n,cache.weights(gauss_order)+(p+1)*n);
+            offsets.push_back(x.size());
+        }
+    }
+
+    void HeadMatEntries::integrals(const unsigned m,const unsigned p,const Nodes& nodes,const bool strict,double* results,const unsigned stride) const {
+        const analyticS& analyS = mesh(m).cache().analyS(p);
+        std::vector<double> values;
+        for (std::vector<Nodes::Segment>::const_iterator sit=nodes.segments.begin();sit!=nodes.segments.end();++sit) {
+            if (sit->mesh>m || !interact(m,sit->mesh))
+                continue;
+            const unsigned end   = (sit->mesh==m) ? nodes.end(*sit,p,strict) : sit->end;
+            const unsigned first = nodes.offsets[sit->begin];
+            const unsigned npts  = nodes.offsets[end]-first;
+            if (npts==0)
+                continue;
+            values.resize(npts);
+            analyS.f(npts,&nodes.x[first],&nodes.y[first],&nodes.z[first],&values[0]);
+            for (unsigned t=sit->begin,i=0;t<end;++t) {
+                double result = 0;
+                for (const unsigned e=nodes.offsets[t+1]-first;i<e;++i)
+                    multadd(result,nodes.w[first+i],values[i]);
+                results[static_cast<size_t>(stride)*nodes.order[t]] = result;
+            }
+        }
+    }
+
+    void HeadMatEntries::integrals(const Triangles& T1,const Triangles& T2,Matrix& values,const KernelContext& context) const {
+        values.set(0.0);
+        if (!batched(context)) {
+            for (unsigned j=0;j<T2.size();++j)
+                for (unsigned i=0;i<T1.size();++i)
+                    if (interact(T1.meshes[i],T2.meshes[j]))
+                        values(i,j) = S(T1.meshes[i],T1.positions[i],T2.meshes[j],T2.positions[j],context);
+            return;
+        }
+
+        // As in S, each integral is computed with the kernel of the triangle of the last mesh (or of the smallest
+        // position in the same mesh), on the nodes of the other one: the kernel of each triangle of T1 (resp. T2)
+        // is evaluated at once on the nodes of the triangles of T2 (resp. T1) which come before it in this order.
+
+        const Nodes nodes1(*this,T1,context.gauss_order);
+        const Nodes nodes2(*this,T2,context.gauss_order);
+        for (unsigned i=0;i<T1.size();++i)
+            integrals(T1.meshes[i],T1.positions[i],nodes2,false,&values(i,0),values.nlin());
+        for (unsigned j=0;j<T2.size();++j)
+            integrals(T2.meshes[j],T2.positions[j],nodes1,true,&values(0,j),1);
+    }
+
+    void HeadMatEntries::blockS(const std::vector<unsigned>& rows,const std::vector<unsigned>& cols,Matrix& values,const KernelContext& context) const {
+        Triangles T1,T2;
+        for (unsigned i=0;i<rows.size();++i)
+            T1.add(unknowns[rows[i]].mesh,unknowns[rows[i]].position);
+        for (unsigned j=0;j<cols.size();++j)
+            T2.add(unknowns[cols[j]].mesh,unknowns[cols[j]].position);
+        integrals(T1,T2,values,context);
+        for (unsigned j=0;j<cols.size();++j)
+            for (unsigned i=0;i<rows.size();++i)
+                values(i,j) *= Scoeff(T1.meshes[i],T2.meshes[j]);
+    }
+
+    void HeadMatEntries::blockD(const std::vector<unsigned>& triangles,const std::vector<unsigned>& vertices,Matrix& values,KernelContext& context) const {
+        // As in the optimized D operator, the integrals of a pair of triangles give the contributions to the 3
+        // vertices of the second one.
+        Adjacency adj;
+        adjacency(vertices,adj);
+    #ifndef OPTIMIZED_OPERATOR_D
+        for (unsigned i=0;i<triangles.size();++i) {
+            const Unknown& ut = unknowns[triangles[i]];
+            for (unsigned j=0;j<vertices.size();++j) {
+                const Vertex& V = *unknowns[vertices[j]].vertex;
+                double value = 0.0;
+                for (std::vector<unsigned>::const_iterator mit=vertex_meshes[vertices[j]].begin();mit!=vertex_meshes[vertices[j]].end();++mit)
+                    if (interact(ut.mesh,*mit))
+                        value += Dcoeff(ut.mesh,*mit)*_operatorD(mesh(ut.mesh),ut.position,V,mesh(*mit),context);
+                values(i,j) = value;
+            }
+        }
+    #else
+        // D[k*nt+i]: integral on triangle i of the kernel of the k-th adjacent triangle.
+
+        Triangles T;
+        for (unsigned i=0;i<triangles.size();++i)
+            T.add(unknowns[triangles[i]].mesh,unknowns[triangles[i]].position);
+        const unsigned nt = T.size();
+        std::vector<Vect3> D(static_cast<size_t>(nt)*adj.size(),Vect3(0.0));
+        if (batched(context)) {
+            const Nodes nodes(*this,T,context.gauss_order);
+            std::vector<double> kernel;
+            for (unsigned k=0;k<adj.size();++k) {
+                const analyticD3& analyD = mesh(adj.meshes[k]).cache().analyD3(adj.positions[k]);
+                for (std::vector<Nodes::Segment>::const_iterator sit=nodes.segments.begin();sit!=nodes.segments.end();++sit) {
+                    if (!interact(sit->mesh,adj.meshes[k]))
+                        continue;
+                    const unsigned first = nodes.offsets[sit->begin];
+                    const unsigned npts  = nodes.offsets[sit->end]-first;
+                    kernel.resize(3*npts);
+                    analyD.f(npts,&nodes.x[first],&nodes.y[first],&nodes.z[first],&kernel[0],&kernel[npts],&kernel[2*npts]);
+                    for (unsigned t=sit->begin,i=0;t<sit->end;++t) {
+                        Vect3 result = 0;
+                        for (const unsigned e=nodes.offsets[t+1]-first;i<e;++i)
+                            multadd(result,nodes.w[first+i],Vect3(kernel[i],kernel[npts+i],kernel[2*npts+i]));
+                        D[static_cast<size_t>(k)*nt+nodes.order[t]] = result;
+                    }
+                }
+            }
+        } else {
+            for (unsigned k=0;k<adj.size();++k)
+                for (unsigned i=0;i<nt;++i)
+                    if (interact(T.meshes[i],adj.meshes[k]))
+                        D[static_cast<size_t>(k)*nt+i] = _operatorD(mesh(T.meshes[i]),T.positions[i],mesh(adj.meshes[k]),adj.positions[k],context);
+        }
+        for (unsigned j=0;j<vertices.size();++j)
+            for (unsigned i=0;i<nt;++i) {
+                double value = 0.0;
+                for (std::vector<Adjacency::Link>::const_iterator lit=adj.links[j].begin();lit!=adj.links[j].end();++lit)
+                    value += Dcoeff(T.meshes[i],lit->mesh)*D[static_cast<size_t>(lit->triangle)*nt+i](lit->vertex);
+                values(i,j) = value;
+            }
+    #endif
+    }
+
+    void HeadMatEntries::blockN(const std::vector<unsigned>& rows,const std::vector<unsigned>& cols,Matrix& values,const KernelContext& context) const {
+        Adjacency adj1,adj2;
+        adjacency(rows,adj1);
+        adjacency(cols,adj2);
+
+        // Operator S of the pairs of adjacent triangles, divided by their areas, as read by _operatorN: the HeadMat
+        // entries or, when a current barrier is involved, S itself.
+
+        Matrix Iqr(adj1.size(),adj2.size());
+        integrals(adj1,adj2,Iqr,context);
+        for (unsigned b=0;b<adj2.size();++b) {
+            const unsigned mb = adj2.meshes[b];
+            const double   ab = (mesh(mb).begin()+adj2.positions[b])->area();
+            for (unsigned a=0;a<adj1.size();++a) {
+                const unsigned ma    = adj1.meshes[a];
+                const double   aa    = (mesh(ma).begin()+adj1.positions[a])->area();
+                const double   coeff = (mesh(ma).current_barrier() || mesh(mb).current_barrier()) ? 1.0 : Scoeff(ma,mb);
+                Iqr(a,b) *= coeff/(aa*ab);
+            }
+        }
+
+        // Same sum as _operatorN, for all the pairs of meshes containing the vertices. Pairs of meshes are assembled
+        // once (with the last mesh first), so that for a vertex shared by two meshes, the diagonal entry only gets
+        // the contribution of one ordering.
+
+        typedef std::vector<Adjacency::Link> Links;
+        for (unsigned j=0;j<cols.size();++j)
+            for (unsigned i=0;i<rows.size();++i) {
+                const bool same = (rows[i]==cols[j]);
+                double value = 0.0;
+                for (Links::const_iterator lit1=adj1.links[i].begin();lit1!=adj1.links[i].end();++lit1)
+                    for (Links::const_iterator lit2=adj2.links[j].begin();lit2!=adj2.links[j].end();++lit2) {
+                        const unsigned m1 = lit1->mesh;
+                        const unsigned m2 = lit2->mesh;
+                        if (!interact(m1,m2) || (same && m1<m2))
+                            continue;
+                        const double factor = (m1!=m2 && same) ? 0.5 : 0.25;
+                        value -= Ncoeff(m1,m2)*factor*(lit1->edge*lit2->edge)*Iqr(lit1->triangle,lit2->triangle);
+                    }
+                for (unsigned g=0;g<deflated_meshes.size();++g)
+                    for (std::vector<unsigned>::const_iterator mit=deflated_meshes[g].begin();mit!=deflated_meshes[g].end();++mit)
+                        if (contains(*mit,rows[i]) && contains(*mit,cols[j]))
+                            value += deflation_coeffs[g];
+                values(i,j) = value;
+            }
+    }
+
+    void HeadMatEntries::block(const std::vector<unsigned>& rows,const std::vector<unsigned>& cols,Matrix& values) const {
+        // Rows and columns are split into vertices and triangles (the clusters of the H-matrix do not mix them).
+        std::vector<unsigned> rv,rt,cv,ct;
+        std::vector<unsigned> irv,irt,icv,ict;
+        for (unsigned i=0;i<rows.size();++i) {
+            std::vector<unsigned>& r = (unknowns[rows[i]].vertex) ? rv : rt;
+            r.push_back(rows[i]);
+            ((unknowns[rows[i]].vertex) ? irv : irt).push_back(i);
+        }
+        for (unsigned j=0;j<cols.size();++j) {
+            std::vector<unsigned>& c = (unknowns[cols[j]].vertex) ? cv : ct;
+            c.push_back(cols[j]);
+            ((unknowns[cols[j]].vertex) ? icv : ict).push_back(j);
+        }
+
+        KernelContext context(quadrature);
+
+        if (!rt.empty() && !ct.empty()) {
+            Matrix v(rt.size(),ct.size());
+            blockS(rt,ct,v,context);
+            for (unsigned j=0;j<ct.size();++j)
+                for (unsigned i=0;i<rt.size();++i)
+                    values(irt[i],ict[j]) = v(i,j);
+        }
+        if (!rt.empty() && !cv.empty()) {
+            Matrix v(rt.size(),cv.size());
+            blockD(rt,cv,v,context);
+            for (unsigned j=0;j<cv.size();++j)
+                for (unsigned i=0;i<rt.size();++i)
+                    values(irt[i],icv[j]) = v(i,j);
+        }
+        if (!rv.empty() && !ct.empty()) {
+            Matrix v(ct.size(),rv.size());
+            blockD(ct,rv,v,context);
+            for (unsigned j=0;j<ct.size();++j)
+                for (unsigned i=0;i<rv.size();++i)
+                    values(irv[i],ict[j]) = v(j,i);
+        }
+        if (!rv.empty() && !cv.empty()) {
+            Matrix v(rv.size(),cv.size());
+            blockN(rv,cv,v,context);
+            for (unsigned j=0;j<cv.size();++j)
+                for (unsigned i=0;i<rv.size();++i)
+                    values(irv[i],icv[j]) = v(i,j);
+        }
+    }
+}
@@ -0,0 +1,198 @@
+/* OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include <matrix.h>
+#include <geometry.h>
+#include <operators.h>
+#include <hmatrix.h>
+
+namespace OpenMEEG {
+
+    // Entries of the HeadMat computed on demand, for its compression as an H-matrix. They are the ones assembled by
+    // assemble_HM (same mesh pairs, coefficients, orientation of the quadratures and deflation), so that the
+    // H-matrix only differs from the dense HeadMat by the compression error.
+    // The integrals are computed block by block, so that the S (resp. D) integrals of a pair of triangles are
+    // shared by the N (resp. D) entries of the vertices of these triangles.
+
+    class HeadMatEntries: public HMatrixEntries {
+    public:
+
+        HeadMatEntries(const Geometry& geo,const QuadraturePolicy& quadrature);
+
+        void block(const std::vector<unsigned>& rows,const std::vector<unsigned>& cols,Matrix& values) const;
+
+        bool symmetric() const { return true; }
+
+        /// Clusters of the unknowns, the triangles and the vertices of each mesh being separate groups.
+
+        ClusterTree cluster_tree() const;
+
+        /// Coefficients of the blocks of two meshes (designated by their position in the geometry).
+
+        bool   interact(const unsigned m1,const unsigned m2) const { return interactions[m1*nb_meshes+m2]; }
+        double Scoeff(const unsigned m1,const unsigned m2)   const { return coeffs(m1,3*m2);   }
+        double Dcoeff(const unsigned m1,const unsigned m2)   const { return coeffs(m1,3*m2+1); }
+        double Ncoeff(const unsigned m1,const unsigned m2)   const { return coeffs(m1,3*m2+2); }
+
+        /// y += (deflation of the outermost meshes) x.
+
+        void deflate(const Vector& x,Vector& y) const;
+
+    private:
+
+        // An unknown is either a vertex, or the triangle of a mesh at a given position.
+
+        struct Unknown {
+            Unknown(): vertex(0),mesh(0),position(0) { }
+            const Vertex* vertex;
+            unsigned      mesh;
+            unsigned      position;
+        };
+
+        // A list of triangles, designated by their mesh and their position in this mesh.
+
+        struct Triangles {
+            unsigned size() const { return meshes.size(); }
+            void add(const unsigned mesh,const unsigned position) {
+                meshes.push_back(mesh);
+                positions.push_back(position);
+            }
+
+            std::vector<unsigned> meshes;
+            std::vector<unsigned> positions;
+        };
+
+        // Triangles adjacent to a set of vertices (in all the meshes containing them), numbered locally.
+
+        struct Adjacency: public Triangles {
+            struct Link {
+                unsigned mesh;      // mesh of the triangle
+                unsigned triangle;  // local number of the triangle
+                unsigned vertex;    // position of the vertex in the triangle
+                Vect3    edge;      // opposite edge (as used by the N operator)
+            };
+
+            std::vector<std::vector<Link> > links;      // links of each vertex of the set
+        };
+
+        // Quadrature nodes of a list of triangles sorted by mesh, gathered so that the kernel of a triangle is
+        // evaluated at once on all of them (batched kernels, as in TriangleCache::integrate). The triangles of
+        // each mesh are sorted by decreasing position, so that the ones integrated with the kernel of a triangle
+        // of the same mesh (see S) come first.
+
+        struct Nodes {
+            struct Segment {
+                unsigned mesh;
+                unsigned begin,end;  // triangles of the mesh in the sorted list
+            };
+
+            Nodes(const HeadMatEntries& entries,const Triangles& triangles,const unsigned gauss_order);
+
+            // End of the triangles of a segment whose position is at least (or greater than if strict) p.
+
+            unsigned end(const Segment& seg,const unsigned p,const bool strict) const {
+                const std::vector<unsigned>::const_iterator first = positions.begin()+seg.begin;
+                const std::vector<unsigned>::const_iterator last  = positions.begin()+seg.end;
+                return ((strict) ? std::lower_bound(first,last,p,std::greater<unsigned>()) :
+                                   std::upper_bound(first,last,p,std::greater<unsigned>()))-positions.begin();
+            }
+
+            std::vector<unsigned> order;      // sorted triangle -> triangle of the list
+            std::vector<unsigned> positions;  // positions of the sorted triangles
+            std::vector<Segment>  segments;
+            std::vector<unsigned> offsets;    // nodes of the i-th sorted triangle: [offsets[i],offsets[i+1][
+            std::vector<double>   x,y,z,w;
+        };
+
+        bool batched(const KernelContext& context) const {
+        #ifdef ADAPT_LHS
+            return false;
+        #else
+            return context.quadrature.type()==QuadraturePolicy::FIXED;
+        #endif
+        }
+
+        const Mesh& mesh(const unsigned m) const { return *(geo.begin()+m); }
+
+        double& Scoeff(const unsigned m1,const unsigned m2) { return coeffs(m1,3*m2);   }
+        double& Dcoeff(const unsigned m1,const unsigned m2) { return coeffs(m1,3*m2+1); }
+        double& Ncoeff(const unsigned m1,const unsigned m2) { return coeffs(m1,3*m2+2); }
+
+        bool contains(const unsigned m,const unsigned v) const {
+            return std::find(vertex_meshes[v].begin(),vertex_meshes[v].end(),m)!=vertex_meshes[v].end();
+        }
+
+        void adjacency(const std::vector<unsigned>& vertices,Adjacency& adj) const;
+
+        // S integral of the triangles i1 of m1 and i2 of m2, oriented as in the assembly of the HeadMat.
+
+        double S(const unsigned m1,const unsigned i1,const unsigned m2,const unsigned i2,const KernelContext& context) const;
+
+        // S integrals of the pairs of triangles of two lists, 0 for the meshes which do not interact.
+
+        void integrals(const Triangles& T1,const Triangles& T2,Matrix& values,const KernelContext& context) const;
+
+        // S integrals of triangle p of mesh m with the sorted triangles of nodes which come before it in the order
+        // of S (strictly or not), stored in results[stride*i] for the i-th triangle of the list.
+
+        void integrals(const unsigned m,const unsigned p,const Nodes& nodes,const bool strict,double* results,const unsigned stride) const;
+
+        void blockS(const std::vector<unsigned>& rows,const std::vector<unsigned>& cols,Matrix& values,const KernelContext& context) const;
+        void blockD(const std::vector<unsigned>& triangles,const std::vector<unsigned>& vertices,Matrix& values,KernelContext& context) const;
+        void blockN(const std::vector<unsigned>& rows,const std::vector<unsigned>& cols,Matrix& values,const KernelContext& context) const;
+
+        const Geometry&                     geo;
+        const QuadraturePolicy              quadrature;
+        const unsigned                      nb_meshes;
+        std::vector<Unknown>                unknowns;
+        std::vector<std::vector<unsigned> > vertex_meshes;  // meshes containing each vertex (indexed by unknown)
+        std::vector<bool>                   interactions;
+        Matrix                              coeffs;
+
+        // Deflation of the outermost meshes of each group of the geometry.
+
+        std::vector<std::vector<unsigned> > deflated_meshes;
+        std::vector<double>                 deflation_coeffs;
+    };
+}
@@ -0,0 +1,356 @@
+/* OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <map>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include <matrix.h>
+#include <symmatrix.h>
+#include <geometry.h>
+#include <operators.h>
+#include <assemble.h>
+#include <GeometryExceptions.H>
+
+#include "headmat.h"
+
+namespace OpenMEEG {
+
+    namespace {
+
+        // FNV-1a hash of the vertices of a mesh (in its order) and of its triangles (as positions of their vertices).
+
+        class MeshHash {
+        public:
+
+            MeshHash(): value(14695981039346656037ULL) { }
+
+            template <typename T>
+            void add(const T& data) {
+                const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&data);
+                for (unsigned i=0;i<sizeof(T);++i) {
+                    value ^= bytes[i];
+                    value *= 1099511628211ULL;
+                }
+            }
+
+            unsigned long long value;
+        };
+
+        unsigned long long mesh_hash(const Mesh& m) {
+            MeshHash hash;
+            std::map<const Vertex*,unsigned> positions;
+            for (Mesh::const_vertex_iterator vit=m.vertex_begin();vit!=m.vertex_end();++vit) {
+                positions[*vit] = vit-m.vertex_begin();
+                hash.add((*vit)->x());
+                hash.add((*vit)->y());
+                hash.add((*vit)->z());
+            }
+            for (Mesh::const_iterator tit=m.begin();tit!=m.end();++tit)
+                for (unsigned k=0;k<3;++k)
+                    hash.add(positions[&tit->vertex(k)]);
+            return hash.value;
+        }
+
+        const char     layout_magic[8] = { 'O', 'M', 'H', 'M', 'L', 'A', 'Y', 'T' };
+        const unsigned layout_version  = 1;
+    }
+
+    HeadMatLayout::HeadMatLayout(const Geometry& geo, const SymMatrix& HM) {
+
+        describe(geo);
+        if (HM.nlin()!=dimension)
+            throw std::invalid_argument("HeadMatLayout: the HeadMat does not match the geometry.");
+
+        // The first diagonal entry of a group received its deflation coefficient once per mesh containing its vertex.
+
+        const std::vector<DeflationGroup>& groups = deflation_groups(geo);
+        for (std::vector<DeflationGroup>::const_iterator git=groups.begin();git!=groups.end();++git) {
+            if (git->meshes.empty())
+                continue;
+            Deflation deflation;
+            unsigned nb_first = 0;
+            for (std::vector<const Mesh*>::const_iterator mit=git->meshes.begin();mit!=git->meshes.end();++mit) {
+                deflation.meshes.push_back(*mit-&*geo.begin());
+                for (Mesh::const_vertex_iterator vit=(*mit)->vertex_begin();vit!=(*mit)->vertex_end();++vit)
+                    if ((*vit)->index()==git->i_first) {
+                        ++nb_first;
+                        break;
+                    }
+            }
+            deflation.coef = HM(git->i_first,git->i_first)/(git->nb_vertices+nb_first);
+            deflations.push_back(deflation);
+        }
+    }
+
+    void HeadMatLayout::describe(const Geometry& geo) {
+
+        dimension = geo.size()-geo.nb_current_barrier_triangles();
+        meshes.clear();
+        deflations.clear();
+        for (Geometry::const_iterator mit=geo.begin();mit!=geo.end();++mit) {
+            MeshInfo info;
+            info.name            = mit->name();
+            info.hash            = mesh_hash(*mit);
+            info.current_barrier = mit->current_barrier();
+            info.isolated        = mit->isolated();
+            if (!mit->isolated()) {
+                if (!mit->current_barrier())
+                    for (Mesh::const_iterator tit=mit->begin();tit!=mit->end();++tit)
+                        info.triangles.push_back(tit->index());
+                for (Mesh::const_vertex_iterator vit=mit->vertex_begin();vit!=mit->vertex_end();++vit)
+                    info.vertices.push_back((*vit)->index());
+            }
+            meshes.push_back(info);
+        }
+
+        const unsigned nb = meshes.size();
+        coefficients.assign(4*nb*nb,0.0);
+        for (Geometry::const_iterator mit1=geo.begin();mit1!=geo.end();++mit1)
+            for (Geometry::const_iterator mit2=geo.begin();mit2!=(mit1+1);++mit2) {
+                const unsigned m1 = mit1-geo.begin();
+                const unsigned m2 = mit2-geo.begin();
+                double* c = &coefficients[4*(m1*nb+m2)];
+                if (HM_coefficients(geo,*mit1,*mit2,c[1],c[2],c[3]))
+                    c[0] = 1.0;
+                std::copy(c,c+4,&coefficients[4*(m2*nb+m1)]);
+            }
+    }
+
+    void HeadMatLayout::assemble(const Geometry& geo, const SymMatrix& previous, SymMatrix& mat, const QuadraturePolicy& quadrature) const {
+
+        if (previous.nlin()!=dimension)
+            throw std::invalid_argument("HeadMatLayout: the previous HeadMat does not match the layout.");
+
+        HeadMatLayout current;
+        current.describe(geo);
+        const unsigned nb     = current.meshes.size();
+        const unsigned nb_old = meshes.size();
+
+        // Previous mesh of each mesh (matched by name) and modified meshes.
+
+        std::vector<int>  old(nb,-1);
+        std::vector<bool> kept(nb_old,false);
+        std::vector<bool> modified(nb,true);
+        for (unsigned i=0;i<nb;++i)
+            for (unsigned k=0;k<nb_old;++k)
+                if (!kept[k] && meshes[k].name==current.meshes[i].name) {
+                    const MeshInfo& m  = current.meshes[i];
+                    const MeshInfo& m0 = meshes[k];
+                    old[i]      = k;
+                    kept[k]     = true;
+                    modified[i] = m.hash!=m0.hash || m.current_barrier!=m0.current_barrier || m.isolated!=m0.isolated ||
+                                  m.triangles.size()!=m0.triangles.size() || m.vertices.size()!=m0.vertices.size();
+                    break;
+                }
+
+        // Pairs of meshes whose coefficients (conductivities, orientations) changed.
+
+        for (unsigned i=0;i<nb;++i)
+            for (unsigned j=0;j<=i;++j)
+                if (old[i]>=0 && old[j]>=0) {
+                    const double* c  = &current.coefficients[4*(i*nb+j)];
+                    const double* c0 = &coefficients[4*(old[i]*nb_old+old[j])];
+                    if (!std::equal(c,c+4,c0))
+                        modified[i] = modified[j] = true;
+                }
+
+        // Entries of shared vertices gather the contributions of all the meshes containing them: meshes sharing
+        // vertices with a modified (or removed) mesh, in the new or in the previous geometry, are modified.
+
+        for (bool changed=true;changed;) {
+            changed = false;
+            std::vector<bool> touched(current.dimension,false);
+            std::vector<bool> touched_old(dimension,false);
+            for (unsigned i=0;i<nb;++i)
+                if (modified[i]) {
+                    for (unsigned v=0;v<current.meshes[i].vertices.size();++v)
+                        touched[current.meshes[i].vertices[v]] = true;
+                    if (old[i]>=0)
+                        for (unsigned v=0;v<meshes[old[i]].vertices.size();++v)
+                            touched_old[meshes[old[i]].vertices[v]] = true;
+                }
+            for (unsigned k=0;k<nb_old;++k)
+                if (!kept[k])
+                    for (unsigned v=0;v<meshes[k].vertices.size();++v)
+                        touched_old[meshes[k].vertices[v]] = true;
+            for (unsigned i=0;i<nb;++i)
+                if (!modified[i]) {
+                    const std::vector<unsigned>& vertices     = current.meshes[i].vertices;
+                    const std::vector<unsigned>& old_vertices = meshes[old[i]].vertices;
+                    for (unsigned v=0;!modified[i] && v<vertices.size();++v)
+                        modified[i] = touched[vertices[v]] || touched_old[old_vertices[v]];
+                    changed = changed || modified[i];
+                }
+        }
+
+        // Entries between the unknowns of unmodified meshes are copied to their new indices.
+
+        std::vector<int> renumber(dimension,-1);
+        for (unsigned i=0;i<nb;++i)
+            if (!modified[i]) {
+                const MeshInfo& m  = current.meshes[i];
+                const MeshInfo& m0 = meshes[old[i]];
+                for (unsigned t=0;t<m.triangles.size();++t)
+                    renumber[m0.triangles[t]] = m.triangles[t];
+                for (unsigned v=0;v<m.vertices.size();++v)
+                    renumber[m0.vertices[v]] = m.vertices[v];
+            }
+
+        std::vector<unsigned> from;
+        std::vector<unsigned> to;
+        for (unsigned k=0;k<dimension;++k)
+            if (renumber[k]>=0) {
+                from.push_back(k);
+                to.push_back(renumber[k]);
+            }
+
+        mat = SymMatrix(current.dimension);
+        mat.set(0.0);
+        for (unsigned j=0;j<from.size();++j)
+            for (unsigned i=0;i<=j;++i)
+                mat(to[i],to[j]) = previous(from[i],from[j]);
+
+        // Remove the previous deflation from the copied entries.
+
+        for (std::vector<Deflation>::const_iterator dit=deflations.begin();dit!=deflations.end();++dit)
+            for (std::vector<unsigned>::const_iterator mit=dit->meshes.begin();mit!=dit->meshes.end();++mit) {
+                const std::vector<unsigned>& vertices = meshes[*mit].vertices;
+                if (vertices.empty() || renumber[vertices[0]]<0)
+                    continue;
+                for (unsigned v1=0;v1<vertices.size();++v1)
+                    for (unsigned v2=v1;v2<vertices.size();++v2)
+                        mat(renumber[vertices[v1]],renumber[vertices[v2]]) -= dit->coef;
+            }
+
+        // Blocks of the pairs of meshes involving a modified mesh are assembled as in assemble_HM.
+
+        TaskScheduler scheduler;
+        for (Geometry::const_iterator mit1=geo.begin();mit1!=geo.end();++mit1)
+            for (Geometry::const_iterator mit2=geo.begin();mit2!=(mit1+1);++mit2) {
+                double Scoeff, Dcoeff, Ncoeff;
+                if ((modified[mit1-geo.begin()] || modified[mit2-geo.begin()]) &&
+                    HM_coefficients(geo,*mit1,*mit2,Scoeff,Dcoeff,Ncoeff))
+                    schedule_HM_blocks(scheduler,*mit1,*mit2,mat,Scoeff,Dcoeff,Ncoeff,quadrature);
+            }
+        scheduler.run();
+
+        deflat(mat,geo);
+    }
+
+    void HeadMatLayout::save(const std::string& filename) const {
+        std::ofstream os(filename.c_str(),std::ios::binary);
+        if (!os.is_open())
+            throw OpenMEEG::OpenError(filename);
+
+        const unsigned header[3] = { layout_version, dimension, static_cast<unsigned>(meshes.size()) };
+        write_values(os,layout_magic,8);
+        write_values(os,header,3);
+        for (std::vector<MeshInfo>::const_iterator mit=meshes.begin();mit!=meshes.end();++mit) {
+            const unsigned info[5] = { static_cast<unsigned>(mit->name.size()), mit->current_barrier, mit->isolated,
+                                       static_cast<unsigned>(mit->triangles.size()), static_cast<unsigned>(mit->vertices.size()) };
+            write_values(os,info,5);
+            write_values(os,mit->name.data(),mit->name.size());
+            write_values(os,&mit->hash,1);
+            write_values(os,mit->triangles);
+            write_values(os,mit->vertices);
+        }
+        write_values(os,coefficients);
+
+        const unsigned nb = deflations.size();
+        write_values(os,&nb,1);
+        for (std::vector<Deflation>::const_iterator dit=deflations.begin();dit!=deflations.end();++dit) {
+            const unsigned nb_meshes = dit->meshes.size();
+            write_values(os,&nb_meshes,1);
+            write_values(os,dit->meshes);
+            write_values(os,&dit->coef,1);
+        }
+        if (!os)
+            throw std::runtime_error("HeadMatLayout: error while writing "+filename+".");
+    }
+
+    void HeadMatLayout::load(const std::string& filename) {
+        std::ifstream is(filename.c_str(),std::ios::binary);
+        if (!is.is_open())
+            throw OpenMEEG::OpenError(filename);
+
+        char     magic[8];
+        unsigned header[3];
+        read_values(is,magic,8);
+        read_values(is,header,3);
+        if (!is || !std::equal(magic,magic+8,layout_magic) || header[0]!=layout_version)
+            throw OpenMEEG::WrongFileFormat(filename);
+
+        dimension = header[1];
+        meshes.clear();
+        meshes.resize(header[2]);
+        for (std::vector<MeshInfo>::iterator mit=meshes.begin();is && mit!=meshes.end();++mit) {
+            unsigned info[5];
+            read_values(is,info,5);
+            if (!is)
+                break;
+            std::vector<char> name(info[0]);
+            read_values(is,name);
+            mit->name.assign(name.begin(),name.end());
+            read_values(is,&mit->hash,1);
+            mit->current_barrier = info[1];
+            mit->isolated        = info[2];
+            mit->triangles.resize(info[3]);
+            mit->vertices.resize(info[4]);
+            read_values(is,mit->triangles);
+            read_values(is,mit->vertices);
+        }
+        coefficients.resize(4*meshes.size()*meshes.size());
+        read_values(is,coefficients);
+
+        unsigned nb = 0;
+        read_values(is,&nb,1);
+        deflations.clear();
+        deflations.resize(is ? nb : 0);
+        for (std::vector<Deflation>::iterator dit=deflations.begin();is && dit!=deflations.end();++dit) {
+            unsigned nb_meshes = 0;
+            read_values(is,&nb_meshes,1);
+            dit->meshes.resize(is ? nb_meshes : 0);
+            read_values(is,dit->meshes);
+            read_values(is,&dit->coef,1);
+        }
+        if (!is)
+            throw OpenMEEG::WrongFileFormat(filename);
+    }
+}
@@ -0,0 +1,248 @@
+/* OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#if WIN32
+#define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+#include <map>
+#include <iostream>
+
+#include <matrix.h>
+#include <geometry.h>
+#include <assemble.h>
+#include <fmm.h>
+
+#include "headmat_entries.h"
+
+namespace OpenMEEG {
+
+    // Meshes are designated by their position in the geometry. The fast operators of an ordered pair of interacting
+    // meshes (m1,m2) give the D block of the triangles of m1 and the vertices of m2 (and its transpose). For m1>=m2, they
+    // also give the S block as oriented in assemble_HM (and its transpose), which is reused for the N blocks.
+
+    struct HeadMatOperator::Implementation {
+
+        Implementation(const Geometry& g,const FMMParameters& parameters,const QuadraturePolicy& quadrature);
+        ~Implementation();
+
+        void product(const Vector& x,Vector& y) const;
+
+        // y += coeff*sum_c C_c^T G(:,first+c), C_c giving the curls (component c) of the P1 functions of mesh m on its triangles.
+
+        void add_curls(const unsigned m,const double coeff,const Matrix& G,const unsigned first,Vector& y) const;
+
+        const Geometry&                     geo;
+        const unsigned                      nb_meshes;
+        const HeadMatEntries                entries;
+        std::vector<FMMOperators*>          operators;   // nb_meshes x nb_meshes (null if not needed)
+        std::vector<std::vector<unsigned> > triangles;   // indices of the triangles of each mesh (in the HeadMat)
+        std::vector<std::vector<unsigned> > vertices;    // indices of the vertices of each mesh (in the HeadMat)
+        std::vector<std::vector<unsigned> > corners;     // positions in the mesh of the vertices of each triangle
+        std::vector<std::vector<Vect3> >    curls;       // (next-prev)/area for each vertex of each triangle
+    };
+
+    HeadMatOperator::Implementation::Implementation(const Geometry& g,const FMMParameters& parameters,const QuadraturePolicy& quadrature):
+        geo(g),nb_meshes(g.nb_meshes()),entries(g,quadrature),operators(nb_meshes*nb_meshes,static_cast<FMMOperators*>(0)),
+        triangles(nb_meshes),vertices(nb_meshes),corners(nb_meshes),curls(nb_meshes)
+    {
+        for (unsigned m=0;m<nb_meshes;++m) {
+            const Mesh& msh = *(geo.begin()+m);
+            if (msh.isolated())
+                continue;
+            std::map<const Vertex*,unsigned> positions;
+            for (Mesh::const_vertex_iterator vit=msh.vertex_begin();vit!=msh.vertex_end();++vit) {
+                positions[*vit] = vertices[m].size();
+                vertices[m].push_back((*vit)->index());
+            }
+            for (Mesh::const_iterator tit=msh.begin();tit!=msh.end();++tit) {
+                if (!msh.current_barrier())
+                    triangles[m].push_back(tit->index());
+                for (unsigned k=0;k<3;++k) {
+                    corners[m].push_back(positions[&(*tit)(k)]);
+                    curls[m].push_back(((*tit)((k+1)%3)-(*tit)((k+2)%3))/tit->area());
+                }
+            }
+        }
+
+        for (unsigned m1=0;m1<nb_meshes;++m1)
+            for (unsigned m2=0;m2<nb_meshes;++m2)
+                if (entries.interact(m1,m2) && (m1>=m2 || !(geo.begin()+m1)->current_barrier()))
+                    operators[m1*nb_meshes+m2] = new FMMOperators(*(geo.begin()+m1),*(geo.begin()+m2),parameters,quadrature);
+    }
+
+    HeadMatOperator::Implementation::~Implementation() {
+        for (std::vector<FMMOperators*>::iterator oit=operators.begin();oit!=operators.end();++oit)
+            delete *oit;
+    }
+
+    void HeadMatOperator::Implementation::add_curls(const unsigned m,const double coeff,const Matrix& G,const unsigned first,Vector& y) const {
+        for (unsigned t=0;t<G.nlin();++t)
+            for (unsigned k=0;k<3;++k) {
+                const Vect3& curl = curls[m][3*t+k];
+                y(corners[m][3*t+k]) += coeff*(curl(0)*G(t,first)+curl(1)*G(t,first+1)+curl(2)*G(t,first+2));
+            }
+    }
+
+    void HeadMatOperator::Implementation::product(const Vector& x,Vector& y) const {
+
+        // Restrictions of x to the triangles and the vertices of each mesh, and curls of the P1 functions.
+
+        std::vector<Vector> xt(nb_meshes),xv(nb_meshes),yt(nb_meshes),yv(nb_meshes);
+        std::vector<Matrix> F(nb_meshes);
+        for (unsigned m=0;m<nb_meshes;++m) {
+            xt[m] = Vector(triangles[m].size());
+            yt[m] = Vector(triangles[m].size());
+            xv[m] = Vector(vertices[m].size());
+            yv[m] = Vector(vertices[m].size());
+            for (unsigned i=0;i<triangles[m].size();++i) {
+                xt[m](i) = x(triangles[m][i]);
+                yt[m](i) = 0.0;
+            }
+            for (unsigned i=0;i<vertices[m].size();++i) {
+                xv[m](i) = x(vertices[m][i]);
+                yv[m](i) = 0.0;
+            }
+            F[m] = Matrix(corners[m].size()/3,3);
+            for (unsigned t=0;t<F[m].nlin();++t) {
+                Vect3 f(0.0);
+                for (unsigned k=0;k<3;++k)
+                    f += xv[m](corners[m][3*t+k])*curls[m][3*t+k];
+                for (unsigned c=0;c<3;++c)
+                    F[m](t,c) = f(c);
+            }
+        }
+
+        // S and N blocks (and their transposes), as in assemble_HM and _operatorN. For a vertex shared by two meshes,
+        // the N term of the pair (m1,m2) and of its transpose each give one half of its assembled value.
+        // The three curl components (and the S block) are products by the same operator, computed at once.
+
+        for (unsigned m1=0;m1<nb_meshes;++m1)
+            for (unsigned m2=0;m2<=m1;++m2) {
+                if (!entries.interact(m1,m2))
+                    continue;
+                const FMMOperators& op = *operators[m1*nb_meshes+m2];
+                const bool barrier = (geo.begin()+m1)->current_barrier() || (geo.begin()+m2)->current_barrier();
+                const double Scoeff = entries.Scoeff(m1,m2);
+                const double Ncoeff = -0.25*entries.Ncoeff(m1,m2)*((barrier) ? 1.0 : Scoeff);
+                const unsigned first = (barrier) ? 0 : 1;
+                const unsigned ncols = first+3;
+
+                for (unsigned pass=0;pass<((m1!=m2) ? 2 : 1);++pass) {
+                    const unsigned mx = (pass==0) ? m2 : m1;
+                    const unsigned my = (pass==0) ? m1 : m2;
+                    Matrix X(F[mx].nlin(),ncols);
+                    Matrix Y(F[my].nlin(),ncols);
+                    Y.set(0.0);
+                    for (unsigned t=0;t<X.nlin();++t) {
+                        if (!barrier)
+                            X(t,0) = Scoeff*xt[mx](t);
+                        for (unsigned c=0;c<3;++c)
+                            X(t,first+c) = F[mx](t,c);
+                    }
+                    if (pass==0) {
+                        op.S(X,Y);
+                    } else {
+                        op.Sstar(X,Y);
+                    }
+                    if (!barrier)
+                        for (unsigned t=0;t<Y.nlin();++t)
+                            yt[my](t) += Y(t,0);
+                    add_curls(my,Ncoeff,Y,first,yv[my]);
+                }
+            }
+
+        // D blocks (and their transposes).
+
+        for (unsigned mt=0;mt<nb_meshes;++mt)
+            for (unsigned mv=0;mv<nb_meshes;++mv) {
+                if (!entries.interact(mt,mv) || (geo.begin()+mt)->current_barrier())
+                    continue;
+                const FMMOperators& op = *operators[mt*nb_meshes+mv];
+                const double Dcoeff = entries.Dcoeff(mt,mv);
+                op.D(xv[mv]*Dcoeff,yt[mt]);
+                op.Dstar(xt[mt]*Dcoeff,yv[mv]);
+            }
+
+        for (unsigned m=0;m<nb_meshes;++m) {
+            for (unsigned i=0;i<triangles[m].size();++i)
+                y(triangles[m][i]) += yt[m](i);
+            for (unsigned i=0;i<vertices[m].size();++i)
+                y(vertices[m][i]) += yv[m](i);
+        }
+
+        entries.deflate(x,y);
+    }
+
+    HeadMatOperator::HeadMatOperator(const Geometry& geo, const FMMParameters& parameters, const QuadraturePolicy& quadrature):
+        LinOp(geo.size()-geo.nb_current_barrier_triangles(),geo.size()-geo.nb_current_barrier_triangles(),FULL,2),
+        impl(new Implementation(geo,parameters,quadrature))
+    { }
+
+    HeadMatOperator::~HeadMatOperator() { delete impl; }
+
+    Vector HeadMatOperator::operator*(const Vector& x) const {
+        om_assert(x.size()==ncol());
+        Vector y(nlin());
+        y.set(0.0);
+        impl->product(x,y);
+        return y;
+    }
+
+    double HeadMatOperator::operator()(const size_t i,const size_t j) const {
+        const std::vector<unsigned> rows(1,i);
+        const std::vector<unsigned> cols(1,j);
+        Matrix value(1,1);
+        impl->entries.block(rows,cols,value);
+        return value(0,0);
+    }
+
+    void HeadMatOperator::info() const {
+        unsigned nb_operators = 0;
+        unsigned nb_near_pairs = 0;
+        for (std::vector<FMMOperators*>::const_iterator oit=impl->operators.begin();oit!=impl->operators.end();++oit)
+            if (*oit) {
+                ++nb_operators;
+                nb_near_pairs += (*oit)->nb_near_pairs();
+            }
+        std::cout << "Matrix-free HeadMat" << std::endl;
+        std::cout << "Dimensions : " << nlin() << " x " << ncol() << std::endl;
+        std::cout << "Pairs of meshes : " << nb_operators << " (" << nb_near_pairs << " near pairs of triangles)" << std::endl;
+    }
+}
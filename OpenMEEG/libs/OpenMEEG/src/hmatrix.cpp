@@ -0,0 +1,1096 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+#include <hmatrix.h>
+#include <gmres.h>
+#include <task_scheduler.h>
+
+namespace OpenMEEG {
+
+    // =================
+    // = Cluster trees =
+    // =================
+
+    namespace {
+
+        struct GroupBelow {
+            GroupBelow(const std::vector<unsigned>& g,const unsigned v): groups(g),value(v) { }
+            bool operator()(const unsigned i) const { return groups[i]<value; }
+            const std::vector<unsigned>& groups;
+            const unsigned               value;
+        };
+
+        struct CoordinateLess {
+            CoordinateLess(const std::vector<Vect3>& p,const unsigned a): points(p),axis(a) { }
+            bool operator()(const unsigned i,const unsigned j) const { return points[i](axis)<points[j](axis); }
+            const std::vector<Vect3>& points;
+            const unsigned            axis;
+        };
+
+        // Eigenvectors of a symmetric 3x3 matrix C (Jacobi rotations), returned as the columns of V.
+
+        void eigenvectors(double C[3][3],double V[3][3]) {
+            for (unsigned i=0;i<3;++i)
+                for (unsigned j=0;j<3;++j)
+                    V[i][j] = (i==j) ? 1.0 : 0.0;
+            for (unsigned sweep=0;sweep<32;++sweep) {
+                const double off  = C[0][1]*C[0][1]+C[0][2]*C[0][2]+C[1][2]*C[1][2];
+                const double diag = C[0][0]*C[0][0]+C[1][1]*C[1][1]+C[2][2]*C[2][2];
+                if (off<=1e-30*diag || off==0.0)
+                    return;
+                for (unsigned p=0;p<2;++p)
+                    for (unsigned q=p+1;q<3;++q) {
+                        if (C[p][q]==0.0)
+                            continue;
+                        const double theta = 0.5*(C[q][q]-C[p][p])/C[p][q];
+                        const double t     = ((theta>=0.0) ? 1.0 : -1.0)/(std::abs(theta)+sqrt(theta*theta+1.0));
+                        const double c     = 1.0/sqrt(t*t+1.0);
+                        const double s     = t*c;
+                        for (unsigned k=0;k<3;++k) {
+                            const double ckp = C[k][p];
+                            const double ckq = C[k][q];
+                            C[k][p] = c*ckp-s*ckq;
+                            C[k][q] = s*ckp+c*ckq;
+                        }
+                        for (unsigned k=0;k<3;++k) {
+                            const double cpk = C[p][k];
+                            const double cqk = C[q][k];
+                            C[p][k] = c*cpk-s*cqk;
+                            C[q][k] = s*cpk+c*cqk;
+                        }
+                        for (unsigned k=0;k<3;++k) {
+                            const double vkp = V[k][p];
+                            const double vkq = V[k][q];
+                            V[k][p] = c*vkp-s*vkq;
+                            V[k][q] = s*vkp+c*vkq;
+                        }
+                    }
+            }
+        }
+
+        // Half width of the projection of the principal box of a cluster on an axis.
+
+        double half_width(const ClusterTree::Cluster& c,const Vect3& axis) {
+            double w = 0.0;
+            for (unsigned k=0;k<3;++k)
+                w += c.half_extents(k)*std::abs(c.axes[k]*axis);
+            return w;
+        }
+    }
+
+    ClusterTree::ClusterTree(const std::vector<Vect3>& points,const std::vector<unsigned>& groups,const unsigned leaf_size):
+        permutation_(points.size())
+    {
+        for (unsigned i=0;i<permutation_.size();++i)
+            permutation_[i] = i;
+        if (!points.empty())
+            build(points,groups,0,points.size(),std::max(leaf_size,1U));
+    }
+
+    unsigned ClusterTree::build(const std::vector<Vect3>& points,const std::vector<unsigned>& groups,const unsigned begin,const unsigned end,const unsigned leaf_size) {
+
+        const unsigned id = clusters_.size();
+        clusters_.push_back(Cluster());
+
+        Cluster cluster;
+        cluster.begin   = begin;
+        cluster.end     = end;
+        cluster.sons[0] = cluster.sons[1] = -1;
+        cluster.lower   = cluster.upper = points[permutation_[begin]];
+        for (unsigned i=begin+1;i<end;++i) {
+            const Vect3& p = points[permutation_[i]];
+            for (unsigned k=0;k<3;++k) {
+                cluster.lower(k) = std::min(cluster.lower(k),p(k));
+                cluster.upper(k) = std::max(cluster.upper(k),p(k));
+            }
+        }
+
+        // Principal box: axes of the covariance of the positions.
+
+        Vect3 mean(0.0);
+        for (unsigned i=begin;i<end;++i)
+            mean = mean+points[permutation_[i]];
+        mean = mean/(end-begin);
+        double C[3][3] = { { 0.0,0.0,0.0 },{ 0.0,0.0,0.0 },{ 0.0,0.0,0.0 } };
+        for (unsigned i=begin;i<end;++i) {
+            const Vect3 d = points[permutation_[i]]-mean;
+            for (unsigned k=0;k<3;++k)
+                for (unsigned l=0;l<3;++l)
+                    C[k][l] += d(k)*d(l);
+        }
+        double V[3][3];
+        eigenvectors(C,V);
+        cluster.center = Vect3(0.0);
+        for (unsigned k=0;k<3;++k) {
+            cluster.axes[k] = Vect3(V[0][k],V[1][k],V[2][k]);
+            double pmin = points[permutation_[begin]]*cluster.axes[k];
+            double pmax = pmin;
+            for (unsigned i=begin+1;i<end;++i) {
+                const double proj = points[permutation_[i]]*cluster.axes[k];
+                pmin = std::min(pmin,proj);
+                pmax = std::max(pmax,proj);
+            }
+            cluster.center = cluster.center+0.5*(pmin+pmax)*cluster.axes[k];
+            cluster.half_extents(k) = 0.5*(pmax-pmin);
+        }
+
+        if (end-begin>leaf_size) {
+            std::vector<unsigned>::iterator first = permutation_.begin()+begin;
+            std::vector<unsigned>::iterator last  = permutation_.begin()+end;
+
+            unsigned gmin = groups[*first];
+            unsigned gmax = gmin;
+            for (std::vector<unsigned>::const_iterator it=first;it!=last;++it) {
+                gmin = std::min(gmin,groups[*it]);
+                gmax = std::max(gmax,groups[*it]);
+            }
+
+            unsigned middle;
+            if (gmin!=gmax) {
+                // Groups are never mixed. They are separated according to the first bit (most significant first)
+                // which differs between their labels, so that labels can encode a hierarchy of groups.
+                unsigned bit = 1U << (8*sizeof(unsigned)-1);
+                while (((gmin^gmax)&bit)==0)
+                    bit >>= 1;
+                middle = std::partition(first,last,GroupBelow(groups,gmax&~(bit-1)))-permutation_.begin();
+            } else {
+                const Vect3 extent = cluster.upper-cluster.lower;
+                const unsigned axis = (extent(0)>=extent(1)) ? ((extent(0)>=extent(2)) ? 0 : 2) : ((extent(1)>=extent(2)) ? 1 : 2);
+                middle = (begin+end)/2;
+                std::nth_element(first,permutation_.begin()+middle,last,CoordinateLess(points,axis));
+            }
+            cluster.sons[0] = build(points,groups,begin,middle,leaf_size);
+            cluster.sons[1] = build(points,groups,middle,end,leaf_size);
+        }
+
+        clusters_[id] = cluster;
+        return id;
+    }
+
+    double ClusterTree::distance(const Cluster& c1,const Cluster& c2) {
+        double d2 = 0.0;
+        for (unsigned k=0;k<3;++k) {
+            const double gap = std::max(0.0,std::max(c1.lower(k)-c2.upper(k),c2.lower(k)-c1.upper(k)));
+            d2 += gap*gap;
+        }
+        double dist = sqrt(d2);
+
+        // Separating axes: the principal axes of both clusters and the line of their centers.
+
+        const Vect3 delta  = c2.center-c1.center;
+        const double norm  = delta.norm();
+        for (unsigned k=0;k<7;++k) {
+            const Vect3  axis = (k<3) ? c1.axes[k] : (k<6) ? c2.axes[k-3] : delta/((norm>0.0) ? norm : 1.0);
+            dist = std::max(dist,std::abs(delta*axis)-half_width(c1,axis)-half_width(c2,axis));
+        }
+        return dist;
+    }
+
+    // ==============
+    // = H-matrices =
+    // ==============
+
+    /// A block of the H-matrix: the rows [row_begin,row_begin+nrows[ and columns [col_begin,col_begin+ncols[ of the
+    /// tree ordering. Low rank blocks are stored as U*V^T, hierarchical ones have 4 sons (sons[2*i+j] for the i-th
+    /// son of the row cluster and the j-th son of the column cluster).
+
+    struct HMatrix::Block {
+
+        typedef enum { DENSE, LOW_RANK, HIERARCHICAL } Type;
+
+        Block(const ClusterTree::Cluster& t,const ClusterTree::Cluster& s,const Type tp):
+            row_begin(t.begin),nrows(t.size()),col_begin(s.begin),ncols(s.size()),type(tp)
+        {
+            std::fill(sons,sons+4,static_cast<Block*>(0));
+        }
+
+        Block(const Block& b):
+            row_begin(b.row_begin),nrows(b.nrows),col_begin(b.col_begin),ncols(b.ncols),type(b.type)
+        {
+            std::fill(sons,sons+4,static_cast<Block*>(0));
+            if (type==DENSE)
+                dense = Matrix(b.dense,DEEP_COPY);
+            if (type==LOW_RANK) {
+                U = Matrix(b.U,DEEP_COPY);
+                V = Matrix(b.V,DEEP_COPY);
+            }
+            if (type==HIERARCHICAL)
+                for (unsigned k=0;k<4;++k)
+                    sons[k] = new Block(*b.sons[k]);
+        }
+
+        ~Block() {
+            for (unsigned k=0;k<4;++k)
+                delete sons[k];
+        }
+
+        unsigned rank() const { return U.ncol(); }
+
+        size_t size() const {
+            switch (type) {
+                case DENSE:    return static_cast<size_t>(nrows)*ncols;
+                case LOW_RANK: return static_cast<size_t>(rank())*(nrows+ncols);
+                default: {
+                    size_t sz = 0;
+                    for (unsigned k=0;k<4;++k)
+                        sz += sons[k]->size();
+                    return sz;
+                }
+            }
+        }
+
+        unsigned row_begin,nrows;
+        unsigned col_begin,ncols;
+        Type     type;
+        Matrix   dense;     // entries of a dense block, or pending updates of a low rank one (see flush)
+        Matrix   U,V;
+        Block*   sons[4];
+
+    private:
+
+        Block& operator=(const Block&);
+    };
+
+    namespace {
+
+        typedef HMatrix::Block Block;
+
+        // Column major view on (a part of) a dense matrix.
+
+        struct View {
+            View(double* d,const unsigned m,const unsigned n,const unsigned l): data(d),nlin(m),ncol(n),ld(l) { }
+            View(const Matrix& M): data(M.data()),nlin(M.nlin()),ncol(M.ncol()),ld(M.nlin()) { }
+
+            View rows(const unsigned i,const unsigned n) const { return View(data+i,n,ncol,ld); }
+
+            double& operator()(const unsigned i,const unsigned j) const { return data[i+static_cast<size_t>(j)*ld]; }
+
+            double*  data;
+            unsigned nlin,ncol,ld;
+        };
+
+        // C += alpha*op(A)*op(B), op(A) being of size m x k and op(B) of size k x n.
+
+        void gemm(const bool ta,const bool tb,const unsigned m,const unsigned n,const unsigned k,const double alpha,
+                  const View& A,const View& B,const View& C)
+        {
+            if (m==0 || n==0 || k==0)
+                return;
+        #ifdef HAVE_BLAS
+            DGEMM((ta) ? CblasTrans : CblasNoTrans,(tb) ? CblasTrans : CblasNoTrans,
+                  m,n,k,alpha,A.data,A.ld,B.data,B.ld,1.0,C.data,C.ld);
+        #else
+            for (unsigned j=0;j<n;++j)
+                for (unsigned l=0;l<k;++l) {
+                    const double b = alpha*((tb) ? B(j,l) : B(l,j));
+                    for (unsigned i=0;i<m;++i)
+                        C(i,j) += ((ta) ? A(l,i) : A(i,l))*b;
+                }
+        #endif
+        }
+
+        Matrix zeros(const unsigned m,const unsigned n) {
+            Matrix M(m,n);
+            M.set(0.0);
+            return M;
+        }
+
+        Matrix transpose(const View& A) {
+            Matrix T(A.ncol,A.nlin);
+            for (unsigned j=0;j<A.ncol;++j)
+                for (unsigned i=0;i<A.nlin;++i)
+                    T(j,i) = A(i,j);
+            return T;
+        }
+
+        // Concatenation [A B] of two matrices with the same number of lines.
+
+        Matrix concatenate(const View& A,const View& B) {
+            Matrix C(A.nlin,A.ncol+B.ncol);
+            for (unsigned j=0;j<A.ncol;++j)
+                std::copy(&A(0,j),&A(0,j)+A.nlin,&C(0,j));
+            for (unsigned j=0;j<B.ncol;++j)
+                std::copy(&B(0,j),&B(0,j)+B.nlin,&C(0,A.ncol+j));
+            return C;
+        }
+
+        // Recompression of a low rank matrix U*V^T: singular values below epsilon times the largest one are dropped.
+        // The SVD is the one of the product of the R factors of the QR factorizations of U and V or, when the rank is
+        // not smaller than one of the dimensions, the one of U*V^T itself.
+
+        void truncate(Matrix& U,Matrix& V,const double epsilon) {
+            const unsigned m = U.nlin();
+            const unsigned n = V.nlin();
+            const unsigned k = U.ncol();
+            if (k==0)
+                return;
+
+            const bool full = k>=std::min(m,n);
+            Matrix Qu,Qv,W,S,Z;
+            if (full) {
+                U.multt(V).svd(W,S,Z,false);
+            } else {
+                Qu = Matrix(U,DEEP_COPY);
+                Qv = Matrix(V,DEEP_COPY);
+                const Matrix& Ru = BlockOrthonormalize(Qu);
+                const Matrix& Rv = BlockOrthonormalize(Qv);
+                Ru.multt(Rv).svd(W,S,Z);
+            }
+
+            const unsigned rmax = std::min(S.nlin(),S.ncol());
+            unsigned r = 0;
+            while (r<rmax && S(r,r)>epsilon*S(0,0))
+                ++r;
+
+            Matrix WS(W.nlin(),r);
+            Matrix Zr(Z.nlin(),r);
+            for (unsigned l=0;l<r;++l) {
+                for (unsigned i=0;i<W.nlin();++i)
+                    WS(i,l) = W(i,l)*S(l,l);
+                std::copy(&Z(0,l),&Z(0,l)+Z.nlin(),&Zr(0,l));
+            }
+            if (full) {
+                U = WS;
+                V = Zr;
+            } else {
+                U = zeros(m,r);
+                V = zeros(n,r);
+                gemm(false,false,m,r,k,1.0,View(Qu),View(WS),View(U));
+                gemm(false,false,n,r,k,1.0,View(Qv),View(Zr),View(V));
+            }
+        }
+
+        // Low rank representation of a dense matrix (the identity is put on its smallest side).
+
+        void low_rank(const View& P,Matrix& U,Matrix& V) {
+            if (P.nlin<=P.ncol) {
+                U = zeros(P.nlin,P.nlin);
+                for (unsigned i=0;i<P.nlin;++i)
+                    U(i,i) = 1.0;
+                V = transpose(P);
+            } else {
+                U = zeros(P.nlin,P.ncol);
+                for (unsigned j=0;j<P.ncol;++j)
+                    std::copy(&P(0,j),&P(0,j)+P.nlin,&U(0,j));
+                V = zeros(P.ncol,P.ncol);
+                for (unsigned i=0;i<P.ncol;++i)
+                    V(i,i) = 1.0;
+            }
+        }
+
+        // Adaptive cross approximation with partial pivoting of the entries rows x cols.
+        // Returns false if the block does not have a low rank representation cheaper than the dense one.
+
+        bool aca(const HMatrixEntries& entries,const std::vector<unsigned>& rows,const std::vector<unsigned>& cols,
+                 const double epsilon,Matrix& U,Matrix& V)
+        {
+            const unsigned m = rows.size();
+            const unsigned n = cols.size();
+            const unsigned max_rank = (static_cast<size_t>(m)*n)/(m+n);
+
+            // Rows which are exactly null are skipped. After max_failures consecutive null rows, the residual is
+            // considered null (e.g. for blocks coupling meshes which do not interact).
+
+            const unsigned max_failures = 8;
+
+            std::vector<std::vector<double> > us,vs;
+            std::vector<bool> used(m,false);
+            std::vector<unsigned> row(1),col(1);
+            Matrix r(1,n),c(m,1);
+
+            double   norm2    = 0.0;
+            unsigned failures = 0;
+            unsigned i        = 0;
+            while (us.size()<max_rank) {
+                row[0] = rows[i];
+                entries.block(row,cols,r);
+                for (unsigned l=0;l<us.size();++l)
+                    for (unsigned j=0;j<n;++j)
+                        r(0,j) -= us[l][i]*vs[l][j];
+                used[i] = true;
+
+                unsigned pivot = 0;
+                for (unsigned j=1;j<n;++j)
+                    if (std::abs(r(0,j))>std::abs(r(0,pivot)))
+                        pivot = j;
+
+                if (r(0,pivot)==0.0) {
+                    unsigned next = i;
+                    do
+                        next = (next+1)%m;
+                    while (used[next] && next!=i);
+                    if (++failures==max_failures || next==i)
+                        break;
+                    i = next;
+                    continue;
+                }
+                failures = 0;
+
+                std::vector<double> v(n),u(m);
+                for (unsigned j=0;j<n;++j)
+                    v[j] = r(0,j)/r(0,pivot);
+
+                col[0] = cols[pivot];
+                entries.block(rows,col,c);
+                for (unsigned k=0;k<m;++k)
+                    u[k] = c(k,0);
+                for (unsigned l=0;l<us.size();++l)
+                    for (unsigned k=0;k<m;++k)
+                        u[k] -= vs[l][pivot]*us[l][k];
+
+                // Update of the Frobenius norm of the approximation.
+
+                double nu2 = 0.0;
+                double nv2 = 0.0;
+                for (unsigned k=0;k<m;++k)
+                    nu2 += u[k]*u[k];
+                for (unsigned j=0;j<n;++j)
+                    nv2 += v[j]*v[j];
+                for (unsigned l=0;l<us.size();++l) {
+                    double su = 0.0;
+                    double sv = 0.0;
+                    for (unsigned k=0;k<m;++k)
+                        su += u[k]*us[l][k];
+                    for (unsigned j=0;j<n;++j)
+                        sv += v[j]*vs[l][j];
+                    norm2 += 2.0*su*sv;
+                }
+                norm2 += nu2*nv2;
+
+                us.push_back(u);
+                vs.push_back(v);
+
+                if (sqrt(nu2*nv2)<=epsilon*sqrt(std::abs(norm2)))
+                    break;
+
+                // The next row is the one of the largest entry of the last column.
+
+                bool found = false;
+                for (unsigned k=0;k<m;++k)
+                    if (!used[k] && (!found || std::abs(u[k])>std::abs(u[i]))) {
+                        i = k;
+                        found = true;
+                    }
+                if (!found)
+                    break;
+            }
+
+            if (us.size()>=max_rank && max_rank<std::min(m,n))
+                return false;
+
+            U = Matrix(m,us.size());
+            V = Matrix(n,vs.size());
+            for (unsigned l=0;l<us.size();++l) {
+                std::copy(us[l].begin(),us[l].end(),&U(0,0)+static_cast<size_t>(l)*m);
+                std::copy(vs[l].begin(),vs[l].end(),&V(0,0)+static_cast<size_t>(l)*n);
+            }
+            truncate(U,V,epsilon);
+            return true;
+        }
+
+        // Computation of a leaf of the block cluster tree.
+
+        class BlockAssembly: public Task {
+        public:
+
+            BlockAssembly(const std::vector<unsigned>& permutation,const HMatrixEntries& entries,Block& block,const double epsilon):
+                permutation_(permutation),entries_(entries),block_(block),epsilon_(epsilon) { }
+
+            void run() {
+                const std::vector<unsigned> rows(permutation_.begin()+block_.row_begin,permutation_.begin()+block_.row_begin+block_.nrows);
+                const std::vector<unsigned> cols(permutation_.begin()+block_.col_begin,permutation_.begin()+block_.col_begin+block_.ncols);
+                if (block_.type==Block::LOW_RANK && aca(entries_,rows,cols,epsilon_,block_.U,block_.V))
+                    return;
+                block_.type  = Block::DENSE;
+                block_.dense = Matrix(rows.size(),cols.size());
+                entries_.block(rows,cols,block_.dense);
+            }
+
+            double cost() const {
+                const double size = static_cast<double>(block_.nrows)*block_.ncols;
+                return (block_.type==Block::LOW_RANK) ? std::min(size,32.0*(block_.nrows+block_.ncols)) : size;
+            }
+
+        private:
+
+            const std::vector<unsigned>& permutation_;
+            const HMatrixEntries&        entries_;
+            Block&                       block_;
+            const double                 epsilon_;
+        };
+
+        // Admissible blocks are compressed only if their low rank representation can be cheaper than the dense one:
+        // the ranks of the admissible blocks of the BEM operators hardly depend on their sizes, and are about 3 times
+        // the number of digits of the accuracy (e.g. 15 to 20 for 1e-6). Smaller blocks are directly stored as dense.
+
+        bool compressible(const ClusterTree::Cluster& t,const ClusterTree::Cluster& s,const double epsilon) {
+            const double expected_rank = 3.0*std::max(1.0,-log10(epsilon));
+            return static_cast<double>(t.size())*s.size()>expected_rank*(t.size()+s.size());
+        }
+
+        Block* build(const ClusterTree& tree,const ClusterTree::Cluster& t,const ClusterTree::Cluster& s,const double eta,
+                     TaskScheduler& scheduler,const HMatrixEntries& entries,const double epsilon)
+        {
+            Block* block;
+            if (ClusterTree::admissible(t,s,eta) && compressible(t,s,epsilon)) {
+                block = new Block(t,s,Block::LOW_RANK);
+            } else if (t.leaf() || s.leaf()) {
+                block = new Block(t,s,Block::DENSE);
+            } else {
+                block = new Block(t,s,Block::HIERARCHICAL);
+                for (unsigned i=0;i<2;++i)
+                    for (unsigned j=0;j<2;++j)
+                        block->sons[2*i+j] = build(tree,tree[t.sons[i]],tree[s.sons[j]],eta,scheduler,entries,epsilon);
+                return block;
+            }
+            // The blocks of the lower part of a symmetric matrix are copied from the upper part (see mirror).
+
+            if (!entries.symmetric() || t.begin<=s.begin)
+                scheduler.add(new BlockAssembly(tree.permutation(),entries,*block,epsilon));
+            return block;
+        }
+
+        // B <- A^T, B having the transposed structure of A.
+
+        void transpose(const Block& A,Block& B) {
+            B.type = A.type;
+            switch (A.type) {
+                case Block::DENSE:
+                    B.dense = transpose(View(A.dense));
+                    break;
+                case Block::LOW_RANK:
+                    B.U = Matrix(A.V,DEEP_COPY);
+                    B.V = Matrix(A.U,DEEP_COPY);
+                    break;
+                case Block::HIERARCHICAL:
+                    for (unsigned i=0;i<2;++i)
+                        for (unsigned j=0;j<2;++j)
+                            transpose(*A.sons[2*i+j],*B.sons[2*j+i]);
+                    break;
+            }
+        }
+
+        // Lower part of a diagonal block of a symmetric matrix.
+
+        void mirror(Block& A) {
+            if (A.type!=Block::HIERARCHICAL)
+                return;
+            transpose(*A.sons[1],*A.sons[2]);
+            mirror(*A.sons[0]);
+            mirror(*A.sons[3]);
+        }
+
+        // Y += alpha*op(A)*X
+
+        void addmul(const Block& A,const bool trans,const double alpha,const View& X,const View& Y) {
+            switch (A.type) {
+                case Block::DENSE:
+                    gemm(trans,false,Y.nlin,X.ncol,X.nlin,alpha,View(A.dense),X,Y);
+                    break;
+                case Block::LOW_RANK: {
+                    const Matrix& L = (trans) ? A.V : A.U;
+                    const Matrix& R = (trans) ? A.U : A.V;
+                    Matrix W = zeros(A.rank(),X.ncol);
+                    gemm(true,false,A.rank(),X.ncol,X.nlin,1.0,View(R),X,View(W));
+                    gemm(false,false,Y.nlin,X.ncol,A.rank(),alpha,View(L),View(W),Y);
+                    break;
+                }
+                case Block::HIERARCHICAL:
+                    for (unsigned k=0;k<4;++k) {
+                        const Block& son = *A.sons[k];
+                        const unsigned ro = son.row_begin-A.row_begin;
+                        const unsigned co = son.col_begin-A.col_begin;
+                        if (trans) {
+                            addmul(son,true,alpha,X.rows(ro,son.nrows),Y.rows(co,son.ncols));
+                        } else {
+                            addmul(son,false,alpha,X.rows(co,son.ncols),Y.rows(ro,son.nrows));
+                        }
+                    }
+                    break;
+            }
+        }
+
+        // Dense kernels of the H-LU factorization (L has a unit diagonal, L and U are stored in the same matrix).
+
+        void lu(const View& A) {
+            for (unsigned k=0;k<A.nlin;++k) {
+                const double pivot = A(k,k);
+                if (pivot==0.0)
+                    throw std::runtime_error("HMatrix::factorize: null pivot.");
+                for (unsigned i=k+1;i<A.nlin;++i)
+                    A(i,k) /= pivot;
+                for (unsigned j=k+1;j<A.ncol;++j) {
+                    const double a = A(k,j);
+                    for (unsigned i=k+1;i<A.nlin;++i)
+                        A(i,j) -= A(i,k)*a;
+                }
+            }
+        }
+
+        // X <- L^-1 X
+
+        void solve_lower(const View& L,const View& X) {
+            for (unsigned j=0;j<X.ncol;++j)
+                for (unsigned k=0;k<X.nlin;++k) {
+                    const double x = X(k,j);
+                    for (unsigned i=k+1;i<X.nlin;++i)
+                        X(i,j) -= L(i,k)*x;
+                }
+        }
+
+        // X <- U^-1 X
+
+        void solve_upper(const View& U,const View& X) {
+            for (unsigned j=0;j<X.ncol;++j)
+                for (unsigned k=X.nlin;k-->0;) {
+                    const double x = (X(k,j) /= U(k,k));
+                    for (unsigned i=0;i<k;++i)
+                        X(i,j) -= U(i,k)*x;
+                }
+        }
+
+        // X <- U^-T X
+
+        void solve_upper_transposed(const View& U,const View& X) {
+            for (unsigned j=0;j<X.ncol;++j)
+                for (unsigned k=0;k<X.nlin;++k) {
+                    double x = X(k,j);
+                    for (unsigned i=0;i<k;++i)
+                        x -= U(i,k)*X(i,j);
+                    X(k,j) = x/U(k,k);
+                }
+        }
+
+        // Same operations with a (diagonal) H-matrix block.
+
+        void solve_lower(const Block& L,const View& X) {
+            if (L.type==Block::DENSE) {
+                solve_lower(View(L.dense),X);
+            } else {
+                const unsigned n0 = L.sons[0]->nrows;
+                const View X0 = X.rows(0,n0);
+                const View X1 = X.rows(n0,X.nlin-n0);
+                solve_lower(*L.sons[0],X0);
+                addmul(*L.sons[2],false,-1.0,X0,X1);
+                solve_lower(*L.sons[3],X1);
+            }
+        }
+
+        void solve_upper(const Block& U,const View& X) {
+            if (U.type==Block::DENSE) {
+                solve_upper(View(U.dense),X);
+            } else {
+                const unsigned n0 = U.sons[0]->nrows;
+                const View X0 = X.rows(0,n0);
+                const View X1 = X.rows(n0,X.nlin-n0);
+                solve_upper(*U.sons[3],X1);
+                addmul(*U.sons[1],false,-1.0,X1,X0);
+                solve_upper(*U.sons[0],X0);
+            }
+        }
+
+        void solve_upper_transposed(const Block& U,const View& X) {
+            if (U.type==Block::DENSE) {
+                solve_upper_transposed(View(U.dense),X);
+            } else {
+                const unsigned n0 = U.sons[0]->nrows;
+                const View X0 = X.rows(0,n0);
+                const View X1 = X.rows(n0,X.nlin-n0);
+                solve_upper_transposed(*U.sons[0],X0);
+                addmul(*U.sons[1],true,-1.0,X0,X1);
+                solve_upper_transposed(*U.sons[3],X1);
+            }
+        }
+
+        // Formatted additions: C += U*V^T and C += P.
+        // A low rank block receives many updates during the H-LU factorization (one per product of the blocks of
+        // its row and of its column). They are accumulated (dense updates in C.dense, low rank ones by concatenation
+        // as long as the rank stays below the one of a dense block), and C is truncated to the accuracy epsilon only
+        // once, when it is finally used (flush).
+
+        void flush(Block& C,const double epsilon) {
+            if (C.type!=Block::LOW_RANK)
+                return;
+            if (C.dense.nlin()!=0) {
+                Matrix U,V;
+                low_rank(View(C.dense),U,V);
+                C.U = concatenate(View(C.U),View(U));
+                C.V = concatenate(View(C.V),View(V));
+                C.dense = Matrix();
+            }
+            truncate(C.U,C.V,epsilon);
+        }
+
+        void add_low_rank(Block& C,const View& U,const View& V,const double epsilon) {
+            if (U.ncol==0)
+                return;
+            switch (C.type) {
+                case Block::DENSE:
+                    gemm(false,true,C.nrows,C.ncols,U.ncol,1.0,U,V,View(C.dense));
+                    break;
+                case Block::LOW_RANK:
+                    C.U = concatenate(View(C.U),U);
+                    C.V = concatenate(View(C.V),V);
+                    if (C.rank()>std::min(C.nrows,C.ncols))
+                        truncate(C.U,C.V,epsilon);
+                    break;
+                case Block::HIERARCHICAL:
+                    for (unsigned k=0;k<4;++k) {
+                        Block& son = *C.sons[k];
+                        add_low_rank(son,U.rows(son.row_begin-C.row_begin,son.nrows),V.rows(son.col_begin-C.col_begin,son.ncols),epsilon);
+                    }
+                    break;
+            }
+        }
+
+        void add_dense(Block& C,const View& P,const double epsilon) {
+            switch (C.type) {
+                case Block::DENSE:
+                    for (unsigned j=0;j<C.ncols;++j)
+                        for (unsigned i=0;i<C.nrows;++i)
+                            C.dense(i,j) += P(i,j);
+                    break;
+                case Block::LOW_RANK:
+                    if (C.dense.nlin()==0)
+                        C.dense = zeros(C.nrows,C.ncols);
+                    for (unsigned j=0;j<C.ncols;++j)
+                        for (unsigned i=0;i<C.nrows;++i)
+                            C.dense(i,j) += P(i,j);
+                    break;
+                case Block::HIERARCHICAL:
+                    for (unsigned k=0;k<4;++k) {
+                        Block& son = *C.sons[k];
+                        const View Q(&P(son.row_begin-C.row_begin,son.col_begin-C.col_begin),son.nrows,son.ncols,P.ld);
+                        add_dense(son,Q,epsilon);
+                    }
+                    break;
+            }
+        }
+
+        // Dense product alpha*A*B, one of A or B being dense.
+
+        Matrix dense_product(const Block& A,const Block& B,const double alpha) {
+            Matrix P = zeros(A.nrows,B.ncols);
+            if (B.type==Block::DENSE) {
+                addmul(A,false,alpha,View(B.dense),View(P));
+            } else {
+                // P^T = B^T*A^T
+                const Matrix T = transpose(View(A.dense));
+                Matrix W = zeros(B.ncols,A.nrows);
+                addmul(B,true,alpha,View(T),View(W));
+                P = transpose(View(W));
+            }
+            return P;
+        }
+
+        // Low rank representation U*V^T of alpha*A*B, A or B being low rank.
+
+        void product(const Block& A,const Block& B,const double alpha,Matrix& U,Matrix& V) {
+            if (A.type==Block::LOW_RANK) {
+                U = Matrix(A.U,DEEP_COPY);
+                U *= alpha;
+                V = zeros(B.ncols,A.rank());
+                addmul(B,true,1.0,View(A.V),View(V));
+            } else {
+                U = zeros(A.nrows,B.rank());
+                addmul(A,false,alpha,View(B.U),View(U));
+                V = Matrix(B.V,DEEP_COPY);
+            }
+        }
+
+        // D += A (D being a dense view of the size of A).
+
+        void expand(const Block& A,const View& D) {
+            switch (A.type) {
+                case Block::DENSE:
+                    for (unsigned j=0;j<A.ncols;++j)
+                        for (unsigned i=0;i<A.nrows;++i)
+                            D(i,j) += A.dense(i,j);
+                    break;
+                case Block::LOW_RANK:
+                    gemm(false,true,A.nrows,A.ncols,A.rank(),1.0,View(A.U),View(A.V),D);
+                    break;
+                case Block::HIERARCHICAL:
+                    for (unsigned k=0;k<4;++k) {
+                        const Block& son = *A.sons[k];
+                        expand(son,View(&D(son.row_begin-A.row_begin,son.col_begin-A.col_begin),son.nrows,son.ncols,D.ld));
+                    }
+                    break;
+            }
+        }
+
+        // C += alpha*A*B
+
+        void mult_add(Block& C,const Block& A,const Block& B,const double alpha,const double epsilon) {
+            if (A.type==Block::LOW_RANK || B.type==Block::LOW_RANK) {
+                Matrix U,V;
+                product(A,B,alpha,U,V);
+                add_low_rank(C,View(U),View(V),epsilon);
+            } else if (A.type==Block::DENSE || B.type==Block::DENSE) {
+                const Matrix P = dense_product(A,B,alpha);
+                add_dense(C,View(P),epsilon);
+            } else if (C.type==Block::HIERARCHICAL) {
+                for (unsigned i=0;i<2;++i)
+                    for (unsigned j=0;j<2;++j)
+                        for (unsigned k=0;k<2;++k)
+                            mult_add(*C.sons[2*i+j],*A.sons[2*i+k],*B.sons[2*k+j],alpha,epsilon);
+            } else {
+                // C is a leaf: the product of the hierarchical blocks A and B is added as a dense matrix.
+                Matrix D = zeros(B.nrows,B.ncols);
+                expand(B,View(D));
+                Matrix P = zeros(A.nrows,B.ncols);
+                addmul(A,false,alpha,View(D),View(P));
+                add_dense(C,View(P),epsilon);
+            }
+        }
+
+        // X <- L^-1 X and X <- X U^-1 for H-matrix blocks X.
+
+        void solve_lower(const Block& L,Block& X,const double epsilon) {
+            switch (X.type) {
+                case Block::DENSE:
+                    solve_lower(L,View(X.dense));
+                    break;
+                case Block::LOW_RANK:
+                    flush(X,epsilon);
+                    solve_lower(L,View(X.U));
+                    break;
+                case Block::HIERARCHICAL:
+                    for (unsigned j=0;j<2;++j) {
+                        solve_lower(*L.sons[0],*X.sons[j],epsilon);
+                        mult_add(*X.sons[2+j],*L.sons[2],*X.sons[j],-1.0,epsilon);
+                        solve_lower(*L.sons[3],*X.sons[2+j],epsilon);
+                    }
+                    break;
+            }
+        }
+
+        void solve_upper_right(const Block& U,Block& X,const double epsilon) {
+            switch (X.type) {
+                case Block::DENSE: {
+                    const Matrix T = transpose(View(X.dense));
+                    solve_upper_transposed(U,View(T));
+                    X.dense = transpose(View(T));
+                    break;
+                }
+                case Block::LOW_RANK:
+                    flush(X,epsilon);
+                    solve_upper_transposed(U,View(X.V));
+                    break;
+                case Block::HIERARCHICAL:
+                    for (unsigned i=0;i<2;++i) {
+                        solve_upper_right(*U.sons[0],*X.sons[2*i],epsilon);
+                        mult_add(*X.sons[2*i+1],*X.sons[2*i],*U.sons[1],-1.0,epsilon);
+                        solve_upper_right(*U.sons[3],*X.sons[2*i+1],epsilon);
+                    }
+                    break;
+            }
+        }
+
+        void lu(Block& A,const double epsilon) {
+            if (A.type==Block::DENSE) {
+                lu(View(A.dense));
+            } else {
+                lu(*A.sons[0],epsilon);
+                solve_lower(*A.sons[0],*A.sons[1],epsilon);
+                solve_upper_right(*A.sons[0],*A.sons[2],epsilon);
+                mult_add(*A.sons[3],*A.sons[2],*A.sons[1],-1.0,epsilon);
+                lu(*A.sons[3],epsilon);
+            }
+        }
+
+        void count_blocks(const Block& b,unsigned& nb_dense,unsigned& nb_low_rank,unsigned& max_rank) {
+            switch (b.type) {
+                case Block::DENSE:
+                    ++nb_dense;
+                    break;
+                case Block::LOW_RANK:
+                    ++nb_low_rank;
+                    max_rank = std::max(max_rank,b.rank());
+                    break;
+                case Block::HIERARCHICAL:
+                    for (unsigned k=0;k<4;++k)
+                        count_blocks(*b.sons[k],nb_dense,nb_low_rank,max_rank);
+                    break;
+            }
+        }
+    }
+
+    HMatrix::HMatrix(const ClusterTree& tree,const HMatrixEntries& entries,const double epsilon,const double eta):
+        base(0,0,FULL,2),root_(0),epsilon_(epsilon),factorized_(false)
+    {
+        assemble(tree,entries,epsilon,eta);
+    }
+
+    void HMatrix::assemble(const ClusterTree& tree,const HMatrixEntries& entries,const double epsilon,const double eta) {
+        delete root_;
+        root_       = 0;
+        tree_       = tree;
+        epsilon_    = epsilon;
+        factorized_ = false;
+        nlin() = ncol() = tree_.nb_unknowns();
+        if (tree_.nb_unknowns()==0)
+            return;
+
+        // The leaves of the block cluster tree are computed concurrently.
+
+        TaskScheduler scheduler;
+        root_ = build(tree_,tree_.root(),tree_.root(),eta,scheduler,entries,epsilon);
+        scheduler.run();
+        if (entries.symmetric())
+            mirror(*root_);
+    }
+
+    HMatrix::HMatrix(const HMatrix& H):
+        base(H.nlin(),H.ncol(),FULL,2),tree_(H.tree_),root_((H.root_) ? new Block(*H.root_) : 0),
+        epsilon_(H.epsilon_),factorized_(H.factorized_) { }
+
+    HMatrix& HMatrix::operator=(const HMatrix& H) {
+        if (this!=&H) {
+            base::operator=(H);
+            delete root_;
+            tree_       = H.tree_;
+            root_       = (H.root_) ? new Block(*H.root_) : 0;
+            epsilon_    = H.epsilon_;
+            factorized_ = H.factorized_;
+        }
+        return *this;
+    }
+
+    HMatrix::~HMatrix() { delete root_; }
+
+    size_t HMatrix::size() const { return (root_) ? root_->size() : 0; }
+
+    unsigned HMatrix::nb_dense_blocks() const {
+        unsigned nb_dense    = 0;
+        unsigned nb_low_rank = 0;
+        unsigned max_rank    = 0;
+        if (root_)
+            count_blocks(*root_,nb_dense,nb_low_rank,max_rank);
+        return nb_dense;
+    }
+
+    unsigned HMatrix::nb_low_rank_blocks() const {
+        unsigned nb_dense    = 0;
+        unsigned nb_low_rank = 0;
+        unsigned max_rank    = 0;
+        if (root_)
+            count_blocks(*root_,nb_dense,nb_low_rank,max_rank);
+        return nb_low_rank;
+    }
+
+    void HMatrix::info() const {
+        if (root_==0) {
+            std::cout << "Matrix Empty" << std::endl;
+            return;
+        }
+        unsigned nb_dense    = 0;
+        unsigned nb_low_rank = 0;
+        unsigned max_rank    = 0;
+        count_blocks(*root_,nb_dense,nb_low_rank,max_rank);
+        std::cout << "Dimensions : " << nlin() << " x " << ncol() << ((factorized_) ? " (H-LU factors)" : "") << std::endl;
+        std::cout << "Blocks : " << nb_dense << " dense, " << nb_low_rank << " low rank (maximal rank " << max_rank << ")" << std::endl;
+        std::cout << "Storage : " << 100.0*compression() << "% of the dense matrix (accuracy " << epsilon_ << ")" << std::endl;
+    }
+
+    Matrix HMatrix::operator*(const Matrix& X) const {
+        om_assert(X.nlin()==ncol());
+        om_assert(!factorized_);
+        const std::vector<unsigned>& perm = tree_.permutation();
+        Matrix Xp(X.nlin(),X.ncol());
+        for (unsigned j=0;j<X.ncol();++j)
+            for (unsigned i=0;i<X.nlin();++i)
+                Xp(i,j) = X(perm[i],j);
+        Matrix Yp = zeros(nlin(),X.ncol());
+        if (root_)
+            addmul(*root_,false,1.0,View(Xp),View(Yp));
+        Matrix Y(nlin(),X.ncol());
+        for (unsigned j=0;j<X.ncol();++j)
+            for (unsigned i=0;i<nlin();++i)
+                Y(perm[i],j) = Yp(i,j);
+        return Y;
+    }
+
+    Vector HMatrix::operator*(const Vector& x) const {
+        Matrix X(x.nlin(),1);
+        std::copy(x.data(),x.data()+x.nlin(),X.data());
+        const Matrix& Y = (*this)*X;
+        Vector y(nlin());
+        std::copy(Y.data(),Y.data()+nlin(),y.data());
+        return y;
+    }
+
+    void HMatrix::factorize() {
+        om_assert(!factorized_);
+        if (root_)
+            lu(*root_,epsilon_);
+        factorized_ = true;
+    }
+
+    Matrix HMatrix::solveLin(Matrix& B) const {
+        om_assert(B.nlin()==nlin());
+        if (!factorized_)
+            throw std::runtime_error("HMatrix::solveLin: the matrix must be factorized first.");
+        const std::vector<unsigned>& perm = tree_.permutation();
+        Matrix Bp(B.nlin(),B.ncol());
+        for (unsigned j=0;j<B.ncol();++j)
+            for (unsigned i=0;i<B.nlin();++i)
+                Bp(i,j) = B(perm[i],j);
+        if (root_) {
+            solve_lower(*root_,View(Bp));
+            solve_upper(*root_,View(Bp));
+        }
+        for (unsigned j=0;j<B.ncol();++j)
+            for (unsigned i=0;i<B.nlin();++i)
+                B(perm[i],j) = Bp(i,j);
+        return B;
+    }
+
+    Vector HMatrix::solveLin(const Vector& b) const {
+        Matrix B(b.nlin(),1);
+        std::copy(b.data(),b.data()+b.nlin(),B.data());
+        solveLin(B);
+        Vector x(nlin());
+        std::copy(B.data(),B.data()+nlin(),x.data());
+        return x;
+    }
+}
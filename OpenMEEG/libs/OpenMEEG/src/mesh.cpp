@@ -38,6 +38,8 @@ knowledge of the CeCILL-B license and that you accept its terms.
 */
 
 #include <sstream>
+#include <algorithm>
+#include <stdexcept>
 #include <mesh.h>
 #include <Triangle_triangle_intersection.h>
 
@@ -67,6 +69,9 @@ namespace OpenMEEG {
                 push_back(*tit);
             }
             build_mesh_vertices();
+            build_adjacency();
+            cache_ = m.cache_;
+            compact_.build(*this);
         }
         outermost_ = m.outermost_;
         name_      = m.name_;
@@ -119,7 +124,13 @@ namespace OpenMEEG {
         vertices_.clear();
         set_vertices_.clear();
         name_.clear();
-        links_.clear();
+        vertex_offsets_.clear();
+        vertex_triangles_.clear();
+        triangle_offsets_.clear();
+        triangle_neighbours_.clear();
+        vertex_positions_.clear();
+        cache_.clear();
+        compact_.clear();
         outermost_ = false;
         allocate_ = false;
     }
@@ -165,10 +176,7 @@ namespace OpenMEEG {
         set_vertices_.clear();
 
         // make links
-        links_.clear();
-        for (const_iterator tit = begin(); tit != end(); ++tit)
-            for (Triangle::const_iterator sit = tit->begin(); sit != tit->end(); ++sit)
-                links_[*sit].push_back(const_cast<Triangle *>(&*tit));
+        build_adjacency();
 
         // If indices are not set, we generate them for sorting edge and testing orientation
         if (allocate_) {
@@ -183,14 +191,83 @@ namespace OpenMEEG {
             tit->area()    = tit->normal().norm() / 2.0;
             tit->normal().normalize();
         }
+
+        cache_.build(*this);
+        compact_.build(*this);
+    }
+
+    /// Build the compressed adjacency arrays (triangles of the vertices, neighbours of the triangles).
+
+    void Mesh::build_adjacency() {
+
+        vertex_positions_.clear();
+        vertex_positions_.reserve(nb_vertices());
+        for (unsigned i = 0; i < nb_vertices(); ++i)
+            vertex_positions_.push_back(std::make_pair(const_cast<const Vertex *>(vertices_[i]), i));
+        std::sort(vertex_positions_.begin(), vertex_positions_.end());
+
+        // Triangles of each vertex, counted then filled in the order of the triangles.
+
+        std::vector<unsigned> corners(3*size());
+        vertex_offsets_.assign(nb_vertices()+1, 0);
+        for (const_iterator tit = begin(); tit != end(); ++tit)
+            for (unsigned k = 0; k < 3; ++k) {
+                const unsigned i = vertex_position((*tit)(k));
+                corners[3*position(*tit)+k] = i;
+                if (i < nb_vertices())
+                    ++vertex_offsets_[i+1];
+            }
+        for (unsigned i = 0; i < nb_vertices(); ++i)
+            vertex_offsets_[i+1] += vertex_offsets_[i];
+
+        vertex_triangles_.resize(vertex_offsets_.back());
+        std::vector<unsigned> next(vertex_offsets_.begin(), vertex_offsets_.end()-1);
+        for (unsigned t = 0; t < size(); ++t)
+            for (unsigned k = 0; k < 3; ++k)
+                if (corners[3*t+k] < nb_vertices())
+                    vertex_triangles_[next[corners[3*t+k]]++] = t;
+
+        // Neighbours of each triangle: the other triangles containing two of its vertices.
+
+        triangle_offsets_.assign(size()+1, 0);
+        triangle_neighbours_.clear();
+        std::vector<unsigned> candidates;
+        for (unsigned t = 0; t < size(); ++t) {
+            candidates.clear();
+            for (unsigned k = 0; k < 3; ++k)
+                if (corners[3*t+k] < nb_vertices()) {
+                    const Positions triangles = vertex_triangles(corners[3*t+k]);
+                    candidates.insert(candidates.end(), triangles.begin(), triangles.end());
+                }
+            std::sort(candidates.begin(), candidates.end());
+            for (unsigned c = 0, e = 0; c < candidates.size(); c = e) {
+                while (e < candidates.size() && candidates[e] == candidates[c])
+                    ++e;
+                if (e-c == 2) // t itself contains the 3 vertices
+                    triangle_neighbours_.push_back(candidates[c]);
+            }
+            triangle_offsets_[t+1] = triangle_neighbours_.size();
+        }
+    }
+
+    unsigned Mesh::vertex_position(const Vertex& V) const {
+
+        const std::pair<const Vertex *, unsigned> key(&V, 0);
+        std::vector<std::pair<const Vertex *, unsigned> >::const_iterator it = std::lower_bound(vertex_positions_.begin(), vertex_positions_.end(), key);
+        return (it != vertex_positions_.end() && it->first == &V) ? it->second : nb_vertices();
     }
 
     /// compute the normal at vertex
     Normal Mesh::normal(const Vertex& v) const {
 
+        const unsigned i = vertex_position(v);
+        if (i == nb_vertices())
+            throw std::out_of_range("Mesh::normal: the vertex does not belong to the mesh");
+
         Normal _normal(0);
-        for (VectPTriangle::const_iterator tit = links_.at(&v).begin(); tit != links_.at(&v).end(); ++tit)
-            _normal += (*tit)->normal();
+        const Positions triangles = vertex_triangles(i);
+        for (Positions::const_iterator tit = triangles.begin(); tit != triangles.end(); ++tit)
+            _normal += (begin()+*tit)->normal();
         _normal.normalize();
         return _normal;
     }
@@ -233,11 +310,13 @@ namespace OpenMEEG {
 
         std::vector< std::set<Vertex> > neighbors(nb_vertices());
         unsigned i = 0;
-        for (const_vertex_iterator vit = vertex_begin(); vit != vertex_end(); ++vit, ++i)
-            for (VectPTriangle::const_iterator tit = links_[*vit].begin(); tit != links_[*vit].end(); ++tit)
+        for (const_vertex_iterator vit = vertex_begin(); vit != vertex_end(); ++vit, ++i) {
+            const Positions triangles = vertex_triangles(i);
+            for (Positions::const_iterator tit = triangles.begin(); tit != triangles.end(); ++tit)
                 for (unsigned  k = 0; k < 3; ++k)
-                    if ((**tit)(k) == **vit)
-                        neighbors[i].insert((**tit)(k));
+                    if ((*(begin()+*tit))(k) == **vit)
+                        neighbors[i].insert((*(begin()+*tit))(k));
+        }
 
         Vertices new_pts(nb_vertices());
         for (unsigned n = 0; n < niter; ++n) {
@@ -261,19 +340,22 @@ namespace OpenMEEG {
 
         /// V
         // self
-        for (const_vertex_iterator vit = vertex_begin(); vit != vertex_end(); ++vit)
-            for (VectPTriangle::const_iterator tit = links_.at(*vit).begin(); tit != links_.at(*vit).end(); ++tit) {
-                Vertex * v2;
-                Vertex * v3;
-                if (((**tit)[0]) == *vit) {
-                    v2 = (**tit)[1]; v3 = (**tit)[2];
-                } else if ((**tit)[1] == *vit) {
-                    v2 = (**tit)[2]; v3 = (**tit)[0];
+        for (const_vertex_iterator vit = vertex_begin(); vit != vertex_end(); ++vit) {
+            const Positions triangles = vertex_triangles(vit-vertex_begin());
+            for (Positions::const_iterator tit = triangles.begin(); tit != triangles.end(); ++tit) {
+                const Triangle& T = *(begin()+*tit);
+                const Vertex * v2;
+                const Vertex * v3;
+                if (T[0] == *vit) {
+                    v2 = T[1]; v3 = T[2];
+                } else if (T[1] == *vit) {
+                    v2 = T[2]; v3 = T[0];
                 } else {
-                    v2 = (**tit)[0]; v3 = (**tit)[1];
+                    v2 = T[0]; v3 = T[1];
                 }
-                A((*vit)->index(), (*vit)->index()) += P1gradient(**vit, *v2, *v3).norm2() * std::pow((*tit)->area(),2);
+                A((*vit)->index(), (*vit)->index()) += P1gradient(**vit, *v2, *v3).norm2() * std::pow(T.area(),2);
             }
+        }
 
         // edges
 
@@ -286,10 +368,12 @@ namespace OpenMEEG {
         if (!outermost_) // if it is an outermost mesh: p=0 thus no need for computing it
             for (const_iterator tit = begin(); tit != end(); ++tit) {
                 A(tit->index(), tit->index()) = 0.;
-                VectPTriangle Tadj = adjacent_triangles(*tit);
-                for (VectPTriangle::const_iterator tit2 = Tadj.begin(); tit2 != Tadj.end(); ++tit2)
-                    if (tit->index() < (*tit2)->index()) // sym matrix only lower half
-                        A(tit->index(), (*tit2)->index()) += P0gradient_norm2(*tit, **tit2) * tit->area() * (*tit2)->area();
+                const Positions Tadj = triangle_neighbours(position(*tit));
+                for (Positions::const_iterator tit2 = Tadj.begin(); tit2 != Tadj.end(); ++tit2) {
+                    const Triangle& T2 = *(begin()+*tit2);
+                    if (tit->index() < T2.index()) // sym matrix only lower half
+                        A(tit->index(), T2.index()) += P0gradient_norm2(*tit, T2) * tit->area() * T2.area();
+                }
             }
     }
 
@@ -358,16 +442,16 @@ namespace OpenMEEG {
         return tri_tri_overlap_test_3d(pp1, qq1, rr1, pp2, qq2, rr2);
     }
 
-    const Mesh::VectPTriangle& Mesh::get_triangles_for_vertex(const Vertex& V) const {
+    Mesh::VectPTriangle Mesh::get_triangles_for_vertex(const Vertex& V) const {
 
-        std::map<const Vertex *, Mesh::VectPTriangle>::const_iterator it = links_.find(&V);
-        if (it != links_.end()) {
-            return it->second;
-        } else {
-            static Mesh::VectPTriangle a;
-            return a;
+        VectPTriangle triangles;
+        const unsigned i = vertex_position(V);
+        if (i < nb_vertices()) {
+            const Positions positions = vertex_triangles(i);
+            for (Positions::const_iterator pit = positions.begin(); pit != positions.end(); ++pit)
+                triangles.push_back(const_cast<Triangle *>(&*(begin()+*pit)));
         }
-        // TODO const_cast here
+        return triangles;
     }
 
     /// For IO:s -------------------------------------------------------------------------------------------
@@ -985,52 +1069,32 @@ namespace OpenMEEG {
         os.close();
     }
 
-    const Mesh::EdgeMap Mesh::compute_edge_map() const {
-
-        // define the triangle edges as (first vertex, second vertex)
-        // if a triangle edge is ordered with (lower index, higher index) add 1 to its map else remove 1
-        // in the end each mapping should be: 0 (well oriented), 1 for border edge (non closed), and 2 for non well oriented
-
-        EdgeMap mape; // map the edges with an unsigned
-        for (const_iterator tit = begin(); tit != end(); ++tit)
-            for (unsigned j = 0; j < 3; ++j)
-                if ((*tit)(j).index() > (*tit)(j+1).index()) {
-                    std::pair<const Vertex *, const Vertex *> pairv((*tit)[j], (*tit)[j+1]);
-                    if (mape.count(pairv) == 0) {
-                        mape[pairv] = 1;
-                    } else {
-                        mape[pairv]++;
-                    }
-                } else {
-                    std::pair<const Vertex *, const Vertex *> pairv((*tit)[j+1], (*tit)[j]);
-                    if (mape.count(pairv) == 0) {
-                        mape[pairv] = -1;
-                    } else {
-                        mape[pairv]--;
-                    }
-                }
-
-        return mape;
-    }
-
     /// get the 3 adjacents triangles of a triangle t
     Mesh::VectPTriangle Mesh::adjacent_triangles(const Triangle& t) const {
 
         VectPTriangle tris;
-        std::map<Triangle *, unsigned> mapt;
+        if (size() != 0 && &t >= &*begin() && &t < &*begin()+size()) {
+            const Positions neighbours = triangle_neighbours(position(t));
+            for (Positions::const_iterator tit = neighbours.begin(); tit != neighbours.end(); ++tit)
+                tris.push_back(const_cast<Triangle *>(&*(begin()+*tit)));
+            return tris;
+        }
+
+        // t belongs to another mesh: triangles of this mesh containing two of its vertices.
+
+        std::map<unsigned, unsigned> mapt;
         for (Triangle::const_iterator sit = t.begin(); sit != t.end(); ++sit) {
-            VectPTriangle tri1 = links_.at(*sit);
-            for (VectPTriangle::const_iterator tit = tri1.begin(); tit != tri1.end(); ++tit)
-                if (mapt.count(*tit) == 0) {
-                    mapt[*tit] = 1;
-                } else {
-                    mapt[*tit]++;
-                }
+            const unsigned i = vertex_position(**sit);
+            if (i < nb_vertices()) {
+                const Positions triangles = vertex_triangles(i);
+                for (Positions::const_iterator tit = triangles.begin(); tit != triangles.end(); ++tit)
+                    ++mapt[*tit];
+            }
         }
 
-        for (std::map<Triangle *, unsigned>::iterator mit = mapt.begin(); mit != mapt.end(); ++mit)
+        for (std::map<unsigned, unsigned>::iterator mit = mapt.begin(); mit != mapt.end(); ++mit)
             if (mit->second == 2)
-                tris.push_back(mit->first);
+                tris.push_back(const_cast<Triangle *>(&*(begin()+mit->first)));
 
         return tris;
     }
@@ -1075,31 +1139,38 @@ namespace OpenMEEG {
         while ( !t_stack.empty()) {
             Triangle * t = t_stack.top();
             t_stack.pop();
-            VectPTriangle t_adj = adjacent_triangles(*t);
-            for (VectPTriangle::iterator tit = t_adj.begin(); tit != t_adj.end(); ++tit)
-                if (tri_reoriented.count(*tit) == 0) {
-                    t_stack.push(*tit);
-                    for (Triangle::iterator vit = (*tit)->begin(); vit != (*tit)->end(); ++vit)
-                        if (t->next(**vit) == (*tit)->next(**vit)) {
-                            (*tit)->flip();
+            const Positions t_adj = triangle_neighbours(position(*t));
+            for (Positions::const_iterator pit = t_adj.begin(); pit != t_adj.end(); ++pit) {
+                Triangle * tit = &*(begin()+*pit);
+                if (tri_reoriented.count(tit) == 0) {
+                    t_stack.push(tit);
+                    for (Triangle::iterator vit = tit->begin(); vit != tit->end(); ++vit)
+                        if (t->next(**vit) == tit->next(**vit)) {
+                            tit->flip();
                             break;
                         }
-                    tri_reoriented[*tit] = true;
+                    tri_reoriented[tit] = true;
                 }
+            }
         }
     }
 
     bool Mesh::has_correct_orientation() const {
 
-        /// Check the local orientation (that all the triangles are all oriented in the same way)
-
-        const EdgeMap mape = compute_edge_map();
+        /// Check the local orientation (that all the triangles are all oriented in the same way):
+        /// two neighbouring triangles must traverse their common edge in opposite directions.
 
-        for (EdgeMap::const_iterator eit = mape.begin(); eit != mape.end(); ++eit)
-            if (std::abs(eit->second) == 2) {
-                std::cerr << "Local orientation problem..." << std::endl << std::endl;
-                return false;
+        for (const_iterator tit = begin(); tit != end(); ++tit) {
+            const Positions neighbours = triangle_neighbours(position(*tit));
+            for (Positions::const_iterator nit = neighbours.begin(); nit != neighbours.end(); ++nit) {
+                const Triangle& T2 = *(begin()+*nit);
+                for (unsigned j = 0; j < 3; ++j)
+                    if (T2.contains((*tit)(j)) && T2.contains((*tit)(j+1)) && &T2.next((*tit)(j)) == &(*tit)(j+1)) {
+                        std::cerr << "Local orientation problem..." << std::endl << std::endl;
+                        return false;
+                    }
             }
+        }
 
         return true;
     }
@@ -45,8 +45,8 @@ namespace OpenMEEG {
     {
         std::cout << "INTERNAL OPERATOR D..." << std::endl;
         for ( Vertices::const_iterator vit = points.begin(); vit != points.end(); ++vit)  {
-            for ( Mesh::const_iterator tit = m.begin(); tit != m.end(); ++tit) {
-                _operatorDinternal(*tit, *vit, mat, coeff);
+            for ( unsigned i = 0; i < m.nb_triangles(); ++i) {
+                _operatorDinternal(m, i, *vit, mat, coeff);
             }
         }
     }
@@ -56,7 +56,7 @@ namespace OpenMEEG {
         std::cout << "INTERNAL OPERATOR S..." << std::endl;
         for ( Vertices::const_iterator vit = points.begin(); vit != points.end(); ++vit)  {
             for ( Mesh::const_iterator tit = m.begin(); tit != m.end(); ++tit) {
-                mat(vit->index(), tit->index()) = _operatorSinternal(*tit, *vit) * coeff;
+                mat(vit->index(), tit->index()) = _operatorSinternal(m, tit-m.begin(), *vit) * coeff;
             }
         }
     }
@@ -72,7 +72,7 @@ namespace OpenMEEG {
         #else
         for (Mesh::const_vertex_iterator vit=m.vertex_begin();vit<m.vertex_end();++vit) {
         #endif
-            Vect3 v = _operatorFerguson(x, **vit, m);
+            Vect3 v = _operatorFerguson(x, m, vit-m.vertex_begin());
             mat(offsetI + 0, (*vit)->index()) += v.x() * coeff;
             mat(offsetI + 1, (*vit)->index()) += v.y() * coeff;
             mat(offsetI + 2, (*vit)->index()) += v.z() * coeff;
@@ -81,21 +81,20 @@ namespace OpenMEEG {
 
     void operatorDipolePotDer(const Vect3& r0,const Vect3& q,const Mesh& m,Vector& rhs,const double& coeff,const unsigned gauss_order,const bool adapt_rhs) 
     {
-        static analyticDipPotDer anaDPD;
-
         Integrator<Vect3,analyticDipPotDer>* gauss = (adapt_rhs) ? new AdaptiveIntegrator<Vect3, analyticDipPotDer>(0.001) :
                                                                    new Integrator<Vect3, analyticDipPotDer>;
 
         gauss->setOrder(gauss_order);
-        #pragma omp parallel for private(anaDPD)
+        #pragma omp parallel for
         #ifndef OPENMP_3_0
         for (int i=0;i<m.size();++i) {
             const Mesh::const_iterator tit=m.begin()+i;
         #else
         for (Mesh::const_iterator tit=m.begin();tit<m.end();++tit) {
         #endif
+            analyticDipPotDer anaDPD;
             anaDPD.init(*tit, q, r0);
-            Vect3 v = gauss->integrate(anaDPD, *tit);
+            const Vect3 v = (adapt_rhs) ? gauss->integrate(anaDPD, *tit) : m.cache().integrate<Vect3>(anaDPD, tit-m.begin(), gauss->getOrder());
             #pragma omp critical
             {
                 rhs(tit->s1().index() ) += v(0) * coeff;
@@ -108,8 +107,8 @@ namespace OpenMEEG {
 
     void operatorDipolePot(const Vect3& r0, const Vect3& q, const Mesh& m, Vector& rhs, const double& coeff, const unsigned gauss_order, const bool adapt_rhs) 
     {
-        static analyticDipPot anaDP;
-
+        // anaDP only depends on the dipole, it is shared (read only) by the threads.
+        analyticDipPot anaDP;
         anaDP.init(q, r0);
         Integrator<double, analyticDipPot> *gauss;
         if ( adapt_rhs ) {
@@ -126,11 +125,40 @@ namespace OpenMEEG {
         #else
         for (Mesh::const_iterator tit=m.begin();tit<m.end();++tit) {
         #endif
-            double d = gauss->integrate(anaDP, *tit);
+            const double d = (adapt_rhs) ? gauss->integrate(anaDP, *tit) : m.cache().integrate<double>(anaDP, tit-m.begin(), gauss->getOrder());
             #pragma omp critical
             rhs(tit->index()) += d * coeff;
         }
         delete gauss;
     }
 
+
+    //  Serial versions of the two operators above accumulating in a column of a matrix. They are meant to be
+    //  called concurrently on different dipoles (see assemble_DipSourceMat), each column being owned by a thread.
+
+    void operatorDipolePotDer(const Vect3& r0,const Vect3& q,const Mesh& m,double* rhs,const double& coeff,const unsigned gauss_order,const bool adapt_rhs) 
+    {
+        AdaptiveIntegrator<Vect3,analyticDipPotDer> adaptive(0.001);
+        adaptive.setOrder(gauss_order);
+        for (Mesh::const_iterator tit=m.begin();tit!=m.end();++tit) {
+            analyticDipPotDer anaDPD;
+            anaDPD.init(*tit, q, r0);
+            const Vect3 v = (adapt_rhs) ? adaptive.integrate(anaDPD, *tit) : m.cache().integrate<Vect3>(anaDPD, tit-m.begin(), adaptive.getOrder());
+            rhs[tit->s1().index()] += v(0) * coeff;
+            rhs[tit->s2().index()] += v(1) * coeff;
+            rhs[tit->s3().index()] += v(2) * coeff;
+        }
+    }
+
+    void operatorDipolePot(const Vect3& r0,const Vect3& q,const Mesh& m,double* rhs,const double& coeff,const unsigned gauss_order,const bool adapt_rhs) 
+    {
+        analyticDipPot anaDP;
+        anaDP.init(q, r0);
+        AdaptiveIntegrator<double,analyticDipPot> adaptive(0.001);
+        adaptive.setOrder(gauss_order);
+        for (Mesh::const_iterator tit=m.begin();tit!=m.end();++tit) {
+            const double d = (adapt_rhs) ? adaptive.integrate(anaDP, *tit) : m.cache().integrate<double>(anaDP, tit-m.begin(), adaptive.getOrder());
+            rhs[tit->index()] += d * coeff;
+        }
+    }
 }
@@ -0,0 +1,385 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include <preconditioners.h>
+#include <assemble.h>
+
+#include "headmat.h"
+
+namespace OpenMEEG {
+
+    namespace {
+
+        //  Barycentric coordinates w of the point of the triangle (a,b,c) closest to p (Ericson, Real-Time Collision
+        //  Detection, 5.1.5). Returns the square of the distance.
+
+        double closest_point(const Vect3& p,const Vect3& a,const Vect3& b,const Vect3& c,double w[3]) {
+            const Vect3  ab = b-a;
+            const Vect3  ac = c-a;
+            const double d1 = ab*(p-a);
+            const double d2 = ac*(p-a);
+            const double d3 = ab*(p-b);
+            const double d4 = ac*(p-b);
+            const double d5 = ab*(p-c);
+            const double d6 = ac*(p-c);
+            const double va = d3*d6-d5*d4;
+            const double vb = d5*d2-d1*d6;
+            const double vc = d1*d4-d3*d2;
+            w[0] = w[1] = w[2] = 0.0;
+            if (d1<=0.0 && d2<=0.0) {
+                w[0] = 1.0;
+            } else if (d3>=0.0 && d4<=d3) {
+                w[1] = 1.0;
+            } else if (d6>=0.0 && d5<=d6) {
+                w[2] = 1.0;
+            } else if (vc<=0.0 && d1>=0.0 && d3<=0.0) {
+                w[1] = d1/(d1-d3);
+                w[0] = 1.0-w[1];
+            } else if (vb<=0.0 && d2>=0.0 && d6<=0.0) {
+                w[2] = d2/(d2-d6);
+                w[0] = 1.0-w[2];
+            } else if (va<=0.0 && d4-d3>=0.0 && d5-d6>=0.0) {
+                w[2] = (d4-d3)/((d4-d3)+(d5-d6));
+                w[1] = 1.0-w[2];
+            } else {
+                w[1] = vb/(va+vb+vc);
+                w[2] = vc/(va+vb+vc);
+                w[0] = 1.0-w[1]-w[2];
+            }
+            return (p-(a*w[0]+b*w[1]+c*w[2])).norm2();
+        }
+
+        //  Triangle of m closest to p (searched around the vertex of m closest to p), with the barycentric coordinates
+        //  of the closest point.
+
+        const Triangle& closest_triangle(const Mesh& m,const Vect3& p,double w[3]) {
+            unsigned nearest = 0;
+            double   dmin    = std::numeric_limits<double>::max();
+            for (Mesh::const_vertex_iterator vit=m.vertex_begin();vit!=m.vertex_end();++vit) {
+                const double d = (**vit-p).norm2();
+                if (d<dmin) {
+                    dmin    = d;
+                    nearest = vit-m.vertex_begin();
+                }
+            }
+
+            std::vector<unsigned> candidates;
+            const Mesh::Positions& incident = m.vertex_triangles(nearest);
+            for (Mesh::Positions::const_iterator it=incident.begin();it!=incident.end();++it) {
+                candidates.push_back(*it);
+                const Mesh::Positions& neighbours = m.triangle_neighbours(*it);
+                candidates.insert(candidates.end(),neighbours.begin(),neighbours.end());
+            }
+
+            const Triangle* best = 0;
+            dmin = std::numeric_limits<double>::max();
+            for (std::vector<unsigned>::const_iterator it=candidates.begin();it!=candidates.end();++it) {
+                const Triangle& t = *(m.begin()+*it);
+                double wt[3];
+                const double d = closest_point(p,t.s1(),t.s2(),t.s3(),wt);
+                if (d<dmin) {
+                    dmin = d;
+                    best = &t;
+                    std::copy(wt,wt+3,w);
+                }
+            }
+            return *best;
+        }
+    }
+
+    HeadMatUnknowns::HeadMatUnknowns(const Geometry& geo): spacing(0.0) {
+        const unsigned dimension = geo.size()-geo.nb_current_barrier_triangles();
+        positions.resize(dimension);
+        std::vector<bool> assigned(dimension,false);
+        double   length   = 0.0;
+        unsigned nb_edges = 0;
+        for (Geometry::const_iterator mit=geo.begin();mit!=geo.end();++mit) {
+            std::vector<unsigned> unknowns;
+            if (!mit->isolated()) {
+                for (Mesh::const_vertex_iterator vit=mit->vertex_begin();vit!=mit->vertex_end();++vit) {
+                    const unsigned index = (*vit)->index();
+                    if (!assigned[index]) {
+                        assigned[index]  = true;
+                        positions[index] = **vit;
+                        unknowns.push_back(index);
+                    }
+                }
+                if (!mit->current_barrier())
+                    for (Mesh::const_iterator tit=mit->begin();tit!=mit->end();++tit) {
+                        positions[tit->index()] = tit->center();
+                        unknowns.push_back(tit->index());
+                    }
+            }
+            for (Mesh::const_iterator tit=mit->begin();tit!=mit->end();++tit) {
+                length += (tit->s1()-tit->s2()).norm()+(tit->s2()-tit->s3()).norm()+(tit->s3()-tit->s1()).norm();
+                nb_edges += 3;
+            }
+            meshes.push_back(unknowns);
+            kernels.push_back(mit->current_barrier() && !mit->isolated() && !mit->outermost() && !unknowns.empty());
+        }
+        spacing = (nb_edges!=0) ? length/nb_edges : 1.0;
+    }
+
+    void MeshBlockPreconditioner::deflate(SymMatrix& block) {
+        const double coef = block(0,0)/block.nlin();
+        for (unsigned j=0;j<block.nlin();++j)
+            for (unsigned i=0;i<=j;++i)
+                block(i,j) += coef;
+    }
+
+    void MeshBlockPreconditioner::add_block(const std::vector<unsigned>& indices,SymMatrix& block) {
+        std::vector<double> inverse_diagonal(indices.size());
+        for (unsigned i=0;i<indices.size();++i)
+            inverse_diagonal[i] = 1.0/block(i,i);
+
+        const SymFactorization factorization(block,SymFactorization::BUNCH_KAUFMAN);
+        blocks.push_back(indices);
+        factors.push_back(factorization.valid() ? factorization : SymFactorization());
+        diagonals.push_back(factorization.valid() ? std::vector<double>() : inverse_diagonal);
+    }
+
+    Matrix MeshBlockPreconditioner::operator()(const Matrix& G) const {
+        om_assert(G.nlin()==dimension);
+        Matrix X(G,DEEP_COPY);
+        #pragma omp parallel for
+        for (int b=0;b<static_cast<int>(blocks.size());++b) {
+            const std::vector<unsigned>& indices = blocks[b];
+            Matrix Xb(indices.size(),G.ncol());
+            for (unsigned j=0;j<G.ncol();++j)
+                for (unsigned i=0;i<indices.size();++i)
+                    Xb(i,j) = G(indices[i],j);
+            if (diagonals[b].empty()) {
+                factors[b].solveLin(Xb);
+            } else {
+                for (unsigned j=0;j<G.ncol();++j)
+                    for (unsigned i=0;i<indices.size();++i)
+                        Xb(i,j) *= diagonals[b][i];
+            }
+            for (unsigned j=0;j<G.ncol();++j)
+                for (unsigned i=0;i<indices.size();++i)
+                    X(indices[i],j) = Xb(i,j);
+        }
+        return X;
+    }
+
+    Vector MeshBlockPreconditioner::operator()(const Vector& g) const {
+        Matrix G(g.nlin(),1);
+        G.setcol(0,g);
+        return operator()(G).getcol(0);
+    }
+
+    //  The unknowns are sorted in the cells of a regular grid of size radius (enlarged if there are many more cells
+    //  than unknowns), the neighbours of an unknown then being in the 27 cells around its own.
+
+    void NearFieldILU::pattern(const HeadMatUnknowns& unknowns,const double radius) {
+        const unsigned n = unknowns.size();
+        Vect3 pmin = unknowns.positions[0];
+        Vect3 pmax = unknowns.positions[0];
+        for (unsigned i=1;i<n;++i)
+            for (unsigned c=0;c<3;++c) {
+                pmin(c) = std::min(pmin(c),unknowns.positions[i](c));
+                pmax(c) = std::max(pmax(c),unknowns.positions[i](c));
+            }
+
+        double   cell = radius;
+        unsigned dims[3];
+        for (;;) {
+            for (unsigned c=0;c<3;++c)
+                dims[c] = static_cast<unsigned>((pmax(c)-pmin(c))/cell)+1;
+            if (static_cast<double>(dims[0])*dims[1]*dims[2]<=8.0*n)
+                break;
+            cell *= 2.0;
+        }
+
+        std::vector<unsigned> cells(n);
+        std::vector<unsigned> cell_start(dims[0]*dims[1]*dims[2]+1,0);
+        for (unsigned i=0;i<n;++i) {
+            unsigned ind[3];
+            for (unsigned c=0;c<3;++c)
+                ind[c] = static_cast<unsigned>((unknowns.positions[i](c)-pmin(c))/cell);
+            cells[i] = (ind[2]*dims[1]+ind[1])*dims[0]+ind[0];
+            ++cell_start[cells[i]+1];
+        }
+        for (unsigned k=1;k<cell_start.size();++k)
+            cell_start[k] += cell_start[k-1];
+        std::vector<unsigned> sorted(n);
+        std::vector<unsigned> fill(cell_start.begin(),cell_start.end()-1);
+        for (unsigned i=0;i<n;++i)
+            sorted[fill[cells[i]]++] = i;
+
+        std::vector<std::vector<unsigned> > neighbours(n);
+        #pragma omp parallel for
+        for (int i=0;i<static_cast<int>(n);++i) {
+            const Vect3& p = unknowns.positions[i];
+            int ind[3];
+            for (unsigned c=0;c<3;++c)
+                ind[c] = static_cast<int>((p(c)-pmin(c))/cell);
+            for (int z=std::max(ind[2]-1,0);z<=std::min(ind[2]+1,static_cast<int>(dims[2])-1);++z)
+                for (int y=std::max(ind[1]-1,0);y<=std::min(ind[1]+1,static_cast<int>(dims[1])-1);++y)
+                    for (int x=std::max(ind[0]-1,0);x<=std::min(ind[0]+1,static_cast<int>(dims[0])-1);++x) {
+                        const unsigned k = (z*dims[1]+y)*dims[0]+x;
+                        for (unsigned l=cell_start[k];l<cell_start[k+1];++l)
+                            if ((unknowns.positions[sorted[l]]-p).norm()<radius || sorted[l]==static_cast<unsigned>(i))
+                                neighbours[i].push_back(sorted[l]);
+                    }
+            std::sort(neighbours[i].begin(),neighbours[i].end());
+        }
+
+        rows.assign(1,0);
+        columns.clear();
+        for (unsigned i=0;i<n;++i) {
+            columns.insert(columns.end(),neighbours[i].begin(),neighbours[i].end());
+            rows.push_back(columns.size());
+        }
+    }
+
+    //  ILU(0) by rows (IKJ variant): row i is eliminated by the previous rows of its pattern, the updates falling outside
+    //  the pattern being dropped. Vanishing pivots are replaced by the diagonal entries of the HeadMat.
+
+    void NearFieldILU::factorize() {
+        const unsigned n = rows.size()-1;
+        diagonal.resize(n);
+        for (unsigned i=0;i<n;++i)
+            diagonal[i] = std::lower_bound(columns.begin()+rows[i],columns.begin()+rows[i+1],i)-columns.begin();
+
+        std::vector<int> position(n,-1);
+        for (unsigned i=0;i<n;++i) {
+            const double entry = values[diagonal[i]];
+            for (unsigned k=rows[i];k<rows[i+1];++k)
+                position[columns[k]] = k;
+            for (unsigned k=rows[i];k<diagonal[i];++k) {
+                const unsigned j = columns[k];
+                values[k] /= values[diagonal[j]];
+                for (unsigned l=diagonal[j]+1;l<rows[j+1];++l)
+                    if (position[columns[l]]>=0)
+                        values[position[columns[l]]] -= values[k]*values[l];
+            }
+            for (unsigned k=rows[i];k<rows[i+1];++k)
+                position[columns[k]] = -1;
+            if (std::abs(values[diagonal[i]])<=std::numeric_limits<double>::epsilon()*std::abs(entry))
+                values[diagonal[i]] = entry;
+        }
+    }
+
+    void NearFieldILU::solve(double* x) const {
+        const unsigned n = rows.size()-1;
+        for (unsigned i=0;i<n;++i)
+            for (unsigned k=rows[i];k<diagonal[i];++k)
+                x[i] -= values[k]*x[columns[k]];
+        for (unsigned i=n;i-->0;) {
+            for (unsigned k=diagonal[i]+1;k<rows[i+1];++k)
+                x[i] -= values[k]*x[columns[k]];
+            x[i] /= values[diagonal[i]];
+        }
+    }
+
+    Matrix NearFieldILU::operator()(const Matrix& G) const {
+        om_assert(G.nlin()==rows.size()-1);
+        Matrix X(G,DEEP_COPY);
+        #pragma omp parallel for
+        for (int j=0;j<static_cast<int>(G.ncol());++j)
+            solve(X.data()+j*X.nlin());
+        return X;
+    }
+
+    Vector NearFieldILU::operator()(const Vector& g) const {
+        Vector x(g,DEEP_COPY);
+        solve(x.data());
+        return x;
+    }
+
+    CoarseCorrection::CoarseCorrection(const Geometry& fine,const Geometry& coarse,const unsigned gauss_order) {
+        if (fine.nb_meshes()!=coarse.nb_meshes())
+            throw std::invalid_argument("CoarseCorrection: the coarse geometry does not match the fine one.");
+
+        const unsigned nfine   = fine.size()-fine.nb_current_barrier_triangles();
+        const unsigned ncoarse = coarse.size()-coarse.nb_current_barrier_triangles();
+        P = SparseMatrix(nfine,ncoarse);
+
+        std::vector<bool> interpolated(nfine,false);
+        for (Geometry::const_iterator fit=fine.begin(),cit=coarse.begin();fit!=fine.end();++fit,++cit) {
+            if (fit->isolated())
+                continue;
+            double w[3];
+            for (Mesh::const_vertex_iterator vit=fit->vertex_begin();vit!=fit->vertex_end();++vit) {
+                const unsigned i = (*vit)->index();
+                if (i>=nfine || interpolated[i])
+                    continue;
+                interpolated[i] = true;
+                const Triangle& t = closest_triangle(*cit,**vit,w);
+                for (unsigned c=0;c<3;++c)
+                    if (w[c]!=0.0)
+                        P(i,t.vertex(c).index()) += w[c];
+            }
+            if (!fit->current_barrier())
+                for (Mesh::const_iterator tit=fit->begin();tit!=fit->end();++tit)
+                    P(tit->index(),closest_triangle(*cit,tit->center(),w).index()) = 1.0;
+        }
+        Pt = P.transpose();
+
+        //  As the cortex of HeadMN1, the current barriers which are not outermost must be deflated in the coarse HeadMat
+        //  (see HeadMatUnknowns), whose factorization would otherwise amplify the constants of their kernel.
+
+        HeadMat HC(coarse,gauss_order);
+        const HeadMatUnknowns unknowns(coarse);
+        unsigned m = 0;
+        for (Geometry::const_iterator mit=coarse.begin();mit!=coarse.end();++mit,++m)
+            if (unknowns.kernels[m]) {
+                DeflationGroup group;
+                group.meshes.push_back(&*mit);
+                group.i_first     = (*mit->vertex_begin())->index();
+                group.nb_vertices = mit->vertex_size();
+                deflat(HC,group,HC(group.i_first,group.i_first)/group.nb_vertices);
+            }
+        factors = SymFactorization(HC,SymFactorization::BUNCH_KAUFMAN);
+        if (!factors.valid())
+            throw std::runtime_error("CoarseCorrection: the coarse HeadMat is singular.");
+    }
+
+    Matrix CoarseCorrection::operator()(const Matrix& R) const {
+        Matrix RC = Pt*R;
+        factors.solveLin(RC);
+        return P*RC;
+    }
+}
@@ -0,0 +1,180 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
+#include <task_scheduler.h>
+#include <mesh.h>
+
+namespace OpenMEEG {
+
+    Tiles make_tiles(const unsigned n1,const unsigned n2,const bool triangular,const unsigned tile_size) {
+        Tiles tiles;
+        for (unsigned i=0;i<n1;i+=tile_size) {
+            const unsigned j0 = (triangular) ? i : 0;
+            for (unsigned j=j0;j<n2;j+=tile_size)
+                tiles.push_back(Tile(i,std::min(i+tile_size,n1),j,std::min(j+tile_size,n2)));
+        }
+        return tiles;
+    }
+
+    #ifdef USE_OMP
+    BlockLock::BlockLock(): lock(new omp_lock_t),shared(0) { omp_init_lock(static_cast<omp_lock_t*>(lock)); }
+
+    BlockLock::~BlockLock() {
+        omp_destroy_lock(static_cast<omp_lock_t*>(lock));
+        delete static_cast<omp_lock_t*>(lock);
+    }
+
+    void BlockLock::set()   { omp_set_lock(static_cast<omp_lock_t*>((shared) ? shared->lock : lock)); }
+    void BlockLock::unset() { omp_unset_lock(static_cast<omp_lock_t*>((shared) ? shared->lock : lock)); }
+    #else
+    BlockLock::BlockLock(): lock(0),shared(0) { }
+    BlockLock::~BlockLock() { }
+    void BlockLock::set()   { }
+    void BlockLock::unset() { }
+    #endif
+
+    namespace {
+        bool larger_cost(const Task* t1,const Task* t2) { return t1->cost()>t2->cost(); }
+    }
+
+    void TaskScheduler::add(Task* task,const unsigned stage) {
+        if (stage>=stages.size())
+            stages.resize(stage+1);
+        stages[stage].push_back(task);
+    }
+
+    BlockLock& TaskScheduler::block_lock(const Mesh& m1,const Mesh& m2) {
+        const LockedBlock block = { new BlockLock, &m1, &m2 };
+        locks.push_back(block);
+        return *block.lock;
+    }
+
+    void TaskScheduler::share_locks() {
+        std::set<const Mesh*> meshes;
+        for (std::vector<LockedBlock>::const_iterator lit=locks.begin();lit!=locks.end();++lit) {
+            meshes.insert(lit->m1);
+            meshes.insert(lit->m2);
+        }
+
+        // Meshes having a vertex in common with another one.
+
+        std::map<const Vertex*,const Mesh*> owners;
+        std::set<const Mesh*>               shared;
+        for (std::set<const Mesh*>::const_iterator mit=meshes.begin();mit!=meshes.end();++mit)
+            for (Mesh::VectPVertex::const_iterator vit=(*mit)->vertices().begin();vit!=(*mit)->vertices().end();++vit) {
+                const std::pair<std::map<const Vertex*,const Mesh*>::iterator,bool> owner = owners.insert(std::make_pair(*vit,*mit));
+                if (!owner.second && owner.first->second!=*mit) {
+                    shared.insert(*mit);
+                    shared.insert(owner.first->second);
+                }
+            }
+
+        for (std::vector<LockedBlock>::iterator lit=locks.begin();lit!=locks.end();++lit)
+            lit->lock->shared = (shared.count(lit->m1)!=0 || shared.count(lit->m2)!=0) ? &common_lock : 0;
+    }
+
+    unsigned TaskScheduler::size() const {
+        unsigned n = 0;
+        for (std::vector<Stage>::const_iterator sit=stages.begin();sit!=stages.end();++sit)
+            n += sit->size();
+        return n;
+    }
+
+    void TaskScheduler::run() {
+
+        #ifdef USE_PROGRESSBAR
+        const unsigned ntasks = size();
+        unsigned done = 0;
+        #endif
+
+        share_locks();
+
+        for (std::vector<Stage>::iterator sit=stages.begin();sit!=stages.end();++sit) {
+
+            // Starting with the most expensive tasks leaves the small ones to fill the gaps at the end of the stage.
+
+            Stage& tasks = *sit;
+            std::stable_sort(tasks.begin(),tasks.end(),larger_cost);
+
+            #ifdef OPENMP_3_0
+            #pragma omp parallel
+            #pragma omp single nowait
+            for (Stage::const_iterator tit=tasks.begin();tit!=tasks.end();++tit) {
+                Task* task = *tit;
+                #pragma omp task firstprivate(task)
+                {
+                    task->run();
+                    #ifdef USE_PROGRESSBAR
+                    #pragma omp critical(task_scheduler_progress)
+                    PROGRESSBAR(done++,ntasks);
+                    #endif
+                }
+            }
+            #else
+            #pragma omp parallel for schedule(dynamic,1)
+            for (int i=0;i<static_cast<int>(tasks.size());++i) {
+                tasks[i]->run();
+                #ifdef USE_PROGRESSBAR
+                #pragma omp critical(task_scheduler_progress)
+                PROGRESSBAR(done++,ntasks);
+                #endif
+            }
+            #endif
+        }
+        clear();
+    }
+
+    void TaskScheduler::clear() {
+        for (std::vector<Stage>::iterator sit=stages.begin();sit!=stages.end();++sit)
+            for (Stage::iterator tit=sit->begin();tit!=sit->end();++tit)
+                delete *tit;
+        stages.clear();
+        for (std::vector<LockedBlock>::iterator lit=locks.begin();lit!=locks.end();++lit)
+            delete lit->lock;
+        locks.clear();
+    }
+}
@@ -0,0 +1,206 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <algorithm>
+
+#include <triangle_cache.h>
+
+namespace OpenMEEG {
+
+    void TriangleCache::build(const Triangles& triangles) {
+
+        const unsigned ntri = triangles.size();
+
+        for (unsigned order=0;order<4;++order) {
+            const unsigned n = nbPts[order];
+            Nodes& q = nodes[order];
+            q.x.resize(ntri*n);
+            q.y.resize(ntri*n);
+            q.z.resize(ntri*n);
+            q.w.resize(ntri*n);
+            for (unsigned t=0;t<ntri;++t) {
+                const Triangle& T = triangles[t];
+                const Vect3 points[3] = { T.s1(), T.s2(), T.s3() };
+
+                // Same nodes and weights as Integrator::triangle_integration.
+
+                const double S = ((points[1]-points[0])^(points[2]-points[0])).norm();
+                for (unsigned i=0;i<n;++i) {
+                    Vect3 v(0.0,0.0,0.0);
+                    for (unsigned j=0;j<3;++j)
+                        v.multadd(cordBars[order][i][j],points[j]);
+                    q.x[t*n+i] = v.x();
+                    q.y[t*n+i] = v.y();
+                    q.z[t*n+i] = v.z();
+                    q.w[t*n+i] = cordBars[order][i][3]*S;
+                }
+            }
+        }
+
+        analyS_.resize(ntri);
+        analyD3_.resize(ntri);
+        centers_.resize(ntri);
+        diameters_.resize(ntri);
+        for (unsigned t=0;t<ntri;++t) {
+            const Triangle& T = triangles[t];
+            analyS_[t].init(T);
+            analyD3_[t].init(T);
+            centers_[t]   = T.center();
+            diameters_[t] = std::max((T.s2()-T.s1()).norm(),std::max((T.s3()-T.s2()).norm(),(T.s1()-T.s3()).norm()));
+        }
+    }
+
+    void TriangleCache::integrate(const analyticS& fc,const unsigned t_begin,const unsigned t_end,const unsigned order,double* results) const {
+        const Nodes&   q     = nodes[order];
+        const unsigned n     = nbPts[order];
+        const unsigned first = t_begin*n;
+        const unsigned npts  = (t_end-t_begin)*n;
+        if (npts==0)
+            return;
+
+        std::vector<double> values(npts);
+        fc.f(npts,&q.x[first],&q.y[first],&q.z[first],&values[0]);
+
+        // Same summation order as integrate<double>.
+
+        for (unsigned t=0;t<t_end-t_begin;++t) {
+            double result = 0;
+            for (unsigned i=t*n;i<(t+1)*n;++i)
+                multadd(result,q.w[first+i],values[i]);
+            results[t] = result;
+        }
+    }
+
+    void TriangleCache::integrate(const analyticD3& fc,const unsigned t_begin,const unsigned t_end,const unsigned order,Vect3* results) const {
+        const Nodes&   q     = nodes[order];
+        const unsigned n     = nbPts[order];
+        const unsigned first = t_begin*n;
+        const unsigned npts  = (t_end-t_begin)*n;
+        if (npts==0)
+            return;
+
+        std::vector<double> values(3*npts);
+        fc.f(npts,&q.x[first],&q.y[first],&q.z[first],&values[0],&values[npts],&values[2*npts]);
+
+        for (unsigned t=0;t<t_end-t_begin;++t) {
+            Vect3 result = 0;
+            for (unsigned i=t*n;i<(t+1)*n;++i)
+                multadd(result,q.w[first+i],Vect3(values[i],values[npts+i],values[2*npts+i]));
+            results[t] = result;
+        }
+    }
+
+    void TriangleCache::gather(const unsigned t_begin,const unsigned t_end,const unsigned* orders,
+                               std::vector<double>& x,std::vector<double>& y,std::vector<double>& z,std::vector<double>& w) const
+    {
+        x.clear();
+        y.clear();
+        z.clear();
+        w.clear();
+        for (unsigned t=t_begin;t<t_end;++t) {
+            const unsigned order = orders[t-t_begin];
+            const Nodes&   q     = nodes[order];
+            const unsigned n     = nbPts[order];
+            x.insert(x.end(),q.x.begin()+t*n,q.x.begin()+(t+1)*n);
+            y.insert(y.end(),q.y.begin()+t*n,q.y.begin()+(t+1)*n);
+            z.insert(z.end(),q.z.begin()+t*n,q.z.begin()+(t+1)*n);
+            w.insert(w.end(),q.w.begin()+t*n,q.w.begin()+(t+1)*n);
+        }
+    }
+
+    void TriangleCache::integrate(const analyticS& fc,const unsigned t_begin,const unsigned t_end,const unsigned* orders,double* results) const {
+        if (t_end==t_begin)
+            return;
+
+        // Nodes are gathered only when the orders differ.
+
+        if (std::count(orders,orders+(t_end-t_begin),orders[0])==static_cast<int>(t_end-t_begin)) {
+            integrate(fc,t_begin,t_end,orders[0],results);
+            return;
+        }
+
+        std::vector<double> x,y,z,w;
+        gather(t_begin,t_end,orders,x,y,z,w);
+        std::vector<double> values(x.size());
+        fc.f(x.size(),&x[0],&y[0],&z[0],&values[0]);
+
+        for (unsigned t=0,i=0;t<t_end-t_begin;++t) {
+            double result = 0;
+            for (const unsigned end=i+nbPts[orders[t]];i<end;++i)
+                multadd(result,w[i],values[i]);
+            results[t] = result;
+        }
+    }
+
+    void TriangleCache::integrate(const analyticD3& fc,const unsigned t_begin,const unsigned t_end,const unsigned* orders,Vect3* results) const {
+        if (t_end==t_begin)
+            return;
+
+        if (std::count(orders,orders+(t_end-t_begin),orders[0])==static_cast<int>(t_end-t_begin)) {
+            integrate(fc,t_begin,t_end,orders[0],results);
+            return;
+        }
+
+        std::vector<double> x,y,z,w;
+        gather(t_begin,t_end,orders,x,y,z,w);
+        const unsigned npts = x.size();
+        std::vector<double> values(3*npts);
+        fc.f(npts,&x[0],&y[0],&z[0],&values[0],&values[npts],&values[2*npts]);
+
+        for (unsigned t=0,i=0;t<t_end-t_begin;++t) {
+            Vect3 result = 0;
+            for (const unsigned end=i+nbPts[orders[t]];i<end;++i)
+                multadd(result,w[i],Vect3(values[i],values[npts+i],values[2*npts+i]));
+            results[t] = result;
+        }
+    }
+
+    void TriangleCache::clear() {
+        for (unsigned order=0;order<4;++order) {
+            nodes[order].x.clear();
+            nodes[order].y.clear();
+            nodes[order].z.clear();
+            nodes[order].w.clear();
+        }
+        analyS_.clear();
+        analyD3_.clear();
+        centers_.clear();
+        diameters_.clear();
+    }
+}
@@ -121,6 +121,8 @@ extern "C" {
     #define CblasRight 'R'
     #define CblasLeft 'L'
     #define CblasUpper 'U'
+    #define CblasUnit 'U'
+    #define CblasNonUnit 'N'
     #define BLAS(x,X) FC_GLOBAL(x,X)
     #define LAPACK(x,X) FC_GLOBAL(x,X)
 
@@ -136,6 +138,7 @@ extern "C" {
         void BLAS(dsymm,DSYMM)(const char&,const char&,const int&,const int&,const double&,const double*,const int&,const double*,const int&, const double&,double*,const int&);
         void BLAS(dgemm,DGEMM)(const char&,const char&,const int&,const int&,const int&,const double&,const double*,const int&,const double*,const int&,const double&,double*,const int&);
         void BLAS(dtrmm,DTRMM)(const char&,const char&,const char&,const char&,const int&,const int&,const double&,const double*,const int&,const double*,const int&);
+        void BLAS(dtrsm,DTRSM)(const char&,const char&,const char&,const char&,const int&,const int&,const double&,const double*,const int&,double*,const int&);
         void BLAS(dgemv,DGEMV)(const char&,const int&,const int&,const double&,const double*,const int&,const double*,const int&,const double&,double*,const int&);
     }
 #endif
@@ -157,8 +160,16 @@ extern "C" {
         void FC_GLOBAL(dsptri,DSPTRI)(const char&,const int&,double*,int*,double*,int&);
         void FC_GLOBAL(dpptrf,DPPTRF)(const char&,const int&,double*,int&);
         void FC_GLOBAL(dpptri,DPPTRI)(const char&,const int&,double*,int&);
+        void FC_GLOBAL(dtrtri,DTRTRI)(const char&,const char&,const int&,double*,const int&,int&);
+        void FC_GLOBAL(dpftrf,DPFTRF)(const char&,const char&,const int&,double*,int&);
+        void FC_GLOBAL(dpftri,DPFTRI)(const char&,const char&,const int&,double*,int&);
+        void FC_GLOBAL(dpftrs,DPFTRS)(const char&,const char&,const int&,const int&,const double*,double*,const int&,int&);
         void FC_GLOBAL(dspevd,DSPEVD)(const char&,const char&,const int&,double*,double*,double*,const int&,double*,const int&,int*,const int&,int&);
         void FC_GLOBAL(dsptrs,DSPTRS)(const char&,const int&,const int&,double*,int*,double*,const int&,int&);
+        void FC_GLOBAL(ssptrf,SSPTRF)(const char&,const int&,float*,int*,int&);
+        void FC_GLOBAL(ssptrs,SSPTRS)(const char&,const int&,const int&,float*,int*,float*,const int&,int&);
+        void FC_GLOBAL(dgeqrf,DGEQRF)(const int&,const int&,double*,const int&,double*,double*,const int&,int&);
+        void FC_GLOBAL(dorgqr,DORGQR)(const int&,const int&,const int&,double*,const int&,const double*,double*,const int&,int&);
     }
 #endif
 
@@ -170,8 +181,16 @@ extern "C" {
 #define DTPTRI FC_GLOBAL(dtptri,DTPTRI)
 #define DPPTRF FC_GLOBAL(dpptrf,DPPTRF)
 #define DPPTRI FC_GLOBAL(dpptri,DPPTRI)
+#define DTRTRI FC_GLOBAL(dtrtri,DTRTRI)
+#define DPFTRF FC_GLOBAL(dpftrf,DPFTRF)
+#define DPFTRI FC_GLOBAL(dpftri,DPFTRI)
+#define DPFTRS FC_GLOBAL(dpftrs,DPFTRS)
 #define DSPEVD FC_GLOBAL(dspevd,DSPEVD)
 #define DSPTRS FC_GLOBAL(dsptrs,DSPTRS)
+#define SSPTRF FC_GLOBAL(ssptrf,SSPTRF)
+#define SSPTRS FC_GLOBAL(ssptrs,SSPTRS)
+#define DGEQRF FC_GLOBAL(dgeqrf,DGEQRF)
+#define DORGQR FC_GLOBAL(dorgqr,DORGQR)
 
 #if defined(USE_ATLAS) || defined(USE_MKL)
     #define DGER(X1,X2,X3,X4,X5,X6,X7,X8,X9) BLAS(dger,DGER)(CblasColMajor,X1,X2,X3,X4,X5,X6,X7,X8,X9)
@@ -181,6 +200,7 @@ extern "C" {
     #define DGEMV(X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11) BLAS(dgemv,DGEMV)(CblasColMajor,X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11)
     #define DGEMM(X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11,X12,X13) BLAS(dgemm,DGEMM)(CblasColMajor,X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11,X12,X13)
     #define DTRMM(X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11) BLAS(dtrmm,DTRMM)(CblasColMajor,X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11)
+    #define DTRSM(X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11) BLAS(dtrsm,DTRSM)(CblasColMajor,X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11)
     #if defined(USE_ATLAS)
         #ifdef __APPLE__
             #define DGETRF(X1,X2,X3,X4,X5,X6) LAPACK(dgetrf,DGETRF)(&X1,&X2,X3,&X4,X5,&X6)
@@ -204,6 +224,7 @@ extern "C" {
     #define DGEMV(X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11) BLAS(dgemv,DGEMV)(X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11)
     #define DGEMM(X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11,X12,X13) BLAS(dgemm,DGEMM)(X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11,X12,X13)
     #define DTRMM(X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11) BLAS(dtrmm,DTRMM)(X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11)
+    #define DTRSM(X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11) BLAS(dtrsm,DTRSM)(X1,X2,X3,X4,X5,X6,X7,X8,X9,X10,X11)
     #define DGETRF LAPACK(dgetrf,DGETRF)
     #if defined(USE_ACML)
         #define DGETRI(X1,X2,X3,X4,X5,X6,X7) LAPACK(dgetri,DGETRI)(X1,X2,X3,X4,X7)
@@ -0,0 +1,114 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "OpenMEEGMathsConfig.h"
+#include "matrix.h"
+
+namespace OpenMEEG {
+
+    /// Reads blocks of columns of a full matrix stored in the binary format (.bin, see TrivialBinIO), in which the
+    /// columns are contiguous, without loading the rest of the matrix (e.g. the DipSourceMat of many dipoles).
+
+    class OPENMEEGMATHS_EXPORT ColumnReader {
+    public:
+
+        explicit ColumnReader(const std::string& filename);
+
+        size_t nlin() const { return rows; }
+        size_t ncol() const { return cols; }
+
+        /// Columns first to first+n-1.
+
+        Matrix read(const size_t first,const size_t n);
+
+    private:
+
+        std::ifstream is;
+        std::string   name;
+        size_t        rows;
+        size_t        cols;
+    };
+
+    /// Writes a nlin x ncol matrix in the binary format (.bin, see TrivialBinIO) by blocks of columns appended in
+    /// order. A thread writes the blocks while the next ones are computed, at most max_pending of them waiting to
+    /// be written (append() waits otherwise), so that the memory does not depend on the number of columns.
+    /// close() waits for the last blocks and throws if the file could not be written or is incomplete.
+
+    class OPENMEEGMATHS_EXPORT ColumnWriter {
+    public:
+
+        ColumnWriter(const std::string& filename,const size_t nlin,const size_t ncol,const unsigned max_pending=2);
+        ~ColumnWriter();
+
+        void append(const Matrix& columns);
+        void close();
+
+    private:
+
+        ColumnWriter(const ColumnWriter&);
+        ColumnWriter& operator=(const ColumnWriter&);
+
+        void write_blocks();
+        void stop();
+
+        std::ofstream                   os;
+        std::string                     name;
+        const size_t                    rows;
+        const size_t                    cols;
+        const unsigned                  max_blocks;
+        size_t                          appended;
+        bool                            closing;
+        bool                            failed;
+        std::deque<std::vector<double> > pending;  // the first block is the one being written
+        std::mutex                      mutex;
+        std::condition_variable         ready;     // a block was appended or the writer is closing
+        std::condition_variable         space;     // a block was written
+        std::thread                     writer;
+    };
+}
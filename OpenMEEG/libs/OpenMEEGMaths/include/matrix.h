@@ -426,27 +426,6 @@ namespace OpenMEEG {
             return C;
     }
 
-    inline Matrix Matrix::operator*(const SymMatrix &B) const {
-        om_assert(ncol()==B.ncol());
-        Matrix C(nlin(),B.ncol());
-
-    #ifdef HAVE_BLAS
-        Matrix D(B);
-        const int n = nlin();
-        const int m = D.ncol();
-        const int l = C.nlin();
-        DSYMM(CblasRight,CblasUpper,n,m,1.,D.data(),m,data(),n,0.,C.data(),l);
-    #else
-        for (size_t j=0;j<B.ncol();j++)
-            for (size_t i=0;i<ncol();i++) {
-                C(i,j)=0;
-                for (size_t k=0;k<ncol();k++)
-                    C(i,j)+=(*this)(i,k)*B(k,j);
-            }
-    #endif
-            return C;
-    }
-    
     inline Matrix Matrix::operator+(const Matrix &B) const {
         om_assert(ncol()==B.ncol());
         om_assert(nlin()==B.nlin());
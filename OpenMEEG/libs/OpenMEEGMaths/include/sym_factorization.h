@@ -0,0 +1,115 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "OpenMEEGMathsConfig.h"
+#include "matrix.h"
+#include "symmatrix.h"
+
+namespace OpenMEEG {
+
+    /// Factorization of a symmetric matrix kept to solve systems A X = B for many right hand sides, possibly
+    /// in other programs (see save() and load()): om_minverser -factor writes the one of a HeadMat, which then
+    /// serves the gains of all the sensors and sources of the subject. Three methods are available:
+    /// - UDUT: the tiled A = UDU' factorization without pivoting (see TiledLDLt),
+    /// - BUNCH_KAUFMAN: the packed LAPACK factorization with symmetric pivoting (DSPTRF),
+    /// - MIXED: the same factorization in single precision (SSPTRF), which is about twice as fast. The matrix is
+    ///   also kept in single precision, so that the factors and the matrix take the memory of the double precision
+    ///   factors. The solutions are refined by GMRES-IR (the residuals are computed in double precision, the
+    ///   corrections by GMRes preconditioned by the factors): they are the ones of the matrix rounded to single
+    ///   precision, whose relative error is about cond(A) 6e-8.
+
+    class OPENMEEGMATHS_EXPORT SymFactorization {
+    public:
+
+        typedef enum { UDUT, BUNCH_KAUFMAN, MIXED } Method;
+
+        SymFactorization(): factorization_method(UDUT),factorized(false),dim(0),norm(0.0) { }
+
+        /// Factorize A in place (A then holds the factors). The UDUT factorization fails (see valid()) when a
+        /// pivot vanishes, A is then lost and must be factorized again with the BUNCH_KAUFMAN method.
+        /// The MIXED method leaves A unchanged.
+
+        explicit SymFactorization(SymMatrix& A,const Method m=UDUT);
+
+        explicit SymFactorization(const char* filename): factorization_method(UDUT),factorized(false),dim(0),norm(0.0) { load(filename); }
+
+        bool   valid()  const { return factorized;           }
+        Method method() const { return factorization_method; }
+        size_t nlin()   const { return dim;                  }
+
+        /// Replace B by the solution X of A X = B. With the MIXED method, the refinement of a column stops when
+        /// its residual is at the rounding level of double precision or after max_refinements corrections, each
+        /// made of at most gmres_iterations GMRes steps.
+
+        void solveLin(Matrix& B) const;
+
+        /// Binary file holding the method, the pivots and the factors (in the PACKED order).
+
+        void save(const char* filename) const;
+        void load(const char* filename);
+
+        void save(const std::string& s) const { save(s.c_str()); }
+        void load(const std::string& s)       { load(s.c_str()); }
+
+        /// Tells whether filename holds a factorization (and not a matrix).
+
+        static bool identify(const char* filename);
+        static bool identify(const std::string& s) { return identify(s.c_str()); }
+
+        static const unsigned max_refinements  = 30;
+        static const unsigned gmres_iterations = 10;
+
+    private:
+
+        void refine(Matrix& B) const;
+
+        SymMatrix          F;              // factors (UDUT and BUNCH_KAUFMAN)
+        std::vector<float> single_factors; // MIXED: packed single precision factors
+        std::vector<float> single_matrix;  // MIXED: packed single precision matrix
+        std::vector<int>   pivots;
+        Method             factorization_method;
+        bool               factorized;
+        size_t             dim;
+        double             norm;           // MIXED: infinity norm of the matrix
+    };
+}
@@ -43,6 +43,7 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #include <iostream>
 #include <cstdlib>
 #include <string>
+#include <algorithm>
 
 #include <vector.h>
 #include <linop.h>
@@ -53,18 +54,34 @@ namespace OpenMEEG {
 
     class OPENMEEGMATHS_EXPORT SymMatrix : public LinOp {
 
+    public:
+
+        /// Storage of the upper triangle, all layouts use N(N+1)/2 values:
+        /// - PACKED: LAPACK upper packed columns,
+        /// - RFP: LAPACK Rectangular Full Packed (TRANSR='N', UPLO='U'),
+        /// - TILED: tile_size x tile_size tiles stored column of tiles by column of tiles, the off-diagonal
+        ///   tiles being full column major blocks and the diagonal ones upper packed.
+        /// Files are always written and read in the PACKED order.
+
+        typedef enum { PACKED, RFP, TILED } Layout;
+
+        static const size_t tile_size = 128;
+
+    private:
+
         friend class Vector;
 
         utils::RCPtr<LinOpValue> value;
+        Layout                   storage_layout;
 
     public:
 
-        SymMatrix(): LinOp(0,0,SYMMETRIC,2),value() {}
+        SymMatrix(): LinOp(0,0,SYMMETRIC,2),value(),storage_layout(PACKED) {}
 
-        SymMatrix(const char* fname): LinOp(0,0,SYMMETRIC,2),value() { this->load(fname); }
-        SymMatrix(size_t N): LinOp(N,N,SYMMETRIC,2),value(new LinOpValue(size())) { }
-        SymMatrix(size_t M,size_t N): LinOp(N,N,SYMMETRIC,2),value(new LinOpValue(size())) { om_assert(N==M); }
-        SymMatrix(const SymMatrix& S,const DeepCopy): LinOp(S.nlin(),S.nlin(),SYMMETRIC,2),value(new LinOpValue(S.size(),S.data())) { }
+        SymMatrix(const char* fname): LinOp(0,0,SYMMETRIC,2),value(),storage_layout(PACKED) { this->load(fname); }
+        SymMatrix(size_t N,const Layout l=PACKED): LinOp(N,N,SYMMETRIC,2),value(new LinOpValue(size())),storage_layout(l) { }
+        SymMatrix(size_t M,size_t N): LinOp(N,N,SYMMETRIC,2),value(new LinOpValue(size())),storage_layout(PACKED) { om_assert(N==M); }
+        SymMatrix(const SymMatrix& S,const DeepCopy): LinOp(S.nlin(),S.nlin(),SYMMETRIC,2),value(new LinOpValue(S.size(),S.data())),storage_layout(S.layout()) { }
 
         explicit SymMatrix(const Vector& v);
         explicit SymMatrix(const Matrix& A);
@@ -82,9 +99,47 @@ namespace OpenMEEG {
         void set(double x) ;
         double* data() const { return value->data; }
 
+        Layout layout() const { return storage_layout; }
+
+        /// Change the storage layout, converting the values if any.
+
+        void set_layout(const Layout l);
+
+        /// Deep copy of the matrix stored with the layout l.
+
+        SymMatrix converted(const Layout l) const;
+
+        /// Position in data() of the value (i,j) with i<=j.
+
+        inline size_t index(size_t i,size_t j) const;
+
+        /// Column major storage (leading dimension tile_size) of the off-diagonal tile (I,J), I<J, of a TILED matrix.
+
+        double* tile(const size_t I,const size_t J) const {
+            const size_t nj = std::min(tile_size,nlin()-J*tile_size);
+            return data()+J*tile_size*(J*tile_size+1)/2+I*tile_size*nj;
+        }
+
         inline double operator()(size_t i,size_t j) const;
         inline double& operator()(size_t i,size_t j) ;
 
+        /// Entries of a matrix stored in the PACKED layout, addressed without the dispatch on the layout of
+        /// operator() (for the inner loops of the assembly, see assemble_entries in operators.h).
+
+        class PackedEntries {
+        public:
+
+            PackedEntries(const SymMatrix& m): values(m.data()) { om_assert(m.layout()==PACKED); }
+
+            double& operator()(const size_t i,const size_t j) const {
+                return (i<=j) ? values[i+j*(j+1)/2] : values[j+i*(i+1)/2];
+            }
+
+        private:
+
+            double* values;
+        };
+
         Matrix    operator()(size_t i_start, size_t i_end, size_t j_start, size_t j_end) const;
         Matrix    submat(size_t istart, size_t isize, size_t jstart, size_t jsize) const;
         SymMatrix submat(size_t istart, size_t iend) const;
@@ -123,25 +178,40 @@ namespace OpenMEEG {
         friend class Matrix;
     };
 
+    inline size_t SymMatrix::index(size_t i,size_t j) const {
+        switch (storage_layout) {
+            case RFP: {
+                const size_t n1 = nlin()/2;
+                const size_t ld = (nlin()%2) ? nlin() : nlin()+1;
+                return (j>=n1) ? i+(j-n1)*ld : n1+1+j+i*ld;
+            }
+            case TILED: {
+                const size_t I  = i/tile_size;
+                const size_t J  = j/tile_size;
+                const size_t ii = i-I*tile_size;
+                const size_t jj = j-J*tile_size;
+                const size_t nj = std::min(tile_size,nlin()-J*tile_size);
+                const size_t column = J*tile_size*(J*tile_size+1)/2+I*tile_size*nj;
+                return (I<J) ? column+ii+jj*tile_size : column+ii+jj*(jj+1)/2;
+            }
+            default:
+                return i+j*(j+1)/2;
+        }
+    }
+
     inline double SymMatrix::operator()(size_t i,size_t j) const {
         om_assert(i<nlin() && j<nlin());
-        if(i<=j)
-            return data()[i+j*(j+1)/2];
-        else
-            return data()[j+i*(i+1)/2];
+        return (i<=j) ? data()[index(i,j)] : data()[index(j,i)];
     }
 
     inline double& SymMatrix::operator()(size_t i,size_t j) {
         om_assert(i<nlin() && j<nlin());
-        if(i<=j)
-            return data()[i+j*(j+1)/2];
-        else
-            return data()[j+i*(i+1)/2];
+        return (i<=j) ? data()[index(i,j)] : data()[index(j,i)];
     }
 
     //returns the solution of (this)*X = B
     inline Vector SymMatrix::solveLin(const Vector &B) const {
-        SymMatrix invA(*this,DEEP_COPY);
+        SymMatrix invA = converted(PACKED);
         Vector X(B,DEEP_COPY);
 
     #ifdef HAVE_LAPACK
@@ -161,7 +231,7 @@ namespace OpenMEEG {
 
     // stores in B the solution of (this)*X = B, where B is a set of nbvect vector
     inline void SymMatrix::solveLin(Vector * B, int nbvect) {
-        SymMatrix invA(*this,DEEP_COPY);
+        SymMatrix invA = converted(PACKED);
 
     #ifdef HAVE_LAPACK
         // Bunch Kaufman Factorization
@@ -179,8 +249,9 @@ namespace OpenMEEG {
     #endif
     }
 
-    inline void SymMatrix::operator -=(const SymMatrix &B) {
-        om_assert(nlin()==B.nlin());
+    inline void SymMatrix::operator -=(const SymMatrix &M) {
+        om_assert(nlin()==M.nlin());
+        const SymMatrix& B = (M.layout()==layout()) ? M : M.converted(layout());
     #ifdef HAVE_BLAS
         BLAS(daxpy,DAXPY)((int)(nlin()*(nlin()+1)/2), -1.0, B.data(), 1, data() , 1);
     #else
@@ -189,8 +260,9 @@ namespace OpenMEEG {
     #endif
     }
 
-    inline void SymMatrix::operator +=(const SymMatrix &B) {
-        om_assert(nlin()==B.nlin());
+    inline void SymMatrix::operator +=(const SymMatrix &M) {
+        om_assert(nlin()==M.nlin());
+        const SymMatrix& B = (M.layout()==layout()) ? M : M.converted(layout());
     #ifdef HAVE_BLAS
         BLAS(daxpy,DAXPY)((int)(nlin()*(nlin()+1)/2), 1.0, B.data(), 1, data() , 1);
     #else
@@ -201,20 +273,28 @@ namespace OpenMEEG {
 
     inline SymMatrix SymMatrix::posdefinverse() const {
         // supposes (*this) is definite positive
-        SymMatrix invA(*this,DEEP_COPY);
     #ifdef HAVE_LAPACK
-        // U'U factorization then inverse
+        // U'U factorization then inverse, with the blocked routines for the RFP layout.
         int Info;
+        if (layout()==RFP) {
+            SymMatrix invA(*this,DEEP_COPY);
+            DPFTRF('N','U',nlin(),invA.data(),Info);
+            DPFTRI('N','U',nlin(),invA.data(),Info);
+            return invA;
+        }
+        SymMatrix invA = converted(PACKED);
         DPPTRF('U',nlin(),invA.data(),Info);
         DPPTRI('U',nlin(),invA.data(),Info);
+        invA.set_layout(layout());
     #else
+        SymMatrix invA(*this,DEEP_COPY);
         std::cerr << "Positive definite inverse not defined" << std::endl;
     #endif
         return invA;
     }
 
     inline double SymMatrix::det() {
-        SymMatrix invA(*this,DEEP_COPY);
+        SymMatrix invA = converted(PACKED);
         double d = 1.0;
     #ifdef HAVE_LAPACK
         // Bunch Kaufmqn
@@ -269,8 +349,9 @@ namespace OpenMEEG {
     // #endif
     // }
 
-    inline SymMatrix SymMatrix::operator +(const SymMatrix &B) const {
-        om_assert(nlin()==B.nlin());
+    inline SymMatrix SymMatrix::operator +(const SymMatrix &M) const {
+        om_assert(nlin()==M.nlin());
+        const SymMatrix& B = (M.layout()==layout()) ? M : M.converted(layout());
         SymMatrix C(*this,DEEP_COPY);
     #ifdef HAVE_BLAS
         BLAS(daxpy,DAXPY)((int)(nlin()*(nlin()+1)/2), 1.0, B.data(), 1, C.data() , 1);
@@ -281,9 +362,10 @@ namespace OpenMEEG {
         return C;
     }
 
-    inline SymMatrix SymMatrix::operator -(const SymMatrix &B) const
+    inline SymMatrix SymMatrix::operator -(const SymMatrix &M) const
     {
-        om_assert(nlin()==B.nlin());
+        om_assert(nlin()==M.nlin());
+        const SymMatrix& B = (M.layout()==layout()) ? M : M.converted(layout());
         SymMatrix C(*this,DEEP_COPY);
     #ifdef HAVE_BLAS
         BLAS(daxpy,DAXPY)((int)(nlin()*(nlin()+1)/2), -1.0, B.data(), 1, C.data() , 1);
@@ -296,7 +378,7 @@ namespace OpenMEEG {
 
     inline SymMatrix SymMatrix::inverse() const {
     #ifdef HAVE_LAPACK
-        SymMatrix invA(*this, DEEP_COPY);
+        SymMatrix invA = converted(PACKED);
         // LU
         int *pivots = new int[nlin()];
         int Info;
@@ -308,6 +390,7 @@ namespace OpenMEEG {
 
         delete[] pivots;
         delete[] work;
+        invA.set_layout(layout());
         return invA;
     #else
         std::cerr << "!!!!! Inverse not implemented !!!!!" << std::endl;
@@ -317,6 +400,8 @@ namespace OpenMEEG {
 
     inline void SymMatrix::invert() {
     #ifdef HAVE_LAPACK
+        const Layout l = layout();
+        set_layout(PACKED);
         // LU
         int *pivots = new int[nlin()];
         int Info;
@@ -328,6 +413,7 @@ namespace OpenMEEG {
 
         delete[] pivots;
         delete[] work;
+        set_layout(l);
         return;
     #else
         std::cerr << "!!!!! Inverse not implemented !!!!!" << std::endl;
@@ -335,21 +421,6 @@ namespace OpenMEEG {
     #endif
     }
 
-    inline Vector SymMatrix::operator *(const Vector &v) const {
-        om_assert(nlin()==v.size());
-        Vector y(nlin());
-    #ifdef HAVE_BLAS
-        DSPMV(CblasUpper,(int)nlin(),1.,data(),v.data(),1,0.,y.data(),1);
-    #else
-        for (size_t i=0;i<nlin();i++) {
-            y(i)=0;
-            for (size_t j=0;j<nlin();j++)
-                y(i)+=(*this)(i,j)*v(j);
-        }
-    #endif
-        return y;
-    }
-
     inline Vector SymMatrix::getlin(size_t i) const {
         om_assert(i<nlin());
         Vector v(ncol());
@@ -0,0 +1,87 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#pragma once
+
+#include "OpenMEEGMathsConfig.h"
+#include "matrix.h"
+#include "symmatrix.h"
+
+namespace OpenMEEG {
+
+    /// Factorization A = UDU' (U unit upper triangular, D diagonal) of a symmetric matrix, computed in place in
+    /// the half storage of a TILED SymMatrix: D is stored on the diagonal and U above it. The tile kernels are
+    /// BLAS-3 calls and the tiles of each step are processed in parallel.
+    /// The unknowns are eliminated from the last one and there is no pivoting, so the factorization fails if a
+    /// pivot vanishes (see valid()). This suits the HeadMat, whose unknowns of the triangles come last, use
+    /// SymMatrix::invert() or solveLin() for general symmetric matrices.
+
+    class OPENMEEGMATHS_EXPORT TiledLDLt {
+    public:
+
+        /// Factorize A in place: A is converted to the TILED layout and then holds the factors.
+
+        TiledLDLt(SymMatrix& A);
+
+        /// Use A (converted to the TILED layout) as an already computed factorization.
+
+        TiledLDLt(SymMatrix& A,const bool factorized);
+
+        bool valid() const { return factorized; }
+
+        const SymMatrix& factors() const { return F; }
+
+        /// Replace B by the solution X of A X = B.
+
+        void solve(Matrix& B) const;
+
+        /// Replace the factors by the inverse of A, which is returned.
+
+        SymMatrix& invert();
+
+    private:
+
+        bool   factorize();
+        size_t dim(const size_t K) const { return std::min(SymMatrix::tile_size,F.nlin()-K*SymMatrix::tile_size); }
+
+        SymMatrix F;
+        size_t    ntiles;
+        bool      factorized;
+    };
+}
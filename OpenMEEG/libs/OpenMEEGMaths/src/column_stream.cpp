@@ -0,0 +1,146 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <sstream>
+#include <algorithm>
+
+#include "Exceptions.H"
+#include "column_stream.h"
+
+namespace OpenMEEG {
+
+    //  Binary format: the number of lines and of columns (unsigned) followed by the columns.
+
+    ColumnReader::ColumnReader(const std::string& filename): is(filename.c_str(),std::ios::binary),name(filename) {
+        if (!is.is_open())
+            throw maths::BadFileOpening(filename,maths::BadFileOpening::READ);
+
+        unsigned header[2];
+        is.read(reinterpret_cast<char*>(header),sizeof(header));
+        rows = header[0];
+        cols = header[1];
+
+        is.seekg(0,std::ios::end);
+        const std::streamoff size = is.tellg();
+        if (!is || size!=static_cast<std::streamoff>(sizeof(header)+rows*cols*sizeof(double)))
+            throw maths::BadContent("binary",filename+" full matrix");
+    }
+
+    Matrix ColumnReader::read(const size_t first,const size_t n) {
+        om_assert(first+n<=cols);
+        Matrix M(rows,n);
+        is.seekg(2*sizeof(unsigned)+first*rows*sizeof(double),std::ios::beg);
+        is.read(reinterpret_cast<char*>(M.data()),rows*n*sizeof(double));
+        if (!is)
+            throw maths::BadData("binary");
+        return M;
+    }
+
+    ColumnWriter::ColumnWriter(const std::string& filename,const size_t nlin,const size_t ncol,const unsigned max_pending):
+        os(filename.c_str(),std::ios::binary),name(filename),rows(nlin),cols(ncol),max_blocks(std::max(max_pending,1U)),
+        appended(0),closing(false),failed(false)
+    {
+        if (!os.is_open())
+            throw maths::BadFileOpening(filename,maths::BadFileOpening::WRITE);
+
+        const unsigned header[2] = { static_cast<unsigned>(nlin), static_cast<unsigned>(ncol) };
+        os.write(reinterpret_cast<const char*>(header),sizeof(header));
+        writer = std::thread(&ColumnWriter::write_blocks,this);
+    }
+
+    ColumnWriter::~ColumnWriter() { stop(); }
+
+    //  The blocks are copied, the Matrix reference counts not being shared safely between threads.
+
+    void ColumnWriter::append(const Matrix& columns) {
+        om_assert(columns.nlin()==rows && appended+columns.ncol()<=cols);
+        std::vector<double> block(columns.data(),columns.data()+columns.nlin()*columns.ncol());
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (pending.size()>=max_blocks)
+            space.wait(lock);
+        pending.push_back(std::vector<double>());
+        pending.back().swap(block);
+        appended += columns.ncol();
+        ready.notify_one();
+    }
+
+    void ColumnWriter::close() {
+        stop();
+        os.close();
+        if (failed || !os)
+            throw maths::BadData("binary");
+        if (appended!=cols) {
+            std::ostringstream message;
+            message << "Only " << appended << " of the " << cols << " columns of " << name << " were written.";
+            throw maths::IOException(message.str());
+        }
+    }
+
+    void ColumnWriter::stop() {
+        if (!writer.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        ready.notify_one();
+        writer.join();
+    }
+
+    void ColumnWriter::write_blocks() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            while (pending.empty() && !closing)
+                ready.wait(lock);
+            if (pending.empty())
+                return;
+
+            const std::vector<double>& block = pending.front();
+            lock.unlock();
+            if (!block.empty())
+                os.write(reinterpret_cast<const char*>(&block[0]),block.size()*sizeof(double));
+            lock.lock();
+
+            failed = failed || !os;
+            pending.pop_front();
+            space.notify_one();
+        }
+    }
+}
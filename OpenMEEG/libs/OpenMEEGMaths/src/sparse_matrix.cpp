@@ -37,11 +37,25 @@ The fact that you are presently reading this means that you have had
 knowledge of the CeCILL-B license and that you accept its terms.
 */
 
+#include <vector>
+#include <algorithm>
+
 #include "sparse_matrix.h"
 #include "symmatrix.h"
 
 namespace OpenMEEG {
 
+    namespace {
+
+        struct Entry {
+            Entry(const size_t l,const size_t c,const double v): i(l),j(c),val(v) { }
+            size_t i,j;
+            double val;
+        };
+
+        bool by_column(const Entry& e1,const Entry& e2) { return e1.j<e2.j; }
+    }
+
     double SparseMatrix::frobenius_norm() const {
         double d = 0.;
         for ( const_iterator it = m_tank.begin() ; it != m_tank.end(); ++it) {
@@ -66,20 +80,57 @@ namespace OpenMEEG {
         return ret;
     }
 
+    //  Column k of the packed storage of mat holds mat(j,k) for j<=k. The product is done in two
+    //  passes which both read this storage contiguously: the entries with j<=k column by column,
+    //  then the entries with j>k, which form the beginning of the packed column j.
+
     Matrix SparseMatrix::operator*(const SymMatrix &mat) const
     {
         om_assert(ncol()==mat.nlin());
         Matrix out(nlin(),mat.ncol());
         out.set(0.0);
 
-        Tank::const_iterator it;
-        for(it = m_tank.begin(); it != m_tank.end(); ++it) {
-            size_t i = it->first.first;
-            size_t j = it->first.second;
-            double val = it->second;
-            for(size_t k = 0; k < mat.ncol(); ++k) {
-                out(i,k) += val * mat(j,k);
+        if (mat.layout()!=SymMatrix::PACKED) {
+            for (Tank::const_iterator it=m_tank.begin();it!=m_tank.end();++it)
+                for (size_t k=0;k<mat.ncol();++k)
+                    out(it->first.first,k) += it->second*mat(it->first.second,k);
+            return out;
+        }
+
+        std::vector<Entry> entries;
+        std::vector<size_t> rows(1,0);
+        for (Tank::const_iterator it=m_tank.begin();it!=m_tank.end();++it) {
+            if (!entries.empty() && it->first.first!=entries.back().i)
+                rows.push_back(entries.size());
+            entries.push_back(Entry(it->first.first,it->first.second,it->second));
+        }
+        rows.push_back(entries.size());
+
+        const double* packed = mat.data();
+
+        //  Entries in the lower part: the rows of the result are accumulated by distinct threads.
+
+        #pragma omp parallel for
+        for (int r=0;r<static_cast<int>(rows.size())-1;++r) {
+            std::vector<double> row(mat.ncol(),0.0);
+            for (size_t e=rows[r];e<rows[r+1];++e) {
+                const double* column = packed+entries[e].j*(entries[e].j+1)/2;
+                for (size_t k=0;k<entries[e].j;++k)
+                    row[k] += entries[e].val*column[k];
             }
+            if (rows[r]<rows[r+1])
+                for (size_t k=0;k<mat.ncol();++k)
+                    out(entries[rows[r]].i,k) += row[k];
+        }
+
+        //  Entries in the upper part (and the diagonal): the columns of the result are independent.
+
+        std::stable_sort(entries.begin(),entries.end(),by_column);
+        #pragma omp parallel for
+        for (int k=0;k<static_cast<int>(mat.ncol());++k) {
+            const double* column = packed+static_cast<size_t>(k)*(k+1)/2;
+            for (size_t e=0;e<entries.size() && entries[e].j<=static_cast<size_t>(k);++e)
+                out(entries[e].i,k) += entries[e].val*column[entries[e].j];
         }
 
         return out;
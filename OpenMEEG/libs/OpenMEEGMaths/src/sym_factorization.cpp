@@ -0,0 +1,396 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <algorithm>
+
+#include "Exceptions.H"
+#include "tiled_ldlt.h"
+#include "sym_factorization.h"
+
+namespace OpenMEEG {
+
+    namespace {
+
+        const char magic[8] = { 'O', 'M', 'S', 'Y', 'M', 'F', 'A', 'C' };
+
+        const unsigned version = 1;
+
+        template <typename T>
+        void write_values(std::ofstream& os,const T* values,const size_t n) {
+            os.write(reinterpret_cast<const char*>(values),n*sizeof(T));
+        }
+
+        template <typename T>
+        void read_values(std::ifstream& is,T* values,const size_t n) {
+            is.read(reinterpret_cast<char*>(values),n*sizeof(T));
+        }
+
+        //  Infinity norm of the upper packed n x n symmetric matrix A.
+
+        template <typename T>
+        double infinity_norm(const T* A,const size_t n) {
+            std::vector<double> rows(n,0.0);
+            for (size_t j=0;j<n;++j) {
+                const T* column = A+j*(j+1)/2;
+                for (size_t i=0;i<j;++i) {
+                    rows[i] += std::abs(column[i]);
+                    rows[j] += std::abs(column[i]);
+                }
+                rows[j] += std::abs(column[j]);
+            }
+            return (n==0) ? 0.0 : *std::max_element(rows.begin(),rows.end());
+        }
+
+        //  y = A x in double precision, A being upper packed in single precision.
+
+        void product(const float* A,const size_t n,const double* x,double* y) {
+            std::fill(y,y+n,0.0);
+            for (size_t j=0;j<n;++j) {
+                const float* column = A+j*(j+1)/2;
+                double s = 0.0;
+                for (size_t i=0;i<j;++i) {
+                    y[i] += column[i]*x[j];
+                    s    += column[i]*x[i];
+                }
+                y[j] += s+column[j]*x[j];
+            }
+        }
+
+        double vector_norm(const double* x,const size_t n) {
+            double norm = 0.0;
+            for (size_t i=0;i<n;++i)
+                norm = std::max(norm,std::abs(x[i]));
+            return norm;
+        }
+
+        double dot(const double* x,const double* y,const size_t n) {
+            double s = 0.0;
+            for (size_t i=0;i<n;++i)
+                s += x[i]*y[i];
+            return s;
+        }
+
+        //  The single precision matrix and factors of the MIXED method, with the workspace of the GMRes of a column.
+
+        class MixedSystem {
+        public:
+
+            MixedSystem(const float* a,float* f,int* p,const size_t size,const unsigned m):
+                A(a),factors(f),pivots(p),n(size),iterations(m),V((m+1)*size),H((m+1)*m),cs(m),sn(m),g(m+1),w(size),z(size) { }
+
+            //  Approximate solution d of A d = r by at most iterations steps of GMRes, left preconditioned by the single
+            //  precision factors (GMRES-IR, Carson and Higham). The preconditioned matrix is close to the identity, so
+            //  that a few steps are enough, even when plain refinement by single precision solves would diverge.
+
+            void correction(const double* r,double* d) {
+                precondition(r,&V[0]);
+                const double beta = std::sqrt(dot(&V[0],&V[0],n));
+                std::fill(d,d+n,0.0);
+                if (beta==0.0)
+                    return;
+                for (size_t i=0;i<n;++i)
+                    V[i] /= beta;
+                std::fill(g.begin(),g.end(),0.0);
+                g[0] = beta;
+
+                unsigned k = 0;
+                while (k<iterations) {
+                    product(A,n,&V[k*n],&w[0]);
+                    double* v = &V[(k+1)*n];
+                    precondition(&w[0],v);
+                    double* h = &H[k*(iterations+1)];
+                    for (unsigned i=0;i<=k;++i) {
+                        h[i] = dot(v,&V[i*n],n);
+                        for (size_t l=0;l<n;++l)
+                            v[l] -= h[i]*V[i*n+l];
+                    }
+                    h[k+1] = std::sqrt(dot(v,v,n));
+                    if (h[k+1]!=0.0)
+                        for (size_t l=0;l<n;++l)
+                            v[l] /= h[k+1];
+
+                    for (unsigned i=0;i<k;++i) {
+                        const double t = cs[i]*h[i]+sn[i]*h[i+1];
+                        h[i+1] = -sn[i]*h[i]+cs[i]*h[i+1];
+                        h[i]   = t;
+                    }
+                    const double rho = std::sqrt(h[k]*h[k]+h[k+1]*h[k+1]);
+                    cs[k] = h[k]/rho;
+                    sn[k] = h[k+1]/rho;
+                    h[k]   = rho;
+                    h[k+1] = 0.0;
+                    g[k+1] = -sn[k]*g[k];
+                    g[k]   = cs[k]*g[k];
+                    ++k;
+                    if (std::abs(g[k])<=inner_tolerance*beta)
+                        break;
+                }
+
+                for (unsigned i=k;i-->0;) {
+                    for (unsigned j=i+1;j<k;++j)
+                        g[i] -= H[j*(iterations+1)+i]*g[j];
+                    g[i] /= H[i*(iterations+1)+i];
+                }
+                for (unsigned i=0;i<k;++i)
+                    for (size_t l=0;l<n;++l)
+                        d[l] += g[i]*V[i*n+l];
+            }
+
+        private:
+
+            //  y = F^{-1} x with the single precision factors F.
+
+            void precondition(const double* x,double* y) {
+                for (size_t i=0;i<n;++i)
+                    z[i] = static_cast<float>(x[i]);
+                int Info;
+                SSPTRS('U',static_cast<int>(n),1,factors,pivots,&z[0],static_cast<int>(n),Info);
+                for (size_t i=0;i<n;++i)
+                    y[i] = z[i];
+            }
+
+            static const double inner_tolerance;
+
+            const float*        A;
+            float*              factors;
+            int*                pivots;
+            const size_t        n;
+            const unsigned      iterations;
+            std::vector<double> V;
+            std::vector<double> H;
+            std::vector<double> cs;
+            std::vector<double> sn;
+            std::vector<double> g;
+            std::vector<double> w;
+            std::vector<float>  z;
+        };
+
+        const double MixedSystem::inner_tolerance = 1e-4;
+    }
+
+    SymFactorization::SymFactorization(SymMatrix& A,const Method m):
+        factorization_method(m),factorized(false),dim(A.nlin()),norm(0.0)
+    {
+        if (m==UDUT) {
+            TiledLDLt factorization(A);
+            F = factorization.factors();
+            factorized = factorization.valid();
+            return;
+        }
+
+    #ifdef HAVE_LAPACK
+        pivots.resize(dim);
+        int Info;
+        if (m==MIXED) {
+            const SymMatrix& P = (A.layout()==SymMatrix::PACKED) ? A : A.converted(SymMatrix::PACKED);
+            single_matrix.resize(dim*(dim+1)/2);
+            for (size_t k=0;k<single_matrix.size();++k)
+                single_matrix[k] = static_cast<float>(P.data()[k]);
+            norm = infinity_norm(&single_matrix[0],dim);
+            single_factors = single_matrix;
+            SSPTRF('U',dim,&single_factors[0],&pivots[0],Info);
+        } else {
+            A.set_layout(SymMatrix::PACKED);
+            F = A;
+            DSPTRF('U',dim,F.data(),&pivots[0],Info);
+        }
+        factorized = (Info==0);
+    #else
+        std::cerr << "Bunch-Kaufman factorization not defined without LAPACK" << std::endl;
+    #endif
+    }
+
+    //  The columns of B are solved by blocks of tile_size columns, in parallel.
+
+    void SymFactorization::solveLin(Matrix& B) const {
+        om_assert(factorized && B.nlin()==dim);
+
+        if (factorization_method==UDUT) {
+            SymMatrix A(F);
+            TiledLDLt(A,true).solve(B);
+            return;
+        }
+
+        if (factorization_method==MIXED) {
+            refine(B);
+            return;
+        }
+
+    #ifdef HAVE_LAPACK
+        const size_t nb      = SymMatrix::tile_size;
+        const int    ld      = static_cast<int>(B.nlin());
+        const int    nblocks = static_cast<int>((B.ncol()+nb-1)/nb);
+        int* ipiv = const_cast<int*>(&pivots[0]);
+
+        #pragma omp parallel for
+        for (int b=0;b<nblocks;++b) {
+            const size_t c0 = b*nb;
+            const int    nc = static_cast<int>(std::min(nb,B.ncol()-c0));
+            int Info;
+            DSPTRS('U',ld,nc,F.data(),ipiv,B.data()+c0*ld,ld,Info);
+        }
+    #else
+        std::cerr << "solveLin not defined" << std::endl;
+    #endif
+    }
+
+    //  GMRES-IR: the residuals are computed in double precision with the single precision matrix, the corrections are
+    //  given by GMRes preconditioned by the single precision factors (see MixedSystem). As in LAPACK DSPOSV, a column
+    //  has converged when ||r|| <= ||x|| ||A|| eps sqrt(n) (infinity norms).
+
+    void SymFactorization::refine(Matrix& B) const {
+    #ifdef HAVE_LAPACK
+        const size_t ld        = B.nlin();
+        const double tolerance = norm*std::numeric_limits<double>::epsilon()*std::sqrt(static_cast<double>(dim));
+        float* factors = const_cast<float*>(&single_factors[0]);
+        int*   ipiv    = const_cast<int*>(&pivots[0]);
+
+        int failures = 0;
+        #pragma omp parallel for reduction(+:failures)
+        for (int c=0;c<static_cast<int>(B.ncol());++c) {
+            MixedSystem system(&single_matrix[0],factors,ipiv,dim,gmres_iterations);
+            double* x = B.data()+c*ld;
+            const std::vector<double> b(x,x+ld);
+            std::vector<double> r(b);
+            std::vector<double> d(ld);
+            std::fill(x,x+ld,0.0);
+
+            bool converged = false;
+            for (unsigned it=0;it<=max_refinements && !converged;++it) {
+                system.correction(&r[0],&d[0]);
+                for (size_t i=0;i<ld;++i)
+                    x[i] += d[i];
+                product(&single_matrix[0],dim,x,&r[0]);
+                for (size_t i=0;i<ld;++i)
+                    r[i] = b[i]-r[i];
+                converged = vector_norm(&r[0],ld)<=tolerance*vector_norm(x,ld);
+            }
+            if (!converged)
+                ++failures;
+        }
+
+        if (failures!=0)
+            std::cerr << "Warning: the iterative refinement did not converge for " << failures << " of the "
+                      << B.ncol() << " systems (ill-conditioned matrix)." << std::endl;
+    #else
+        std::cerr << "solveLin not defined" << std::endl;
+    #endif
+    }
+
+    //  File: magic, version, method and size, the pivots (BUNCH_KAUFMAN and MIXED), then the upper triangle of
+    //  the factors column by column (for MIXED, the packed single precision factors followed by the matrix).
+
+    void SymFactorization::save(const char* filename) const {
+        std::ofstream os(filename,std::ios::binary);
+        if (!os.is_open())
+            throw maths::BadFileOpening(filename,maths::BadFileOpening::WRITE);
+
+        const unsigned header[3] = { version, static_cast<unsigned>(factorization_method), static_cast<unsigned>(dim) };
+        write_values(os,magic,8);
+        write_values(os,header,3);
+        if (factorization_method!=UDUT)
+            write_values(os,&pivots[0],pivots.size());
+
+        if (factorization_method==MIXED) {
+            write_values(os,&single_factors[0],single_factors.size());
+            write_values(os,&single_matrix[0],single_matrix.size());
+            return;
+        }
+
+        std::vector<double> column(dim);
+        for (size_t j=0;j<dim;++j) {
+            for (size_t i=0;i<=j;++i)
+                column[i] = F.data()[F.index(i,j)];
+            write_values(os,&column[0],j+1);
+        }
+    }
+
+    void SymFactorization::load(const char* filename) {
+        std::ifstream is(filename,std::ios::binary);
+        if (!is.is_open())
+            throw maths::BadFileOpening(filename,maths::BadFileOpening::READ);
+
+        char     m[8];
+        unsigned header[3];
+        read_values(is,m,8);
+        read_values(is,header,3);
+        if (!is || std::memcmp(m,magic,8) || header[0]!=version || header[1]>MIXED)
+            throw maths::BadHeader(is);
+
+        factorization_method = static_cast<Method>(header[1]);
+        dim = header[2];
+        pivots.clear();
+        if (factorization_method!=UDUT) {
+            pivots.resize(dim);
+            read_values(is,&pivots[0],pivots.size());
+        }
+
+        single_factors.clear();
+        single_matrix.clear();
+        if (factorization_method==MIXED) {
+            single_factors.resize(dim*(dim+1)/2);
+            single_matrix.resize(dim*(dim+1)/2);
+            read_values(is,&single_factors[0],single_factors.size());
+            read_values(is,&single_matrix[0],single_matrix.size());
+            F = SymMatrix();
+            norm = infinity_norm(&single_matrix[0],dim);
+        } else {
+            F = SymMatrix(dim,(factorization_method==UDUT) ? SymMatrix::TILED : SymMatrix::PACKED);
+            std::vector<double> column(dim);
+            for (size_t j=0;j<dim;++j) {
+                read_values(is,&column[0],j+1);
+                for (size_t i=0;i<=j;++i)
+                    F.data()[F.index(i,j)] = column[i];
+            }
+        }
+        if (!is)
+            throw maths::BadData("symmetric factorization");
+        factorized = true;
+    }
+
+    bool SymFactorization::identify(const char* filename) {
+        std::ifstream is(filename,std::ios::binary);
+        char m[8];
+        return is.read(m,8) && !std::memcmp(m,magic,8);
+    }
+}
@@ -40,6 +40,8 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #include <sstream>
 #include <cmath>
 #include <cstdlib>
+#include <vector>
+#include <algorithm>
 
 #include "OpenMEEGMathsConfig.h"
 #include "matrix.h"
@@ -48,32 +50,102 @@ knowledge of the CeCILL-B license and that you accept its terms.
 
 namespace OpenMEEG {
 
+    namespace {
+
+        //  Size of the blocks used by the products with a PACKED or RFP symmetric matrix
+        //  (TILED matrices use their own tiles).
+
+        const size_t block_size = 256;
+
+        //  Copy the block [i0,i0+ni)x[j0,j0+nj) of a symmetric matrix in a column major tile.
+        //  For the PACKED layout, both loops read the storage contiguously.
+
+        void unpack_tile(const SymMatrix& A,const size_t i0,const size_t ni,const size_t j0,const size_t nj,double* tile) {
+            if (A.layout()!=SymMatrix::PACKED) {
+                for (size_t j=0;j<nj;++j)
+                    for (size_t i=0;i<ni;++i)
+                        tile[j*ni+i] = A(i0+i,j0+j);
+                return;
+            }
+            const double* packed = A.data();
+            for (size_t j=j0;j<j0+nj;++j) {
+                const size_t iend = std::min(i0+ni,j+1);
+                if (iend>i0)
+                    std::copy(packed+i0+j*(j+1)/2,packed+iend+j*(j+1)/2,tile+(j-j0)*ni);
+            }
+            for (size_t i=std::max(i0,j0+1);i<i0+ni;++i) {
+                const size_t jend = std::min(j0+nj,i);
+                for (size_t j=j0;j<jend;++j)
+                    tile[(j-j0)*ni+i-i0] = packed[j+i*(i+1)/2];
+            }
+        }
+
+        //  Values of the block [i0,i0+ni)x[j0,j0+nj) with their leading dimension. The off-diagonal tiles
+        //  of a TILED matrix are used in place (transposed below the diagonal), other blocks are unpacked.
+
+        const double* block(const SymMatrix& A,const size_t i0,const size_t ni,const size_t j0,const size_t nj,
+                            double* buffer,bool& transposed,int& ld)
+        {
+            transposed = false;
+            if (A.layout()==SymMatrix::TILED && i0!=j0) {
+                ld = SymMatrix::tile_size;
+                if (i0<j0)
+                    return A.tile(i0/SymMatrix::tile_size,j0/SymMatrix::tile_size);
+                transposed = true;
+                return A.tile(j0/SymMatrix::tile_size,i0/SymMatrix::tile_size);
+            }
+            ld = ni;
+            unpack_tile(A,i0,ni,j0,nj,buffer);
+            return buffer;
+        }
+    }
+
+    const size_t SymMatrix::tile_size;
+
     const SymMatrix& SymMatrix::operator=(const double d) {
         for(size_t i=0;i<size();i++) data()[i]=d;
         return *this;
     }
 
-    SymMatrix::SymMatrix(const Vector& v) {
+    SymMatrix::SymMatrix(const Vector& v): storage_layout(PACKED) {
         size_t N = v.size();
         nlin() = (size_t)((sqrt((double)(1+8*N))-1)/2+0.1);
         om_assert(nlin()*(nlin()+1)/2==N);
         value = v.value;
     }
 
-    SymMatrix::SymMatrix(const Matrix& M): LinOp(M.nlin(),M.nlin(),SYMMETRIC,2),value(new LinOpValue(size())){
+    SymMatrix::SymMatrix(const Matrix& M): LinOp(M.nlin(),M.nlin(),SYMMETRIC,2),value(new LinOpValue(size())),storage_layout(PACKED) {
         om_assert(nlin() == M.nlin());
         for (size_t i=0; i<nlin();++i)
             for (size_t j=i; j<nlin();++j)
                 (*this)(i,j) = M(i,j);
     }
 
+    SymMatrix SymMatrix::converted(const Layout l) const {
+        SymMatrix C(nlin(),l);
+        if (l==layout()) {
+            std::copy(data(),data()+size(),C.data());
+            return C;
+        }
+        for (size_t j=0;j<nlin();++j)
+            for (size_t i=0;i<=j;++i)
+                C.data()[C.index(i,j)] = data()[index(i,j)];
+        return C;
+    }
+
+    void SymMatrix::set_layout(const Layout l) {
+        if (l!=layout() && nlin()!=0)
+            value = converted(l).value;
+        storage_layout = l;
+    }
+
     void SymMatrix::set(double x) {
         for (size_t i=0;i<(nlin()*(nlin()+1))/2;i++)
             data()[i]=x;
     }
 
     SymMatrix SymMatrix::operator *(double x) const {
-        SymMatrix C(nlin());
+        SymMatrix C(nlin(),layout());
         for (size_t k=0; k<nlin()*(nlin()+1)/2; k++) C.data()[k] = data()[k]*x;
         return C;
     }
@@ -132,13 +204,31 @@ namespace OpenMEEG {
     #endif
     }
 
+    //  The products with a dense matrix work on the storage by tiles: each tile is unpacked in a small
+    //  buffer (or used in place for TILED matrices) and multiplied with DGEMM, so the matrix is never
+    //  expanded to a full one. The tiles of a given block of the result are handled by a single thread.
+
     Matrix SymMatrix::operator*(const Matrix &B) const
     {
         om_assert(ncol()==B.nlin());
         Matrix C(nlin(),B.ncol());
     #ifdef HAVE_BLAS
-        Matrix D(*this);
-        DSYMM(CblasLeft,CblasUpper ,(int)nlin(), (int)B.ncol(), 1. , D.data(), (int)D.ncol(), B.data(), (int)B.nlin(), 0, C.data(),(int)C.nlin());
+        const size_t N  = nlin();
+        const size_t nb = (layout()==TILED) ? tile_size : block_size;
+        const int nblocks = static_cast<int>((N+nb-1)/nb);
+        #pragma omp parallel for
+        for (int ib=0;ib<nblocks;++ib) {
+            const size_t i0 = ib*nb;
+            const size_t ni = std::min(nb,N-i0);
+            std::vector<double> buffer(ni*nb);
+            for (size_t j0=0;j0<N;j0+=nb) {
+                const size_t nj = std::min(nb,N-j0);
+                bool transposed;
+                int  ld;
+                const double* A = block(*this,i0,ni,j0,nj,&buffer[0],transposed,ld);
+                DGEMM((transposed)?CblasTrans:CblasNoTrans,CblasNoTrans,(int)ni,(int)B.ncol(),(int)nj,1.,A,ld,B.data()+j0,(int)B.nlin(),(j0==0)?0.:1.,C.data()+i0,(int)C.nlin());
+            }
+        }
     #else
         for ( size_t j = 0; j < B.ncol(); ++j) {
             for ( size_t i = 0; i < ncol(); ++i) {
@@ -152,10 +242,65 @@ namespace OpenMEEG {
         return C;
     }
 
+    Matrix Matrix::operator*(const SymMatrix &B) const
+    {
+        om_assert(ncol()==B.nlin());
+        Matrix C(nlin(),B.ncol());
+    #ifdef HAVE_BLAS
+        if (C.nlin()==0)
+            return C;
+        const size_t N  = B.nlin();
+        const size_t nb = (B.layout()==SymMatrix::TILED) ? SymMatrix::tile_size : block_size;
+        const int nblocks = static_cast<int>((N+nb-1)/nb);
+        #pragma omp parallel for
+        for (int jb=0;jb<nblocks;++jb) {
+            const size_t j0 = jb*nb;
+            const size_t nj = std::min(nb,N-j0);
+            std::vector<double> buffer(nb*nj);
+            for (size_t i0=0;i0<N;i0+=nb) {
+                const size_t ni = std::min(nb,N-i0);
+                bool transposed;
+                int  ld;
+                const double* A = block(B,i0,ni,j0,nj,&buffer[0],transposed,ld);
+                DGEMM(CblasNoTrans,(transposed)?CblasTrans:CblasNoTrans,(int)nlin(),(int)nj,(int)ni,1.,data()+i0*nlin(),(int)nlin(),A,ld,(i0==0)?0.:1.,C.data()+j0*C.nlin(),(int)C.nlin());
+            }
+        }
+    #else
+        for (size_t j=0;j<B.ncol();j++)
+            for (size_t i=0;i<nlin();i++) {
+                C(i,j)=0;
+                for (size_t k=0;k<ncol();k++)
+                    C(i,j)+=(*this)(i,k)*B(k,j);
+            }
+    #endif
+        return C;
+    }
+
+    Vector SymMatrix::operator*(const Vector &v) const {
+        om_assert(nlin()==v.size());
+        Vector y(nlin());
+    #ifdef HAVE_BLAS
+        if (layout()==PACKED) {
+            DSPMV(CblasUpper,(int)nlin(),1.,data(),v.data(),1,0.,y.data(),1);
+        } else {
+            Matrix V(nlin(),1);
+            V.setcol(0,v);
+            y = ((*this)*V).getcol(0);
+        }
+    #else
+        for (size_t i=0;i<nlin();i++) {
+            y(i)=0;
+            for (size_t j=0;j<nlin();j++)
+                y(i)+=(*this)(i,j)*v(j);
+        }
+    #endif
+        return y;
+    }
+
     Matrix SymMatrix::solveLin(Matrix &RHS) const
     {
     #ifdef HAVE_LAPACK
-        SymMatrix A(*this,DEEP_COPY);
+        SymMatrix A = converted(PACKED);
         // LU
         int *pivots=new int[nlin()];
         int Info;
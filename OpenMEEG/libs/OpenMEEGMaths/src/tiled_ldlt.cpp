@@ -0,0 +1,301 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include "tiled_ldlt.h"
+
+namespace OpenMEEG {
+
+    namespace {
+
+        const size_t nb = SymMatrix::tile_size;
+
+        //  The diagonal tiles are upper packed, they are expanded to column major n x n blocks for the kernels.
+
+        double* diagonal_tile(const SymMatrix& F,const size_t K) { return F.data()+F.index(K*nb,K*nb); }
+
+        void unpack_upper(const double* packed,const size_t n,double* dense) {
+            for (size_t j=0;j<n;++j)
+                std::copy(packed+j*(j+1)/2,packed+(j+1)*(j+2)/2,dense+j*n);
+        }
+
+        void pack_upper(const double* dense,const size_t n,double* packed) {
+            for (size_t j=0;j<n;++j)
+                std::copy(dense+j*n,dense+j*n+j+1,packed+j*(j+1)/2);
+        }
+    }
+
+    TiledLDLt::TiledLDLt(SymMatrix& A): ntiles((A.nlin()+nb-1)/nb) {
+        A.set_layout(SymMatrix::TILED);
+        F = A;
+        factorized = factorize();
+    }
+
+    TiledLDLt::TiledLDLt(SymMatrix& A,const bool f): ntiles((A.nlin()+nb-1)/nb),factorized(f) {
+        A.set_layout(SymMatrix::TILED);
+        F = A;
+    }
+
+    //  Factorization from the last tile column to the first one, for each tile column k:
+    //  - UDU' factorization of the diagonal tile,
+    //  - panel: V_ik = A_ik U_kk^{-T} and U_ik = V_ik D_k^{-1},
+    //  - update of the leading tiles: A_ij -= V_ik U_jk'.
+    //  For the HeadMat, this eliminates the unknowns of the triangles (S blocks) before those of the vertices,
+    //  whose leading blocks (N operators of closed surfaces) alone are singular.
+
+    bool TiledLDLt::factorize() {
+
+        //  Without pivoting, a tiny pivot means an unstable factorization, which is reported as a failure.
+
+        double scale = 0.0;
+        for (size_t i=0;i<F.nlin();++i)
+            scale = std::max(scale,std::abs(F(i,i)));
+        const double threshold = scale*std::sqrt(std::numeric_limits<double>::epsilon());
+
+        std::vector<double> diag(nb*nb);
+        std::vector<double> column(nb);
+        std::vector<double> panel;
+        for (size_t k=ntiles;k-->0;) {
+            const size_t nk = dim(k);
+
+            unpack_upper(diagonal_tile(F,k),nk,&diag[0]);
+            double* a = &diag[0];
+            for (size_t j=nk;j-->0;) {
+                const double d = a[j+j*nk];
+                if (!(std::abs(d)>threshold))
+                    return false;
+                for (size_t l=0;l<j;++l) {
+                    column[l]   = a[l+j*nk];
+                    a[l+j*nk] /= d;
+                }
+                for (size_t l=0;l<j;++l)
+                    for (size_t m=0;m<=l;++m)
+                        a[m+l*nk] -= a[m+j*nk]*column[l];
+            }
+            pack_upper(a,nk,diagonal_tile(F,k));
+
+            const int npanel = static_cast<int>(k);
+            panel.resize(npanel*nb*nb);
+
+            #pragma omp parallel for
+            for (int i=0;i<npanel;++i) {
+                double* U = F.tile(i,k);
+                double* V = &panel[i*nb*nb];
+                DTRSM(CblasRight,CblasUpper,CblasTrans,CblasUnit,(int)nb,(int)nk,1.,a,(int)nk,U,(int)nb);
+                for (size_t c=0;c<nk;++c)
+                    for (size_t r=0;r<nb;++r) {
+                        V[r+c*nb]  = U[r+c*nb];
+                        U[r+c*nb] /= a[c+c*nk];
+                    }
+            }
+
+            std::vector<std::pair<size_t,size_t> > updates;
+            for (size_t j=0;j<k;++j)
+                for (size_t i=0;i<=j;++i)
+                    updates.push_back(std::make_pair(i,j));
+
+            #pragma omp parallel for schedule(dynamic)
+            for (int t=0;t<static_cast<int>(updates.size());++t) {
+                const size_t i = updates[t].first;
+                const size_t j = updates[t].second;
+                const double* V = &panel[i*nb*nb];
+                const double* U = F.tile(j,k);
+                if (i<j) {
+                    DGEMM(CblasNoTrans,CblasTrans,(int)nb,(int)nb,(int)nk,-1.,V,(int)nb,U,(int)nb,1.,F.tile(i,j),(int)nb);
+                } else {
+                    std::vector<double> W(nb*nb);
+                    DGEMM(CblasNoTrans,CblasTrans,(int)nb,(int)nb,(int)nk,1.,V,(int)nb,U,(int)nb,0.,&W[0],(int)nb);
+                    double* packed = diagonal_tile(F,i);
+                    for (size_t c=0;c<nb;++c)
+                        for (size_t r=0;r<=c;++r)
+                            packed[r+c*(c+1)/2] -= W[r+c*nb];
+                }
+            }
+        }
+
+        return true;
+    }
+
+    //  X = U^{-T} D^{-1} U^{-1} B. The columns of B are independent and are processed by blocks in parallel.
+
+    void TiledLDLt::solve(Matrix& B) const {
+        om_assert(factorized && B.nlin()==F.nlin());
+
+        const int ld      = static_cast<int>(B.nlin());
+        const int nblocks = static_cast<int>((B.ncol()+nb-1)/nb);
+
+        #pragma omp parallel for
+        for (int b=0;b<nblocks;++b) {
+            const size_t c0 = b*nb;
+            const int    nc = static_cast<int>(std::min(nb,B.ncol()-c0));
+            double* X = B.data()+c0*ld;
+            std::vector<double> diag(nb*nb);
+
+            for (size_t k=ntiles;k-->0;) {
+                const size_t nk = dim(k);
+                unpack_upper(diagonal_tile(F,k),nk,&diag[0]);
+                DTRSM(CblasLeft,CblasUpper,CblasNoTrans,CblasUnit,(int)nk,nc,1.,&diag[0],(int)nk,X+k*nb,ld);
+                for (size_t i=0;i<k;++i)
+                    DGEMM(CblasNoTrans,CblasNoTrans,(int)nb,nc,(int)nk,-1.,F.tile(i,k),(int)nb,X+k*nb,ld,1.,X+i*nb,ld);
+            }
+
+            for (size_t i=0;i<F.nlin();++i) {
+                const double dinv = 1.0/F(i,i);
+                for (int c=0;c<nc;++c)
+                    X[i+c*ld] *= dinv;
+            }
+
+            for (size_t k=0;k<ntiles;++k) {
+                const size_t nk = dim(k);
+                for (size_t i=0;i<k;++i)
+                    DGEMM(CblasTrans,CblasNoTrans,(int)nk,nc,(int)nb,-1.,F.tile(i,k),(int)nb,X+i*nb,ld,1.,X+k*nb,ld);
+                unpack_upper(diagonal_tile(F,k),nk,&diag[0]);
+                DTRSM(CblasLeft,CblasUpper,CblasTrans,CblasUnit,(int)nk,nc,1.,&diag[0],(int)nk,X+k*nb,ld);
+            }
+        }
+    }
+
+    //  A^{-1} = X' D^{-1} X with X = U^{-1}, both steps in place:
+    //  - X_ij = -(sum_{i<=k<j} X_ik U_kj) X_jj for the tile columns j in increasing order,
+    //  - (A^{-1})_ij = sum_{k<=i} X_ki' D_k^{-1} X_kj for the tile rows i in decreasing order.
+    //  The tiles of a column (resp. row) are computed in parallel in a buffer before being stored.
+
+    SymMatrix& TiledLDLt::invert() {
+        om_assert(factorized);
+
+        std::vector<double> dinv(F.nlin());
+        for (size_t i=0;i<F.nlin();++i)
+            dinv[i] = 1.0/F(i,i);
+
+        //  Inverses of the unit diagonal tiles (DTRTRI does not touch the diagonal, which keeps D).
+
+        #pragma omp parallel for
+        for (int k=0;k<static_cast<int>(ntiles);++k) {
+            const size_t nk = dim(k);
+            std::vector<double> diag(nk*nk);
+            unpack_upper(diagonal_tile(F,k),nk,&diag[0]);
+            int info;
+            DTRTRI('U','U',(int)nk,&diag[0],(int)nk,info);
+            pack_upper(&diag[0],nk,diagonal_tile(F,k));
+        }
+
+        std::vector<double> buffer;
+        for (size_t j=1;j<ntiles;++j) {
+            const size_t nj = dim(j);
+            buffer.resize(j*nb*nb);
+
+            #pragma omp parallel for
+            for (int i=0;i<static_cast<int>(j);++i) {
+                double* T = &buffer[i*nb*nb];
+                const double* U = F.tile(i,j);
+                std::copy(U,U+nb*nj,T);
+                std::vector<double> diag(nb*nb);
+                unpack_upper(diagonal_tile(F,i),nb,&diag[0]);
+                DTRMM(CblasLeft,CblasUpper,CblasNoTrans,CblasUnit,(int)nb,(int)nj,1.,&diag[0],(int)nb,T,(int)nb);
+                for (size_t k=i+1;k<j;++k)
+                    DGEMM(CblasNoTrans,CblasNoTrans,(int)nb,(int)nj,(int)nb,1.,F.tile(i,k),(int)nb,F.tile(k,j),(int)nb,1.,T,(int)nb);
+            }
+
+            std::vector<double> Xjj(nj*nj);
+            unpack_upper(diagonal_tile(F,j),nj,&Xjj[0]);
+
+            #pragma omp parallel for
+            for (int i=0;i<static_cast<int>(j);++i) {
+                double* T = &buffer[i*nb*nb];
+                DTRMM(CblasRight,CblasUpper,CblasNoTrans,CblasUnit,(int)nb,(int)nj,-1.,&Xjj[0],(int)nj,T,(int)nb);
+                std::copy(T,T+nb*nj,F.tile(i,j));
+            }
+        }
+
+        for (size_t i=ntiles;i-->0;) {
+            const size_t ni = dim(i);
+            const int nrow = static_cast<int>(ntiles-i);
+            buffer.resize(nrow*nb*nb);
+
+            std::vector<double> Xii(ni*ni,0.0);
+            unpack_upper(diagonal_tile(F,i),ni,&Xii[0]);
+            for (size_t c=0;c<ni;++c)
+                Xii[c+c*ni] = 1.0;
+
+            #pragma omp parallel for schedule(dynamic)
+            for (int p=0;p<nrow;++p) {
+                const size_t j  = i+p;
+                const size_t nj = dim(j);
+                double* R = &buffer[p*nb*nb];
+                std::fill(R,R+nb*nb,0.0);
+                std::vector<double> W(nb*nb);
+
+                for (size_t k=0;k<i;++k) {
+                    const double* Xkj = F.tile(k,j);
+                    for (size_t c=0;c<nj;++c)
+                        for (size_t r=0;r<nb;++r)
+                            W[r+c*nb] = dinv[k*nb+r]*Xkj[r+c*nb];
+                    DGEMM(CblasTrans,CblasNoTrans,(int)ni,(int)nj,(int)nb,1.,F.tile(k,i),(int)nb,&W[0],(int)nb,1.,R,(int)nb);
+                }
+
+                //  Term k=i with the unit upper triangular X_ii.
+
+                for (size_t c=0;c<nj;++c)
+                    for (size_t r=0;r<ni;++r)
+                        W[r+c*nb] = dinv[i*nb+r]*((i<j) ? F.tile(i,j)[r+c*nb] : Xii[r+c*ni]);
+                DGEMM(CblasTrans,CblasNoTrans,(int)ni,(int)nj,(int)ni,1.,&Xii[0],(int)ni,&W[0],(int)nb,1.,R,(int)nb);
+            }
+
+            for (int p=0;p<nrow;++p) {
+                const size_t j = i+p;
+                const double* R = &buffer[p*nb*nb];
+                if (p==0) {
+                    double* packed = diagonal_tile(F,i);
+                    for (size_t c=0;c<ni;++c)
+                        for (size_t r=0;r<=c;++r)
+                            packed[r+c*(c+1)/2] = R[r+c*nb];
+                } else {
+                    std::copy(R,R+nb*dim(j),F.tile(i,j));
+                }
+            }
+        }
+
+        factorized = false;
+        return F;
+    }
+}
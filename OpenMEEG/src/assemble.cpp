@@ -37,6 +37,7 @@ knowledge of the CeCILL-B license and that you accept its terms.
 */
 
 #include <fstream>
+#include <cstdio>
 #include <cstring>
 #include <sstream>
 #include <stdexcept>
@@ -53,12 +54,61 @@ using namespace OpenMEEG;
 
 unsigned gauss_order = 3;
 
+// Ordering of the unknowns (-ordering file|morton|hilbert|cluster). When it is not the file ordering, the permutation
+// of the unknowns is saved next to each output indexed by them (output.perm), so that om_minverser and om_gain can
+// check that the matrices they combine use the same ordering. With the file ordering, the permutation left by a
+// previous run is removed, as om_minverser does.
+
+UnknownOrdering ordering = FILE_ORDER;
+
+void save_ordering(const Geometry& geo, const std::string& output) {
+    const std::string perm = output+".perm";
+    if ( geo.ordering() != FILE_ORDER )
+        geo.save_ordering(perm);
+    else
+        std::remove(perm.c_str());
+}
+
 void getHelp(char** argv);
 
 int main(int argc, char** argv)
 {
     print_version(argv[0]);
 
+    // The quadrature policy of the integral operators (-quadrature fixed|adaptive-distance) can be given anywhere
+    // on the command line, it is removed from the arguments.
+
+    QuadraturePolicy quadrature(gauss_order);
+    for (int i=1;i<argc;++i) {
+        if (!strcmp(argv[i],"-quadrature")) {
+            if ( i+1<argc && !strcmp(argv[i+1],"adaptive-distance") ) {
+                quadrature = QuadraturePolicy(gauss_order,QuadraturePolicy::DISTANCE_ADAPTIVE);
+            } else if ( i+1==argc || strcmp(argv[i+1],"fixed") ) {
+                cerr << "Unknown quadrature policy (use fixed or adaptive-distance)." << endl;
+                exit(1);
+            }
+            for (int j=i;j+2<=argc;++j)
+                argv[j] = argv[j+2];
+            argc -= 2;
+            std::cout << "Using " << quadrature.name() << " quadrature." << std::endl;
+            break;
+        }
+    }
+
+    for (int i=1;i<argc;++i) {
+        if (!strcmp(argv[i],"-ordering")) {
+            if ( i+1==argc || !unknown_ordering(argv[i+1],ordering) ) {
+                cerr << "Unknown ordering of the unknowns (use file, morton, hilbert or cluster)." << endl;
+                exit(1);
+            }
+            for (int j=i;j+2<=argc;++j)
+                argv[j] = argv[j+2];
+            argc -= 2;
+            std::cout << "Using " << unknown_ordering_name(ordering) << " ordering of the unknowns." << std::endl;
+            break;
+        }
+    }
+
     bool OLD_ORDERING = false;
     if ( argc<2) {
         cerr << "Not enough arguments \nPlease try \"" << argv[0] << " -h\" or \"" << argv[0] << " --help \" \n" << endl;
@@ -96,6 +146,7 @@ int main(int argc, char** argv)
         }
         // Loading surfaces from geometry file
         Geometry geo;
+        geo.ordering() = ordering;
         geo.read(argv[2], argv[3], OLD_ORDERING);
 
         // Check for intersecting meshes
@@ -104,8 +155,164 @@ int main(int argc, char** argv)
         }
 
         // Assembling Matrix from discretization :
-        HeadMat HM(geo, gauss_order);
+        HeadMat HM(geo, quadrature);
         HM.save(argv[4]);
+        save_ordering(geo, argv[4]);
+    }
+
+    /*********************************************************************************************
+    * Computation of the blocks of the Head Matrix which do not depend on the conductivities
+    **********************************************************************************************/
+    else if ( ( !strcmp(argv[1], "-HeadMatBlocks") ) | ( !strcmp(argv[1], "-HMB" ) ) | ( !strcmp(argv[1], "-hmb") ) ) {
+        if ( argc < 3 ) {
+            std::cerr << "Please set geometry filepath !" << endl;
+            exit(1);
+        }
+        if ( argc < 4 ) {
+            std::cerr << "Please set conductivities filepath !" << endl;
+            exit(1);
+        }
+        if ( argc < 5 ) {
+            std::cerr << "Please set output filepath !" << endl;
+            exit(1);
+        }
+        // Loading surfaces from geometry file
+        Geometry geo;
+        geo.ordering() = ordering;
+        geo.read(argv[2], argv[3], OLD_ORDERING);
+
+        // Check for intersecting meshes
+        if ( !geo.selfCheck() ) {
+            exit(1);
+        }
+
+        HeadMatBlocks blocks(geo, quadrature);
+        blocks.save(argv[4]);
+        save_ordering(geo, argv[4]);
+    }
+
+    /*********************************************************************************************
+    * Computation of Head Matrices from their blocks, for one or several sets of conductivities
+    **********************************************************************************************/
+    else if ( ( !strcmp(argv[1], "-HeadMatFromBlocks") ) | ( !strcmp(argv[1], "-HMFB" ) ) | ( !strcmp(argv[1], "-hmfb") ) ) {
+        const int nargs = (OLD_ORDERING) ? argc-1 : argc;
+        if ( nargs < 3 ) {
+            std::cerr << "Please set geometry filepath !" << endl;
+            exit(1);
+        }
+        if ( nargs < 4 ) {
+            std::cerr << "Please set blocks filepath !" << endl;
+            exit(1);
+        }
+        if ( nargs < 5 ) {
+            std::cerr << "Please set conductivities and output filepaths (or a file listing them) !" << endl;
+            exit(1);
+        }
+
+        // Pairs of conductivity and output files, given on the command line or listed in a file (one pair per line).
+
+        std::vector<std::pair<std::string,std::string> > jobs;
+        if ( nargs == 5 ) {
+            std::ifstream list(argv[4]);
+            if ( !list.is_open() ) {
+                std::cerr << "Cannot open file " << argv[4] << " !" << endl;
+                exit(1);
+            }
+            std::string cond, output;
+            while ( list >> cond >> output )
+                jobs.push_back(std::make_pair(cond, output));
+        } else {
+            if ( (nargs-4)%2 != 0 ) {
+                std::cerr << "Please set an output filepath for each conductivities file !" << endl;
+                exit(1);
+            }
+            for ( int i = 4; i < nargs; i += 2)
+                jobs.push_back(std::make_pair(std::string(argv[i]), std::string(argv[i+1])));
+        }
+
+        HeadMatBlocks blocks;
+        blocks.load(argv[3]);
+
+        for ( unsigned i = 0; i < jobs.size(); ++i) {
+            std::cout << "HeadMat for conductivities " << jobs[i].first << " (" << i+1 << "/" << jobs.size() << ")" << std::endl;
+            Geometry geo;
+            geo.ordering() = ordering;
+            geo.read(argv[2], jobs[i].first, OLD_ORDERING);
+            HeadMat HM(geo, blocks);
+            HM.save(jobs[i].second);
+            save_ordering(geo, jobs[i].second);
+        }
+    }
+
+    /*********************************************************************************************
+    * Layout of a Head Matrix, to update it when some meshes change (see -HeadMatUpdate)
+    **********************************************************************************************/
+    else if ( ( !strcmp(argv[1], "-HeadMatLayout") ) | ( !strcmp(argv[1], "-HML" ) ) | ( !strcmp(argv[1], "-hml") ) ) {
+        if ( argc < 3 ) {
+            std::cerr << "Please set geometry filepath !" << endl;
+            exit(1);
+        }
+        if ( argc < 4 ) {
+            std::cerr << "Please set conductivities filepath !" << endl;
+            exit(1);
+        }
+        if ( argc < 5 ) {
+            std::cerr << "Please set head matrix filepath !" << endl;
+            exit(1);
+        }
+        if ( argc < 6 ) {
+            std::cerr << "Please set output filepath !" << endl;
+            exit(1);
+        }
+        Geometry geo;
+        geo.ordering() = ordering;
+        geo.read(argv[2], argv[3], OLD_ORDERING);
+
+        SymMatrix HM;
+        HM.load(argv[4]);
+        HeadMatLayout layout(geo, HM);
+        layout.save(argv[5]);
+    }
+
+    /*********************************************************************************************
+    * Update of a Head Matrix after some meshes changed, only the blocks of these meshes are recomputed
+    **********************************************************************************************/
+    else if ( ( !strcmp(argv[1], "-HeadMatUpdate") ) | ( !strcmp(argv[1], "-HMU" ) ) | ( !strcmp(argv[1], "-hmu") ) ) {
+        if ( argc < 3 ) {
+            std::cerr << "Please set geometry filepath !" << endl;
+            exit(1);
+        }
+        if ( argc < 4 ) {
+            std::cerr << "Please set conductivities filepath !" << endl;
+            exit(1);
+        }
+        if ( argc < 6 ) {
+            std::cerr << "Please set previous head matrix and layout filepaths !" << endl;
+            exit(1);
+        }
+        if ( argc < 8 ) {
+            std::cerr << "Please set output head matrix and layout filepaths !" << endl;
+            exit(1);
+        }
+        // Loading surfaces from geometry file
+        Geometry geo;
+        geo.ordering() = ordering;
+        geo.read(argv[2], argv[3], OLD_ORDERING);
+
+        // Check for intersecting meshes
+        if ( !geo.selfCheck() ) {
+            exit(1);
+        }
+
+        SymMatrix previous;
+        previous.load(argv[4]);
+        HeadMatLayout layout;
+        layout.load(argv[5]);
+
+        HeadMat HM(geo, previous, layout, quadrature);
+        HM.save(argv[6]);
+        save_ordering(geo, argv[6]);
+        HeadMatLayout(geo, HM).save(argv[7]);
     }
 
     /*********************************************************************************************
@@ -173,6 +380,7 @@ int main(int argc, char** argv)
 
         // Loading surfaces from geometry file
         Geometry geo;
+        geo.ordering() = ordering;
         geo.read(argv[2], argv[3], OLD_ORDERING);
 
         // Check for intersecting meshes
@@ -187,11 +395,12 @@ int main(int argc, char** argv)
         // Assembling Matrix from discretization :
         Matrix *CM;
         if (gamma > 0.) {
-            CM = new CorticalMat2(geo, M, argv[5], gauss_order, gamma, filename);
+            CM = new CorticalMat2(geo, M, argv[5], quadrature, gamma, filename);
         } else {
-            CM = new CorticalMat(geo, M, argv[5], gauss_order, alpha, beta, filename);
+            CM = new CorticalMat(geo, M, argv[5], quadrature, alpha, beta, filename);
         }
         CM->save(argv[6]);
+        save_ordering(geo, argv[6]);
     }
 
     /*********************************************************************************************
@@ -213,6 +422,7 @@ int main(int argc, char** argv)
 
         // Loading surfaces from geometry file.
         Geometry geo;
+        geo.ordering() = ordering;
         geo.read(argv[2], argv[3], OLD_ORDERING);
 
         // Loading mesh for distributed sources
@@ -220,8 +430,9 @@ int main(int argc, char** argv)
         mesh_sources.load(argv[4]);
 
         // Assembling Matrix from discretization :
-        SurfSourceMat ssm(geo, mesh_sources, gauss_order);
+        SurfSourceMat ssm(geo, mesh_sources, quadrature);
         ssm.save(argv[5]); // if outfile is specified
+        save_ordering(geo, argv[5]);
     }
 
     /*********************************************************************************************
@@ -248,6 +459,7 @@ int main(int argc, char** argv)
 
         // Loading surfaces from geometry file.
         Geometry geo;
+        geo.ordering() = ordering;
         geo.read(argv[2], argv[3], OLD_ORDERING);
 
         // Loading Matrix of dipoles :
@@ -267,6 +479,7 @@ int main(int argc, char** argv)
         DipSourceMat dsm(geo, dipoles, gauss_order, adapt_rhs, domain_name);
         // Saving RHS Matrix for dipolar case :
         dsm.save(argv[5]);
+        save_ordering(geo, argv[5]);
     }
 
     /*********************************************************************************************
@@ -293,11 +506,13 @@ int main(int argc, char** argv)
 
         // Loading surfaces from geometry file.
         Geometry geo;
+        geo.ordering() = ordering;
         geo.read(argv[2], argv[3], OLD_ORDERING);
 
         Sensors electrodes(argv[4], geo); // special parameter for EIT electrodes: the interface
-        EITSourceMat EITsource(geo, electrodes, gauss_order);
+        EITSourceMat EITsource(geo, electrodes, quadrature);
         EITsource.save(argv[5]);
+        save_ordering(geo, argv[5]);
     }
 
     /*********************************************************************************************
@@ -322,6 +537,7 @@ int main(int argc, char** argv)
 
         // Loading surfaces from geometry file.
         Geometry geo;
+        geo.ordering() = ordering;
         geo.read(argv[2], argv[3], OLD_ORDERING);
 
         // read the file containing the positions of the EEG patches
@@ -332,6 +548,7 @@ int main(int argc, char** argv)
         Head2EEGMat mat(geo, electrodes);
         // Saving Head2EEG Matrix :
         mat.save(argv[5]);
+        save_ordering(geo, argv[5]);
     }
 
     /*********************************************************************************************
@@ -364,6 +581,7 @@ int main(int argc, char** argv)
 
         // Loading surfaces from geometry file.
         Geometry geo;
+        geo.ordering() = ordering;
         geo.read(argv[2], argv[3], OLD_ORDERING);
 
         // Find the mesh of the Ecog electrodes
@@ -378,6 +596,7 @@ int main(int argc, char** argv)
 
         // Saving Head2ECoG Matrix :
         mat.save(argv[6]);
+        save_ordering(geo, argv[6]);
     }
 
     /*********************************************************************************************
@@ -402,6 +621,7 @@ int main(int argc, char** argv)
 
         // Loading surfaces from geometry file.
         Geometry geo;
+        geo.ordering() = ordering;
         geo.read(argv[2], argv[3]);
 
         // Load positions and orientations of sensors  :
@@ -411,6 +631,7 @@ int main(int argc, char** argv)
         Head2MEGMat mat(geo, sensors);
         // Saving Head2MEG Matrix :
         mat.save(argv[5]); // if outfile is specified
+        save_ordering(geo, argv[5]);
     }
 
     /*********************************************************************************************
@@ -493,11 +714,13 @@ int main(int argc, char** argv)
         }
         // Loading surfaces from geometry file
         Geometry geo;
+        geo.ordering() = ordering;
         geo.read(argv[2], argv[3], OLD_ORDERING);
         Matrix points(argv[4]);
         Surf2VolMat mat(geo, points);
         // Saving SurfToVol Matrix :
         mat.save(argv[5]);
+        save_ordering(geo, argv[5]);
     }
     /*********************************************************************************************
     * Computation of the discrete linear application which maps the dipoles
@@ -552,6 +775,18 @@ void getHelp(char** argv) {
     cout << argv[0] <<" [-option] [filepaths...]" << endl << endl;
 
     cout << "option :" << endl;
+    cout << "   -quadrature fixed|adaptive-distance (may be combined with the options below):" << endl;
+    cout << "       Quadrature of the integral operators (HeadMat, CorticalMat, SurfSourceMat, EITSourceMat)." << endl;
+    cout << "       fixed (default) uses 16 points on each pair of triangles, adaptive-distance uses fewer points" << endl;
+    cout << "       for the pairs of triangles which are far apart compared to their size." << endl << endl;
+
+    cout << "   -ordering file|morton|hilbert|cluster (may be combined with the options below):" << endl;
+    cout << "       Ordering of the unknowns within the vertices (grouped by mesh) and within the triangles of each mesh." << endl;
+    cout << "       file (default) keeps the order of the mesh files, morton and hilbert sort the unknowns along a" << endl;
+    cout << "       space-filling curve, cluster in the order of the leaves of a cluster tree. The permutation of the" << endl;
+    cout << "       unknowns is saved next to the output (output.perm): all the matrices of a computation must use" << endl;
+    cout << "       the same ordering." << endl << endl;
+
     cout << "   -HeadMat, -HM, -hm :   " << endl;
     cout << "       Compute Head Matrix for Symmetric BEM (left-hand side of linear system)." << endl;
     cout << "             Arguments :" << endl;
@@ -559,6 +794,43 @@ void getHelp(char** argv) {
     cout << "               conductivity file (.cond)" << endl;
     cout << "               output matrix" << endl << endl;
 
+    cout << "   -HeadMatBlocks, -HMB, -hmb :   " << endl;
+    cout << "       Compute the blocks of the Head Matrix which do not depend on the conductivities," << endl;
+    cout << "       to compute the Head Matrices of several sets of conductivities (see -HeadMatFromBlocks)." << endl;
+    cout << "       The conductivities may change, but not the domains of null conductivity." << endl;
+    cout << "             Arguments :" << endl;
+    cout << "               geometry file (.geom)" << endl;
+    cout << "               conductivity file (.cond)" << endl;
+    cout << "               output blocks file" << endl << endl;
+
+    cout << "   -HeadMatFromBlocks, -HMFB, -hmfb :   " << endl;
+    cout << "       Compute Head Matrices from their blocks (see -HeadMatBlocks), for one or several sets of conductivities." << endl;
+    cout << "             Arguments :" << endl;
+    cout << "               geometry file (.geom)" << endl;
+    cout << "               blocks file" << endl;
+    cout << "               conductivity file (.cond) and output matrix, repeated for each set of conductivities," << endl;
+    cout << "               or a text file listing a conductivity file and an output matrix per line" << endl << endl;
+
+    cout << "   -HeadMatLayout, -HML, -hml :   " << endl;
+    cout << "       Save the layout of a Head Matrix (per mesh content hashes and unknowns), to update it when" << endl;
+    cout << "       some meshes of the geometry change (see -HeadMatUpdate)." << endl;
+    cout << "             Arguments :" << endl;
+    cout << "               geometry file (.geom)" << endl;
+    cout << "               conductivity file (.cond)" << endl;
+    cout << "               head matrix of this geometry" << endl;
+    cout << "               output layout file" << endl << endl;
+
+    cout << "   -HeadMatUpdate, -HMU, -hmu :   " << endl;
+    cout << "       Update a Head Matrix after some meshes changed: meshes are matched by name, and only the blocks" << endl;
+    cout << "       of the pairs of meshes involving a modified mesh are recomputed." << endl;
+    cout << "             Arguments :" << endl;
+    cout << "               geometry file (.geom)" << endl;
+    cout << "               conductivity file (.cond)" << endl;
+    cout << "               previous head matrix" << endl;
+    cout << "               previous layout file (see -HeadMatLayout)" << endl;
+    cout << "               output matrix" << endl;
+    cout << "               output layout file" << endl << endl;
+
     cout << "   -CorticalMat, -CM, -cm :   " << endl;
     cout << "       Compute Cortical Matrix for Symmetric BEM (left-hand side of linear system)." << endl;
     cout << "       Comment on optional parameters:" << endl;
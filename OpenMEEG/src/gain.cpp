@@ -37,7 +37,9 @@ The fact that you are presently reading this means that you have had
 knowledge of the CeCILL-B license and that you accept its terms.
 */
 
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <cpuChrono.h>
 #include <gain.h>
 
@@ -46,6 +48,178 @@ using namespace OpenMEEG;
 
 void getHelp(char** argv);
 
+// Matrices indexed by the unknowns must use the same ordering of the unknowns (see om_assemble -ordering), whose
+// permutation is saved next to them (file.perm, nothing for the file ordering). Exits if they differ.
+
+UnknownOrdering check_ordering(char** files, const unsigned nb_files, std::vector<unsigned>& permutation) {
+    UnknownOrdering ordering = FILE_ORDER;
+    for (unsigned i=0;i<nb_files;++i) {
+        UnknownOrdering       o = FILE_ORDER;
+        std::vector<unsigned> p;
+        const std::string     perm = std::string(files[i])+".perm";
+        if ( std::ifstream(perm.c_str()).is_open() && !Geometry::load_ordering(perm, o, p) ) {
+            cerr << "Cannot read the ordering of the unknowns " << perm << endl;
+            exit(1);
+        }
+        if ( i>0 && (o!=ordering || p!=permutation) ) {
+            cerr << "The unknowns of " << files[i] << " (" << unknown_ordering_name(o) << " ordering) are not ordered as the ones of "
+                 << files[0] << " (" << unknown_ordering_name(ordering) << " ordering)." << endl;
+            exit(1);
+        }
+        ordering    = o;
+        permutation = p;
+    }
+    return ordering;
+}
+
+// Reads the geometry of the adjoint gains with the ordering of the unknowns of their matrices.
+
+void read_geometry(Geometry& geo, char** argv, char** files, const unsigned nb_files) {
+    std::vector<unsigned> permutation;
+    geo.ordering() = check_ordering(files, nb_files, permutation);
+    geo.read(argv[2], argv[3]);
+    if ( geo.ordering()!=FILE_ORDER && geo.permutation()!=permutation ) {
+        cerr << "The ordering of the unknowns of " << files[0] << " does not match the geometry." << endl;
+        exit(1);
+    }
+}
+
+// Reads and coarsens the geometry again for the two-grid preconditioner of GMRes.
+
+void read_coarse_geometry(Geometry& coarse, char** argv, SolverParameters& solver) {
+    if ( solver.solver!=SolverParameters::GMRES || solver.preconditioner!=SolverParameters::TWO_GRID )
+        return;
+    coarse.read(argv[2], argv[3]);
+    coarse.coarsen(solver.coarsening);
+    solver.coarse = &coarse;
+}
+
+// Options of the solver of the HeadMat systems of the adjoint gains (see SolverParameters), which are removed
+// from the arguments: -solver lapack|gmres, -preconditioner jacobi|blocks|ilu|twogrid, -near r, -coarsening r,
+// -restart m, -block p, -tolerance t.
+
+SolverParameters solver_options(int& argc, char** argv) {
+    SolverParameters parameters;
+    int nargs = 1;
+    for (int i=1;i<argc;++i) {
+        const bool has_value = i+1<argc;
+        if ( has_value && !strcmp(argv[i], "-solver") ) {
+            ++i;
+            if ( !strcmp(argv[i], "gmres") ) {
+                parameters.solver = SolverParameters::GMRES;
+            } else if ( !strcmp(argv[i], "lapack") ) {
+                parameters.solver = SolverParameters::LAPACK;
+            } else {
+                cerr << "Unknown solver " << argv[i] << " (lapack or gmres)." << endl;
+                exit(1);
+            }
+        } else if ( has_value && !strcmp(argv[i], "-preconditioner") ) {
+            ++i;
+            if ( !strcmp(argv[i], "jacobi") ) {
+                parameters.preconditioner = SolverParameters::JACOBI;
+            } else if ( !strcmp(argv[i], "blocks") ) {
+                parameters.preconditioner = SolverParameters::MESH_BLOCKS;
+            } else if ( !strcmp(argv[i], "ilu") ) {
+                parameters.preconditioner = SolverParameters::NEAR_FIELD;
+            } else if ( !strcmp(argv[i], "twogrid") ) {
+                parameters.preconditioner = SolverParameters::TWO_GRID;
+            } else {
+                cerr << "Unknown preconditioner " << argv[i] << " (jacobi, blocks, ilu or twogrid)." << endl;
+                exit(1);
+            }
+        } else if ( has_value && !strcmp(argv[i], "-near") ) {
+            parameters.near_field = atof(argv[++i]);
+        } else if ( has_value && !strcmp(argv[i], "-coarsening") ) {
+            parameters.coarsening = atof(argv[++i]);
+        } else if ( has_value && !strcmp(argv[i], "-restart") ) {
+            parameters.restart = atoi(argv[++i]);
+        } else if ( has_value && !strcmp(argv[i], "-block") ) {
+            parameters.block_size = atoi(argv[++i]);
+        } else if ( has_value && !strcmp(argv[i], "-tolerance") ) {
+            parameters.tolerance = atof(argv[++i]);
+        } else {
+            argv[nargs++] = argv[i];
+        }
+    }
+    if ( parameters.restart==0 || parameters.block_size==0 || parameters.tolerance<=0.0 || parameters.near_field<=0.0 ) {
+        cerr << "The restart length, the block size, the tolerance and the near field radius of GMRes must be positive." << endl;
+        exit(1);
+    }
+    if ( parameters.coarsening<=0.0 || parameters.coarsening>=1.0 ) {
+        cerr << "The coarsening ratio of the two-grid preconditioner must be between 0 and 1." << endl;
+        exit(1);
+    }
+    argc = nargs;
+    return parameters;
+}
+
+// Option -chunk k, which is removed from the arguments: the gains are computed and written by blocks of k sources
+// (see StreamedGains) and the output files are then in the binary format.
+
+unsigned chunk_option(int& argc, char** argv) {
+    unsigned chunk = 0;
+    int nargs = 1;
+    for (int i=1;i<argc;++i) {
+        if ( i+1<argc && !strcmp(argv[i], "-chunk") ) {
+            chunk = atoi(argv[++i]);
+            if ( chunk==0 ) {
+                cerr << "The number of sources of the blocks (-chunk) must be positive." << endl;
+                exit(1);
+            }
+        } else {
+            argv[nargs++] = argv[i];
+        }
+    }
+    argc = nargs;
+    return chunk;
+}
+
+bool binary_suffix(const char* name) {
+    try {
+        return maths::MathsIO::format_from_suffix(name)->identity()=="binary";
+    } catch (maths::Exception&) {
+        return true; // no suffix of another format
+    }
+}
+
+void check_streamed_output(const char* name) {
+    if ( binary_suffix(name) )
+        return;
+    cerr << "The gains computed by blocks of sources (-chunk) are written in the binary format (.bin): " << name << endl;
+    exit(1);
+}
+
+// SourceMat and Source2MEGMat are read by blocks of columns (see ColumnReader), which requires the binary format.
+
+void check_streamed_input(const char* name) {
+    if ( binary_suffix(name) )
+        return;
+    cerr << "The matrices read by blocks of sources (-chunk) must be in the binary format (.bin): " << name << endl;
+    exit(1);
+}
+
+// Lines Head2X HeadMatInv of the gains, HeadMatInv being given either as the inverse or as the factorization of the HeadMat.
+
+template <typename HEAD2X>
+Matrix sensor_matrix(const char* name, const HEAD2X& Head2X) {
+    if ( SymFactorization::identify(name) )
+        return AdjointSolutions(SymFactorization(name), Head2X);
+    SymMatrix HeadMatInv;
+    HeadMatInv.load(name);
+    return Head2X*HeadMatInv;
+}
+
+// Same lines from the HeadMat or its factorization (adjoint gains).
+
+template <typename HEAD2X>
+Matrix adjoint_sensor_matrix(const char* name, const Geometry& geo, const HEAD2X& Head2X, const SolverParameters& solver) {
+    if ( SymFactorization::identify(name) )
+        return AdjointSolutions(SymFactorization(name), Head2X);
+    SymMatrix HeadMat;
+    HeadMat.load(name);
+    return AdjointSolutions(geo, HeadMat, Head2X, solver);
+}
+
 int main(int argc, char **argv)
 {
     print_version(argv[0]);
@@ -59,6 +233,9 @@ int main(int argc, char **argv)
         getHelp(argv);
     }
 
+    SolverParameters solver = solver_options(argc, argv);
+    const unsigned chunk = chunk_option(argc, argv);
+
     // Start Chrono
     cpuChrono C;
     C.start();
@@ -79,15 +256,32 @@ int main(int argc, char **argv)
             return 0;
         }
         LinOpInfo matinfo = OpenMEEG::maths::info(argv[3]);
-        SymMatrix HeadMatInv;
-        HeadMatInv.load(argv[2]);
+        std::vector<unsigned> permutation;
+        check_ordering(argv+2, 3, permutation);
         SparseMatrix Head2EEGMat;
         Head2EEGMat.load(argv[4]);
-        Matrix SourceMat;
-        SourceMat.load(argv[3]);
 
-        GainEEG EEGGainMat(HeadMatInv, SourceMat, Head2EEGMat);
-        EEGGainMat.save(argv[5]);
+        if ( chunk!=0 ) {
+            check_streamed_output(argv[5]);
+            check_streamed_input(argv[3]);
+            ColumnReader SourceColumns(argv[3]);
+            const std::vector<StreamedGain> outputs(1, StreamedGain(argv[5], 0, Head2EEGMat.nlin()));
+            StreamedGains(sensor_matrix(argv[2], Head2EEGMat), SourceColumns, outputs, chunk);
+        } else {
+            Matrix SourceMat;
+            SourceMat.load(argv[3]);
+
+            if ( SymFactorization::identify(argv[2]) ) {
+                const SymFactorization HeadMatFactors(argv[2]);
+                GainEEG EEGGainMat(HeadMatFactors, SourceMat, Head2EEGMat);
+                EEGGainMat.save(argv[5]);
+            } else {
+                SymMatrix HeadMatInv;
+                HeadMatInv.load(argv[2]);
+                GainEEG EEGGainMat(HeadMatInv, SourceMat, Head2EEGMat);
+                EEGGainMat.save(argv[5]);
+            }
+        }
     }
     // compute the gain matrix with the adjoint method for use with EEG DATA
     else if ( !strcmp(argv[1], "-EEGadjoint") ) {
@@ -97,15 +291,28 @@ int main(int argc, char **argv)
         }
         LinOpInfo matinfo = OpenMEEG::maths::info(argv[3]);
         Geometry geo;
-        geo.read(argv[2], argv[3]);
+        read_geometry(geo, argv, argv+5, 2);
+        Geometry coarse;
+        read_coarse_geometry(coarse, argv, solver);
         Matrix dipoles(argv[4]);
-        SymMatrix HeadMat;
-        HeadMat.load(argv[5]);
         SparseMatrix Head2EEGMat;
         Head2EEGMat.load(argv[6]);
 
-        GainEEGadjoint EEGGainMat(geo, dipoles, HeadMat, Head2EEGMat);
-        EEGGainMat.save(argv[7]);
+        if ( chunk!=0 ) {
+            check_streamed_output(argv[7]);
+            DipoleSourceColumns SourceColumns(geo, dipoles);
+            const std::vector<StreamedGain> outputs(1, StreamedGain(argv[7], 0, Head2EEGMat.nlin()));
+            StreamedGains(adjoint_sensor_matrix(argv[5], geo, Head2EEGMat, solver), SourceColumns, outputs, chunk);
+        } else if ( SymFactorization::identify(argv[5]) ) {
+            const SymFactorization HeadMatFactors(argv[5]);
+            GainEEGadjoint EEGGainMat(geo, dipoles, HeadMatFactors, Head2EEGMat);
+            EEGGainMat.save(argv[7]);
+        } else {
+            SymMatrix HeadMat;
+            HeadMat.load(argv[5]);
+            GainEEGadjoint EEGGainMat(geo, dipoles, HeadMat, Head2EEGMat, solver);
+            EEGGainMat.save(argv[7]);
+        }
     }
     // for use with MEG DATA
     else if ( !strcmp(argv[1], "-MEG") ) {
@@ -114,17 +321,35 @@ int main(int argc, char **argv)
             return 0;
         }
         LinOpInfo matinfo = OpenMEEG::maths::info(argv[3]);
-        SymMatrix HeadMatInv;
-        HeadMatInv.load(argv[2]);
-        Matrix SourceMat;
-        SourceMat.load(argv[3]);
+        std::vector<unsigned> permutation;
+        check_ordering(argv+2, 3, permutation);
         Matrix Head2MEGMat;
         Head2MEGMat.load(argv[4]);
-        Matrix Source2MEGMat;
-        Source2MEGMat.load(argv[5]);
 
-        GainMEG MEGGainMat(HeadMatInv, SourceMat, Head2MEGMat, Source2MEGMat);
-        MEGGainMat.save(argv[6]);
+        if ( chunk!=0 ) {
+            check_streamed_output(argv[6]);
+            check_streamed_input(argv[3]);
+            check_streamed_input(argv[5]);
+            ColumnReader SourceColumns(argv[3]);
+            const std::vector<StreamedGain> outputs(1, StreamedGain(argv[6], 0, Head2MEGMat.nlin(), argv[5]));
+            StreamedGains(sensor_matrix(argv[2], Head2MEGMat), SourceColumns, outputs, chunk);
+        } else {
+            Matrix SourceMat;
+            SourceMat.load(argv[3]);
+            Matrix Source2MEGMat;
+            Source2MEGMat.load(argv[5]);
+
+            if ( SymFactorization::identify(argv[2]) ) {
+                const SymFactorization HeadMatFactors(argv[2]);
+                GainMEG MEGGainMat(HeadMatFactors, SourceMat, Head2MEGMat, Source2MEGMat);
+                MEGGainMat.save(argv[6]);
+            } else {
+                SymMatrix HeadMatInv;
+                HeadMatInv.load(argv[2]);
+                GainMEG MEGGainMat(HeadMatInv, SourceMat, Head2MEGMat, Source2MEGMat);
+                MEGGainMat.save(argv[6]);
+            }
+        }
     }
     // compute the gain matrix with the adjoint method for use with MEG DATA
     else if ( !strcmp(argv[1], "-MEGadjoint") ) {
@@ -134,17 +359,34 @@ int main(int argc, char **argv)
         }
         LinOpInfo matinfo = OpenMEEG::maths::info(argv[3]);
         Geometry geo;
-        geo.read(argv[2], argv[3]);
+        read_geometry(geo, argv, argv+5, 2);
+        Geometry coarse;
+        read_coarse_geometry(coarse, argv, solver);
         Matrix dipoles(argv[4]);
-        SymMatrix HeadMat;
-        HeadMat.load(argv[5]);
         Matrix Head2MEGMat;
         Head2MEGMat.load(argv[6]);
-        Matrix Source2MEGMat;
-        Source2MEGMat.load(argv[7]);
 
-        GainMEGadjoint MEGGainMat(geo, dipoles, HeadMat, Head2MEGMat, Source2MEGMat);
-        MEGGainMat.save(argv[8]);
+        if ( chunk!=0 ) {
+            check_streamed_output(argv[8]);
+            check_streamed_input(argv[7]);
+            DipoleSourceColumns SourceColumns(geo, dipoles);
+            const std::vector<StreamedGain> outputs(1, StreamedGain(argv[8], 0, Head2MEGMat.nlin(), argv[7]));
+            StreamedGains(adjoint_sensor_matrix(argv[5], geo, Head2MEGMat, solver), SourceColumns, outputs, chunk);
+        } else {
+            Matrix Source2MEGMat;
+            Source2MEGMat.load(argv[7]);
+
+            if ( SymFactorization::identify(argv[5]) ) {
+                const SymFactorization HeadMatFactors(argv[5]);
+                GainMEGadjoint MEGGainMat(geo, dipoles, HeadMatFactors, Head2MEGMat, Source2MEGMat);
+                MEGGainMat.save(argv[8]);
+            } else {
+                SymMatrix HeadMat;
+                HeadMat.load(argv[5]);
+                GainMEGadjoint MEGGainMat(geo, dipoles, HeadMat, Head2MEGMat, Source2MEGMat, solver);
+                MEGGainMat.save(argv[8]);
+            }
+        }
     }
     // compute the gain matrices with the adjoint method for use with EEG and MEG DATA
     else if ( !strcmp(argv[1], "-EEGMEGadjoint") ) {
@@ -154,28 +396,58 @@ int main(int argc, char **argv)
         }
         LinOpInfo matinfo = OpenMEEG::maths::info(argv[3]);
         Geometry geo;
-        geo.read(argv[2], argv[3]);
+        read_geometry(geo, argv, argv+5, 3);
+        Geometry coarse;
+        read_coarse_geometry(coarse, argv, solver);
         Matrix dipoles(argv[4]);
-        SymMatrix HeadMat;
-        HeadMat.load(argv[5]);
         SparseMatrix Head2EEGMat;
         Head2EEGMat.load(argv[6]);
         Matrix Head2MEGMat;
         Head2MEGMat.load(argv[7]);
-        Matrix Source2MEGMat;
-        Source2MEGMat.load(argv[8]);
 
-        GainEEGMEGadjoint EEGMEGGainMat(geo, dipoles, HeadMat, Head2EEGMat, Head2MEGMat, Source2MEGMat);
-        EEGMEGGainMat.saveEEG(argv[9]);
-        EEGMEGGainMat.saveMEG(argv[10]);
+        if ( chunk!=0 ) {
+            check_streamed_output(argv[9]);
+            check_streamed_output(argv[10]);
+            check_streamed_input(argv[8]);
+            const unsigned nEEG = Head2EEGMat.nlin();
+            const unsigned nMEG = Head2MEGMat.nlin();
+            Matrix Head2Sensors(nEEG+nMEG, Head2MEGMat.ncol());
+            for ( unsigned i = 0; i < nEEG; ++i) {
+                Head2Sensors.setlin(i, Head2EEGMat.getlin(i));
+            }
+            for ( unsigned i = 0; i < nMEG; ++i) {
+                Head2Sensors.setlin(i + nEEG, Head2MEGMat.getlin(i));
+            }
+            DipoleSourceColumns SourceColumns(geo, dipoles);
+            std::vector<StreamedGain> outputs;
+            outputs.push_back(StreamedGain(argv[9], 0, nEEG));
+            outputs.push_back(StreamedGain(argv[10], nEEG, nMEG, argv[8]));
+            StreamedGains(adjoint_sensor_matrix(argv[5], geo, Head2Sensors, solver), SourceColumns, outputs, chunk);
+        } else {
+            Matrix Source2MEGMat;
+            Source2MEGMat.load(argv[8]);
+
+            if ( SymFactorization::identify(argv[5]) ) {
+                const SymFactorization HeadMatFactors(argv[5]);
+                GainEEGMEGadjoint EEGMEGGainMat(geo, dipoles, HeadMatFactors, Head2EEGMat, Head2MEGMat, Source2MEGMat);
+                EEGMEGGainMat.saveEEG(argv[9]);
+                EEGMEGGainMat.saveMEG(argv[10]);
+            } else {
+                SymMatrix HeadMat;
+                HeadMat.load(argv[5]);
+                GainEEGMEGadjoint EEGMEGGainMat(geo, dipoles, HeadMat, Head2EEGMat, Head2MEGMat, Source2MEGMat, solver);
+                EEGMEGGainMat.saveEEG(argv[9]);
+                EEGMEGGainMat.saveMEG(argv[10]);
+            }
+        }
     }
     else if ( (!strcmp(argv[1], "-InternalPotential"))|(!strcmp(argv[1], "-IP")) ) {
         if ( argc<7 ) {
             cerr << "Not enough arguments \nPlease try \"" << argv[0] << " -h\" or \"" << argv[0] << " --help \" \n" << endl;
             return 0;
         }
-        SymMatrix HeadMatInv;
-        HeadMatInv.load(argv[2]);
+        std::vector<unsigned> permutation;
+        check_ordering(argv+2, 3, permutation);
         Matrix SourceMat;
         SourceMat.load(argv[3]);
         Matrix Head2IPMat;
@@ -183,38 +455,62 @@ int main(int argc, char **argv)
         Matrix Source2IPMat;
         Source2IPMat.load(argv[5]);
 
-        GainInternalPot InternalPotGainMat(HeadMatInv, SourceMat, Head2IPMat, Source2IPMat);
-        InternalPotGainMat.save(argv[6]);
+        if ( SymFactorization::identify(argv[2]) ) {
+            const SymFactorization HeadMatFactors(argv[2]);
+            GainInternalPot InternalPotGainMat(HeadMatFactors, SourceMat, Head2IPMat, Source2IPMat);
+            InternalPotGainMat.save(argv[6]);
+        } else {
+            SymMatrix HeadMatInv;
+            HeadMatInv.load(argv[2]);
+            GainInternalPot InternalPotGainMat(HeadMatInv, SourceMat, Head2IPMat, Source2IPMat);
+            InternalPotGainMat.save(argv[6]);
+        }
     }
     else if ( (!strcmp(argv[1], "-StimInternalPotential"))|(!strcmp(argv[1], "-SIP")) ) {
         if ( argc<6 ) {
             cerr << "Not enough arguments \nPlease try \"" << argv[0] << " -h\" or \"" << argv[0] << " --help \" \n" << endl;
             return 0;
         }
-        SymMatrix HeadMatInv;
-        HeadMatInv.load(argv[2]);
+        std::vector<unsigned> permutation;
+        check_ordering(argv+2, 3, permutation);
         Matrix SourceMat;
         SourceMat.load(argv[3]);
         Matrix Head2IPMat;
         Head2IPMat.load(argv[4]);
 
-        GainStimInternalPot StimInternalPotGainMat(HeadMatInv, SourceMat, Head2IPMat);
-        StimInternalPotGainMat.save(argv[5]);
+        if ( SymFactorization::identify(argv[2]) ) {
+            const SymFactorization HeadMatFactors(argv[2]);
+            GainStimInternalPot StimInternalPotGainMat(HeadMatFactors, SourceMat, Head2IPMat);
+            StimInternalPotGainMat.save(argv[5]);
+        } else {
+            SymMatrix HeadMatInv;
+            HeadMatInv.load(argv[2]);
+            GainStimInternalPot StimInternalPotGainMat(HeadMatInv, SourceMat, Head2IPMat);
+            StimInternalPotGainMat.save(argv[5]);
+        }
     }
         else if ( (!strcmp(argv[1], "-EITInternalPotential"))||(!strcmp(argv[1], "-EITIP")) ) {
             if ( argc<6 ){
                 cerr << "Not enough arguments \nPlease try \"" << argv[0] << " -h\" or \"" << argv[0] << " --help \" \n" << endl;
                 return 0;
             }
-            SymMatrix HeadMatInv;
-            HeadMatInv.load(argv[2]);
+            std::vector<unsigned> permutation;
+            check_ordering(argv+2, 3, permutation);
             Matrix SourceMat;
             SourceMat.load(argv[3]);
             Matrix Head2IPMat;
             Head2IPMat.load(argv[4]);
 
-            GainEITInternalPot InternalPotGainMat(HeadMatInv, SourceMat, Head2IPMat);
-            InternalPotGainMat.save(argv[5]);
+            if ( SymFactorization::identify(argv[2]) ) {
+                const SymFactorization HeadMatFactors(argv[2]);
+                GainEITInternalPot InternalPotGainMat(HeadMatFactors, SourceMat, Head2IPMat);
+                InternalPotGainMat.save(argv[5]);
+            } else {
+                SymMatrix HeadMatInv;
+                HeadMatInv.load(argv[2]);
+                GainEITInternalPot InternalPotGainMat(HeadMatInv, SourceMat, Head2IPMat);
+                InternalPotGainMat.save(argv[5]);
+            }
 	}
     else
     {
@@ -233,6 +529,29 @@ void getHelp(char** argv)
     cout << argv[0] <<" [-option] [filepaths...]" << endl << endl;
 
     cout << "-option :" << endl;
+    cout << "   HeadMatInv and HeadMat can also be the factorization of the HeadMat written by" << endl;
+    cout << "   om_minverser -factor, the gains are then computed by solving systems." << endl << endl;
+    cout << "   Solver of the HeadMat systems of the adjoint gains (options placed anywhere):" << endl;
+    cout << "       -solver lapack|gmres : Bunch-Kaufman factorization (default) or block GMRes" << endl;
+    cout << "                              (only products with the HeadMat)," << endl;
+    cout << "       -preconditioner jacobi|blocks|ilu|twogrid : preconditioner of GMRes: diagonal" << endl;
+    cout << "                              (default), factorized diagonal blocks of the meshes, incomplete" << endl;
+    cout << "                              LU factorization of the near field of the HeadMat or two-grid" << endl;
+    cout << "                              method (the latter smoothing the HeadMat of a coarsened geometry)," << endl;
+    cout << "       -near r              : near field of the unknowns closer than r mean edge lengths" << endl;
+    cout << "                              (default 2)," << endl;
+    cout << "       -coarsening r        : ratio of the vertices kept in the coarse geometry of the" << endl;
+    cout << "                              two-grid preconditioner (default 0.25)," << endl;
+    cout << "       -restart m           : GMRes restarted every m block iterations (default 30)," << endl;
+    cout << "       -block p             : right hand sides solved by blocks of p (default 16), GMRes" << endl;
+    cout << "                              stores at most (m+1)*p vectors of the size of the HeadMat," << endl;
+    cout << "       -tolerance t         : relative residual of GMRes (default 1e-7)." << endl << endl;
+    cout << "   Large source spaces (-EEG, -MEG and the adjoint gains, option placed anywhere):" << endl;
+    cout << "       -chunk k             : the gains are computed by blocks of k sources, which are" << endl;
+    cout << "                              written to the output files (binary format, .bin) while" << endl;
+    cout << "                              the next blocks are computed, the memory then does not" << endl;
+    cout << "                              depend on the number of sources (SourceMat and" << endl;
+    cout << "                              Source2MEGMat are read by blocks, they must be .bin files)." << endl << endl;
     cout << "   -EEG :   Compute the gain for EEG " << endl;
     cout << "            Filepaths are in order :" << endl;
     cout << "            HeadMatInv, SourceMat, Head2EEGMat, EEGGainMatrix" << endl;
@@ -37,10 +37,14 @@ The fact that you are presently reading this means that you have had
 knowledge of the CeCILL-B license and that you accept its terms.
 */
 
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 
 #include <matrix.h>
 #include <symmatrix.h>
+#include <tiled_ldlt.h>
+#include <sym_factorization.h>
 #include <vector.h>
 #include <cpuChrono.h>
 #include <om_utils.h>
@@ -64,15 +68,106 @@ int main(int argc, char **argv)
 
     disp_argv(argc,argv);
 
+    // Options: -factor (write the factorization instead of the inverse), -pivoting (packed Bunch-Kaufman),
+    // -single (single precision Bunch-Kaufman factorization and HeadMat, with GMRES-IR refinement of the solutions).
+
+    bool factor_only = false;
+    bool pivoting    = false;
+    bool single      = false;
+    int  first       = 1;
+    for (;first<argc-2;++first)
+        if (!strcmp(argv[first],"-factor"))
+            factor_only = true;
+        else if (!strcmp(argv[first],"-pivoting"))
+            pivoting = true;
+        else if (!strcmp(argv[first],"-single"))
+            single = true;
+        else
+            break;
+
+    if (argc-first!=2 || (single && !factor_only)) {
+        cerr << "Bad arguments, please try \"" << argv[0] << " -h\"" << endl;
+        return 1;
+    }
+
+    const char* input  = argv[first];
+    const char* output = argv[first+1];
+
     // Start Chrono
     cpuChrono C;
     C.start();
 
     SymMatrix HeadMat;
 
-    HeadMat.load(argv[1]);
-    HeadMat.invert(); // invert inplace
-    HeadMat.save(argv[2]);
+    // The factorization is saved for om_gain, which then solves systems instead of multiplying by the inverse.
+
+    if (factor_only && single) {
+        HeadMat.load(input);
+        SymFactorization factorization(HeadMat,SymFactorization::MIXED);
+        if (!factorization.valid()) {
+            cerr << "The single precision factorization of " << input << " failed." << endl;
+            return 1;
+        }
+        factorization.save(output);
+    } else if (factor_only) {
+        if (!pivoting) {
+            HeadMat.set_layout(SymMatrix::TILED);
+            HeadMat.load(input);
+            SymFactorization factorization(HeadMat);
+            if (factorization.valid()) {
+                factorization.save(output);
+            } else {
+                cerr << "The tiled factorization failed (vanishing pivot), using the Bunch-Kaufman one." << endl;
+                HeadMat = SymMatrix();
+                pivoting = true;
+            }
+        }
+        if (pivoting) {
+            HeadMat.load(input);
+            SymFactorization factorization(HeadMat,SymFactorization::BUNCH_KAUFMAN);
+            if (!factorization.valid()) {
+                cerr << "The HeadMat " << input << " is singular." << endl;
+                return 1;
+            }
+            factorization.save(output);
+        }
+    }
+
+    // The tiled factorization works in place in the half storage and falls back to the packed Bunch-Kaufman
+    // routines when a pivot vanishes.
+
+    if (!factor_only && !pivoting) {
+        HeadMat.set_layout(SymMatrix::TILED);
+        HeadMat.load(input);
+        TiledLDLt factorization(HeadMat);
+        if (factorization.valid()) {
+            factorization.invert();
+        } else {
+            cerr << "The tiled factorization failed (vanishing pivot), using the Bunch-Kaufman one." << endl;
+            HeadMat = SymMatrix();
+            pivoting = true;
+        }
+    }
+
+    if (!factor_only) {
+        if (pivoting) {
+            HeadMat.load(input);
+            HeadMat.invert(); // invert inplace
+        }
+        HeadMat.save(output);
+    }
+
+    // The inverse (or factorization) keeps the ordering of the unknowns of the HeadMat (see om_assemble -ordering).
+
+    const std::string perm     = std::string(input)+".perm";
+    const std::string inv_perm = std::string(output)+".perm";
+    std::ifstream is(perm.c_str());
+    if (is.is_open()) {
+        std::ofstream os(inv_perm.c_str());
+        os << is.rdbuf();
+    } else {
+        std::remove(inv_perm.c_str());
+    }
 
     // Stop Chrono
     C.stop();
@@ -89,5 +184,15 @@ void getHelp(char** argv)
     cout << "   Filepaths are in order :" << endl;
     cout << "       HeadMat (bin), HeadMatInv (bin)" << endl << endl;
 
+    cout << "   Options :" << endl;
+    cout << "       -factor   : write the factorization of HeadMat instead of its inverse (UDU', or" << endl;
+    cout << "                   Bunch-Kaufman with -pivoting), om_gain then uses it in place of HeadMatInv" << endl;
+    cout << "                   or HeadMat to solve systems." << endl;
+    cout << "       -single   : with -factor, factorize in single precision (about twice as fast), keeping the" << endl;
+    cout << "                   HeadMat in single precision too (the file has the size of the double precision" << endl;
+    cout << "                   factors), the solutions computed by om_gain are refined by GMRES-IR." << endl;
+    cout << "       -pivoting : use the packed Bunch-Kaufman factorization (used anyway when the tiled" << endl;
+    cout << "                   factorization meets a vanishing pivot)." << endl << endl;
+
     exit(0);
 }
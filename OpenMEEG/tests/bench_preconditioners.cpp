@@ -0,0 +1,135 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <ctime>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+
+#include <symmatrix.h>
+#include <geometry.h>
+#include <assemble.h>
+#include <gmres.h>
+#include <preconditioners.h>
+
+using namespace OpenMEEG;
+
+//  Iteration counts and timings of GMRes on the HeadMat of a geometry (e.g. data/Head1, Head2 and Head3) with the
+//  Jacobi, mesh block, near field ILU and two-grid preconditioners (see test_preconditioners for their accuracy).
+
+namespace {
+
+    double seconds(const clock_t start) { return static_cast<double>(clock()-start)/CLOCKS_PER_SEC; }
+
+    //  Counts the applications of a preconditioner, i.e. the iterations of GMRes (plus one per restart).
+
+    template <typename P>
+    struct Counted {
+        Counted(const P& p): M(p),count(0) { }
+        Vector operator()(const Vector& g) const { ++count; return M(g); }
+        const P&         M;
+        mutable unsigned count;
+    };
+
+    template <typename P>
+    void run(const char* name,const SymMatrix& HM,const P& M,const double setup,const Matrix& B) {
+        const unsigned restart = 100;
+        const double   tol     = 1e-8;
+        const Counted<P> counted(M);
+        unsigned failures = 0;
+        const clock_t start = clock();
+        for (unsigned j=0;j<B.ncol();++j) {
+            Vector x(HM.nlin());
+            failures += GMRes(HM,counted,x,B.getcol(j),1000,tol,restart);
+        }
+        const double solve = seconds(start);
+        std::cout << std::setw(12) << name << " : " << std::setw(6) << counted.count/B.ncol() << " iterations per system, setup "
+                  << setup << " s, solves " << solve << " s, " << failures << " failures" << std::endl;
+    }
+}
+
+int main(int argc,char** argv)
+{
+    if (argc!=3) {
+        std::cerr << "Usage: " << argv[0] << " geometry.geom conductivities.cond" << std::endl;
+        exit(1);
+    }
+
+    Geometry geo;
+    geo.read(argv[1],argv[2]);
+
+    const HeadMat HM(geo);
+
+    Matrix B(HM.nlin(),4);
+    for (size_t i=0;i<B.nlin();++i)
+        for (size_t j=0;j<B.ncol();++j)
+            B(i,j) = std::cos(0.1*i+j);
+
+    std::cout << "HeadMat of size " << HM.nlin() << std::endl;
+
+    clock_t start = clock();
+    const Jacobi<SymMatrix> jacobi(HM);
+    run("Jacobi",HM,jacobi,seconds(start),B);
+
+    start = clock();
+    const MeshBlockPreconditioner blocks(HM,geo);
+    run("Mesh blocks",HM,blocks,seconds(start),B);
+
+    start = clock();
+    const NearFieldILU ilu(HM,geo);
+    std::cout << "Near field entries : " << ilu.nb_entries() << " (" << static_cast<double>(ilu.nb_entries())/HM.nlin() << " per line)" << std::endl;
+    run("Near ILU",HM,ilu,seconds(start),B);
+
+    //  Two-grid preconditioner smoothed by the near field ILU, the coarse geometry having a quarter of the vertices
+    //  of each mesh (a Jacobi smoother is too weak, GMRes then hardly converges on Head3).
+
+    Geometry coarse;
+    coarse.read(argv[1],argv[2]);
+    start = clock();
+    coarse.coarsen(0.25);
+    const CoarseCorrection correction(geo,coarse);
+    const double coarse_setup = seconds(start);
+    std::cout << "Coarse HeadMat of size " << correction.size() << std::endl;
+
+    const TwoGridPreconditioner<SymMatrix,NearFieldILU> twogrid_ilu(HM,ilu,correction);
+    run("2-grid ILU",HM,twogrid_ilu,coarse_setup,B);
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include <symmatrix.h>
+#include <geometry.h>
+#include <assemble.h>
+#include <gmres.h>
+#include <gain.h>
+
+using namespace OpenMEEG;
+
+double relative_error(const Matrix& A,const Matrix& B) {
+    double diff = 0.0;
+    double norm = 0.0;
+    for (size_t i=0;i<A.nlin();++i)
+        for (size_t j=0;j<A.ncol();++j) {
+            diff = std::max(diff,std::abs(A(i,j)-B(i,j)));
+            norm = std::max(norm,std::abs(A(i,j)));
+        }
+    return diff/norm;
+}
+
+//  Solutions of the HeadMat systems given by the block GMRes (with and without restarts, with several blocks of
+//  right hand sides) compared to the ones given by its inverse.
+
+int main(int argc,char** argv)
+{
+    if (argc!=3) {
+        std::cerr << "Usage: " << argv[0] << " geometry.geom conductivities.cond" << std::endl;
+        exit(1);
+    }
+
+    Geometry geo;
+    geo.read(argv[1],argv[2]);
+
+    const HeadMat HM(geo);
+    const SymMatrix HMinv = HM.inverse();
+
+    Matrix B(HM.nlin(),7);
+    for (size_t i=0;i<B.nlin();++i)
+        for (size_t j=0;j<B.ncol();++j)
+            B(i,j) = std::cos(0.1*i+j);
+
+    const Matrix X = HMinv*B;
+
+    const unsigned restarts[2] = { 200, 10 };
+    int status = 0;
+    for (unsigned r=0;r<2;++r) {
+        SolverParameters solver(SolverParameters::GMRES);
+        solver.restart        = restarts[r];
+        solver.block_size     = 3;
+        solver.tolerance      = 1e-10;
+        solver.max_iterations = 2000;
+
+        const double error = relative_error(X,KrylovSolutions(geo,HM,B,solver));
+        std::cout << "Block GMRes (restart " << restarts[r] << ") relative error : " << error << std::endl;
+        if (error>1e-7) {
+            std::cerr << "The block GMRes solutions differ from the inverse." << std::endl;
+            status = 1;
+        }
+    }
+
+    return status;
+}
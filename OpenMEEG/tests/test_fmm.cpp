@@ -0,0 +1,151 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <ctime>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include <vector.h>
+#include <matrix.h>
+#include <geometry.h>
+#include <operators.h>
+#include <fmm.h>
+
+using namespace OpenMEEG;
+
+//  Fast products by the S, D, D* and S* operators of all the pairs of meshes of a geometry, compared to the products by
+//  the blocks assembled with the analytic kernels.
+
+namespace {
+
+    double seconds(const clock_t start) { return static_cast<double>(clock()-start)/CLOCKS_PER_SEC; }
+
+    double relative_error(const Vector& ref,const Vector& val) {
+        return (ref-val).norm()/ref.norm();
+    }
+
+    Vector random_vector(const unsigned n) {
+        Vector x(n);
+        for (unsigned i=0;i<n;++i)
+            x(i) = static_cast<double>(rand())/RAND_MAX-0.5;
+        return x;
+    }
+
+    // Dense S and D blocks (without coefficients) of a mesh pair, oriented as in assemble_HM.
+
+    void dense_blocks(const Mesh& m1,const Mesh& m2,Matrix& S,Matrix& D) {
+        std::map<const Vertex*,unsigned> positions;
+        for (Mesh::const_vertex_iterator vit=m2.vertex_begin();vit!=m2.vertex_end();++vit)
+            positions[*vit] = vit-m2.vertex_begin();
+
+        const KernelContext context;
+        S = Matrix(m1.nb_triangles(),m2.nb_triangles());
+        D = Matrix(m1.nb_triangles(),m2.nb_vertices());
+        D.set(0.0);
+        for (unsigned i=0;i<m1.nb_triangles();++i)
+            for (unsigned j=0;j<m2.nb_triangles();++j) {
+                S(i,j) = (&m1==&m2) ? _operatorS(m1,std::min(i,j),m2,std::max(i,j),context) : _operatorS(m1,i,m2,j,context);
+                const Vect3 values = _operatorD(m1,i,m2,j,context);
+                const Triangle& T2 = *(m2.begin()+j);
+                for (unsigned k=0;k<3;++k)
+                    D(i,positions[&T2(k)]) += values(k);
+            }
+    }
+}
+
+int main(int argc,char** argv)
+{
+    if (argc<3 || argc>4) {
+        std::cerr << "Usage: " << argv[0] << " geometry.geom conductivities.cond [accuracy]" << std::endl;
+        exit(1);
+    }
+
+    const double accuracy = (argc==4) ? atof(argv[3]) : 1e-3;
+
+    Geometry geo;
+    geo.read(argv[1],argv[2]);
+
+    srand(0);
+    double max_error = 0.0;
+    for (Geometry::const_iterator mit1=geo.begin();mit1!=geo.end();++mit1)
+        for (Geometry::const_iterator mit2=geo.begin();mit2!=geo.end();++mit2) {
+            clock_t start = clock();
+            Matrix S,D;
+            dense_blocks(*mit1,*mit2,S,D);
+            const double dense_time = seconds(start);
+
+            start = clock();
+            const FMMOperators operators(*mit1,*mit2);
+            const double fmm_time = seconds(start);
+
+            const Vector& xt = random_vector(mit2->nb_triangles());
+            const Vector& xv = random_vector(mit2->nb_vertices());
+            const Vector& xs = random_vector(mit1->nb_triangles());
+
+            Vector ys(mit1->nb_triangles());
+            Vector yd(mit1->nb_triangles());
+            Vector yds(mit2->nb_vertices());
+            Vector yss(mit2->nb_triangles());
+            ys.set(0.0);
+            yd.set(0.0);
+            yds.set(0.0);
+            yss.set(0.0);
+            start = clock();
+            operators.S(xt,ys);
+            operators.D(xv,yd);
+            operators.Dstar(xs,yds);
+            operators.Sstar(xs,yss);
+            const double product_time = seconds(start);
+
+            const double errors[4] = { relative_error(S*xt,ys), relative_error(D*xv,yd), relative_error(D.transpose()*xs,yds),
+                                       relative_error(S.transpose()*xs,yss) };
+            std::cout << "Meshes " << mit1->name() << "/" << mit2->name() << " (" << operators.nb_near_pairs() << " near pairs)"
+                      << " : dense " << dense_time << " s, fast " << fmm_time << " s + " << product_time << " s"
+                      << " - relative errors S " << errors[0] << " D " << errors[1] << " D* " << errors[2] << " S* " << errors[3] << std::endl;
+            max_error = std::max(max_error,*std::max_element(errors,errors+4));
+        }
+
+    if (max_error>accuracy) {
+        std::cerr << "The fast products do not approximate the operators." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
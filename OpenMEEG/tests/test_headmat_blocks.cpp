@@ -0,0 +1,117 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <symmatrix.h>
+#include <geometry.h>
+#include <assemble.h>
+
+using namespace OpenMEEG;
+
+//  HeadMats obtained from the conductivity independent blocks (saved and loaded) compared to the assembled ones,
+//  for the given conductivities and for modified ones (the non null conductivities are scaled).
+
+namespace {
+
+    void scale_conductivities(const std::string& input,const std::string& output) {
+        std::ifstream is(input.c_str());
+        std::ofstream os(output.c_str());
+        std::string line;
+        double factor = 1.0;
+        while (std::getline(is,line)) {
+            std::istringstream iss(line);
+            std::string name;
+            double sigma;
+            if (line.empty() || line[0]=='#' || !(iss >> name >> sigma)) {
+                os << line << std::endl;
+                continue;
+            }
+            factor *= 1.5;
+            os << name << ' ' << sigma*factor << std::endl;
+        }
+    }
+
+    double relative_error(const SymMatrix& ref,const SymMatrix& val) {
+        double diff = 0.0;
+        double norm = 0.0;
+        for (unsigned i=0;i<ref.size();++i) {
+            diff += (ref.data()[i]-val.data()[i])*(ref.data()[i]-val.data()[i]);
+            norm += ref.data()[i]*ref.data()[i];
+        }
+        return sqrt(diff/norm);
+    }
+}
+
+int main(int argc,char** argv)
+{
+    if (argc!=3) {
+        std::cerr << "Usage: " << argv[0] << " geometry.geom conductivities.cond" << std::endl;
+        exit(1);
+    }
+
+    Geometry geo;
+    geo.read(argv[1],argv[2]);
+
+    const HeadMatBlocks blocks(geo);
+    blocks.save("test_headmat_blocks.hmb");
+    HeadMatBlocks loaded;
+    loaded.load("test_headmat_blocks.hmb");
+
+    const double error = relative_error(HeadMat(geo),HeadMat(geo,loaded));
+    std::cout << "Relative error (same conductivities) : " << error << std::endl;
+
+    scale_conductivities(argv[2],"test_headmat_blocks.cond");
+    Geometry geo2;
+    geo2.read(argv[1],"test_headmat_blocks.cond");
+
+    const double error2 = relative_error(HeadMat(geo2),HeadMat(geo2,loaded));
+    std::cout << "Relative error (modified conductivities) : " << error2 << std::endl;
+
+    if (error>1e-12 || error2>1e-12) {
+        std::cerr << "The HeadMats obtained from the blocks differ from the assembled ones." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
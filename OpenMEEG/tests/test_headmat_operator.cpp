@@ -0,0 +1,119 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <ctime>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include <vector.h>
+#include <matrix.h>
+#include <symmatrix.h>
+#include <geometry.h>
+#include <assemble.h>
+#include <gmres.h>
+
+using namespace OpenMEEG;
+
+//  Matrix-free HeadMat: products, entries and GMRes solutions compared to the ones of the assembled HeadMat.
+
+namespace {
+
+    double seconds(const clock_t start) { return static_cast<double>(clock()-start)/CLOCKS_PER_SEC; }
+
+    double relative_error(const Vector& ref,const Vector& val) {
+        return (ref-val).norm()/ref.norm();
+    }
+}
+
+int main(int argc,char** argv)
+{
+    if (argc<3 || argc>4) {
+        std::cerr << "Usage: " << argv[0] << " geometry.geom conductivities.cond [accuracy]" << std::endl;
+        exit(1);
+    }
+
+    const double accuracy = (argc==4) ? atof(argv[3]) : 1e-3;
+
+    Geometry geo;
+    geo.read(argv[1],argv[2]);
+
+    clock_t start = clock();
+    const HeadMat HM(geo);
+    std::cout << "Dense HeadMat : " << seconds(start) << " s" << std::endl;
+
+    start = clock();
+    const HeadMatOperator A(geo);
+    std::cout << "Matrix-free HeadMat : " << seconds(start) << " s" << std::endl;
+    A.info();
+
+    srand(0);
+    Vector x(HM.nlin());
+    for (unsigned i=0;i<x.size();++i)
+        x(i) = static_cast<double>(rand())/RAND_MAX-0.5;
+
+    start = clock();
+    const Vector& b = A*x;
+    std::cout << "Product : " << seconds(start) << " s" << std::endl;
+    const double error_product = relative_error(HM*x,b);
+    std::cout << "Product relative error : " << error_product << std::endl;
+
+    double error_diagonal = 0.0;
+    for (unsigned i=0;i<HM.nlin();++i)
+        error_diagonal = std::max(error_diagonal,std::abs(A(i,i)-HM(i,i))/std::abs(HM(i,i)));
+    std::cout << "Diagonal relative error : " << error_diagonal << std::endl;
+
+    // Same right hand side for both systems, so that the difference of the solutions only reflects the operator.
+
+    const Vector& rhs = HM*x;
+    Vector y(HM.nlin());
+    start = clock();
+    Jacobi<HeadMatOperator> M(A);
+    const unsigned status = GMRes(A,M,y,rhs,1000,1e-9,100);
+    std::cout << "GMRes : " << seconds(start) << " s" << std::endl;
+    const double error_solve = relative_error(x,y);
+    std::cout << "Solution relative error : " << error_solve << std::endl;
+
+    if (error_product>accuracy || error_diagonal>1e-10 || status!=0 || error_solve>100*accuracy) {
+        std::cerr << "The matrix-free HeadMat does not approximate the HeadMat." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <map>
+
+#include <symmatrix.h>
+#include <geometry.h>
+#include <assemble.h>
+
+using namespace OpenMEEG;
+
+//  HeadMats updated from a previous HeadMat and its layout compared to the assembled ones, for the same geometry and
+//  for a geometry whose first mesh is refined (which renumbers the unknowns of all the meshes).
+
+namespace {
+
+    // Write the first mesh of geo split in 4 triangles per triangle (normals are not used), and a geometry file
+    // using it instead of the original mesh.
+
+    void refine_first_mesh(const Geometry& geo,const std::string& geom,const std::string& output) {
+
+        const Mesh& m = *geo.begin();
+        std::map<const Vertex*,unsigned> positions;
+        std::vector<Vect3> vertices;
+        for (Mesh::const_vertex_iterator vit=m.vertex_begin();vit!=m.vertex_end();++vit) {
+            positions[*vit] = vertices.size();
+            vertices.push_back(**vit);
+        }
+
+        std::map<std::pair<unsigned,unsigned>,unsigned> midpoints;
+        std::vector<unsigned> triangles;
+        for (Mesh::const_iterator tit=m.begin();tit!=m.end();++tit) {
+            unsigned v[3],mid[3];
+            for (unsigned k=0;k<3;++k)
+                v[k] = positions[&tit->vertex(k)];
+            for (unsigned k=0;k<3;++k) {
+                const std::pair<unsigned,unsigned> edge(std::min(v[k],v[(k+1)%3]),std::max(v[k],v[(k+1)%3]));
+                if (midpoints.count(edge)==0) {
+                    midpoints[edge] = vertices.size();
+                    vertices.push_back(0.5*(vertices[edge.first]+vertices[edge.second]));
+                }
+                mid[k] = midpoints[edge];
+            }
+            const unsigned split[12] = { v[0], mid[0], mid[2], v[1], mid[1], mid[0], v[2], mid[2], mid[1], mid[0], mid[1], mid[2] };
+            triangles.insert(triangles.end(),split,split+12);
+        }
+
+        const std::string tri = output+".tri";
+        std::ofstream os(tri.c_str());
+        os << "- " << vertices.size() << std::endl;
+        for (unsigned i=0;i<vertices.size();++i)
+            os << vertices[i].x() << ' ' << vertices[i].y() << ' ' << vertices[i].z() << " 0 0 0" << std::endl;
+        const unsigned nb_triangles = triangles.size()/3;
+        os << "- " << nb_triangles << ' ' << nb_triangles << ' ' << nb_triangles << std::endl;
+        for (unsigned i=0;i<nb_triangles;++i)
+            os << triangles[3*i] << ' ' << triangles[3*i+1] << ' ' << triangles[3*i+2] << std::endl;
+
+        // Same geometry file, the meshes being given by absolute paths.
+
+        const std::string::size_type slash = geom.rfind('/');
+        const std::string directory = (slash==std::string::npos) ? std::string("") : geom.substr(0,slash+1);
+        std::ifstream is(geom.c_str());
+        std::ofstream geo_os((output+".geom").c_str());
+        std::string line;
+        bool first = true;
+        while (std::getline(is,line)) {
+            const std::string::size_type quote = line.find('"');
+            if (line.find("Interface:")==0 && quote!=std::string::npos) {
+                const std::string file = line.substr(quote+1,line.rfind('"')-quote-1);
+                line = line.substr(0,quote+1)+((first) ? tri : ((file[0]=='/') ? file : directory+file))+"\"";
+                first = false;
+            }
+            geo_os << line << std::endl;
+        }
+    }
+
+    double relative_error(const SymMatrix& ref,const SymMatrix& val) {
+        if (ref.nlin()!=val.nlin())
+            return 1.0;
+        double diff = 0.0;
+        double norm = 0.0;
+        for (unsigned i=0;i<ref.size();++i) {
+            diff += (ref.data()[i]-val.data()[i])*(ref.data()[i]-val.data()[i]);
+            norm += ref.data()[i]*ref.data()[i];
+        }
+        return sqrt(diff/norm);
+    }
+}
+
+int main(int argc,char** argv)
+{
+    if (argc!=3) {
+        std::cerr << "Usage: " << argv[0] << " geometry.geom conductivities.cond" << std::endl;
+        exit(1);
+    }
+
+    Geometry geo;
+    geo.read(argv[1],argv[2]);
+
+    const HeadMat HM(geo);
+    HeadMatLayout(geo,HM).save("test_headmat_update.hml");
+    HeadMatLayout layout;
+    layout.load("test_headmat_update.hml");
+
+    const double error = relative_error(HM,HeadMat(geo,HM,layout));
+    std::cout << "Relative error (same geometry) : " << error << std::endl;
+
+    refine_first_mesh(geo,argv[1],"test_headmat_update");
+    Geometry geo2;
+    geo2.read("test_headmat_update.geom",argv[2]);
+
+    const double error2 = relative_error(HeadMat(geo2),HeadMat(geo2,HM,layout));
+    std::cout << "Relative error (refined mesh) : " << error2 << std::endl;
+
+    if (error>1e-12 || error2>1e-12) {
+        std::cerr << "The updated HeadMats differ from the assembled ones." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+#include <ctime>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+#include <vector.h>
+#include <matrix.h>
+#include <symmatrix.h>
+#include <geometry.h>
+#include <assemble.h>
+
+using namespace OpenMEEG;
+
+//  Compression of the HeadMat of a geometry as an H-matrix: the products and the solutions obtained with the H-matrix
+//  (and its H-LU factors) are compared to the ones of the dense HeadMat, and some of its blocks must be low rank.
+
+namespace {
+
+    double seconds(const clock_t start) { return static_cast<double>(clock()-start)/CLOCKS_PER_SEC; }
+
+    double relative_error(const Matrix& ref,const Matrix& val) {
+        return (ref-val).frobenius_norm()/ref.frobenius_norm();
+    }
+}
+
+int main(int argc,char** argv)
+{
+    if (argc<3 || argc>4) {
+        std::cerr << "Usage: " << argv[0] << " geometry.geom conductivities.cond [accuracy]" << std::endl;
+        exit(1);
+    }
+
+    const double epsilon = (argc==4) ? atof(argv[3]) : 1e-6;
+
+    Geometry geo;
+    geo.read(argv[1],argv[2]);
+
+    clock_t start = clock();
+    const HeadMat HM(geo);
+    std::cout << "Dense HeadMat : " << seconds(start) << " s" << std::endl;
+
+    start = clock();
+    HeadHMatrix H(geo,epsilon);
+    std::cout << "H-matrix      : " << seconds(start) << " s" << std::endl;
+    H.info();
+
+    Matrix X(HM.nlin(),3);
+    srand(0);
+    for (unsigned j=0;j<X.ncol();++j)
+        for (unsigned i=0;i<X.nlin();++i)
+            X(i,j) = static_cast<double>(rand())/RAND_MAX-0.5;
+
+    const Matrix& B = HM*X;
+    const double error_product = relative_error(B,H*X);
+    std::cout << "Product relative error  : " << error_product << std::endl;
+
+    bool unfactorized_solve = true;
+    try {
+        Matrix Z(B,DEEP_COPY);
+        H.solveLin(Z);
+    } catch (const std::runtime_error&) {
+        unfactorized_solve = false;
+    }
+
+    start = clock();
+    H.factorize();
+    std::cout << "H-LU factorization : " << seconds(start) << " s" << std::endl;
+    H.info();
+
+    Matrix Y(B,DEEP_COPY);
+    H.solveLin(Y);
+    const double error_solve = relative_error(X,Y);
+    std::cout << "Solution relative error : " << error_solve << std::endl;
+
+    if (error_product>100*epsilon || error_solve>1e-2) {
+        std::cerr << "The H-matrix does not approximate the HeadMat." << std::endl;
+        return 1;
+    }
+
+    if (H.nb_low_rank_blocks()==0) {
+        std::cerr << "The H-matrix has no low rank block." << std::endl;
+        return 1;
+    }
+
+    if (unfactorized_solve) {
+        std::cerr << "HMatrix::solveLin did not throw before the factorization." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#include <geometry.h>
+#include <analytics.h>
+
+using namespace OpenMEEG;
+
+//  The S and D kernels integrated on all the pairs of triangles of a geometry with batched evaluations on ranges of
+//  triangles (TriangleCache::integrate) must match the integrals evaluated one quadrature node at a time
+//  (TriangleCache::integrate<T>) up to rounding errors. See bench_kernels for the timings.
+
+namespace {
+
+    double relative_error(const std::vector<double>& ref,const std::vector<double>& val) {
+        double err = 0.0;
+        double nrm = 0.0;
+        for (unsigned i=0;i<ref.size();++i) {
+            err = std::max(err,std::abs(ref[i]-val[i]));
+            nrm = std::max(nrm,std::abs(ref[i]));
+        }
+        return (nrm>0.0) ? err/nrm : err;
+    }
+}
+
+int main(int argc,char** argv)
+{
+    if (argc!=3) {
+        std::cerr << "Usage: " << argv[0] << " geometry.geom conductivities.cond" << std::endl;
+        exit(1);
+    }
+
+    Geometry geo;
+    geo.read(argv[1],argv[2]);
+
+    std::cout << "Instruction set : " << analytics_instruction_set() << std::endl;
+
+    bool ok = true;
+    for (unsigned order=0;order<4;++order) {
+        double error_S = 0.0;
+        double error_D = 0.0;
+        for (Geometry::const_iterator mit1=geo.begin();mit1!=geo.end();++mit1) {
+            for (Geometry::const_iterator mit2=geo.begin();mit2!=geo.end();++mit2) {
+                const TriangleCache& c1 = mit1->cache();
+                const TriangleCache& c2 = mit2->cache();
+                const unsigned n1 = c1.size();
+                const unsigned n2 = c2.size();
+
+                std::vector<double> S0(n1*n2),S1(n1*n2);
+                for (unsigned i=0;i<n1;++i) {
+                    for (unsigned j=0;j<n2;++j)
+                        S0[i*n2+j] = c2.integrate<double>(c1.analyS(i),j,order);
+                    c2.integrate(c1.analyS(i),0,n2,order,&S1[i*n2]);
+                }
+                error_S = std::max(error_S,relative_error(S0,S1));
+
+                std::vector<Vect3>  D(n1);
+                std::vector<double> d0(3*n1*n2),d1(3*n1*n2);
+                for (unsigned j=0;j<n2;++j) {
+                    c1.integrate(c2.analyD3(j),0,n1,order,&D[0]);
+                    for (unsigned i=0;i<n1;++i) {
+                        const Vect3& v = c1.integrate<Vect3>(c2.analyD3(j),i,order);
+                        for (unsigned l=0;l<3;++l) {
+                            d0[3*(j*n1+i)+l] = v(l);
+                            d1[3*(j*n1+i)+l] = D[i](l);
+                        }
+                    }
+                }
+                error_D = std::max(error_D,relative_error(d0,d1));
+            }
+        }
+        std::cout << "Gauss order " << order << " : relative differences S " << error_S << ", D " << error_D << std::endl;
+        ok = ok && error_S<=1e-9 && error_D<=1e-9;
+    }
+
+    if (!ok) {
+        std::cerr << "Batched kernels do not match the scalar ones." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <symmatrix.h>
+#include <geometry.h>
+#include <assemble.h>
+
+using namespace OpenMEEG;
+
+//  HeadMats assembled with the orderings of the unknowns compared to the one of the file ordering, through the
+//  permutations of the unknowns (which are also saved and read back).
+
+namespace {
+
+    // Mean distance between the indices of the neighbouring triangles (a measure of the locality of the ordering).
+
+    double triangle_spread(const Geometry& geo) {
+        double   sum = 0.0;
+        unsigned n   = 0;
+        for (Geometry::const_iterator mit=geo.begin();mit!=geo.end();++mit)
+            for (unsigned i=0;i<mit->nb_triangles();++i) {
+                const Mesh::Positions neighbours = mit->triangle_neighbours(i);
+                for (Mesh::Positions::const_iterator nit=neighbours.begin();nit!=neighbours.end();++nit,++n)
+                    sum += std::abs(static_cast<double>((*mit)[i].index())-static_cast<double>((*mit)[*nit].index()));
+            }
+        return sum/n;
+    }
+}
+
+int main(int argc,char** argv)
+{
+    if (argc!=3) {
+        std::cerr << "Usage: " << argv[0] << " geometry.geom conductivities.cond" << std::endl;
+        exit(1);
+    }
+
+    Geometry reference;
+    reference.read(argv[1],argv[2]);
+    const HeadMat HM(reference);
+    std::cout << "file ordering : triangle spread " << triangle_spread(reference) << std::endl;
+
+    const UnknownOrdering orderings[] = { MORTON_ORDER, HILBERT_ORDER, CLUSTER_ORDER };
+    bool failed = false;
+    for (unsigned k=0;k<3;++k) {
+        Geometry geo;
+        geo.ordering() = orderings[k];
+        geo.read(argv[1],argv[2]);
+        const HeadMat HMo(geo);
+
+        // The permutation must be a bijection keeping vertices among vertices and triangles among triangles.
+
+        const std::vector<unsigned>& permutation = geo.permutation();
+        std::vector<bool> seen(permutation.size(),false);
+        bool bijection = (permutation.size()==reference.size());
+        for (unsigned i=0;bijection && i<permutation.size();++i) {
+            bijection = permutation[i]<seen.size() && !seen[permutation[i]] &&
+                        ((i<reference.nb_vertices())==(permutation[i]<reference.nb_vertices()));
+            if (bijection)
+                seen[permutation[i]] = true;
+        }
+
+        double error = 0.0;
+        double norm  = 0.0;
+        for (unsigned i=0;bijection && i<HMo.nlin();++i)
+            for (unsigned j=i;j<HMo.nlin();++j) {
+                error = std::max(error,std::abs(HMo(i,j)-HM(permutation[i],permutation[j])));
+                norm  = std::max(norm,std::abs(HM(i,j)));
+            }
+        error /= norm;
+
+        // Saved permutation read back.
+
+        const std::string filename = std::string("ordering_")+unknown_ordering_name(orderings[k])+".perm";
+        geo.save_ordering(filename);
+        UnknownOrdering       ordering;
+        std::vector<unsigned> loaded;
+        const bool read = Geometry::load_ordering(filename,ordering,loaded) && ordering==orderings[k] && loaded==permutation;
+        std::remove(filename.c_str());
+
+        std::cout << unknown_ordering_name(orderings[k]) << " ordering : triangle spread " << triangle_spread(geo)
+                  << ", HeadMat relative error " << error << std::endl;
+
+        if (!bijection || error>1e-10 || !read) {
+            std::cerr << "The " << unknown_ordering_name(orderings[k]) << " ordering does not permute the HeadMat." << std::endl;
+            failed = true;
+        }
+    }
+
+    return (failed) ? 1 : 0;
+}
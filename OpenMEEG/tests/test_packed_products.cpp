@@ -0,0 +1,110 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include <matrix.h>
+#include <symmatrix.h>
+#include <sparse_matrix.h>
+
+using namespace OpenMEEG;
+
+//  Products of a packed symmetric matrix with dense and sparse matrices compared to the same products
+//  computed element by element, for sizes which are not multiples of the tile size.
+
+namespace {
+
+    double value(const size_t i,const size_t j) { return std::sin(1.0+0.37*i+0.11*j*j); }
+
+    double relative_error(const Matrix& A,const SymMatrix& S,const Matrix& C) {
+        double diff = 0.0;
+        double norm = 0.0;
+        for (size_t i=0;i<C.nlin();++i)
+            for (size_t j=0;j<C.ncol();++j) {
+                double ref = 0.0;
+                for (size_t k=0;k<S.nlin();++k)
+                    ref += A(i,k)*S(k,j);
+                diff += (ref-C(i,j))*(ref-C(i,j));
+                norm += ref*ref;
+            }
+        return sqrt(diff/norm);
+    }
+}
+
+int main()
+{
+    bool failed = false;
+    const size_t sizes[] = { 1, 255, 256, 613 };
+    for (unsigned n=0;n<sizeof(sizes)/sizeof(sizes[0]);++n) {
+        const size_t N = sizes[n];
+
+        SymMatrix S(N);
+        for (size_t i=0;i<N;++i)
+            for (size_t j=i;j<N;++j)
+                S(i,j) = value(i,j);
+
+        Matrix B(N,7);
+        for (size_t i=0;i<N;++i)
+            for (size_t j=0;j<B.ncol();++j)
+                B(i,j) = value(j,i);
+
+        SparseMatrix P(5,N);
+        for (size_t i=0;i<N;i+=3)
+            P(i%5,i) = value(i,1);
+        P(4,N-1) += 1.0;
+
+        // S*B = (B'*S)'.
+
+        const double e1 = relative_error(B.transpose(),S,(S*B).transpose());
+        const double e2 = relative_error(B.transpose(),S,B.transpose()*S);
+        const double e3 = relative_error(Matrix(P),S,P*S);
+        std::cout << "N = " << N << " : " << e1 << ' ' << e2 << ' ' << e3 << std::endl;
+        if (e1>1e-13 || e2>1e-13 || e3>1e-13)
+            failed = true;
+    }
+
+    if (failed) {
+        std::cerr << "The products with the packed matrix differ from the reference ones." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
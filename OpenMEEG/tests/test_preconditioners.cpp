@@ -0,0 +1,142 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include <symmatrix.h>
+#include <geometry.h>
+#include <assemble.h>
+#include <gmres.h>
+#include <preconditioners.h>
+#include <gain.h>
+
+using namespace OpenMEEG;
+
+//  Block GMRes solutions (as computed by om_gain) of HeadMat X = B with the Jacobi, mesh block, near field ILU and
+//  two-grid preconditioners, B being the product of the HeadMat by known solutions. The HeadMat of a geometry with a
+//  current barrier which is not outermost (e.g. data/HeadMN1) is singular, its solutions are then compared up to the
+//  constants on the vertices of these meshes.
+
+namespace {
+
+    //  Removes from each column of X the mean of its values on the meshes whose constants are in the kernel.
+
+    void remove_kernel(const HeadMatUnknowns& unknowns,Matrix& X) {
+        for (unsigned m=0;m<unknowns.meshes.size();++m) {
+            if (!unknowns.kernels[m])
+                continue;
+            const std::vector<unsigned>& indices = unknowns.meshes[m];
+            for (unsigned j=0;j<X.ncol();++j) {
+                double mean = 0.0;
+                for (unsigned i=0;i<indices.size();++i)
+                    mean += X(indices[i],j);
+                mean /= indices.size();
+                for (unsigned i=0;i<indices.size();++i)
+                    X(indices[i],j) -= mean;
+            }
+        }
+    }
+
+    double relative_error(const Matrix& A,const Matrix& B) {
+        double diff = 0.0;
+        double norm = 0.0;
+        for (size_t i=0;i<A.nlin();++i)
+            for (size_t j=0;j<A.ncol();++j) {
+                diff = std::max(diff,std::abs(A(i,j)-B(i,j)));
+                norm = std::max(norm,std::abs(A(i,j)));
+            }
+        return diff/norm;
+    }
+
+    template <typename P>
+    bool check(const char* name,const SymMatrix& HM,const HeadMatUnknowns& unknowns,const P& M,const Matrix& B,const Matrix& X) {
+        Matrix Y;
+        try {
+            Y = KrylovSolutions(HM,M,B,SolverParameters(SolverParameters::GMRES,30,16,1e-10));
+        } catch (const std::runtime_error& e) {
+            std::cerr << name << " : " << e.what() << std::endl;
+            return false;
+        }
+        remove_kernel(unknowns,Y);
+
+        const double error = relative_error(X,Y);
+        std::cout << name << " : relative error " << error << std::endl;
+        if (error>1e-6) {
+            std::cerr << "GMRes preconditioned by " << name << " did not converge to the solutions." << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc,char** argv)
+{
+    if (argc!=3) {
+        std::cerr << "Usage: " << argv[0] << " geometry.geom conductivities.cond" << std::endl;
+        exit(1);
+    }
+
+    Geometry geo;
+    geo.read(argv[1],argv[2]);
+
+    const HeadMat         HM(geo);
+    const HeadMatUnknowns unknowns(geo);
+
+    Matrix X(HM.nlin(),4);
+    for (size_t i=0;i<X.nlin();++i)
+        for (size_t j=0;j<X.ncol();++j)
+            X(i,j) = std::cos(0.1*i+j);
+    remove_kernel(unknowns,X);
+    const Matrix B = HM*X;
+
+    bool ok = check("Jacobi",HM,unknowns,Jacobi<SymMatrix>(HM),B,X);
+    ok = check("mesh blocks",HM,unknowns,MeshBlockPreconditioner(HM,geo),B,X) && ok;
+    const NearFieldILU ilu(HM,geo);
+    ok = check("near field ILU",HM,unknowns,ilu,B,X) && ok;
+
+    Geometry coarse;
+    coarse.read(argv[1],argv[2]);
+    coarse.coarsen(0.25);
+    const CoarseCorrection correction(geo,coarse);
+    ok = check("two-grid",HM,unknowns,TwoGridPreconditioner<SymMatrix,NearFieldILU>(HM,ilu,correction),B,X) && ok;
+
+    return (ok) ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <symmatrix.h>
+#include <sym_factorization.h>
+#include <geometry.h>
+#include <assemble.h>
+#include <gain.h>
+
+using namespace OpenMEEG;
+
+double relative_error(const Matrix& A,const Matrix& B) {
+    double diff = 0.0;
+    double norm = 0.0;
+    for (size_t i=0;i<A.nlin();++i)
+        for (size_t j=0;j<A.ncol();++j) {
+            diff = std::max(diff,std::abs(A(i,j)-B(i,j)));
+            norm = std::max(norm,std::abs(A(i,j)));
+        }
+    return diff/norm;
+}
+
+//  Solutions and gain products computed with the saved and reloaded factorizations of the HeadMat compared to
+//  the ones given by its inverse.
+
+int main(int argc,char** argv)
+{
+    if (argc!=3) {
+        std::cerr << "Usage: " << argv[0] << " geometry.geom conductivities.cond" << std::endl;
+        exit(1);
+    }
+
+    Geometry geo;
+    geo.read(argv[1],argv[2]);
+
+    const HeadMat HM(geo);
+    const SymMatrix HMinv = HM.inverse();
+
+    Matrix B(HM.nlin(),3);
+    for (size_t i=0;i<B.nlin();++i)
+        for (size_t j=0;j<B.ncol();++j)
+            B(i,j) = std::cos(0.1*i+j);
+    Matrix Head2X(5,HM.nlin());
+    for (size_t i=0;i<Head2X.nlin();++i)
+        for (size_t j=0;j<Head2X.ncol();++j)
+            Head2X(i,j) = std::sin(0.2*j+i);
+
+    const Matrix X  = HMinv*B;
+    const Matrix G  = (Head2X*HMinv)*B;
+    const Matrix Gt = (Head2X.submat(0,2,0,Head2X.ncol())*HMinv)*B;
+
+    const char* filename = "test_sym_factorization.fact";
+    //  The mixed precision solutions are the ones of the HeadMat rounded to single precision.
+
+    const SymFactorization::Method methods[3] = { SymFactorization::UDUT, SymFactorization::BUNCH_KAUFMAN, SymFactorization::MIXED };
+    const char*  names[3]     = { "UDU'", "Bunch-Kaufman", "mixed precision" };
+    const double tolerance[3] = { 1e-8, 1e-8, 1e-5 };
+
+    int status = 0;
+    for (unsigned m=0;m<3;++m) {
+        SymMatrix A(HM,DEEP_COPY);
+        const SymFactorization factorization(A,methods[m]);
+        if (!factorization.valid()) {
+            std::cerr << "The " << names[m] << " factorization of the HeadMat failed." << std::endl;
+            return 1;
+        }
+        factorization.save(filename);
+
+        if (!SymFactorization::identify(filename)) {
+            std::cerr << "The " << names[m] << " factorization file is not identified." << std::endl;
+            return 1;
+        }
+
+        const SymFactorization loaded(filename);
+        std::remove(filename);
+
+        Matrix Y(B,DEEP_COPY);
+        loaded.solveLin(Y);
+
+        const double error  = relative_error(X,Y);
+        const double error2 = relative_error(G,solved_product(loaded,Head2X,B));
+        const double error3 = relative_error(Gt,solved_product(loaded,Head2X.submat(0,2,0,Head2X.ncol()),B));
+
+        std::cout << names[m] << " relative errors (solve, gains) : " << error << " " << error2 << " " << error3 << std::endl;
+
+        if (error>tolerance[m] || error2>tolerance[m] || error3>tolerance[m]) {
+            std::cerr << "The " << names[m] << " factorization differs from the inverse." << std::endl;
+            status = 1;
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,144 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <matrix.h>
+#include <symmatrix.h>
+#include <sparse_matrix.h>
+
+using namespace OpenMEEG;
+
+//  SymMatrix stored with the RFP and TILED layouts compared to the PACKED one: values, products, positive
+//  definite inverse (which uses the LAPACK RFP routines for the RFP layout) and file round trips.
+
+namespace {
+
+    const char* names[] = { "packed", "rfp", "tiled" };
+
+    double difference(const SymMatrix& A,const SymMatrix& B) {
+        double diff = 0.0;
+        double norm = 0.0;
+        for (size_t i=0;i<A.nlin();++i)
+            for (size_t j=i;j<A.nlin();++j) {
+                diff = std::max(diff,std::abs(A(i,j)-B(i,j)));
+                norm = std::max(norm,std::abs(A(i,j)));
+            }
+        return diff/norm;
+    }
+
+    double difference(const Matrix& A,const Matrix& B) {
+        double diff = 0.0;
+        double norm = 0.0;
+        for (size_t i=0;i<A.nlin();++i)
+            for (size_t j=0;j<A.ncol();++j) {
+                diff = std::max(diff,std::abs(A(i,j)-B(i,j)));
+                norm = std::max(norm,std::abs(A(i,j)));
+            }
+        return diff/norm;
+    }
+}
+
+int main()
+{
+    bool failed = false;
+    const size_t sizes[] = { 5, 6, 128, 301 };
+    for (unsigned n=0;n<sizeof(sizes)/sizeof(sizes[0]);++n) {
+        const size_t N = sizes[n];
+
+        //  A positive definite matrix.
+
+        SymMatrix S(N);
+        for (size_t i=0;i<N;++i)
+            for (size_t j=i;j<N;++j)
+                S(i,j) = (i==j) ? N+1.0 : std::sin(1.0+0.37*i+0.11*j*j);
+
+        Matrix B(N,3);
+        for (size_t i=0;i<N;++i)
+            for (size_t j=0;j<B.ncol();++j)
+                B(i,j) = std::cos(0.3*i+j);
+
+        SparseMatrix P(2,N);
+        P(0,0)   = 1.0;
+        P(1,N-1) = 2.0;
+        P(1,N/2) = 3.0;
+
+        const SymMatrix Sinv = S.posdefinverse();
+        const std::string file = "test_symmatrix_layouts.bin";
+        S.save(file);
+
+        for (unsigned l=1;l<3;++l) {
+            const SymMatrix::Layout layout = static_cast<SymMatrix::Layout>(l);
+            const SymMatrix L = S.converted(layout);
+
+            SymMatrix R;
+            R.set_layout(layout);
+            R.load(file);
+
+            const double errors[] = {
+                difference(S,L),
+                difference(S,L.converted(SymMatrix::PACKED)),
+                difference(S*B,L*B),
+                difference(B.transpose()*S,B.transpose()*L),
+                difference(P*S,P*L),
+                difference(Sinv,L.posdefinverse()),
+                difference(S+S,L+S),
+                difference(S,R)
+            };
+
+            double error = 0.0;
+            for (unsigned i=0;i<sizeof(errors)/sizeof(errors[0]);++i)
+                error = std::max(error,errors[i]);
+            std::cout << "N = " << N << " layout " << names[l] << " : " << error << std::endl;
+            if (error>1e-12)
+                failed = true;
+        }
+        std::remove(file.c_str());
+    }
+
+    if (failed) {
+        std::cerr << "The RFP or TILED matrices differ from the PACKED ones." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
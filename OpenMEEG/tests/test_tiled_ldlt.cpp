@@ -0,0 +1,110 @@
+/*
+Project Name : OpenMEEG
+
+© INRIA and ENPC (contributors: Geoffray ADDE, Maureen CLERC, Alexandre
+GRAMFORT, Renaud KERIVEN, Jan KYBIC, Perrine LANDREAU, Théodore PAPADOPOULO,
+Emmanuel OLIVI
+Maureen.Clerc.AT.inria.fr, keriven.AT.certis.enpc.fr,
+kybic.AT.fel.cvut.cz, papadop.AT.inria.fr)
+
+The OpenMEEG software is a C++ package for solving the forward/inverse
+problems of electroencephalography and magnetoencephalography.
+
+This software is governed by the CeCILL-B license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's authors,  the holders of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include <symmatrix.h>
+#include <tiled_ldlt.h>
+#include <geometry.h>
+#include <assemble.h>
+
+using namespace OpenMEEG;
+
+//  Inverse and solutions computed with the tiled U'DU factorization of the HeadMat compared to the ones
+//  given by the packed Bunch-Kaufman factorization.
+
+int main(int argc,char** argv)
+{
+    if (argc!=3) {
+        std::cerr << "Usage: " << argv[0] << " geometry.geom conductivities.cond" << std::endl;
+        exit(1);
+    }
+
+    Geometry geo;
+    geo.read(argv[1],argv[2]);
+
+    const HeadMat HM(geo);
+    const SymMatrix HMinv = HM.inverse();
+
+    Matrix B(HM.nlin(),3);
+    for (size_t i=0;i<B.nlin();++i)
+        for (size_t j=0;j<B.ncol();++j)
+            B(i,j) = std::cos(0.1*i+j);
+    const Matrix X = HMinv*B;
+
+    SymMatrix A = HM.converted(SymMatrix::TILED);
+    TiledLDLt factorization(A);
+    if (!factorization.valid()) {
+        std::cerr << "The tiled factorization of the HeadMat failed." << std::endl;
+        return 1;
+    }
+
+    Matrix Y(B,DEEP_COPY);
+    factorization.solve(Y);
+    const SymMatrix& inverse = factorization.invert();
+
+    double diff  = 0.0;
+    double norm  = 0.0;
+    for (size_t i=0;i<HMinv.nlin();++i)
+        for (size_t j=i;j<HMinv.nlin();++j) {
+            diff = std::max(diff,std::abs(HMinv(i,j)-inverse(i,j)));
+            norm = std::max(norm,std::abs(HMinv(i,j)));
+        }
+    const double error = diff/norm;
+
+    diff = norm = 0.0;
+    for (size_t i=0;i<X.nlin();++i)
+        for (size_t j=0;j<X.ncol();++j) {
+            diff = std::max(diff,std::abs(X(i,j)-Y(i,j)));
+            norm = std::max(norm,std::abs(X(i,j)));
+        }
+    const double error2 = diff/norm;
+
+    std::cout << "Relative error (inverse) : " << error << std::endl;
+    std::cout << "Relative error (solve) : " << error2 << std::endl;
+
+    if (error>1e-8 || error2>1e-8) {
+        std::cerr << "The tiled factorization differs from the Bunch-Kaufman one." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}